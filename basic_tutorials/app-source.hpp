@@ -0,0 +1,292 @@
+#pragma once
+
+#include "pipeline-element.hpp"
+#include <gst/app/gstappsrc.h>
+#include <thread>
+
+/* A set of GstBufferPools, one per size bucket, each filled with all its buffers when it is created unless the
+ * bucket asks to start empty and grow on demand. acquire()
+ * takes a buffer from the smallest bucket that fits and trims it to the requested size; the buffer goes back to
+ * its pool when the last reference is dropped downstream. Once every bucket is sized for the frames in flight,
+ * producing a frame allocates nothing. A request no bucket can serve falls back to gst_buffer_new_allocate() and
+ * is counted, so an undersized pool shows up in fallbackAllocations() instead of stalling the producer. */
+class BucketedBufferPool
+{
+  public:
+    struct Bucket
+    {
+        gsize size;
+        guint buffers;               /* At most */
+        gboolean preallocate = TRUE; /* All `buffers` up front; else they are allocated as first needed */
+    };
+
+    /* Buckets of min_size, 2 * min_size, ... up to the first one holding max_size, `buffers` buffers each. Only
+     * the largest is preallocated: the smaller ones cost nothing until the producer makes frames that small. */
+    static std::vector<Bucket> powerOfTwo(gsize min_size, gsize max_size, guint buffers)
+    {
+        std::vector<Bucket> buckets;
+        gsize size = MAX(min_size, (gsize)1);
+        buckets.push_back(Bucket{size, buffers, FALSE});
+        while (size < max_size)
+        {
+            size *= 2;
+            buckets.push_back(Bucket{size, buffers, FALSE});
+        }
+        buckets.back().preallocate = TRUE;
+        return buckets;
+    }
+
+    BucketedBufferPool(std::vector<Bucket> buckets) : buckets{std::move(buckets)}
+    {
+        std::sort(this->buckets.begin(), this->buckets.end(),
+                  [](const Bucket &a, const Bucket &b) { return a.size < b.size; });
+        for (const Bucket &bucket : this->buckets)
+        {
+            /* min == max: the pool allocates everything on activation and never grows; min 0 grows up to max */
+            guint min_buffers = bucket.preallocate ? bucket.buffers : 0;
+            GstBufferPool *pool = gst_buffer_pool_new();
+            GstStructure *config = gst_buffer_pool_get_config(pool);
+            gst_buffer_pool_config_set_params(config, NULL, (guint)bucket.size, min_buffers, bucket.buffers);
+            if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+            {
+                g_printerr("Buffer pool of %zu x %u bytes could not be activated.\n", (std::size_t)bucket.size,
+                           bucket.buffers);
+                gst_object_unref(pool);
+                pool = nullptr;
+            }
+            else
+            {
+                preallocated_bytes += (guint64)bucket.size * min_buffers;
+                preallocated_buffers += min_buffers;
+            }
+            pools.push_back(pool);
+        }
+    }
+
+    ~BucketedBufferPool()
+    {
+        for (GstBufferPool *pool : pools)
+        {
+            if (pool)
+            {
+                /* Buffers still downstream are freed when released to an inactive pool */
+                gst_buffer_pool_set_active(pool, FALSE);
+                gst_object_unref(pool);
+            }
+        }
+    }
+
+    BucketedBufferPool(const BucketedBufferPool &) = delete;
+    BucketedBufferPool &operator=(const BucketedBufferPool &) = delete;
+
+    /* A writable buffer of exactly `size` bytes. Never blocks. */
+    GstBuffer *acquire(gsize size)
+    {
+        GstBufferPoolAcquireParams params = {};
+        params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+        for (std::size_t i = 0; i < buckets.size(); ++i)
+        {
+            if (buckets[i].size < size || !pools[i])
+            {
+                continue;
+            }
+            GstBuffer *buffer = nullptr;
+            if (gst_buffer_pool_acquire_buffer(pools[i], &buffer, &params) == GST_FLOW_OK)
+            {
+                gst_buffer_set_size(buffer, (gssize)size);
+                pooled.fetch_add(1, std::memory_order_relaxed);
+                return buffer;
+            }
+        }
+        fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return gst_buffer_new_allocate(NULL, size, NULL);
+    }
+
+    guint64 pooledAcquires(void) const
+    {
+        return pooled.load(std::memory_order_relaxed);
+    }
+
+    guint64 fallbackAllocations(void) const
+    {
+        return fallbacks.load(std::memory_order_relaxed);
+    }
+
+    guint64 preallocatedBuffers(void) const
+    {
+        return preallocated_buffers;
+    }
+
+    guint64 preallocatedBytes(void) const
+    {
+        return preallocated_bytes;
+    }
+
+  private:
+    std::vector<Bucket> buckets;
+    std::vector<GstBufferPool *> pools;
+    guint64 preallocated_buffers = 0;
+    guint64 preallocated_bytes = 0;
+    std::atomic<guint64> pooled{0};
+    std::atomic<guint64> fallbacks{0};
+};
+
+/* Pushes application-generated buffers into a pipeline through an appsrc used as the pipeline `source`:
+ *
+ *     AppSource feeder("video/x-raw,format=I420,width=1280,height=720,framerate=30/1", GST_SECOND / 30, producer,
+ *                      BucketedBufferPool::powerOfTwo(4096, frame_size, 8));
+ *     config.source_factory = "appsrc";
+ *     config.source_setup = [&](GstElementPtr src) { feeder.attach(src); };
+ *
+ * The producer takes its buffers from pool() and returns them filled, or nullptr at end of stream. It runs on a
+ * feeder thread that appsrc starts with need-data and parks with enough-data, so at most `max_bytes` wait in the
+ * appsrc queue. Keep `max_bytes` well below the pool capacity, so the buffers queued in the appsrc plus those held
+ * downstream never drain the pool. Buffers without timestamps are stamped at `frame_duration` intervals. */
+class AppSource
+{
+  public:
+    using Producer = std::function<GstBuffer *(BucketedBufferPool &pool)>;
+
+    AppSource(std::string caps, GstClockTime frame_duration, Producer producer,
+              std::vector<BucketedBufferPool::Bucket> buckets, guint64 max_bytes = 0)
+        : caps{std::move(caps)}, frame_duration{frame_duration}, producer{std::move(producer)},
+          buffer_pool{std::move(buckets)}, max_bytes{max_bytes ? max_bytes : buffer_pool.preallocatedBytes() / 4}
+    {
+    }
+
+    ~AppSource()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = TRUE;
+            cond.notify_all();
+        }
+        if (feeder.joinable())
+        {
+            feeder.join();
+        }
+        if (src)
+        {
+            gst_object_unref(src);
+        }
+    }
+
+    AppSource(const AppSource &) = delete;
+    AppSource &operator=(const AppSource &) = delete;
+
+    /* Configure an appsrc created by the pipeline and start the feeder thread, which waits for need-data */
+    void attach(GstElementPtr appsrc)
+    {
+        if (src)
+        {
+            return;
+        }
+        GstCaps *src_caps = caps.empty() ? nullptr : gst_caps_from_string(caps.c_str());
+        g_object_set(appsrc, "format", GST_FORMAT_TIME, "max-bytes", max_bytes, "block", FALSE, "emit-signals",
+                     FALSE, NULL);
+        if (src_caps)
+        {
+            g_object_set(appsrc, "caps", src_caps, NULL);
+            gst_caps_unref(src_caps);
+        }
+
+        GstAppSrcCallbacks callbacks = {};
+        callbacks.need_data = onNeedData;
+        callbacks.enough_data = onEnoughData;
+        gst_app_src_set_callbacks(GST_APP_SRC(appsrc), &callbacks, this, NULL);
+
+        src = GST_APP_SRC(gst_object_ref(appsrc));
+        feeder = std::thread(&AppSource::feed, this);
+    }
+
+    BucketedBufferPool &pool(void)
+    {
+        return buffer_pool;
+    }
+
+    guint64 pushed(void) const
+    {
+        return pushed_buffers.load(std::memory_order_relaxed);
+    }
+
+    guint64 needDataCount(void) const
+    {
+        return need_data.load(std::memory_order_relaxed);
+    }
+
+    guint64 enoughDataCount(void) const
+    {
+        return enough_data.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static void onNeedData(GstAppSrc *appsrc, guint length, gpointer user_data)
+    {
+        AppSource *self = static_cast<AppSource *>(user_data);
+        self->need_data.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(self->lock);
+        self->feeding = TRUE;
+        self->cond.notify_one();
+    }
+
+    static void onEnoughData(GstAppSrc *appsrc, gpointer user_data)
+    {
+        AppSource *self = static_cast<AppSource *>(user_data);
+        self->enough_data.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(self->lock);
+        self->feeding = FALSE;
+    }
+
+    void feed(void)
+    {
+        guint64 frame = 0;
+        std::unique_lock<std::mutex> guard(lock);
+        while (true)
+        {
+            cond.wait(guard, [this] { return feeding || stopping; });
+            if (stopping)
+            {
+                return;
+            }
+            guard.unlock();
+
+            GstBuffer *buffer = producer(buffer_pool);
+            if (!buffer)
+            {
+                gst_app_src_end_of_stream(src);
+                return;
+            }
+            if (!GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)))
+            {
+                GST_BUFFER_PTS(buffer) = frame * frame_duration;
+                GST_BUFFER_DURATION(buffer) = frame_duration;
+            }
+            ++frame;
+
+            /* push_buffer takes the buffer; anything but OK means the pipeline is flushing or shutting down */
+            if (gst_app_src_push_buffer(src, buffer) != GST_FLOW_OK)
+            {
+                return;
+            }
+            pushed_buffers.fetch_add(1, std::memory_order_relaxed);
+            guard.lock();
+        }
+    }
+
+    std::string caps;
+    GstClockTime frame_duration;
+    Producer producer;
+    BucketedBufferPool buffer_pool;
+    guint64 max_bytes;
+    GstAppSrc *src = nullptr;
+    std::thread feeder;
+    std::mutex lock;
+    std::condition_variable cond;
+    gboolean feeding = FALSE;
+    gboolean stopping = FALSE;
+    std::atomic<guint64> pushed_buffers{0};
+    std::atomic<guint64> need_data{0};
+    std::atomic<guint64> enough_data{0};
+};
+
+using AppSourcePtr = AppSource *;
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "simd-kernels.hpp"
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <gst/audio/audio.h>
+#include <mutex>
+#include <vector>
+
+/* Per-channel peak, RMS and clipping of one audio stream, measured with the level kernels of SimdKernels and
+ * published once per `interval_ms` of audio rather than once per buffer:
+ *
+ *     AudioMeter meter(100, [](const AudioMeter::Reading &reading) { ... });
+ *     meter.attach(meter_sink);
+ *
+ * where meter_sink is the fakesink ending a queue on the audio tee. The buffers are measured in a probe on the sink
+ * pad of that element, on the streaming thread of the branch, so a meter has no thread of its own and posts nothing
+ * on the bus; hundreds of them can run side by side. The callback runs on that streaming thread too, and latest()
+ * hands the last reading to any other thread.
+ *
+ * Interleaved S16 and F32 in native byte order are measured; other formats are reported once and skipped. The
+ * interval is counted in audio frames, so readings follow the media whether the branch runs in real time or not, and
+ * the interval that is cut short by EOS is published as well. */
+class AudioMeter
+{
+  public:
+    struct Channel
+    {
+        double peak; /* 1.0 is full scale */
+        double rms;
+        guint64 clips; /* Samples at full scale */
+    };
+
+    struct Reading
+    {
+        GstClockTime pts; /* Of the first sample of the interval */
+        GstClockTime duration;
+        std::vector<Channel> channels;
+    };
+
+    using Callback = std::function<void(const Reading &)>;
+
+    AudioMeter(guint interval_ms, Callback callback = nullptr)
+        : interval_ms{MAX(interval_ms, 1u)}, callback{std::move(callback)}
+    {
+    }
+
+    ~AudioMeter()
+    {
+        detach();
+    }
+
+    /* Measure what reaches the sink pad of `element` */
+    gboolean attach(GstElement *element)
+    {
+        detach();
+        pad = gst_element_get_static_pad(element, "sink");
+        if (!pad)
+        {
+            return FALSE;
+        }
+        GstPadProbeType type = (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM);
+        probe_id = gst_pad_add_probe(pad, type, onProbe, this, NULL);
+        return TRUE;
+    }
+
+    void detach(void)
+    {
+        if (!pad)
+        {
+            return;
+        }
+        gst_pad_remove_probe(pad, probe_id);
+        gst_object_unref(pad);
+        pad = nullptr;
+    }
+
+    /* The last reading published; it has no channels before the first interval is complete */
+    Reading latest(void) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return last;
+    }
+
+    guint64 published(void) const
+    {
+        return readings.load(std::memory_order_relaxed);
+    }
+
+    /* dBFS of a peak or RMS level, -inf for silence */
+    static double decibels(double level)
+    {
+        return level > 0.0 ? 20.0 * std::log10(level) : -INFINITY;
+    }
+
+  private:
+    static GstPadProbeReturn onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        AudioMeter *meter = static_cast<AudioMeter *>(user_data);
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+        {
+            meter->measure(GST_PAD_PROBE_INFO_BUFFER(info));
+            return GST_PAD_PROBE_OK;
+        }
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+        {
+            GstCaps *caps;
+            gst_event_parse_caps(event, &caps);
+            meter->setFormat(caps);
+        }
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS && meter->counted > 0)
+        {
+            meter->publish();
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    void setFormat(GstCaps *caps)
+    {
+        GstAudioInfo info;
+        float_samples = FALSE;
+        channels = 0;
+        if (gst_audio_info_from_caps(&info, caps) && GST_AUDIO_INFO_LAYOUT(&info) == GST_AUDIO_LAYOUT_INTERLEAVED &&
+            (GST_AUDIO_INFO_FORMAT(&info) == GST_AUDIO_FORMAT_S16 ||
+             GST_AUDIO_INFO_FORMAT(&info) == GST_AUDIO_FORMAT_F32))
+        {
+            float_samples = (gboolean)(GST_AUDIO_INFO_FORMAT(&info) == GST_AUDIO_FORMAT_F32);
+            channels = GST_AUDIO_INFO_CHANNELS(&info);
+            rate = GST_AUDIO_INFO_RATE(&info);
+            interval_frames = MAX((gint)((gint64)rate * interval_ms / 1000), 1);
+        }
+        else if (!warned)
+        {
+            gchar *description = gst_caps_to_string(caps);
+            g_printerr("AudioMeter only measures interleaved S16 and F32, not %s.\n", description);
+            g_free(description);
+            warned = TRUE;
+        }
+        reset();
+    }
+
+    void reset(void)
+    {
+        counted = 0;
+        peaks_s16.assign(channels, 0);
+        squares_s16.assign(channels, 0);
+        peaks_f32.assign(channels, 0.0f);
+        squares_f32.assign(channels, 0.0);
+        clips.assign(channels, 0);
+    }
+
+    void measure(GstBuffer *buffer)
+    {
+        GstMapInfo map;
+        if (channels == 0 || !gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            return;
+        }
+        SimdKernels::Level level = SimdKernels::level();
+        gint frame_size = channels * (float_samples ? (gint)sizeof(gfloat) : (gint)sizeof(gint16));
+        gint frames = (gint)(map.size / frame_size);
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+
+        /* A buffer can end one interval and start the next */
+        for (gint done = 0; done < frames;)
+        {
+            if (counted == 0)
+            {
+                interval_pts = GST_CLOCK_TIME_IS_VALID(pts) ? pts + gst_util_uint64_scale_int(done, GST_SECOND, rate)
+                                                           : GST_CLOCK_TIME_NONE;
+            }
+            gint n = MIN(frames - done, interval_frames - counted);
+            if (float_samples)
+            {
+                SimdKernels::levelF32(level, (const gfloat *)map.data + (gsize)done * channels, n, channels,
+                                      peaks_f32.data(), squares_f32.data(), clips.data());
+            }
+            else
+            {
+                SimdKernels::levelS16(level, (const gint16 *)map.data + (gsize)done * channels, n, channels,
+                                      peaks_s16.data(), squares_s16.data(), clips.data());
+            }
+            counted += n;
+            done += n;
+            if (counted == interval_frames)
+            {
+                publish();
+            }
+        }
+        gst_buffer_unmap(buffer, &map);
+    }
+
+    void publish(void)
+    {
+        Reading reading;
+        reading.pts = interval_pts;
+        reading.duration = gst_util_uint64_scale_int(counted, GST_SECOND, rate);
+        reading.channels.resize(channels);
+        for (gint c = 0; c < channels; ++c)
+        {
+            Channel &channel = reading.channels[c];
+            if (float_samples)
+            {
+                channel.peak = peaks_f32[c];
+                channel.rms = std::sqrt(squares_f32[c] / counted);
+            }
+            else
+            {
+                channel.peak = peaks_s16[c] / 32768.0;
+                channel.rms = std::sqrt((double)squares_s16[c] / counted) / 32768.0;
+            }
+            channel.clips = clips[c];
+        }
+        reset();
+
+        if (callback)
+        {
+            callback(reading);
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            last = std::move(reading);
+        }
+        readings.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    guint interval_ms;
+    Callback callback;
+    GstPad *pad = nullptr;
+    gulong probe_id = 0;
+
+    /* Streaming thread only */
+    gboolean float_samples = FALSE;
+    gint channels = 0;
+    gint rate = 0;
+    gint interval_frames = 1;
+    gint counted = 0;
+    GstClockTime interval_pts = GST_CLOCK_TIME_NONE;
+    gboolean warned = FALSE;
+    std::vector<guint32> peaks_s16;
+    std::vector<guint64> squares_s16;
+    std::vector<gfloat> peaks_f32;
+    std::vector<gdouble> squares_f32;
+    std::vector<guint64> clips;
+
+    mutable std::mutex lock;
+    Reading last{GST_CLOCK_TIME_NONE, 0, {}};
+    std::atomic<guint64> readings{0};
+};
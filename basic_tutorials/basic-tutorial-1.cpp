@@ -1,5 +1,8 @@
+#include "fast-startup.hpp"
+#include <cstring>
 #include <gst/gst.h>
 #include <iostream>
+#include <string>
 
 #ifdef __APPLE__
 #include <TargetConditionals.h>
@@ -11,17 +14,50 @@ int tutorial_main(int argc, char *argv[])
     GstBus *bus;
     GstMessage *msg;
 
+    /* Options: --plugin-set FILE starts with only the plugins listed in FILE, --record-plugins FILE writes the
+     * plugins this run loaded, --ttff prints the time from process start to the first frame of every sink,
+     * --uri URI plays something else than the trailer */
+    std::string plugin_set = PluginSet::option(argc, argv, "--plugin-set");
+    std::string record_plugins = PluginSet::option(argc, argv, "--record-plugins");
+    std::string uri = PluginSet::option(argc, argv, "--uri");
+    gboolean ttff = FALSE;
+    for (int i = 1; i < argc; ++i)
+    {
+        ttff |= (gboolean)(strcmp(argv[i], "--ttff") == 0);
+    }
+    if (!plugin_set.empty())
+    {
+        PluginSet::applyEnvironment(plugin_set);
+    }
+
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
+    FirstFrameClock clock;
+    clock.mark("gst_init done");
+    if (!plugin_set.empty() && PluginSet::load(plugin_set) > 0)
+    {
+        return -1;
+    }
+    clock.mark("plugins ready");
 
     /* Build the pipeline */
-    gchar pipeline_description[] = "playbin uri=https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
+    if (uri.empty())
+    {
+        uri = "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
+    }
+    std::string pipeline_description = "playbin uri=" + uri;
     // gchar pipeline_description[] =
     //     "playbin uri=https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm";
-    pipeline = gst_parse_launch(pipeline_description, NULL);
+    pipeline = gst_parse_launch(pipeline_description.c_str(), NULL);
+    if (ttff)
+    {
+        clock.attach(pipeline);
+    }
+    clock.mark("pipeline built");
 
     /* Start playing */
     gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    clock.mark("PLAYING requested");
 
     /* Wait until error or EOS */
     bus = gst_element_get_bus(pipeline);
@@ -34,6 +70,15 @@ int tutorial_main(int argc, char *argv[])
                 "variable set for more details.");
     }
 
+    if (ttff)
+    {
+        clock.report();
+    }
+    if (!record_plugins.empty())
+    {
+        PluginSet::record(record_plugins);
+    }
+
     /* Free resources */
     gst_message_unref(msg);
     gst_object_unref(bus);
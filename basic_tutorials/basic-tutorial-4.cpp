@@ -1,5 +1,8 @@
+#include "keyframe-index.hpp"
+#include <cstring>
 #include <gst/gst.h>
 #include <iostream>
+#include <string>
 
 /* Structure to contain all our information, so we can pass it around */
 typedef struct _CustomData
@@ -31,6 +34,36 @@ int main(int argc, char *argv[])
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
 
+    /* Options: --uri FILE|URI plays something else than the trailer, --index-scan builds the keyframe index up front
+     * when there is none yet (otherwise playback fills it in), --accurate seeks to the exact position */
+    std::string uri = "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
+    gboolean index_scan = FALSE;
+    gboolean accurate = FALSE;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--uri") == 0 && i + 1 < argc)
+        {
+            uri = argv[++i];
+        }
+        else if (strcmp(argv[i], "--index-scan") == 0)
+        {
+            index_scan = TRUE;
+        }
+        else if (strcmp(argv[i], "--accurate") == 0)
+        {
+            accurate = TRUE;
+        }
+    }
+    KeyframeIndex index(uri);
+    if (index.load())
+    {
+        g_print("Loaded the keyframe index: %" G_GSIZE_FORMAT " keyframes.\n", index.size());
+    }
+    else if (index_scan && index.scan())
+    {
+        g_print("Scanned %" G_GSIZE_FORMAT " keyframes.\n", index.size());
+    }
+
     /* Create the elements */
     data.playbin = gst_element_factory_make("playbin", "playbin");
 
@@ -40,8 +73,9 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    /* Set the URI to play */
-    g_object_set(data.playbin, "uri", "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm", NULL);
+    /* Set the URI to play, and learn where its keyframes are while it does */
+    g_object_set(data.playbin, "uri", index.getUri().c_str(), NULL);
+    index.attach(data.playbin);
 
     /* Start playing */
     ret = gst_element_set_state(data.playbin, GST_STATE_PLAYING);
@@ -95,9 +129,7 @@ int main(int argc, char *argv[])
                 if (data.seek_enabled && !data.seek_done && current > 10 * GST_SECOND)
                 {
                     g_print("\nReached 10s, performing seek...\n");
-                    gst_element_seek_simple(data.playbin, GST_FORMAT_TIME,
-                                            (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
-                                            30 * GST_SECOND);
+                    index.seek(data.playbin, 30 * GST_SECOND, accurate);
                     data.seek_done = TRUE;
                 }
             }
@@ -108,6 +140,13 @@ int main(int argc, char *argv[])
     gst_object_unref(bus);
     gst_element_set_state(data.playbin, GST_STATE_NULL);
     gst_object_unref(data.playbin);
+
+    /* Keep what was learnt for the next run */
+    index.detach();
+    if (index.save() && !index.savedTo().empty())
+    {
+        g_print("Keyframe index (%" G_GSIZE_FORMAT " keyframes) saved to %s\n", index.size(), index.savedTo().c_str());
+    }
     return 0;
 }
 
@@ -1,5 +1,7 @@
 #include <string.h>
 
+#include "keyframe-index.hpp"
+#include "scrub-preview.hpp"
 #include <gdk/gdk.h>
 #include <gst/gst.h>
 #include <gtk/gtk.h>
@@ -16,6 +18,13 @@ typedef struct _CustomData
 
     GstState state;                 /* Current state of the pipeline */
     gint64 duration;                /* Duration of the clip, in nanoseconds */
+
+    KeyframeIndex *index;           /* Where the keyframes of the clip are, to resolve the seeks of the slider */
+    gboolean accurate_seeks;        /* Seek to the exact slider position rather than the keyframe before it */
+
+    ScrubPreview *preview;          /* Thumbnails shown while the slider is dragged, NULL when disabled */
+    GtkWidget *preview_image;       /* Image widget showing them */
+    gboolean dragging;              /* Is a mouse button held on the slider? */
 } CustomData;
 
 /* This function is called when the PLAY button is clicked */
@@ -43,13 +52,72 @@ static void delete_event_cb(GtkWidget *widget, GdkEvent *event, CustomData *data
     gtk_main_quit();
 }
 
-/* This function is called when the slider changes its position. We perform a seek to the
- * new position here. */
+/* This function is called when a pixbuf made from a thumbnail is freed, to drop its reference to it */
+static void release_thumbnail(guchar *pixels, gpointer ref)
+{
+    delete static_cast<std::shared_ptr<const ScrubPreview::Thumbnail> *>(ref);
+}
+
+/* Show the cached thumbnail nearest to `position`, if there is one yet */
+static void show_preview(CustomData *data, gint64 position)
+{
+    std::shared_ptr<const ScrubPreview::Thumbnail> thumbnail = data->preview->lookup(position);
+    if (!thumbnail)
+    {
+        return;
+    }
+    /* The pixbuf uses the pixels of the thumbnail in place */
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data(thumbnail->pixels.data(), GDK_COLORSPACE_RGB, FALSE, 8,
+                                                 thumbnail->width, thumbnail->height, thumbnail->stride,
+                                                 release_thumbnail,
+                                                 new std::shared_ptr<const ScrubPreview::Thumbnail>(thumbnail));
+    gtk_image_set_from_pixbuf(GTK_IMAGE(data->preview_image), pixbuf);
+    g_object_unref(pixbuf);
+    gtk_widget_show(data->preview_image);
+}
+
+/* This function is called on the main loop after the preview cache got a new thumbnail, which may be the one
+ * the slider is waiting for */
+static gboolean preview_ready_cb(CustomData *data)
+{
+    if (data->dragging)
+    {
+        show_preview(data, (gint64)(gtk_range_get_value(GTK_RANGE(data->slider)) * GST_SECOND));
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* This function is called when the slider changes its position. While it is being dragged only the
+ * preview follows it; otherwise we perform a seek to the new position here, through the keyframe index
+ * when it knows that part of the clip. */
 static void slider_cb(GtkRange *range, CustomData *data)
 {
     gdouble value = gtk_range_get_value(GTK_RANGE(data->slider));
-    gst_element_seek_simple(data->playbin, GST_FORMAT_TIME,
-                            (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT), (gint64)(value * GST_SECOND));
+    if (data->preview && data->dragging)
+    {
+        show_preview(data, (gint64)(value * GST_SECOND));
+        return;
+    }
+    data->index->seek(data->playbin, (gint64)(value * GST_SECOND), data->accurate_seeks);
+}
+
+/* These functions are called when a mouse button is pressed on the slider and released. The pipeline
+ * seeks once, on release, to where the slider was left. */
+static gboolean slider_pressed_cb(GtkWidget *widget, GdkEventButton *event, CustomData *data)
+{
+    data->dragging = TRUE;
+    return FALSE;
+}
+
+static gboolean slider_released_cb(GtkWidget *widget, GdkEventButton *event, CustomData *data)
+{
+    data->dragging = FALSE;
+    gtk_widget_hide(data->preview_image);
+    if (data->preview)
+    {
+        slider_cb(GTK_RANGE(data->slider), data);
+    }
+    return FALSE;
 }
 
 /* This creates all the GTK+ widgets that compose our application, and registers the callbacks */
@@ -77,6 +145,12 @@ static void create_ui(CustomData *data)
     gtk_scale_set_draw_value(GTK_SCALE(data->slider), 0);
     data->slider_update_signal_id =
         g_signal_connect(G_OBJECT(data->slider), "value-changed", G_CALLBACK(slider_cb), data);
+    g_signal_connect(G_OBJECT(data->slider), "button-press-event", G_CALLBACK(slider_pressed_cb), data);
+    g_signal_connect(G_OBJECT(data->slider), "button-release-event", G_CALLBACK(slider_released_cb), data);
+
+    /* Hidden except while the slider is dragged */
+    data->preview_image = gtk_image_new();
+    gtk_widget_set_no_show_all(data->preview_image, TRUE);
 
     data->streams_list = gtk_text_view_new();
     gtk_text_view_set_editable(GTK_TEXT_VIEW(data->streams_list), FALSE);
@@ -93,6 +167,7 @@ static void create_ui(CustomData *data)
 
     main_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
     gtk_box_pack_start(GTK_BOX(main_box), main_hbox, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(main_box), data->preview_image, FALSE, FALSE, 2);
     gtk_box_pack_start(GTK_BOX(main_box), controls, FALSE, FALSE, 0);
     gtk_container_add(GTK_CONTAINER(main_window), main_box);
     gtk_window_set_default_size(GTK_WINDOW(main_window), 640, 480);
@@ -123,8 +198,18 @@ static gboolean refresh_ui(CustomData *data)
         }
     }
 
+    /* Leave the slider where the user is dragging it */
+    if (data->dragging)
+        return TRUE;
+
     if (gst_element_query_position(data->playbin, GST_FORMAT_TIME, &current))
     {
+        /* Fill the preview cache around what is playing, for when the slider is grabbed */
+        if (data->preview)
+        {
+            data->preview->focus(current);
+        }
+
         /* Block the "value-changed" signal, so the slider_cb function is not called
          * (which would trigger a seek the user has not requested) */
         g_signal_handler_block(data->slider, data->slider_update_signal_id);
@@ -311,6 +396,47 @@ int main(int argc, char *argv[])
     memset(&data, 0, sizeof(data));
     data.duration = GST_CLOCK_TIME_NONE;
 
+    /* Options: --uri FILE|URI plays something else than the trailer, --index-scan builds the keyframe index up front
+     * when there is none yet (otherwise playback fills it in), --accurate seeks to the exact slider position,
+     * --preview-budget MB of thumbnails for the slider (32 by default), --no-preview seeks while dragging instead */
+    const gchar *uri = "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
+    gboolean index_scan = FALSE;
+    gsize preview_budget = 32;
+    gboolean no_preview = FALSE;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--uri") == 0 && i + 1 < argc)
+        {
+            uri = argv[++i];
+        }
+        else if (strcmp(argv[i], "--index-scan") == 0)
+        {
+            index_scan = TRUE;
+        }
+        else if (strcmp(argv[i], "--accurate") == 0)
+        {
+            data.accurate_seeks = TRUE;
+        }
+        else if (strcmp(argv[i], "--preview-budget") == 0 && i + 1 < argc)
+        {
+            preview_budget = (gsize)g_ascii_strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--no-preview") == 0)
+        {
+            no_preview = TRUE;
+        }
+    }
+    KeyframeIndex index(uri);
+    data.index = &index;
+    if (!index.load() && index_scan)
+    {
+        index.scan();
+    }
+
+    /* The preview decodes the keyframes of the index when it covers the clip, at low priority */
+    ScrubPreview preview(index.getUri(), &index, preview_budget * 1024 * 1024);
+    data.preview = no_preview ? NULL : &preview;
+
     /* Create the elements */
     data.playbin = gst_element_factory_make("playbin", "playbin");
     videosink = gst_element_factory_make("glsinkbin", "glsinkbin");
@@ -343,8 +469,9 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    /* Set the URI to play */
-    g_object_set(data.playbin, "uri", "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm", NULL);
+    /* Set the URI to play, and learn where its keyframes are while it does */
+    g_object_set(data.playbin, "uri", index.getUri().c_str(), NULL);
+    index.attach(data.playbin);
 
     /* Set the video-sink  */
     g_object_set(data.playbin, "video-sink", videosink, NULL);
@@ -379,6 +506,13 @@ int main(int argc, char *argv[])
     /* Register a function that GLib will call every second */
     g_timeout_add_seconds(1, (GSourceFunc)refresh_ui, &data);
 
+    /* Start filling the preview cache; new thumbnails are shown from the main loop */
+    if (data.preview)
+    {
+        preview.onThumbnail([&data] { g_idle_add((GSourceFunc)preview_ready_cb, &data); });
+        preview.start();
+    }
+
     /* Start the GTK main loop. We will not regain control until gtk_main_quit is called. */
     gtk_main();
 
@@ -387,5 +521,10 @@ int main(int argc, char *argv[])
     gst_object_unref(data.playbin);
     gst_object_unref(videosink);
 
+    /* Keep what was learnt for the next run */
+    preview.stop();
+    index.detach();
+    index.save();
+
     return 0;
 }
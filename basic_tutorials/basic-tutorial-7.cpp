@@ -1,10 +1,12 @@
+#include "headless.hpp"
+#include "simd-scope.hpp"
 #include <gst/gst.h>
 #include <iostream>
 
 int main(int argc, char *argv[])
 {
     GstElement *pipeline, *audio_source, *tee, *audio_queue, *audio_convert, *audio_resample, *audio_sink;
-    GstElement *video_queue, *visual, *video_convert, *video_sink;
+    GstElement *video_queue, *visual, *visual_caps, *video_convert, *video_sink;
     GstBus *bus;
     GstMessage *msg;
     GstPad *tee_audio_pad, *tee_video_pad;
@@ -12,6 +14,13 @@ int main(int argc, char *argv[])
 
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
+    HeadlessOptions headless = HeadlessOptions::parse(argc, argv);
+    if (!headless.valid)
+    {
+        return -1;
+    }
+    HeadlessReport report;
+    ScopeOptions scope = ScopeOptions::parse(argc, argv);
 
     /* Create the elements */
     audio_source = gst_element_factory_make("audiotestsrc", "audio_source");
@@ -19,17 +28,18 @@ int main(int argc, char *argv[])
     audio_queue = gst_element_factory_make("queue", "audio_queue");
     audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
     audio_resample = gst_element_factory_make("audioresample", "audio_resample");
-    audio_sink = gst_element_factory_make("autoaudiosink", "audio_sink");
+    audio_sink = headless.makeSink("autoaudiosink", "audio_sink");
     video_queue = gst_element_factory_make("queue", "video_queue");
-    visual = gst_element_factory_make("wavescope", "visual");
+    visual = scope.makeScope("visual");
+    visual_caps = scope.makeCapsFilter("visual_caps");
     video_convert = gst_element_factory_make("videoconvert", "csp");
-    video_sink = gst_element_factory_make("autovideosink", "video_sink");
+    video_sink = headless.makeSink("autovideosink", "video_sink");
 
     /* Create the empty pipeline */
     pipeline = gst_pipeline_new("test-pipeline");
 
     if (!pipeline || !audio_source || !tee || !audio_queue || !audio_convert || !audio_resample || !audio_sink ||
-        !video_queue || !visual || !video_convert || !video_sink)
+        !video_queue || !visual || !visual_caps || !video_convert || !video_sink)
     {
         g_printerr("Not all elements could be created.\n");
         return -1;
@@ -37,14 +47,14 @@ int main(int argc, char *argv[])
 
     /* Configure elements */
     g_object_set(audio_source, "freq", 215.0f, NULL);
-    g_object_set(visual, "shader", 0, "style", 1, NULL);
+    headless.limitSource(audio_source);
 
     /* Link all elements that can be automatically linked because they have "Always" pads */
     gst_bin_add_many(GST_BIN(pipeline), audio_source, tee, audio_queue, audio_convert, audio_resample, audio_sink,
-                     video_queue, visual, video_convert, video_sink, NULL);
+                     video_queue, visual, visual_caps, video_convert, video_sink, NULL);
     if (gst_element_link_many(audio_source, tee, NULL) != TRUE ||
         gst_element_link_many(audio_queue, audio_convert, audio_resample, audio_sink, NULL) != TRUE ||
-        gst_element_link_many(video_queue, visual, video_convert, video_sink, NULL) != TRUE)
+        gst_element_link_many(video_queue, visual, visual_caps, video_convert, video_sink, NULL) != TRUE)
     {
         g_printerr("Elements could not be linked.\n");
         gst_object_unref(pipeline);
@@ -68,12 +78,25 @@ int main(int argc, char *argv[])
     gst_object_unref(queue_audio_pad);
     gst_object_unref(queue_video_pad);
 
+    /* Count what reaches the sinks when measuring */
+    if (headless.enabled)
+    {
+        report.watch(audio_sink);
+        report.watch(video_sink);
+        report.start();
+    }
+
     /* Start playing the pipeline */
     gst_element_set_state(pipeline, GST_STATE_PLAYING);
 
     /* Wait until error or EOS */
     bus = gst_element_get_bus(pipeline);
     msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    if (headless.enabled)
+    {
+        report.stop();
+        report.write("basic-tutorial-7", headless);
+    }
 
     /* Release the request pads from the Tee, and unref them */
     gst_element_release_request_pad(tee, tee_audio_pad);
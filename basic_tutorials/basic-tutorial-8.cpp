@@ -0,0 +1,155 @@
+#include "frame-tap.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    GstBus *bus;
+    GstMessage *msg;
+    gboolean terminate = FALSE;
+
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --width/--height of the test frames (1080p by default), --num-buffers to stop after, --in-flight
+     * buffers the tap may hold, --work-us of simulated work per frame in the callback, --sync to pace to the clock */
+    guint width = 1920;
+    guint height = 1080;
+    gint num_buffers = 600;
+    guint in_flight = 4;
+    guint work_us = 0;
+    gboolean sync = FALSE;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+        {
+            width = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+        {
+            height = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--num-buffers") == 0 && i + 1 < argc)
+        {
+            num_buffers = std::stoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc)
+        {
+            in_flight = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--work-us") == 0 && i + 1 < argc)
+        {
+            work_us = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sync") == 0)
+        {
+            sync = TRUE;
+        }
+    }
+
+    /* videotestsrc -> capsfilter -> tee, with the regular video branch ending in a fakesink */
+    PipelineConfig config;
+    config.source_factory = "videotestsrc";
+    config.source_caps = "video/x-raw,format=I420,width=" + std::to_string(width) + ",height=" + std::to_string(height);
+    config.num_buffers = num_buffers;
+    config.audio = FALSE;
+    config.video_sink = SinkConfig{"fakesink", sync};
+    PipelineElementPtr pipeline = new PipelineElement(config);
+
+    /* The tap reads the frames in place; touch one byte per cache line so the memory is really read, as an
+     * analysis callback would */
+    guint64 checksum = 0;
+    gint tap_width = 0, tap_height = 0;
+    VideoFrameTapPtr tap = new VideoFrameTap(
+        [&](const FrameView &frame) {
+            for (gsize i = 0; i < frame.size; i += 64)
+            {
+                checksum += frame.data[i];
+            }
+            if (frame.video_info)
+            {
+                tap_width = GST_VIDEO_INFO_WIDTH(frame.video_info);
+                tap_height = GST_VIDEO_INFO_HEIGHT(frame.video_info);
+            }
+            if (work_us > 0)
+            {
+                g_usleep(work_us);
+            }
+        },
+        in_flight);
+    pipeline->addBranch(tap);
+
+    if (!pipeline->build())
+    {
+        pipeline->unref();
+        delete pipeline;
+        return -1;
+    }
+
+    /* Start playing */
+    gint64 start_us = g_get_monotonic_time();
+    if (pipeline->changeStatePlaying() == GST_STATE_CHANGE_FAILURE)
+    {
+        g_printerr("Unable to set the pipeline to the playing state.\n");
+        pipeline->unref();
+        delete pipeline;
+        return -1;
+    }
+
+    /* Wait until error or EOS */
+    bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+    do
+    {
+        msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                         (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+
+        /* Parse message */
+        if (msg != NULL)
+        {
+            GError *err;
+            gchar *debug_info;
+
+            switch (GST_MESSAGE_TYPE(msg))
+            {
+            case GST_MESSAGE_ERROR:
+                gst_message_parse_error(msg, &err, &debug_info);
+                g_printerr("Error received from element %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+                g_printerr("Debugging information: %s\n", debug_info ? debug_info : "none");
+                g_clear_error(&err);
+                g_free(debug_info);
+                terminate = TRUE;
+                break;
+
+            case GST_MESSAGE_EOS:
+                g_print("End-Of-Stream reached.\n");
+                terminate = TRUE;
+                break;
+
+            default:
+                /* We should not reach here */
+                g_printerr("Unexpected message received.\n");
+                break;
+            }
+            gst_message_unref(msg);
+        }
+    } while (!terminate);
+
+    /* Deliver what the tap still holds, so the counts are final */
+    tap->stop();
+    double wall = (g_get_monotonic_time() - start_us) / 1e6;
+
+    g_print("frames: %dx%d, in-flight: %u, work: %u us\n", tap_width, tap_height, in_flight, work_us);
+    g_print("  delivered: %" G_GUINT64_FORMAT "  dropped: %" G_GUINT64_FORMAT "\n", tap->delivered(), tap->dropped());
+    g_print("  tap: %.1f frames/s  (%.1f frames/s over %.2f s wall)\n", tap->framesPerSecond(),
+            wall > 0 ? tap->delivered() / wall : 0.0, wall);
+    g_print("  checksum: %" G_GUINT64_FORMAT "\n", checksum);
+    pipeline->printBranchStats();
+
+    /* Free resources; the pipeline owns and deletes the tap */
+    gst_object_unref(bus);
+    pipeline->changeStateNull();
+    pipeline->unref();
+    delete pipeline;
+    return 0;
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "gst/gst.h"
+#include "record-sink.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* The file branch of exercise-tutorial-7 (audioconvert ! wavenc ! filesink) run over many inputs at once:
+ *
+ *     std::vector<std::string> uris = BatchExtractor::inputs("/archive/2024");
+ *     BatchExtractor extractor("/archive/2024-wav", 0);
+ *     extractor.run(uris);
+ *
+ * Every worker thread takes the next input, decodes it with its own uridecodebin pipeline and writes
+ * <out_dir>/<name>.wav. Nothing waits for a clock (there is no live sink), so a file is done as fast as it can be
+ * decoded and encoded. Video streams are not decoded at all: decodebin stops at their compressed caps and the pad
+ * is left unlinked. A line is printed per file as it finishes and a summary with files/s at the end. */
+class BatchExtractor
+{
+  public:
+    struct FileResult
+    {
+        std::string uri;
+        std::string output;
+        gboolean ok = FALSE;
+        double wall_ms = 0.0;
+        double media_s = 0.0; /* duration of the decoded audio, 0 when unknown */
+        guint64 bytes = 0;
+    };
+
+    /* `workers` 0 uses one worker per core; `record` picks the sink writing the WAV files */
+    BatchExtractor(const std::string &out_dir, guint workers, const RecordOptions &record = RecordOptions())
+        : out_dir{out_dir}, workers{workers ? workers : std::max(1u, g_get_num_processors())}, record{record}
+    {
+    }
+
+    /* file:// URIs of the regular files in `path` when it is a directory, sorted. Otherwise `path` is a manifest: one
+     * local path or URI per line, blank lines and # comments skipped. Relative paths are taken from the current
+     * directory; an entry that still has no URI is printed and left out. */
+    static std::vector<std::string> inputs(const std::string &path)
+    {
+        std::vector<std::string> uris;
+        if (g_file_test(path.c_str(), G_FILE_TEST_IS_DIR))
+        {
+            GDir *handle = g_dir_open(path.c_str(), 0, NULL);
+            if (!handle)
+            {
+                return uris;
+            }
+            while (const gchar *name = g_dir_read_name(handle))
+            {
+                gchar *file = g_build_filename(path.c_str(), name, NULL);
+                if (g_file_test(file, G_FILE_TEST_IS_REGULAR))
+                {
+                    uris.push_back(toUri(file));
+                }
+                g_free(file);
+            }
+            g_dir_close(handle);
+            std::sort(uris.begin(), uris.end());
+        }
+        else
+        {
+            gchar *contents = NULL;
+            if (!g_file_get_contents(path.c_str(), &contents, NULL, NULL))
+            {
+                g_printerr("Batch manifest %s could not be read.\n", path.c_str());
+                return uris;
+            }
+            gchar **lines = g_strsplit(contents, "\n", -1);
+            g_free(contents);
+            for (gchar **line = lines; *line; ++line)
+            {
+                gchar *entry = g_strstrip(*line);
+                if (*entry && *entry != '#')
+                {
+                    uris.push_back(toUri(entry));
+                }
+            }
+            g_strfreev(lines);
+        }
+        uris.erase(std::remove(uris.begin(), uris.end(), std::string()), uris.end());
+        return uris;
+    }
+
+    /* Extract every input; returns the number of files that failed */
+    guint run(const std::vector<std::string> &uris)
+    {
+        results.assign(uris.size(), FileResult());
+        std::set<std::string> taken;
+        for (std::size_t i = 0; i < uris.size(); ++i)
+        {
+            results[i].uri = uris[i];
+            results[i].output = outputFor(uris[i], taken);
+        }
+        g_mkdir_with_parents(out_dir.c_str(), 0755);
+
+        guint pool = (guint)std::min<std::size_t>(workers, uris.size());
+        g_print("%zu files, %u workers, output in %s\n", uris.size(), pool, out_dir.c_str());
+        g_print("%-6s %-40s %10s %10s %10s %12s\n", "worker", "file", "status", "wall_ms", "x realtime", "bytes");
+
+        next.store(0, std::memory_order_relaxed);
+        gint64 start_us = g_get_monotonic_time();
+        std::vector<std::thread> threads;
+        for (guint w = 0; w < pool; ++w)
+        {
+            threads.emplace_back([this, w] { work(w); });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        double total_s = (g_get_monotonic_time() - start_us) / 1e6;
+
+        guint failed = 0;
+        double media_s = 0.0;
+        guint64 bytes = 0;
+        for (const FileResult &result : results)
+        {
+            failed += result.ok ? 0 : 1;
+            media_s += result.media_s;
+            bytes += result.bytes;
+        }
+        g_print("%zu files (%u failed) in %.2f s: %.2f files/s, %.1f x realtime, %.1f MB/s written\n", results.size(),
+                failed, total_s, total_s > 0 ? results.size() / total_s : 0.0, total_s > 0 ? media_s / total_s : 0.0,
+                total_s > 0 ? bytes / 1e6 / total_s : 0.0);
+        return failed;
+    }
+
+    const std::vector<FileResult> &fileResults(void) const
+    {
+        return results;
+    }
+
+  private:
+    static std::string toUri(const gchar *entry)
+    {
+        if (strstr(entry, "://"))
+        {
+            return entry;
+        }
+        /* Unlike g_filename_to_uri(), this takes relative paths too */
+        GError *err = NULL;
+        gchar *uri = gst_filename_to_uri(entry, &err);
+        if (!uri)
+        {
+            g_printerr("%s is skipped, it has no URI: %s\n", entry, err ? err->message : "unknown error");
+        }
+        std::string result = uri ? uri : "";
+        g_free(uri);
+        g_clear_error(&err);
+        return result;
+    }
+
+    /* <out_dir>/<basename without extension>.wav, with -2, -3, ... appended when two inputs share a name. The
+     * basename is unescaped ("my%20song" becomes "my song"), and the separators and control characters that could
+     * come out of that (e.g. from %2F) are replaced with '_', so the output always lands in out_dir. */
+    std::string outputFor(const std::string &uri, std::set<std::string> &taken) const
+    {
+        gchar *base = g_path_get_basename(uri.c_str());
+        gchar *unescaped = g_uri_unescape_string(base, NULL);
+        std::string stem = unescaped ? unescaped : base;
+        g_free(unescaped);
+        g_free(base);
+        std::size_t dot = stem.rfind('.');
+        if (dot != std::string::npos && dot > 0)
+        {
+            stem.resize(dot);
+        }
+        for (char &c : stem)
+        {
+            if (c == '/' || c == '\\' || g_ascii_iscntrl(c))
+            {
+                c = '_';
+            }
+        }
+        if (stem.empty() || stem == "." || stem == "..")
+        {
+            stem = "audio";
+        }
+        std::string name = stem;
+        for (guint n = 2; !taken.insert(name).second; ++n)
+        {
+            name = stem + "-" + std::to_string(n);
+        }
+        gchar *path = g_build_filename(out_dir.c_str(), (name + ".wav").c_str(), NULL);
+        std::string output = path;
+        g_free(path);
+        return output;
+    }
+
+    void work(guint worker)
+    {
+        for (std::size_t i = next.fetch_add(1, std::memory_order_relaxed); i < results.size();
+             i = next.fetch_add(1, std::memory_order_relaxed))
+        {
+            FileResult &result = results[i];
+            gint64 start_us = g_get_monotonic_time();
+            extract(result, record);
+            result.wall_ms = (g_get_monotonic_time() - start_us) / 1e3;
+
+            gchar *name = g_path_get_basename(result.uri.c_str());
+            std::lock_guard<std::mutex> guard(print_lock);
+            g_print("%-6u %-40s %10s %10.1f %10.1f %12" G_GUINT64_FORMAT "\n", worker, name,
+                    result.ok ? "ok" : "FAILED", result.wall_ms,
+                    result.wall_ms > 0 ? result.media_s * 1e3 / result.wall_ms : 0.0, result.bytes);
+            g_free(name);
+        }
+    }
+
+    /* uridecodebin ! audioconvert ! audioresample ! wavenc ! filesink (or recordsink), one pipeline per file */
+    static void extract(FileResult &result, const RecordOptions &record)
+    {
+        GstElement *pipeline = gst_pipeline_new(NULL);
+        GstElement *source = gst_element_factory_make("uridecodebin", NULL);
+        GstElement *convert = gst_element_factory_make("audioconvert", NULL);
+        GstElement *resample = gst_element_factory_make("audioresample", NULL);
+        GstElement *wavenc = gst_element_factory_make("wavenc", NULL);
+        GstElement *filesink = record.makeSink(NULL);
+        if (!pipeline || !source || !convert || !resample || !wavenc || !filesink)
+        {
+            g_printerr("Not all elements could be created.\n");
+            for (GstElement *element : {pipeline, source, convert, resample, wavenc, filesink})
+            {
+                if (element)
+                {
+                    gst_object_unref(gst_object_ref_sink(element));
+                }
+            }
+            return;
+        }
+        gst_bin_add_many(GST_BIN(pipeline), source, convert, resample, wavenc, filesink, NULL);
+        if (gst_element_link_many(convert, resample, wavenc, filesink, NULL) != TRUE)
+        {
+            g_printerr("Elements could not be linked.\n");
+            gst_object_unref(pipeline);
+            return;
+        }
+        g_object_set(source, "uri", result.uri.c_str(), NULL);
+        g_object_set(filesink, "location", result.output.c_str(), "sync", FALSE, NULL);
+        g_signal_connect(source, "autoplug-continue", G_CALLBACK(audioOnly), NULL);
+        g_signal_connect(source, "pad-added", G_CALLBACK(padAdded), convert);
+        g_signal_connect(source, "no-more-pads", G_CALLBACK(noMorePads), convert);
+
+        GstBus *bus = gst_element_get_bus(pipeline);
+        if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+        {
+            g_printerr("%s: unable to set the pipeline to the playing state.\n", result.uri.c_str());
+        }
+        else
+        {
+            GstMessage *msg = gst_bus_timed_pop_filtered(
+                bus, GST_CLOCK_TIME_NONE,
+                (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_APPLICATION));
+            switch (GST_MESSAGE_TYPE(msg))
+            {
+            case GST_MESSAGE_EOS: {
+                gint64 duration = 0;
+                if (gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration))
+                {
+                    result.media_s = duration / (double)GST_SECOND;
+                }
+                result.ok = TRUE;
+                break;
+            }
+            case GST_MESSAGE_ERROR: {
+                GError *err;
+                gchar *debug_info;
+                gst_message_parse_error(msg, &err, &debug_info);
+                g_printerr("%s: Error received from element %s: %s\n", result.uri.c_str(), GST_OBJECT_NAME(msg->src),
+                           err->message);
+                g_clear_error(&err);
+                g_free(debug_info);
+                break;
+            }
+            default:
+                g_printerr("%s: no audio stream.\n", result.uri.c_str());
+                break;
+            }
+            gst_message_unref(msg);
+        }
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+
+        /* wavenc rewrites its header on EOS, so the size is only final once the filesink closed the file */
+        std::error_code ec;
+        std::uintmax_t bytes = std::filesystem::file_size(result.output, ec);
+        result.bytes = ec ? 0 : (guint64)bytes;
+    }
+
+    /* Keep autoplugging audio only; any other stream is exposed still encoded and never decoded */
+    static gboolean audioOnly(GstElement *bin, GstPad *pad, GstCaps *caps, gpointer user_data)
+    {
+        const gchar *type = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+        return (gboolean)!(g_str_has_prefix(type, "video/") || g_str_has_prefix(type, "image/") ||
+                           g_str_has_prefix(type, "text/") || g_str_has_prefix(type, "subpicture/"));
+    }
+
+    static void padAdded(GstElement *src, GstPad *new_pad, GstElement *convert)
+    {
+        GstCaps *caps = gst_pad_get_current_caps(new_pad);
+        if (!caps)
+        {
+            return;
+        }
+        GstPad *sink_pad = gst_element_get_static_pad(convert, "sink");
+        if (g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "audio/x-raw") &&
+            !gst_pad_is_linked(sink_pad))
+        {
+            gst_pad_link(new_pad, sink_pad);
+        }
+        gst_object_unref(sink_pad);
+        gst_caps_unref(caps);
+    }
+
+    /* A file without audio would never reach EOS at the filesink: tell the worker waiting on the bus */
+    static void noMorePads(GstElement *src, GstElement *convert)
+    {
+        GstPad *sink_pad = gst_element_get_static_pad(convert, "sink");
+        if (!gst_pad_is_linked(sink_pad))
+        {
+            gst_element_post_message(
+                src, gst_message_new_application(GST_OBJECT(src), gst_structure_new_empty("no-audio")));
+        }
+        gst_object_unref(sink_pad);
+    }
+
+    std::string out_dir;
+    guint workers;
+    RecordOptions record;
+    std::vector<FileResult> results;
+    std::atomic<std::size_t> next{0};
+    std::mutex print_lock;
+};
+
+using BatchExtractorPtr = BatchExtractor *;
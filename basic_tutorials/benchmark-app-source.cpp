@@ -0,0 +1,175 @@
+#include "app-source.hpp"
+#include "benchmark-util.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+
+struct RunResult
+{
+    gboolean ok;
+    guint64 frames;
+    double wall_s;
+    double cpu_s;
+    long minor_faults;
+    guint64 allocations;
+    guint64 fallbacks;
+    guint64 need_data;
+    guint64 enough_data;
+};
+
+/* Write the frame like a generator would: the whole frame when `fill`, else only a frame counter */
+static void fill_buffer(GstBuffer *buffer, guint64 frame, gboolean fill)
+{
+    GstMapInfo map;
+    if (gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        if (fill)
+        {
+            memset(map.data, (int)(frame & 0xff), map.size);
+        }
+        memcpy(map.data, &frame, MIN(map.size, sizeof(frame)));
+        gst_buffer_unmap(buffer, &map);
+    }
+}
+
+/* appsrc -> tee -> queue -> videoconvert -> fakesink(sync=false), fed `frames` frames of `frame_size` bytes */
+static RunResult run(gboolean pooled, const std::string &caps, gsize frame_size, guint64 frames, guint pool_buffers,
+                     gboolean fill)
+{
+    RunResult result = {};
+    guint64 produced = 0;
+    guint64 naive_allocations = 0;
+
+    AppSource::Producer producer = [&](BucketedBufferPool &pool) -> GstBuffer * {
+        if (produced == frames)
+        {
+            return nullptr;
+        }
+        GstBuffer *buffer;
+        if (pooled)
+        {
+            buffer = pool.acquire(frame_size);
+        }
+        else
+        {
+            buffer = gst_buffer_new_allocate(NULL, frame_size, NULL);
+            ++naive_allocations;
+        }
+        fill_buffer(buffer, produced++, fill);
+        return buffer;
+    };
+
+    /* Every frame is the same size, so one bucket of exactly that size serves them all. The naive run still gets
+     * a (tiny) pool so both runs share the same appsrc queue limit. */
+    std::vector<BucketedBufferPool::Bucket> buckets;
+    if (pooled)
+    {
+        buckets.push_back(BucketedBufferPool::Bucket{frame_size, pool_buffers});
+    }
+    AppSource feeder(caps, GST_SECOND / 30, producer, buckets, (guint64)frame_size * MAX(pool_buffers / 4, 1u));
+
+    PipelineConfig config;
+    config.verbose = FALSE;
+    config.source_factory = "appsrc";
+    config.source_setup = [&](GstElementPtr src) { feeder.attach(src); };
+    config.audio = FALSE;
+    config.video_sink = SinkConfig{"fakesink", FALSE};
+    PipelineElementPtr pipeline = new PipelineElement(config);
+    if (!pipeline->build())
+    {
+        delete pipeline;
+        return result;
+    }
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    gint64 start_us = g_get_monotonic_time();
+
+    if (pipeline->changeStatePlaying() != GST_STATE_CHANGE_FAILURE)
+    {
+        GstBus *bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+        GstMessage *msg =
+            gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        result.ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        gst_message_unref(msg);
+        gst_object_unref(bus);
+    }
+
+    result.wall_s = (g_get_monotonic_time() - start_us) / 1e6;
+    getrusage(RUSAGE_SELF, &after);
+    result.cpu_s = cpu_seconds(after) - cpu_seconds(before);
+    result.minor_faults = after.ru_minflt - before.ru_minflt;
+    result.frames = feeder.pushed();
+    result.fallbacks = feeder.pool().fallbackAllocations();
+    result.allocations = pooled ? feeder.pool().preallocatedBuffers() + result.fallbacks : naive_allocations;
+    result.need_data = feeder.needDataCount();
+    result.enough_data = feeder.enoughDataCount();
+
+    pipeline->changeStateNull();
+    pipeline->unref();
+    delete pipeline;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --width/--height of the I420 frames, --frames per run, --pool-buffers per bucket, --no-fill to only
+     * stamp a counter instead of writing the whole frame */
+    guint width = 1920;
+    guint height = 1080;
+    guint64 frames = 1000;
+    guint pool_buffers = 16;
+    gboolean fill = TRUE;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+        {
+            width = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+        {
+            height = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = std::stoull(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pool-buffers") == 0 && i + 1 < argc)
+        {
+            pool_buffers = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-fill") == 0)
+        {
+            fill = FALSE;
+        }
+    }
+
+    /* I420: a full-size luma plane and two quarter-size chroma planes */
+    gsize frame_size = (gsize)width * height * 3 / 2;
+    std::string caps = "video/x-raw,format=I420,width=" + std::to_string(width) + ",height=" + std::to_string(height) +
+                       ",framerate=30/1";
+
+    g_print("%dx%d I420, %zu bytes/frame, %" G_GUINT64_FORMAT " frames, %u buffers/bucket\n", width, height,
+            (std::size_t)frame_size, frames, pool_buffers);
+    g_print("%-8s %10s %10s %10s %10s %12s %10s %12s %10s %10s\n", "mode", "frames", "wall_s", "frames/s", "MB/s",
+            "allocations", "fallback", "minor_flt", "need", "enough");
+    for (gboolean pooled : {FALSE, TRUE})
+    {
+        RunResult r = run(pooled, caps, frame_size, frames, pool_buffers, fill);
+        if (!r.ok)
+        {
+            g_printerr("%s run failed.\n", pooled ? "pool" : "naive");
+            return -1;
+        }
+        double fps = r.wall_s > 0 ? r.frames / r.wall_s : 0.0;
+        g_print("%-8s %10" G_GUINT64_FORMAT " %10.2f %10.1f %10.1f %12" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                " %12ld %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n",
+                pooled ? "pool" : "naive", r.frames, r.wall_s, fps, fps * frame_size / 1e6, r.allocations,
+                r.fallbacks, r.minor_faults, r.need_data, r.enough_data);
+        g_print("         cpu %.2f s, %.1f us/frame\n", r.cpu_s, r.frames ? r.cpu_s * 1e6 / r.frames : 0.0);
+    }
+    return 0;
+}
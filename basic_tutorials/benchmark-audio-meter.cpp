@@ -0,0 +1,171 @@
+#include "audio-meter.hpp"
+#include "benchmark-util.hpp"
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+static const gint rate = 48000;
+static const gint samples_per_buffer = 1024;
+
+/* Million samples a second through the level kernels on one thread, over buffers of the size audiotestsrc makes */
+static void bench_kernels(guint channels, guint rounds)
+{
+    std::mt19937 random(1);
+    std::vector<gint16> s16((std::size_t)samples_per_buffer * channels);
+    std::vector<gfloat> f32(s16.size());
+    for (std::size_t i = 0; i < s16.size(); ++i)
+    {
+        s16[i] = (gint16)random();
+        f32[i] = s16[i] / 32768.0f;
+    }
+
+    for (guint level = SimdKernels::scalar; level <= SimdKernels::detected(); ++level)
+    {
+        guint32 peaks[2] = {0, 0};
+        guint64 squares[2] = {0, 0}, clips[2] = {0, 0};
+        gint64 start_us = g_get_monotonic_time();
+        for (guint round = 0; round < rounds; ++round)
+        {
+            SimdKernels::levelS16((SimdKernels::Level)level, s16.data(), samples_per_buffer, channels, peaks, squares,
+                                  clips);
+        }
+        double s16_seconds = (g_get_monotonic_time() - start_us) / 1e6;
+
+        gfloat float_peaks[2] = {0.0f, 0.0f};
+        gdouble float_squares[2] = {0.0, 0.0};
+        start_us = g_get_monotonic_time();
+        for (guint round = 0; round < rounds; ++round)
+        {
+            SimdKernels::levelF32((SimdKernels::Level)level, f32.data(), samples_per_buffer, channels, float_peaks,
+                                  float_squares, clips);
+        }
+        double f32_seconds = (g_get_monotonic_time() - start_us) / 1e6;
+
+        /* The sums are printed so that the loops cannot be optimised away */
+        double samples = (double)rounds * s16.size();
+        g_print("%-8u %-8s %12.1f %12.1f %14.3g\n", channels, SimdKernels::levelName((SimdKernels::Level)level),
+                samples / s16_seconds / 1e6, samples / f32_seconds / 1e6, (double)squares[0] + float_squares[0]);
+    }
+}
+
+struct Mode
+{
+    const gchar *name;
+    const gchar *element; /* In front of every fakesink, nullptr for none */
+    gboolean meter;
+};
+
+struct RunResult
+{
+    PipelineRun played;
+    guint64 bus_messages;
+    guint64 readings;
+};
+
+/* `streams` stereo S16 sources into fakesinks that do not sync, metered by `mode`, in one pipeline. The bus is
+ * drained as the application would, counting the element messages. */
+static RunResult run(const Mode &mode, guint streams, guint buffers)
+{
+    RunResult result = {PipelineRun(), 0, 0};
+    std::string description;
+    for (guint stream = 0; stream < streams; ++stream)
+    {
+        description += "audiotestsrc wave=pink-noise num-buffers=" + std::to_string(buffers) +
+                       " samplesperbuffer=" + std::to_string(samples_per_buffer) +
+                       " ! audio/x-raw,format=S16LE,channels=2,rate=" + std::to_string(rate) + " ! " +
+                       (mode.element ? std::string(mode.element) + " ! " : std::string()) + "fakesink name=sink" +
+                       std::to_string(stream) + " sync=false ";
+    }
+
+    GstElement *pipeline = build_pipeline(description, mode.name);
+    if (!pipeline)
+    {
+        return result;
+    }
+
+    std::vector<std::unique_ptr<AudioMeter>> meters;
+    if (mode.meter)
+    {
+        for (guint stream = 0; stream < streams; ++stream)
+        {
+            GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), ("sink" + std::to_string(stream)).c_str());
+            meters.emplace_back(new AudioMeter(100));
+            meters.back()->attach(sink);
+            gst_object_unref(sink);
+        }
+    }
+
+    result.played = play_to_eos(pipeline, mode.name, [&result](GstMessage *) { ++result.bus_messages; });
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    for (const std::unique_ptr<AudioMeter> &meter : meters)
+    {
+        result.readings += meter->published();
+    }
+    meters.clear();
+    gst_object_unref(pipeline);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --streams N metered at once (200 by default), --seconds N of audio per stream (10 by default) */
+    guint streams = 200;
+    guint seconds = 10;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc)
+        {
+            streams = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    g_print("Level kernels, %d-frame buffers, CPU supports %s\n", samples_per_buffer,
+            SimdKernels::levelName(SimdKernels::detected()));
+    g_print("%-8s %-8s %12s %12s %14s\n", "channels", "kernels", "S16 Msamp/s", "F32 Msamp/s", "checksum");
+    bench_kernels(1, 200000);
+    bench_kernels(2, 100000);
+
+    /* level posting a message per buffer is what the bus has to carry without aggregation */
+    std::string per_buffer =
+        "level post-messages=true interval=" +
+        std::to_string(gst_util_uint64_scale_int(samples_per_buffer, GST_SECOND, rate));
+    const Mode modes[] = {
+        {"none", nullptr, FALSE},
+        {"level/buffer", per_buffer.c_str(), FALSE},
+        {"level/100ms", "level post-messages=true interval=100000000", FALSE},
+        {"meter/100ms", nullptr, TRUE},
+    };
+
+    guint buffers = (guint)((guint64)seconds * rate / samples_per_buffer);
+    double audio_seconds = (double)buffers * samples_per_buffer / rate;
+    g_print("\n%u streams of %.1f s stereo S16 at %d Hz\n", streams, audio_seconds, rate);
+    g_print("%-14s %10s %12s %12s %12s\n", "metering", "x realtime", "cpu_ms/s", "bus msgs/s", "readings/s");
+
+    /* The first run also loads the plugins; it is not counted */
+    run(modes[1], 1, 10);
+    for (const Mode &mode : modes)
+    {
+        RunResult result = run(mode, streams, buffers);
+        if (result.played.wall_seconds < 0)
+        {
+            g_print("%-14s %10s\n", mode.name, "failed");
+            continue;
+        }
+        /* Per stream and per second of audio, so the figures hold for any number of streams played in real time */
+        double per_stream = streams * audio_seconds;
+        g_print("%-14s %10.1f %12.3f %12.1f %12.1f\n", mode.name, audio_seconds / result.played.wall_seconds,
+                result.played.cpu_seconds * 1e3 / per_stream, result.bus_messages / per_stream,
+                result.readings / per_stream);
+    }
+    return 0;
+}
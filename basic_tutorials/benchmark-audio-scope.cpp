@@ -0,0 +1,124 @@
+#include "benchmark-util.hpp"
+#include "simd-scope.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const gint rate = 48000;
+static const gint samples_per_buffer = 1024;
+
+struct Chain
+{
+    const gchar *name;
+    const gchar *scope;
+    const gchar *format;
+};
+
+/* The tutorials' wavescope branch and simdscope, each into a sink that wants YUV (as xvimagesink does) and into one
+ * that takes packed RGB (as ximagesink does) */
+static const Chain chains[] = {
+    {"wavescope", "wavescope shader=none style=lines", "I420"},
+    {"wavescope", "wavescope shader=none style=lines", "BGRx"},
+    {"simdscope", "simdscope", "I420"},
+    {"simdscope", "simdscope", "BGRx"},
+};
+
+/* `streams` independent stereo S16 sources through the scope branch of the tutorials (scope, size and rate caps,
+ * videoconvert, sink caps) into fakesinks that do not sync, all in one pipeline */
+static PipelineRun run(const Chain &chain, guint streams, guint buffers, const std::string &video_caps)
+{
+    std::string description;
+    for (guint stream = 0; stream < streams; ++stream)
+    {
+        description += "audiotestsrc wave=pink-noise num-buffers=" + std::to_string(buffers) +
+                       " samplesperbuffer=" + std::to_string(samples_per_buffer) +
+                       " ! audio/x-raw,format=S16LE,channels=2,rate=" + std::to_string(rate) + " ! " + chain.scope +
+                       " ! " + video_caps + " ! videoconvert ! video/x-raw,format=" + chain.format +
+                       " ! fakesink sync=false ";
+    }
+
+    GstElement *pipeline = build_pipeline(description, chain.name);
+    if (!pipeline)
+    {
+        return PipelineRun();
+    }
+    PipelineRun result = play_to_eos(pipeline, chain.name);
+    stop_pipeline(pipeline);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    SimdScope::registerElement();
+
+    /* Options: --streams N scopes running at once (4 by default), --seconds N of audio per stream (30 by default),
+     * --scope-size WxH and --scope-fps N of the video (640x360 at 30 by default), --levels scalar,sse4.1,avx2 the
+     * kernel levels to run simdscope at (every level the CPU supports by default) */
+    guint streams = 4;
+    guint seconds = 30;
+    ScopeOptions scope = ScopeOptions::parse(argc, argv);
+    std::vector<SimdKernels::Level> levels;
+    if (!parse_levels(argc, argv, levels))
+    {
+        return -1;
+    }
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc)
+        {
+            streams = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = (guint)std::stoul(argv[++i]);
+        }
+    }
+    gint width = scope.width > 0 ? scope.width : 640;
+    gint height = scope.height > 0 ? scope.height : 360;
+    gint fps = scope.fps > 0 ? scope.fps : 30;
+    std::string video_caps = "video/x-raw,width=" + std::to_string(width) + ",height=" + std::to_string(height) +
+                             ",framerate=" + std::to_string(fps) + "/1";
+    guint buffers = (guint)((guint64)seconds * rate / samples_per_buffer);
+    double audio_seconds = (double)buffers * samples_per_buffer / rate;
+
+    /* A stream needs cpu_ms of CPU per second of audio; divided by 10 that is the share of a core it takes when it
+     * plays in real time */
+    g_print("%u streams of %.1f s stereo S16 at %d Hz, %dx%d at %d fps, CPU supports %s\n", streams, audio_seconds,
+            rate, width, height, fps, SimdKernels::levelName(SimdKernels::detected()));
+    g_print("%-10s %-6s %-8s %10s %12s %10s %10s\n", "scope", "sink", "kernels", "x realtime", "cpu_ms/s", "% core",
+            "vs ws");
+
+    /* The first run also loads the plugins; it is not counted */
+    run(chains[0], 1, 10, video_caps);
+
+    double wavescope_cpu[2] = {0.0, 0.0};
+    for (const Chain &chain : chains)
+    {
+        gboolean simd = (gboolean)(strcmp(chain.name, "simdscope") == 0);
+        guint slot = strcmp(chain.format, "I420") == 0 ? 0 : 1;
+        std::vector<SimdKernels::Level> chain_levels = simd ? levels : std::vector<SimdKernels::Level>{levels.back()};
+        for (SimdKernels::Level level : chain_levels)
+        {
+            SimdKernels::setLevel(level);
+            PipelineRun result = run(chain, streams, buffers, video_caps);
+            if (result.wall_seconds < 0)
+            {
+                g_print("%-10s %-6s %-8s %10s\n", chain.name, chain.format, "-", "failed");
+                continue;
+            }
+            double cpu_ms = result.cpu_seconds * 1e3 / streams / audio_seconds;
+            if (!simd)
+            {
+                wavescope_cpu[slot] = cpu_ms;
+            }
+            g_print("%-10s %-6s %-8s %10.1f %12.2f %10.2f %9.2fx\n", chain.name, chain.format,
+                    simd ? SimdKernels::levelName(level) : "-", audio_seconds / result.wall_seconds, cpu_ms,
+                    cpu_ms / 10, cpu_ms > 0 && wavescope_cpu[slot] > 0 ? wavescope_cpu[slot] / cpu_ms : 0.0);
+        }
+        SimdKernels::setLevel(SimdKernels::detected());
+    }
+    return 0;
+}
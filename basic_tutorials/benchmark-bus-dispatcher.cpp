@@ -0,0 +1,325 @@
+#include "bus-dispatcher.hpp"
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* One audio pipeline posting a level message for every 10 ms of audio */
+struct LevelPipeline
+{
+    GstElement *pipeline;
+    GstPad *sink_pad;
+    std::atomic<gint64> eos_at_sink_us{0};
+    gint64 eos_handled_us = 0;
+    gboolean failed = FALSE;
+};
+
+struct RunResult
+{
+    double wall_s;  /* Until every EOS was handled */
+    double total_s; /* Until every level message was handled too */
+    guint64 level_handled;
+    guint64 level_dropped;
+    double eos_mean_ms;
+    double eos_max_ms;
+    double level_mean_ms;
+    double level_max_ms;
+    guint failed;
+};
+
+/* The handler work a UI update or a print would cost */
+static void busy_work(guint work_us)
+{
+    gint64 until = g_get_monotonic_time() + work_us;
+    while (g_get_monotonic_time() < until)
+    {
+    }
+}
+
+/* Stamp when EOS reaches the sink, right before the sink posts the EOS message */
+static GstPadProbeReturn eos_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    LevelPipeline *entry = static_cast<LevelPipeline *>(user_data);
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS)
+    {
+        entry->eos_at_sink_us.store(g_get_monotonic_time());
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static std::deque<LevelPipeline> make_pipelines(guint count, gint num_buffers, gboolean sync)
+{
+    std::deque<LevelPipeline> pipelines;
+    std::string description = "audiotestsrc num-buffers=" + std::to_string(num_buffers) +
+                              " samplesperbuffer=441 ! audio/x-raw,rate=44100,channels=2 ! level interval=10000000 "
+                              "post-messages=true ! fakesink name=sink sync=" +
+                              (sync ? "true" : "false");
+    for (guint i = 0; i < count; ++i)
+    {
+        GError *err = NULL;
+        GstElement *pipeline = gst_parse_launch(description.c_str(), &err);
+        if (err)
+        {
+            g_printerr("Pipeline could not be created: %s\n", err->message);
+            g_clear_error(&err);
+            break;
+        }
+        std::string name = "pipeline-" + std::to_string(i);
+        gst_object_set_name(GST_OBJECT(pipeline), name.c_str());
+
+        pipelines.emplace_back();
+        LevelPipeline &entry = pipelines.back();
+        entry.pipeline = pipeline;
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+        entry.sink_pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(entry.sink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, eos_probe, &entry, NULL);
+        gst_object_unref(sink);
+    }
+    return pipelines;
+}
+
+static void free_pipelines(std::deque<LevelPipeline> &pipelines)
+{
+    for (LevelPipeline &entry : pipelines)
+    {
+        gst_element_set_state(entry.pipeline, GST_STATE_NULL);
+        gst_object_unref(entry.sink_pad);
+        gst_object_unref(entry.pipeline);
+    }
+}
+
+static LevelPipeline *find_pipeline(std::deque<LevelPipeline> &pipelines, GstMessage *msg)
+{
+    for (LevelPipeline &entry : pipelines)
+    {
+        if (gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg), GST_OBJECT(entry.pipeline)))
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+/* Stamp the first EOS or error of the pipeline that posted `msg`. Returns FALSE when it was already done. */
+static gboolean finish_pipeline(std::deque<LevelPipeline> &pipelines, GstMessage *msg)
+{
+    LevelPipeline *entry = find_pipeline(pipelines, msg);
+    if (!entry || entry->eos_handled_us)
+    {
+        return FALSE;
+    }
+    entry->eos_handled_us = g_get_monotonic_time();
+    entry->failed = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR;
+    return TRUE;
+}
+
+static void summarize_eos(std::deque<LevelPipeline> &pipelines, RunResult &result)
+{
+    double sum = 0.0;
+    guint n = 0;
+    for (LevelPipeline &entry : pipelines)
+    {
+        result.failed += entry.failed ? 1 : 0;
+        gint64 at_sink = entry.eos_at_sink_us.load();
+        if (entry.failed || !at_sink)
+        {
+            continue;
+        }
+        double ms = (entry.eos_handled_us - at_sink) / 1e3;
+        sum += ms;
+        result.eos_max_ms = MAX(result.eos_max_ms, ms);
+        ++n;
+    }
+    result.eos_mean_ms = n ? sum / n : 0.0;
+}
+
+/* Baseline: the bus of every pipeline watched from one main loop, every message handled inline in bus order */
+struct WatchRun
+{
+    std::deque<LevelPipeline> *pipelines;
+    GMainLoop *loop;
+    guint work_us;
+    guint running;
+    guint64 level_handled;
+};
+
+static gboolean watch_callback(GstBus *bus, GstMessage *msg, WatchRun *run)
+{
+    switch (GST_MESSAGE_TYPE(msg))
+    {
+    case GST_MESSAGE_ELEMENT:
+        busy_work(run->work_us);
+        ++run->level_handled;
+        break;
+
+    case GST_MESSAGE_ERROR:
+    case GST_MESSAGE_EOS:
+        /* Only the first EOS or error of a pipeline counts, a failing pipeline can post several */
+        if (finish_pipeline(*run->pipelines, msg) && --run->running == 0)
+        {
+            g_main_loop_quit(run->loop);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+static RunResult run_watch(guint count, gint num_buffers, gboolean sync, guint work_us)
+{
+    RunResult result = {};
+    std::deque<LevelPipeline> pipelines = make_pipelines(count, num_buffers, sync);
+    GMainContext *context = g_main_context_new();
+    WatchRun run{&pipelines, g_main_loop_new(context, FALSE), work_us, (guint)pipelines.size(), 0};
+
+    std::vector<GSource *> watches;
+    for (LevelPipeline &entry : pipelines)
+    {
+        GstBus *bus = gst_element_get_bus(entry.pipeline);
+        GSource *watch = gst_bus_create_watch(bus);
+        g_source_set_callback(watch, (GSourceFunc)watch_callback, &run, NULL);
+        g_source_attach(watch, context);
+        watches.push_back(watch);
+        gst_object_unref(bus);
+    }
+
+    gint64 start_us = g_get_monotonic_time();
+    for (LevelPipeline &entry : pipelines)
+    {
+        gst_element_set_state(entry.pipeline, GST_STATE_PLAYING);
+    }
+    if (run.running > 0)
+    {
+        g_main_loop_run(run.loop);
+    }
+    result.wall_s = (g_get_monotonic_time() - start_us) / 1e6;
+    result.total_s = result.wall_s;
+    result.level_handled = run.level_handled;
+    summarize_eos(pipelines, result);
+
+    for (GSource *watch : watches)
+    {
+        g_source_destroy(watch);
+        g_source_unref(watch);
+    }
+    g_main_loop_unref(run.loop);
+    g_main_context_unref(context);
+    free_pipelines(pipelines);
+    return result;
+}
+
+/* BusDispatcher: level messages and EOS/ERROR on separate subscriber threads */
+static RunResult run_dispatcher(guint count, gint num_buffers, gboolean sync, guint work_us, std::size_t capacity)
+{
+    RunResult result = {};
+    std::deque<LevelPipeline> pipelines = make_pipelines(count, num_buffers, sync);
+    std::atomic<guint> running{(guint)pipelines.size()};
+
+    BusDispatcher dispatcher(capacity);
+    std::size_t level = dispatcher.subscribe(
+        GST_MESSAGE_ELEMENT, nullptr, [work_us](GstMessage *msg) { busy_work(work_us); }, capacity);
+    dispatcher.subscribe((GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR), nullptr, [&](GstMessage *msg) {
+        if (finish_pipeline(pipelines, msg))
+        {
+            running.fetch_sub(1);
+            running.notify_all();
+        }
+    });
+    for (LevelPipeline &entry : pipelines)
+    {
+        dispatcher.attach(entry.pipeline);
+    }
+    dispatcher.start();
+
+    gint64 start_us = g_get_monotonic_time();
+    for (LevelPipeline &entry : pipelines)
+    {
+        gst_element_set_state(entry.pipeline, GST_STATE_PLAYING);
+    }
+    for (guint left = running.load(); left > 0; left = running.load())
+    {
+        running.wait(left);
+    }
+    result.wall_s = (g_get_monotonic_time() - start_us) / 1e6;
+
+    /* Let the level handler finish its backlog, so its counts are complete */
+    dispatcher.stop();
+    result.total_s = (g_get_monotonic_time() - start_us) / 1e6;
+    summarize_eos(pipelines, result);
+    BusDispatcher::SubscriptionStats stats = dispatcher.stats(level);
+    result.level_handled = stats.delivered;
+    result.level_dropped = stats.dropped + dispatcher.dropped();
+    result.level_mean_ms = stats.mean_latency_us / 1e3;
+    result.level_max_ms = stats.max_latency_us / 1e3;
+
+    for (LevelPipeline &entry : pipelines)
+    {
+        dispatcher.detach(entry.pipeline);
+    }
+    free_pipelines(pipelines);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --num-buffers N of 10 ms audio per pipeline, --work-us handler cost per level message, --ring ring
+     * capacity, --sync to play in real time instead of as fast as possible; remaining arguments are the pipeline
+     * counts to run */
+    gint num_buffers = 500;
+    guint work_us = 50;
+    std::size_t capacity = 4096;
+    gboolean sync = FALSE;
+    std::vector<guint> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--num-buffers") == 0 && i + 1 < argc)
+        {
+            num_buffers = std::stoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--work-us") == 0 && i + 1 < argc)
+        {
+            work_us = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ring") == 0 && i + 1 < argc)
+        {
+            capacity = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sync") == 0)
+        {
+            sync = TRUE;
+        }
+        else
+        {
+            counts.push_back((guint)std::stoul(argv[i]));
+        }
+    }
+    if (counts.empty())
+    {
+        counts = {1, 8, 32, 64};
+    }
+
+    g_print("%d level messages per pipeline, %u us per message, ring %zu, %s\n", num_buffers, work_us, capacity,
+            sync ? "sync" : "as fast as possible");
+    g_print("%-10s %9s %8s %10s %10s %9s %12s %12s %12s %12s %7s\n", "mode", "pipelines", "wall_s", "handled",
+            "dropped", "msgs/s", "eos_mean_ms", "eos_max_ms", "lvl_mean_ms", "lvl_max_ms", "failed");
+    for (guint n : counts)
+    {
+        for (gboolean dispatched : {FALSE, TRUE})
+        {
+            RunResult r = dispatched ? run_dispatcher(n, num_buffers, sync, work_us, capacity)
+                                     : run_watch(n, num_buffers, sync, work_us);
+            g_print("%-10s %9u %8.2f %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                    " %9.0f %12.2f %12.2f %12.2f %12.2f %7u\n",
+                    dispatched ? "dispatcher" : "watch", n, r.wall_s, r.level_handled, r.level_dropped,
+                    r.total_s > 0 ? r.level_handled / r.total_s : 0.0, r.eos_mean_ms, r.eos_max_ms, r.level_mean_ms,
+                    r.level_max_ms, r.failed);
+        }
+    }
+    return 0;
+}
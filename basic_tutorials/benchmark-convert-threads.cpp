@@ -0,0 +1,123 @@
+#include "pipeline-element.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Size
+{
+    const gchar *name;
+    gint width;
+    gint height;
+};
+
+static const Size sizes[] = {{"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+
+/* Seconds for `frames` videotestsrc frames of `format` to run through one VideoElement branch, or a negative value
+ * when the pipeline failed. simdwarptv only takes BGRx/RGBx, so I420 frames go through a real conversion in front
+ * of it, and BGRx frames pass that videoconvert untouched. */
+static double run(const Size &size, const gchar *format, guint threads, guint frames)
+{
+    PipelineConfig config;
+    config.name = "convert-" + std::to_string(threads);
+    config.verbose = FALSE;
+    config.audio = FALSE;
+    config.video = FALSE;
+    config.source_description = "videotestsrc num-buffers=" + std::to_string(frames) +
+                                " ! video/x-raw,format=" + format + ",width=" + std::to_string(size.width) +
+                                ",height=" + std::to_string(size.height) + ",framerate=30/1";
+
+    PipelineElementPtr pipeline = new PipelineElement(config);
+    VideoElementPtr branch = new VideoElement("simdwarptv", QueueLimits(), SinkConfig{"fakesink", FALSE});
+    branch->setConvertThreads(threads);
+    pipeline->addBranch(branch);
+    if (!pipeline->build())
+    {
+        if (pipeline->getElement("pipeline"))
+        {
+            pipeline->unref();
+        }
+        delete pipeline;
+        return -1.0;
+    }
+
+    double seconds = -1.0;
+    gint64 start_us = g_get_monotonic_time();
+    if (pipeline->changeStatePlaying() != GST_STATE_CHANGE_FAILURE)
+    {
+        GstBus *bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+        GstMessage *msg =
+            gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+        {
+            seconds = (g_get_monotonic_time() - start_us) / 1e6;
+        }
+        gst_message_unref(msg);
+        gst_object_unref(bus);
+    }
+    pipeline->changeStateNull();
+    pipeline->unref();
+    delete pipeline;
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --frames N per run (120 by default), --threads 1,2,4,8,16 the thread counts to try */
+    guint frames = 120;
+    std::vector<guint> thread_counts = {1, 2, 4, 8, 16};
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            thread_counts.clear();
+            gchar **counts = g_strsplit(argv[++i], ",", -1);
+            for (gchar **count = counts; *count; ++count)
+            {
+                thread_counts.push_back((guint)std::stoul(*count));
+            }
+            g_strfreev(counts);
+        }
+    }
+
+    g_print("%u frames per run, %u cores\n", frames, g_get_num_processors());
+    g_print("%-6s %-8s %8s %10s %10s %10s\n", "size", "input", "threads", "fps", "ms/frame", "speedup");
+    for (const Size &size : sizes)
+    {
+        /* The first run also loads the plugins; it is not counted */
+        run(size, "I420", 1, 5);
+
+        /* BGRx input needs no conversion: the ceiling the thread counts can approach */
+        double ceiling = run(size, "BGRx", 1, frames);
+        if (ceiling > 0)
+        {
+            g_print("%-6s %-8s %8s %10.1f %10.2f %10s\n", size.name, "BGRx", "-", frames / ceiling,
+                    ceiling * 1e3 / frames, "-");
+        }
+
+        double single = 0.0;
+        for (guint threads : thread_counts)
+        {
+            double seconds = run(size, "I420", threads, frames);
+            if (seconds < 0)
+            {
+                g_print("%-6s %-8s %8u %10s\n", size.name, "I420", threads, "failed");
+                continue;
+            }
+            if (single == 0.0)
+            {
+                single = seconds;
+            }
+            g_print("%-6s %-8s %8u %10.1f %10.2f %10.2f\n", size.name, "I420", threads, frames / seconds,
+                    seconds * 1e3 / frames, single / seconds);
+        }
+    }
+    return 0;
+}
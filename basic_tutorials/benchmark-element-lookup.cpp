@@ -0,0 +1,116 @@
+#include "pipeline-element.hpp"
+#include <chrono>
+#include <iostream>
+#include <regex>
+#include <string>
+
+/* The string path PipelineElement::getElement used before the slot registry: build a std::string, split on '.',
+ * compile a regex to check the index, then walk an if/else chain of std::string compares in the branch. */
+static bool legacy_is_number(std::string &s)
+{
+    return std::regex_match(s.c_str(), std::regex("[(-|+)|][0-9.]+"));
+}
+
+static GstElementPtr legacy_branch_lookup(ElementPtr branch, const char *_element_name)
+{
+    std::string element_name{_element_name};
+    if (element_name == "video_queue" || element_name == "video_convert" || element_name == "video_filter" ||
+        element_name == "video_convert_after_filter" || element_name == "video_sink")
+    {
+        return branch->getSlot(VideoElement::slotIndex(element_name));
+    }
+    return nullptr;
+}
+
+static GstElementPtr legacy_lookup(PipelineElementPtr data, std::vector<ElementPtr> &branches,
+                                   const char *_element_name)
+{
+    std::string element_name{_element_name};
+    if (element_name == "pipeline" || element_name == "source" || element_name == "tee")
+    {
+        return data->getElement(_element_name);
+    }
+
+    int idx = element_name.find(".");
+    if (idx < 0 || std::string_view(element_name.c_str(), idx) != "list_elements")
+    {
+        return nullptr;
+    }
+    std::string_view sub(element_name.c_str() + idx + 1);
+    idx = sub.find(".");
+    if (idx < 0)
+    {
+        return nullptr;
+    }
+
+    /* The legacy regex wants a leading sign character, so one is prepended to run the same match */
+    std::string list_elements_idx_char = "+" + std::string(sub.substr(0, idx));
+    if (!legacy_is_number(list_elements_idx_char))
+    {
+        return nullptr;
+    }
+    std::size_t list_elements_idx = std::stoul(list_elements_idx_char);
+    if (list_elements_idx >= branches.size())
+    {
+        return nullptr;
+    }
+    std::string_view sub_element_name{sub.data() + idx + 1};
+    return legacy_branch_lookup(branches[list_elements_idx], sub_element_name.data());
+}
+
+template <typename F> static double time_per_call_ns(std::size_t iterations, F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        f(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t n_branches = argc > 1 ? std::stoul(argv[1]) : 256;
+    const std::size_t iterations = argc > 2 ? std::stoul(argv[2]) : 100000;
+
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Lookups never dereference the elements, so the branches are registered but not created */
+    PipelineElementPtr pipeline = new PipelineElement();
+    std::vector<ElementPtr> branches;
+    std::vector<std::size_t> branch_ids;
+    std::vector<std::string> paths;
+    for (std::size_t b = 0; b < n_branches; ++b)
+    {
+        VideoElementPtr branch = new VideoElement("edgetv");
+        branches.push_back(branch);
+        branch_ids.push_back(pipeline->addBranch(branch));
+        paths.push_back("list_elements." + std::to_string(branch_ids.back()) + ".video_convert_after_filter");
+    }
+
+    GstElementPtr volatile sink = nullptr;
+
+    double legacy_ns = time_per_call_ns(iterations, [&](std::size_t i) {
+        sink = legacy_lookup(pipeline, branches, paths[i % n_branches].c_str());
+    });
+    double string_ns = time_per_call_ns(iterations, [&](std::size_t i) {
+        sink = pipeline->getElement(paths[i % n_branches].c_str());
+    });
+    double index_ns = time_per_call_ns(iterations, [&](std::size_t i) {
+        sink = pipeline->getElement(branch_ids[i % n_branches], VideoElement::video_convert_after_filter);
+    });
+    double typed_ns = time_per_call_ns(iterations, [&](std::size_t i) {
+        sink = static_cast<VideoElementPtr>(branches[i % n_branches])->get<VideoElement::video_convert_after_filter>();
+    });
+
+    g_print("branches: %zu  iterations: %zu\n", n_branches, iterations);
+    g_print("  legacy string path (regex):  %10.1f ns/lookup\n", legacy_ns);
+    g_print("  string path (from_chars):    %10.1f ns/lookup\n", string_ns);
+    g_print("  index path (branch, slot):   %10.1f ns/lookup\n", index_ns);
+    g_print("  typed path (get<slot>()):    %10.1f ns/lookup\n", typed_ns);
+
+    delete pipeline;
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "fast-startup.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Case
+{
+    const gchar *name;
+    const gchar *description; /* Linked after the videotestsrc */
+};
+
+/* Every pipeline ends in exactly one sink that FirstFrameClock must list, once: a plain fakesink, and a bin holding
+ * one, which carries the sink flag like autovideosink does */
+static const Case cases[] = {
+    {"fakesink", "fakesink sync=false"},
+    {"sink bin", "queue ! fakesink sync=false"},
+};
+
+/* The time from PLAYING requested until the first buffer reached the sink, in us; -1 if FirstFrameClock recorded
+ * none, or did not list exactly one sink */
+static gint64 run(const Case &test)
+{
+    GError *err = NULL;
+    GstElement *sink = gst_parse_bin_from_description(test.description, TRUE, &err);
+    if (!sink)
+    {
+        g_printerr("%s could not be built: %s\n", test.name, err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return -1;
+    }
+    GstElement *pipeline = gst_pipeline_new("first-frame");
+    GstElement *source = gst_element_factory_make("videotestsrc", "source");
+    if (!source)
+    {
+        gst_object_unref(sink);
+        gst_object_unref(pipeline);
+        return -1;
+    }
+    g_object_set(source, "num-buffers", 5, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), source, sink, NULL);
+    if (!gst_element_link(source, sink))
+    {
+        g_printerr("%s could not be linked\n", test.name);
+        gst_object_unref(pipeline);
+        return -1;
+    }
+
+    FirstFrameClock clock;
+    clock.attach(pipeline);
+    gint64 start_us = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg =
+        gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    if (msg)
+    {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    std::vector<FirstFrameClock::SinkTime> sinks = clock.firstBuffers();
+    gint64 first_us = sinks.size() == 1 && sinks[0].first_buffer_us ? sinks[0].first_buffer_us - start_us : -1;
+    if (first_us < 0)
+    {
+        g_printerr("%s: %zu sinks listed, first buffer %s\n", test.name, sinks.size(),
+                   sinks.empty() || !sinks[0].first_buffer_us ? "not seen" : "seen");
+    }
+    gst_object_unref(pipeline);
+    return first_us;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --runs N per pipeline (20 by default) */
+    guint runs = 20;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+        {
+            runs = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    /* Exits 1 as soon as a pipeline gives no first-frame time, so that --ttff cannot silently report nothing */
+    g_print("%-12s %7s %10s %10s\n", "sink", "runs", "p50 ms", "max ms");
+    for (const Case &test : cases)
+    {
+        std::vector<gint64> times;
+        for (guint i = 0; i < runs; ++i)
+        {
+            gint64 first_us = run(test);
+            if (first_us < 0)
+            {
+                return 1;
+            }
+            times.push_back(first_us);
+        }
+        if (times.empty())
+        {
+            continue;
+        }
+        std::sort(times.begin(), times.end());
+        g_print("%-12s %7zu %10.2f %10.2f\n", test.name, times.size(), times[times.size() / 2] / 1e3,
+                times.back() / 1e3);
+    }
+    return 0;
+}
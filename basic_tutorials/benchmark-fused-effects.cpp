@@ -0,0 +1,118 @@
+#include "benchmark-util.hpp"
+#include "pipeline-element.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+
+struct Size
+{
+    const gchar *name;
+    gint width;
+    gint height;
+};
+
+static const Size sizes[] = {{"720p", 1280, 720}, {"1080p", 1920, 1080}};
+
+struct Chain
+{
+    const gchar *name;
+    const gchar *effect;
+    gboolean fused;
+};
+
+/* effectv and the in-tree effect in the usual convert -> effect -> convert branch, and the in-tree effect fused */
+static const Chain chains[] = {
+    {"effectv", "edgetv", FALSE},    {"split", "simdedgetv", FALSE},  {"fused", "simdedgetv", TRUE},
+    {"effectv", "agingtv", FALSE},   {"split", "simdagingtv", FALSE}, {"fused", "simdagingtv", TRUE},
+};
+
+struct RunResult
+{
+    double seconds;
+    guint64 bytes_per_frame;
+};
+
+/* I420 frames, as a decoder hands them out, through the branch of a VideoElement into a sink that takes I420 only, as
+ * most display sinks prefer. The elements carry the slot names of VideoElement. The split chain pins the effect to
+ * BGRx, the format effectv works in: the in-tree effects take I420 too, and would otherwise leave both converters in
+ * passthrough and measure the fused chain against itself. */
+static RunResult run(const Chain &chain, const Size &size, guint frames)
+{
+    RunResult result = {-1.0, 0};
+    std::string source = "videotestsrc num-buffers=" + std::to_string(frames) +
+                         " ! video/x-raw,format=I420,width=" + std::to_string(size.width) +
+                         ",height=" + std::to_string(size.height) + ",framerate=30/1 ! ";
+    std::string effect = std::string(chain.effect) + " name=video_filter";
+    std::string branch = chain.fused ? effect + " ! videoconvert name=video_convert"
+                                     : "videoconvert name=video_convert ! video/x-raw,format=BGRx ! " + effect +
+                                           " ! video/x-raw,format=BGRx ! videoconvert name=video_convert_after_filter";
+    std::string description = source + branch + " ! video/x-raw,format=I420 ! fakesink sync=false";
+
+    GstElement *pipeline = build_pipeline(description, chain.effect);
+    if (!pipeline)
+    {
+        return result;
+    }
+    result.seconds = play_to_eos(pipeline, chain.effect).wall_seconds;
+
+    /* Still PLAYING after EOS, so the negotiated caps are there to read */
+    for (const gchar *name : {"video_convert", "video_filter", "video_convert_after_filter"})
+    {
+        GstElement *element = result.seconds < 0 ? nullptr : gst_bin_get_by_name(GST_BIN(pipeline), name);
+        if (element)
+        {
+            result.bytes_per_frame += VideoElement::frameTraffic(element, strcmp(name, "video_filter") != 0);
+            gst_object_unref(element);
+        }
+    }
+    stop_pipeline(pipeline);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    SimdEffects::registerElements();
+
+    /* Options: --frames N per run (300 by default) */
+    guint frames = 300;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    g_print("%u I420 frames per run, %s kernels\n", frames, SimdKernels::levelName(SimdKernels::level()));
+    g_print("%-6s %-12s %-8s %10s %10s %12s %12s %12s\n", "size", "effect", "chain", "fps", "ms/frame", "MB/frame",
+            "MB saved", "GB/s saved");
+    for (const Size &size : sizes)
+    {
+        /* The first run also loads the plugins; it is not counted */
+        run(chains[0], size, 10);
+
+        /* Savings are against the split chain of the same effect, the one listed just before it */
+        guint64 split_bytes = 0;
+        for (const Chain &chain : chains)
+        {
+            RunResult result = run(chain, size, frames);
+            if (result.seconds < 0)
+            {
+                g_print("%-6s %-12s %-8s %10s\n", size.name, chain.effect, chain.name, "failed");
+                continue;
+            }
+            if (!chain.fused)
+            {
+                split_bytes = result.bytes_per_frame;
+            }
+            double fps = frames / result.seconds;
+            double saved = split_bytes > result.bytes_per_frame ? (split_bytes - result.bytes_per_frame) / 1e6 : 0.0;
+            g_print("%-6s %-12s %-8s %10.1f %10.3f %12.2f %12.2f %12.2f\n", size.name, chain.effect, chain.name, fps,
+                    result.seconds * 1e3 / frames, result.bytes_per_frame / 1e6, chain.fused ? saved : 0.0,
+                    chain.fused ? saved * fps / 1e3 : 0.0);
+        }
+    }
+    return 0;
+}
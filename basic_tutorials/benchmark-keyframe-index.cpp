@@ -0,0 +1,251 @@
+#include "keyframe-index.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct Mode
+{
+    const gchar *name;
+    gboolean accurate;
+    gboolean indexed;
+};
+
+static const Mode modes[] = {
+    {"key-unit", FALSE, FALSE},
+    {"key-unit, index", FALSE, TRUE},
+    {"accurate", TRUE, FALSE},
+    {"accurate, prefetch", TRUE, TRUE},
+};
+
+/* Every decoded stream ends in its own fakesink */
+static void on_pad_added(GstElement *decode, GstPad *pad, GstElement *pipeline)
+{
+    GstElement *sink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(sink, "sync", FALSE, NULL);
+    gst_bin_add(GST_BIN(pipeline), sink);
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
+    gst_element_sync_state_with_parent(sink);
+}
+
+/* Wait for the pipeline to preroll again; FALSE on an error or after 10 s */
+static gboolean wait_preroll(GstElement *pipeline)
+{
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg =
+        gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_ASYNC_DONE));
+    gboolean ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ASYNC_DONE;
+    if (msg && !ok)
+    {
+        GError *err = NULL;
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("%s\n", err->message);
+        g_clear_error(&err);
+    }
+    if (msg)
+    {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    return ok;
+}
+
+static void drop_cache(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+/* `seeks` flushing seeks of a paused uridecodebin pipeline to random positions, the same ones for every mode. Returns
+ * the time each took until the pipeline had prerolled again, in us and sorted, or nothing if it failed. */
+static std::vector<gint64> run(const Mode &mode, KeyframeIndex &index, guint seeks, gboolean cold,
+                               const std::string &path)
+{
+    std::vector<gint64> latencies;
+    GstElement *pipeline = gst_pipeline_new("seek");
+    GstElement *decode = gst_element_factory_make("uridecodebin", "decode");
+    if (!decode)
+    {
+        gst_object_unref(pipeline);
+        return latencies;
+    }
+    g_object_set(decode, "uri", index.getUri().c_str(), NULL);
+    gst_bin_add(GST_BIN(pipeline), decode);
+    g_signal_connect(decode, "pad-added", G_CALLBACK(on_pad_added), pipeline);
+
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    gint64 duration = 0;
+    if (!wait_preroll(pipeline) || !gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration) || duration <= 0)
+    {
+        g_printerr("%s: the file did not preroll or has no duration\n", mode.name);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+        return latencies;
+    }
+
+    GRand *rand = g_rand_new_with_seed(4);
+    for (guint seek = 0; seek < seeks; ++seek)
+    {
+        gint64 position = (gint64)(g_rand_double(rand) * duration);
+        if (cold)
+        {
+            drop_cache(path);
+        }
+        gint64 start_us = g_get_monotonic_time();
+        if (mode.indexed)
+        {
+            index.seek(pipeline, position, mode.accurate);
+        }
+        else
+        {
+            gst_element_seek_simple(
+                pipeline, GST_FORMAT_TIME,
+                (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | (mode.accurate ? GST_SEEK_FLAG_ACCURATE : GST_SEEK_FLAG_KEY_UNIT)),
+                position);
+        }
+        if (!wait_preroll(pipeline))
+        {
+            latencies.clear();
+            break;
+        }
+        latencies.push_back(g_get_monotonic_time() - start_us);
+    }
+    g_rand_free(rand);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+static double percentile_ms(const std::vector<gint64> &sorted, double fraction)
+{
+    return sorted[std::min(sorted.size() - 1, (std::size_t)(sorted.size() * fraction))] / 1e3;
+}
+
+/* A VP8 WebM of `seconds` at 25 fps with a keyframe every `interval` frames, written by GStreamer itself */
+static gboolean generate(const std::string &path, guint seconds, guint interval)
+{
+    std::string description = "videotestsrc pattern=ball num-buffers=" + std::to_string(seconds * 25) +
+                              " ! video/x-raw,width=640,height=360,framerate=25/1" +
+                              " ! vp8enc deadline=1 keyframe-max-dist=" + std::to_string(interval) +
+                              " ! webmmux ! filesink location=\"" + path + "\"";
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description.c_str(), &err);
+    if (!pipeline)
+    {
+        g_printerr("Could not write %s: %s\n", path.c_str(), err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return FALSE;
+    }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg =
+        gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = (gboolean)(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --file PATH to seek in (any local media with video), or a WebM of --seconds N (300 by default) with
+     * a keyframe every --keyframe-interval N frames (250 by default) written to --dir DIR (the current directory by
+     * default) and removed afterwards; --seeks N per mode (1000 by default); --cold drops the file from the page cache
+     * before every seek */
+    std::string path;
+    guint seconds = 300;
+    guint interval = 250;
+    std::string dir = ".";
+    guint seeks = 1000;
+    gboolean cold = FALSE;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc)
+        {
+            interval = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seeks") == 0 && i + 1 < argc)
+        {
+            seeks = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cold") == 0)
+        {
+            cold = TRUE;
+        }
+    }
+
+    gboolean generated = path.empty();
+    if (generated)
+    {
+        path = dir + "/benchmark-keyframe-index.webm";
+        g_print("Writing %u s of VP8 with a keyframe every %u frames to %s\n", seconds, interval, path.c_str());
+        if (!generate(path, seconds, interval))
+        {
+            return 1;
+        }
+    }
+
+    /* The index is scanned afresh rather than loaded, so that the scan is timed and nothing is written */
+    KeyframeIndex index(path);
+    gint64 scan_us = g_get_monotonic_time();
+    if (!index.scan() || index.size() == 0)
+    {
+        g_printerr("No keyframes found in %s\n", path.c_str());
+        return 1;
+    }
+    scan_us = g_get_monotonic_time() - scan_us;
+    g_print("Indexed %" G_GSIZE_FORMAT " keyframes over %" GST_TIME_FORMAT " in %.1f ms\n", index.size(),
+            GST_TIME_ARGS(index.covered()), scan_us / 1e3);
+
+    /* Latency is from the seek call until the pipeline prerolled at the new position, i.e. a frame was decoded
+     * there. The index turns key-unit seeks into seeks to a known keyframe; accurate seeks keep their target and
+     * flags, and only get the keyframe's bytes prefetched, which shows with --cold. */
+    g_print("%-18s %7s %10s %10s %10s %9s\n", "seek", "seeks", "p50 ms", "p99 ms", "max ms", "indexed");
+    for (const Mode &mode : modes)
+    {
+        KeyframeIndex::Stats before = index.getStats();
+        std::vector<gint64> latencies = run(mode, index, seeks, cold, path);
+        if (latencies.empty())
+        {
+            g_print("%-18s %7s\n", mode.name, "failed");
+            continue;
+        }
+        KeyframeIndex::Stats after = index.getStats();
+        guint64 resolved = after.resolved - before.resolved;
+        g_print("%-18s %7zu %10.2f %10.2f %10.2f %8.0f%%\n", mode.name, latencies.size(), percentile_ms(latencies, 0.5),
+                percentile_ms(latencies, 0.99), latencies.back() / 1e3,
+                mode.indexed ? 100.0 * resolved / latencies.size() : 0.0);
+    }
+
+    if (generated)
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    return 0;
+}
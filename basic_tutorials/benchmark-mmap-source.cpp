@@ -0,0 +1,238 @@
+#include "benchmark-util.hpp"
+#include "mmap-source.hpp"
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct Mode
+{
+    const gchar *name;
+    const gchar *source;  /* Element reading the file, or NULL for uridecodebin */
+    gboolean prefer_mmap; /* For uridecodebin */
+    gboolean cold;        /* The file is dropped from the page cache first */
+};
+
+static const Mode modes[] = {
+    {"filesrc, cold", "filesrc", FALSE, TRUE},
+    {"mmapfilesrc, cold", MmapSource::name, FALSE, TRUE},
+    {"filesrc, warm", "filesrc", FALSE, FALSE},
+    {"mmapfilesrc, warm", MmapSource::name, FALSE, FALSE},
+    {"uridecodebin", NULL, FALSE, FALSE},
+    {"uridecodebin, mmap", NULL, TRUE, FALSE},
+};
+
+struct RunResult
+{
+    PipelineRun played;
+    double resident; /* Fraction of the file in the page cache afterwards */
+    MmapSource::Stats stats;
+};
+
+/* Ask the kernel to forget the cached pages of `path`; dirty pages are written out first so that it can */
+static void drop_cache(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/* Fraction of the pages of `path` that are in the page cache, from mincore() on a fresh mapping */
+static double residency(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 0.0;
+    }
+    gsize page = (gsize)sysconf(_SC_PAGESIZE);
+    gsize size = (gsize)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return 0.0;
+    }
+    std::vector<unsigned char> pages((size + page - 1) / page);
+    gsize resident = 0;
+    if (mincore(base, size, pages.data()) == 0)
+    {
+        for (unsigned char flags : pages)
+        {
+            resident += flags & 1;
+        }
+    }
+    munmap(base, size);
+    return (double)resident / pages.size();
+}
+
+/* Demux `path` as fast as it goes: parsebin splits the container without decoding, so the source and the demuxer are
+ * all that is measured. uridecodebin picks its own source, and decodes. */
+static RunResult run(const Mode &mode, const std::string &path)
+{
+    RunResult result = {PipelineRun(), 0.0, {}};
+    std::string description;
+    if (mode.source)
+    {
+        description =
+            std::string(mode.source) + " name=source location=\"" + path + "\" ! parsebin ! fakesink sync=false";
+    }
+    else
+    {
+        gchar *uri = gst_filename_to_uri(path.c_str(), NULL);
+        description = "uridecodebin name=decode uri=\"" + std::string(uri) + "\" ! fakesink sync=false";
+        g_free(uri);
+    }
+    MmapSource::prefer(mode.prefer_mmap);
+    if (mode.cold)
+    {
+        drop_cache(path);
+    }
+
+    GstElement *pipeline = build_pipeline(description, mode.name);
+    if (!pipeline)
+    {
+        return result;
+    }
+
+    /* With uridecodebin the source is only known once it has been made */
+    GstElement *source = NULL;
+    if (mode.source)
+    {
+        source = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+    }
+    else
+    {
+        GstElement *decode = gst_bin_get_by_name(GST_BIN(pipeline), "decode");
+        g_signal_connect(decode, "source-setup", G_CALLBACK(+[](GstElement *, GstElement *made, gpointer data) {
+                             *(GstElement **)data = (GstElement *)gst_object_ref(made);
+                         }),
+                         &source);
+        gst_object_unref(decode);
+    }
+
+    result.played = play_to_eos(pipeline, mode.name);
+    if (source)
+    {
+        result.stats = MmapSource::stats(source);
+        gst_object_unref(source);
+    }
+    stop_pipeline(pipeline);
+    result.resident = residency(path);
+    return result;
+}
+
+/* A stereo S16 WAV file of about `megabytes`, written by GStreamer itself */
+static gboolean generate(const std::string &path, guint64 megabytes)
+{
+    const guint64 samples_per_buffer = 4096;
+    guint64 buffers = megabytes * 1000 * 1000 / (samples_per_buffer * 4);
+    std::string description = "audiotestsrc wave=white-noise num-buffers=" + std::to_string(buffers) +
+                              " samplesperbuffer=" + std::to_string(samples_per_buffer) +
+                              " ! audio/x-raw,format=S16LE,channels=2,rate=48000 ! wavenc ! filesink location=\"" +
+                              path + "\"";
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description.c_str(), &err);
+    if (!pipeline)
+    {
+        g_printerr("Could not write %s: %s\n", path.c_str(), err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return FALSE;
+    }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg =
+        gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = (gboolean)(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    MmapSource::registerElement();
+
+    /* Options: --file PATH to demux (any local media), or --megabytes N of WAV to write first (2048 by default) into
+     * --dir DIR (the current directory by default) and remove afterwards */
+    std::string path;
+    guint64 megabytes = 2048;
+    std::string dir = ".";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--megabytes") == 0 && i + 1 < argc)
+        {
+            megabytes = std::stoull(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+    }
+
+    gboolean generated = path.empty();
+    if (generated)
+    {
+        path = dir + "/benchmark-mmap-source.wav";
+        g_print("Writing %" G_GUINT64_FORMAT " MB to %s\n", megabytes, path.c_str());
+        if (!generate(path, megabytes))
+        {
+            return 1;
+        }
+    }
+    std::error_code error;
+    guint64 size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        g_printerr("Could not read %s: %s\n", path.c_str(), error.message().c_str());
+        return 1;
+    }
+    g_print("%s, %.1f MB\n", path.c_str(), size / 1e6);
+
+    /* "cold" runs start with the file out of the page cache, so that they read the disk; "warm" ones follow and find
+     * it cached. cpu_ms/GB and the faults are the whole process. "cached" is how much of the file the page cache
+     * holds after the run, "mapped MB" and "read MB" how the source delivered it. */
+    g_print("%-20s %9s %10s %12s %12s %7s %10s %10s %8s\n", "source", "MB/s", "cpu_ms/GB", "minor flt", "major flt",
+            "cached", "mapped MB", "read MB", "advice");
+
+    /* The first run also loads the plugins; it is not counted */
+    run(modes[2], path);
+    for (const Mode &mode : modes)
+    {
+        RunResult result = run(mode, path);
+        if (result.played.wall_seconds < 0)
+        {
+            g_print("%-20s %9s\n", mode.name, "failed");
+            continue;
+        }
+        g_print("%-20s %9.0f %10.1f %12ld %12ld %6.0f%% %10.1f %10.1f %8" G_GUINT64_FORMAT "\n", mode.name,
+                size / 1e6 / result.played.wall_seconds, result.played.cpu_seconds * 1e3 / (size / 1e9),
+                result.played.minor_faults, result.played.major_faults, result.resident * 100,
+                result.stats.wrapped / 1e6, result.stats.read / 1e6, result.stats.advice);
+    }
+    MmapSource::prefer(FALSE);
+
+    if (generated)
+    {
+        std::filesystem::remove(path, error);
+    }
+    return 0;
+}
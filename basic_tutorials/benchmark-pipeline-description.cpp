@@ -0,0 +1,214 @@
+#include "pipeline-description.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* The topology of exercise-tutorial-7-oop with three effect branches, all ending in fakesinks */
+static const char *topology = R"(
+pipeline name=bench verbose=false
+source factory=videotestsrc num-buffers=1
+branch audio sink=fakesink sync=false
+branch video sink=fakesink sync=false
+branch video filter=edgetv max-size-buffers=5 max-size-bytes=0 max-size-time=0 leaky=downstream sink=fakesink
+branch video filter=agingtv max-size-buffers=5 max-size-bytes=0 max-size-time=0 leaky=downstream sink=fakesink
+branch video filter=warptv max-size-buffers=5 max-size-bytes=0 max-size-time=0 leaky=downstream sink=fakesink
+)";
+
+static const char *effects[] = {"edgetv", "agingtv", "warptv"};
+
+/* A request pad of `tee` linked to the sink pad of `queue`, as exercise-tutorial-7 does by hand */
+static gboolean link_tee(GstElement *tee, GstElement *queue)
+{
+    GstPad *tee_pad = gst_element_get_request_pad(tee, "src_%u");
+    GstPad *queue_pad = gst_element_get_static_pad(queue, "sink");
+    gboolean ok = gst_pad_link(tee_pad, queue_pad) == GST_PAD_LINK_OK;
+    gst_object_unref(queue_pad);
+    gst_object_unref(tee_pad);
+    return ok;
+}
+
+/* The same graph wired the way exercise-tutorial-7 does: one gst_element_factory_make per element */
+static GstElement *build_hand_wired(guint index)
+{
+    std::string name = "bench-" + std::to_string(index);
+    GstElement *pipeline = gst_pipeline_new(name.c_str());
+    GstElement *source = gst_element_factory_make("videotestsrc", "source");
+    GstElement *tee = gst_element_factory_make("tee", "tee");
+    GstElement *tee_audio = gst_element_factory_make("tee", "audio_tee");
+    GstElement *audio_queue = gst_element_factory_make("queue", "audio_queue");
+    GstElement *audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
+    GstElement *audio_resample = gst_element_factory_make("audioresample", "audio_resample");
+    GstElement *audio_sink = gst_element_factory_make("fakesink", "audio_sink");
+    GstElement *video_queue = gst_element_factory_make("queue", "video_queue");
+    GstElement *video_convert = gst_element_factory_make("videoconvert", "video_convert");
+    GstElement *video_sink = gst_element_factory_make("fakesink", "video_sink");
+    if (!pipeline || !source || !tee || !tee_audio || !audio_queue || !audio_convert || !audio_resample ||
+        !audio_sink || !video_queue || !video_convert || !video_sink)
+    {
+        g_printerr("Not all elements could be created.\n");
+        return nullptr;
+    }
+    g_object_set(source, "num-buffers", 1, NULL);
+    g_object_set(tee, "allow-not-linked", TRUE, NULL);
+    g_object_set(tee_audio, "allow-not-linked", TRUE, NULL);
+    g_object_set(audio_sink, "sync", FALSE, NULL);
+    g_object_set(video_sink, "sync", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), source, tee, tee_audio, audio_queue, audio_convert, audio_resample,
+                     audio_sink, video_queue, video_convert, video_sink, NULL);
+    gboolean ok = gst_element_link_many(audio_queue, audio_convert, audio_resample, audio_sink, NULL) &&
+                  gst_element_link_many(video_queue, video_convert, video_sink, NULL) &&
+                  link_tee(tee_audio, audio_queue) && link_tee(tee, video_queue) && gst_element_link(source, tee);
+
+    for (std::size_t i = 0; ok && i < G_N_ELEMENTS(effects); ++i)
+    {
+        std::string prefix = std::string(effects[i]) + "_";
+        GstElement *queue = gst_element_factory_make("queue", (prefix + "queue").c_str());
+        GstElement *convert = gst_element_factory_make("videoconvert", (prefix + "convert").c_str());
+        GstElement *filter = gst_element_factory_make(effects[i], (prefix + "filter").c_str());
+        GstElement *convert_after = gst_element_factory_make("videoconvert", (prefix + "convert_after").c_str());
+        GstElement *sink = gst_element_factory_make("fakesink", (prefix + "sink").c_str());
+        if (!queue || !convert || !filter || !convert_after || !sink)
+        {
+            g_printerr("Not all elements could be created.\n");
+            ok = FALSE;
+            break;
+        }
+        QueueLimits::leakyBranch().apply(queue);
+        gst_bin_add_many(GST_BIN(pipeline), queue, convert, filter, convert_after, sink, NULL);
+        ok = gst_element_link_many(queue, convert, filter, convert_after, sink, NULL) && link_tee(tee, queue);
+    }
+
+    if (!ok)
+    {
+        g_printerr("Elements could not be linked.\n");
+        gst_object_unref(pipeline);
+        return nullptr;
+    }
+    return pipeline;
+}
+
+struct RunResult
+{
+    gboolean ok;
+    double build_ms;
+    double ready_ms;
+};
+
+static RunResult run(gboolean described, const PipelineDescription &description, guint count)
+{
+    RunResult result = {TRUE, 0.0, 0.0};
+    std::vector<GstElement *> hand_wired;
+    std::vector<PipelineElementPtr> compiled;
+
+    gint64 start_us = g_get_monotonic_time();
+    for (guint i = 0; i < count && result.ok; ++i)
+    {
+        if (described)
+        {
+            PipelineElementPtr pipeline = description.compile("bench-" + std::to_string(i));
+            result.ok = pipeline != nullptr;
+            if (pipeline)
+            {
+                compiled.push_back(pipeline);
+            }
+        }
+        else
+        {
+            GstElement *pipeline = build_hand_wired(i);
+            result.ok = pipeline != nullptr;
+            if (pipeline)
+            {
+                hand_wired.push_back(pipeline);
+            }
+        }
+    }
+    gint64 built_us = g_get_monotonic_time();
+
+    for (GstElement *pipeline : hand_wired)
+    {
+        result.ok &= gst_element_set_state(pipeline, GST_STATE_READY) != GST_STATE_CHANGE_FAILURE;
+    }
+    for (PipelineElementPtr pipeline : compiled)
+    {
+        result.ok &= pipeline->changeStateReady() != GST_STATE_CHANGE_FAILURE;
+    }
+    result.build_ms = (built_us - start_us) / 1e3;
+    result.ready_ms = (g_get_monotonic_time() - built_us) / 1e3;
+
+    for (GstElement *pipeline : hand_wired)
+    {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+    for (PipelineElementPtr pipeline : compiled)
+    {
+        pipeline->changeStateNull();
+        pipeline->unref();
+        delete pipeline;
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --pipelines N identical pipelines per run, --rounds R runs of each mode, averaged */
+    guint count = 100;
+    guint rounds = 5;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--pipelines") == 0 && i + 1 < argc)
+        {
+            count = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            rounds = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    PipelineDescription description;
+    if (!PipelineDescription::parse(topology, description))
+    {
+        return -1;
+    }
+
+    /* Load every plugin once, so neither mode pays for it */
+    if (!run(FALSE, description, 1).ok || !run(TRUE, description, 1).ok)
+    {
+        g_printerr("Warm-up failed.\n");
+        return -1;
+    }
+
+    g_print("%u pipelines of %zu branches, %u rounds\n", count, description.branches.size(), rounds);
+    g_print("%-12s %12s %14s %12s %14s\n", "mode", "build_ms", "us/pipeline", "ready_ms", "us/pipeline");
+    for (gboolean described : {FALSE, TRUE})
+    {
+        double build_ms = 0.0;
+        double ready_ms = 0.0;
+        for (guint r = 0; r < rounds; ++r)
+        {
+            RunResult result = run(described, description, count);
+            if (!result.ok)
+            {
+                g_printerr("%s run failed.\n", described ? "description" : "hand-wired");
+                return -1;
+            }
+            build_ms += result.build_ms;
+            ready_ms += result.ready_ms;
+        }
+        build_ms /= rounds;
+        ready_ms /= rounds;
+        g_print("%-12s %12.2f %14.1f %12.2f %14.1f\n", described ? "description" : "hand-wired", build_ms,
+                build_ms * 1e3 / count, ready_ms, ready_ms * 1e3 / count);
+    }
+
+    ElementFactoryCache &cache = ElementFactoryCache::instance();
+    g_print("factory cache: %" G_GUINT64_FORMAT " lookups, %" G_GUINT64_FORMAT " registry lookups\n",
+            cache.hits() + cache.misses(), cache.misses());
+    return 0;
+}
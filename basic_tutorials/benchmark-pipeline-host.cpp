@@ -0,0 +1,175 @@
+#include "benchmark-util.hpp"
+#include "pipeline-host.hpp"
+#include <cstring>
+#include <gst/pbutils/pbutils.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Number of threads of this process, from /proc/self/status */
+static guint current_thread_count(void)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("Threads:", 0) == 0)
+        {
+            return (guint)std::stoul(line.substr(8));
+        }
+    }
+    return 0;
+}
+
+/* Whether `uri` has audio and video streams, so that every pipeline gets exactly the branches the file can feed: a
+ * branch waiting for a stream that never comes keeps its sink from prerolling, and the run never ends */
+static gboolean discover_streams(const std::string &uri, gboolean *audio, gboolean *video)
+{
+    GError *err = NULL;
+    GstDiscoverer *discoverer = gst_discoverer_new(10 * GST_SECOND, &err);
+    GstDiscovererInfo *info = discoverer ? gst_discoverer_discover_uri(discoverer, uri.c_str(), &err) : NULL;
+    if (!info || gst_discoverer_info_get_result(info) != GST_DISCOVERER_OK)
+    {
+        g_printerr("Could not discover %s: %s\n", uri.c_str(), err ? err->message : "unknown error");
+        g_clear_error(&err);
+        if (info)
+        {
+            gst_discoverer_info_unref(info);
+        }
+        if (discoverer)
+        {
+            g_object_unref(discoverer);
+        }
+        return FALSE;
+    }
+    GList *audio_streams = gst_discoverer_info_get_audio_streams(info);
+    GList *video_streams = gst_discoverer_info_get_video_streams(info);
+    *audio = (gboolean)(audio_streams != NULL);
+    *video = (gboolean)(video_streams != NULL);
+    gst_discoverer_stream_info_list_free(audio_streams);
+    gst_discoverer_stream_info_list_free(video_streams);
+    gst_discoverer_info_unref(info);
+    g_object_unref(discoverer);
+    return TRUE;
+}
+
+static gboolean sample_threads(guint *peak_threads)
+{
+    *peak_threads = MAX(*peak_threads, current_thread_count());
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --uri FILE|URI decodes a file instead of videotestsrc, --num-buffers N bounds videotestsrc,
+     * --no-sync runs the fakesinks unsynchronised; remaining arguments are the pipeline counts to run */
+    std::string uri;
+    gint num_buffers = 300;
+    gboolean sync = TRUE;
+    std::vector<guint> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--uri") == 0 && i + 1 < argc)
+        {
+            uri = argv[++i];
+        }
+        else if (strcmp(argv[i], "--num-buffers") == 0 && i + 1 < argc)
+        {
+            num_buffers = std::stoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-sync") == 0)
+        {
+            sync = FALSE;
+        }
+        else
+        {
+            counts.push_back((guint)std::stoul(argv[i]));
+        }
+    }
+    if (counts.empty())
+    {
+        counts = {1, 8, 32, 128};
+    }
+    if (!uri.empty() && uri.find("://") == std::string::npos)
+    {
+        /* Unlike g_filename_to_uri(), this takes relative paths too */
+        GError *err = NULL;
+        gchar *file_uri = gst_filename_to_uri(uri.c_str(), &err);
+        if (!file_uri)
+        {
+            g_printerr("--uri %s is not a usable file: %s\n", uri.c_str(), err ? err->message : "unknown error");
+            g_clear_error(&err);
+            return -1;
+        }
+        uri = file_uri;
+        g_free(file_uri);
+    }
+    gboolean audio = FALSE;
+    gboolean video = TRUE;
+    if (!uri.empty() && !discover_streams(uri, &audio, &video))
+    {
+        return -1;
+    }
+
+    g_print("%10s %10s %10s %14s %14s %10s %10s\n", "pipelines", "failed", "wall_s", "cpu_s", "cpu_ms/stream",
+            "core%/str", "threads");
+    for (guint n : counts)
+    {
+        PipelineHostPtr host = new PipelineHost();
+        for (guint i = 0; i < n; ++i)
+        {
+            PipelineConfig config;
+            config.name = "pipeline-" + std::to_string(i);
+            config.verbose = FALSE;
+            config.video_sink = SinkConfig{"fakesink", sync};
+            config.audio_sink = SinkConfig{"fakesink", sync};
+            config.audio = audio;
+            config.video = video;
+            if (uri.empty())
+            {
+                config.source_factory = "videotestsrc";
+                config.num_buffers = num_buffers;
+            }
+
+            PipelineElementPtr pipeline = new PipelineElement(config);
+            if (!pipeline->build())
+            {
+                g_printerr("Pipeline %u could not be built.\n", i);
+                if (pipeline->getElement("pipeline"))
+                {
+                    pipeline->unref();
+                }
+                delete pipeline;
+                delete host;
+                return -1;
+            }
+            pipeline->setSourceProperties(uri);
+            host->add(pipeline);
+        }
+
+        guint peak_threads = current_thread_count();
+        host->addTimeout(100, (GSourceFunc)sample_threads, &peak_threads);
+
+        double cpu_start = cpu_seconds();
+        gint64 wall_start = g_get_monotonic_time();
+        std::size_t failed = host->start();
+        host->run();
+        double wall = (g_get_monotonic_time() - wall_start) / 1e6;
+        double cpu = cpu_seconds() - cpu_start;
+
+        for (const PipelineHost::Entry &entry : host->getEntries())
+        {
+            failed += (entry.failed && entry.end_us != entry.start_us) ? 1 : 0;
+        }
+
+        g_print("%10u %10zu %10.2f %14.2f %14.2f %10.2f %10u\n", n, failed, wall, cpu, cpu * 1e3 / n,
+                wall > 0 ? cpu * 100.0 / wall / n : 0.0, peak_threads);
+        delete host;
+    }
+
+    return 0;
+}
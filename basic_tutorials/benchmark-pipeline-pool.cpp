@@ -0,0 +1,198 @@
+#include "pipeline-pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Write `count` short WAV clips into `dir`, so the benchmark runs without any media at hand */
+static gboolean generate_clips(const std::string &dir, guint count, guint buffers)
+{
+    g_mkdir_with_parents(dir.c_str(), 0755);
+    for (guint i = 0; i < count; ++i)
+    {
+        gchar *path = g_build_filename(dir.c_str(), ("clip-" + std::to_string(i) + ".wav").c_str(), NULL);
+        std::string description = "audiotestsrc num-buffers=" + std::to_string(buffers) + " freq=" +
+                                  std::to_string(220 + i % 880) +
+                                  " ! audio/x-raw,rate=44100,channels=2 ! wavenc ! filesink location=\"" + path + "\"";
+        g_free(path);
+
+        GstElement *pipeline = gst_parse_launch(description.c_str(), NULL);
+        if (!pipeline)
+        {
+            return FALSE;
+        }
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        GstBus *bus = gst_element_get_bus(pipeline);
+        GstMessage *msg =
+            gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        gst_message_unref(msg);
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+        if (!ok)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* file:// URIs of the regular files in `dir`, sorted */
+static std::vector<std::string> list_clips(const std::string &dir)
+{
+    std::vector<std::string> uris;
+    GDir *handle = g_dir_open(dir.c_str(), 0, NULL);
+    if (!handle)
+    {
+        return uris;
+    }
+    while (const gchar *name = g_dir_read_name(handle))
+    {
+        gchar *path = g_build_filename(dir.c_str(), name, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+        {
+            gchar *uri = gst_filename_to_uri(path, NULL); /* Takes a relative --dir too */
+            if (uri)
+            {
+                uris.push_back(uri);
+            }
+            g_free(uri);
+        }
+        g_free(path);
+    }
+    g_dir_close(handle);
+    std::sort(uris.begin(), uris.end());
+    return uris;
+}
+
+static PipelineElementPtr build_pipeline(const PipelineConfig &config)
+{
+    PipelineElementPtr pipeline = new PipelineElement(config);
+    if (!pipeline->build())
+    {
+        delete pipeline;
+        return nullptr;
+    }
+    return pipeline;
+}
+
+/* Build, play and tear down a pipeline per clip, as the OOP tutorial does for its one URI */
+static gboolean play_rebuilt(const PipelineConfig &config, const std::string &uri)
+{
+    PipelineElementPtr pipeline = build_pipeline(config);
+    if (!pipeline)
+    {
+        return FALSE;
+    }
+    std::string url = uri;
+    pipeline->setSourceProperties(url);
+
+    gboolean ok = FALSE;
+    if (pipeline->changeStatePlaying() != GST_STATE_CHANGE_FAILURE)
+    {
+        GstBus *bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+        GstMessage *msg =
+            gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        gst_message_unref(msg);
+        gst_object_unref(bus);
+    }
+    pipeline->changeStateNull();
+    pipeline->unref();
+    delete pipeline;
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+
+    /* Options: --dir DIR of small clips (every regular file is played), --generate N writes N WAV clips of
+     * --clip-buffers buffers into DIR first, --with-video adds a video branch for clips that carry video,
+     * --rounds R plays the whole directory R times per mode */
+    std::string dir = std::string(g_get_tmp_dir()) + "/pipeline-pool-clips";
+    guint generate = 0;
+    guint clip_buffers = 20;
+    gboolean with_video = FALSE;
+    guint rounds = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc)
+        {
+            generate = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--clip-buffers") == 0 && i + 1 < argc)
+        {
+            clip_buffers = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--with-video") == 0)
+        {
+            with_video = TRUE;
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            rounds = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    if (generate > 0 && !generate_clips(dir, generate, clip_buffers))
+    {
+        g_printerr("Clips could not be generated in %s.\n", dir.c_str());
+        return -1;
+    }
+    std::vector<std::string> uris = list_clips(dir);
+    if (uris.empty())
+    {
+        g_printerr("No clips in %s; pass --generate N to create some.\n", dir.c_str());
+        return -1;
+    }
+
+    /* uridecodebin into fakesinks that do not wait for the clock: the time left is the per-clip overhead */
+    PipelineConfig config;
+    config.verbose = FALSE;
+    config.video = with_video;
+    config.audio_sink = SinkConfig{"fakesink", FALSE};
+    config.video_sink = SinkConfig{"fakesink", FALSE};
+
+    g_print("%zu clips in %s, %u rounds\n", uris.size(), dir.c_str(), rounds);
+    g_print("%-10s %8s %8s %12s %12s %12s\n", "mode", "clips", "failed", "setup_ms", "total_s", "ms/clip");
+    for (gboolean pooled : {FALSE, TRUE})
+    {
+        guint failed = 0;
+        gint64 start_us = g_get_monotonic_time();
+        PipelinePoolPtr pool = nullptr;
+        if (pooled)
+        {
+            pool = new PipelinePool(1, [&](std::size_t) { return build_pipeline(config); });
+            if (pool->size() == 0)
+            {
+                g_printerr("Pipeline could not be built.\n");
+                delete pool;
+                return -1;
+            }
+        }
+        double setup_ms = (g_get_monotonic_time() - start_us) / 1e3;
+
+        for (guint r = 0; r < rounds; ++r)
+        {
+            for (const std::string &uri : uris)
+            {
+                failed += (pooled ? pool->process(uri) : play_rebuilt(config, uri)) ? 0 : 1;
+            }
+        }
+        delete pool;
+
+        double total_s = (g_get_monotonic_time() - start_us) / 1e6;
+        std::size_t clips = uris.size() * rounds;
+        g_print("%-10s %8zu %8u %12.2f %12.2f %12.3f\n", pooled ? "pooled" : "rebuild", clips, failed, setup_ms,
+                total_s, total_s * 1e3 / clips);
+    }
+    return 0;
+}
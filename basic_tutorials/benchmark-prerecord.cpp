@@ -0,0 +1,184 @@
+#include "benchmark-util.hpp"
+#include "pre-record.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const gint rate = 48000;
+static const gint samples_per_buffer = 1024;
+
+struct Mode
+{
+    const gchar *name;
+    gboolean ring;
+    gboolean trigger; /* Halfway through */
+};
+
+static const Mode modes[] = {
+    {"record all", FALSE, FALSE},
+    {"ring, holding", TRUE, FALSE},
+    {"ring, triggered", TRUE, TRUE},
+};
+
+struct RunResult
+{
+    double wall_seconds;
+    double cpu_seconds;
+    double rss_mb; /* Growth of the process while the pipelines ran */
+    PreRecord::Stats totals;
+};
+
+/* Resident memory of the process in MB, from /proc */
+static double rss_mb(void)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmRSS:", 0) == 0)
+        {
+            return std::stod(line.substr(6)) / 1024.0;
+        }
+    }
+    return 0.0;
+}
+
+/* `rings` stereo S16 sources through the file branch (wavenc into a fakesink, so that the disk is left out), with a
+ * prerecord stage in front of wavenc or without. Nothing syncs. With `trigger_after_s`, every ring is triggered
+ * once that much wall time has passed. */
+static RunResult run(const Mode &mode, guint rings, guint buffers, guint seconds, double trigger_after_s)
+{
+    RunResult result = {-1.0, 0.0, 0.0, {}};
+    std::string description;
+    for (guint ring = 0; ring < rings; ++ring)
+    {
+        description += "audiotestsrc wave=pink-noise num-buffers=" + std::to_string(buffers) +
+                       " samplesperbuffer=" + std::to_string(samples_per_buffer) +
+                       " ! audio/x-raw,format=S16LE,channels=2,rate=" + std::to_string(rate) + " ! queue ! " +
+                       (mode.ring ? std::string(PreRecord::name) + " name=ring" + std::to_string(ring) +
+                                        " seconds=" + std::to_string(seconds) + " ! "
+                                  : std::string()) +
+                       "wavenc ! fakesink sync=false ";
+    }
+
+    double rss_start = rss_mb();
+    GstElement *pipeline = build_pipeline(description, mode.name);
+    if (!pipeline)
+    {
+        return result;
+    }
+    std::vector<GstElement *> elements;
+    for (guint ring = 0; mode.ring && ring < rings; ++ring)
+    {
+        elements.push_back(gst_bin_get_by_name(GST_BIN(pipeline), ("ring" + std::to_string(ring)).c_str()));
+    }
+
+    double cpu_start = cpu_seconds();
+    gint64 start_us = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gboolean triggered = !mode.trigger;
+    GstMessage *msg = NULL;
+    while (!msg)
+    {
+        msg = gst_bus_timed_pop_filtered(bus, triggered ? GST_CLOCK_TIME_NONE : 10 * GST_MSECOND,
+                                         (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        if (!triggered && (g_get_monotonic_time() - start_us) / 1e6 >= trigger_after_s)
+        {
+            for (GstElement *element : elements)
+            {
+                PreRecord::trigger(element);
+            }
+            triggered = TRUE;
+        }
+    }
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+    {
+        result.wall_seconds = (g_get_monotonic_time() - start_us) / 1e6;
+        result.cpu_seconds = cpu_seconds() - cpu_start;
+        result.rss_mb = rss_mb() - rss_start;
+    }
+    else
+    {
+        GError *err = NULL;
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("%s: %s\n", mode.name, err->message);
+        g_clear_error(&err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    for (GstElement *element : elements)
+    {
+        PreRecord::Stats stats = PreRecord::stats(element);
+        result.totals.capacity += stats.capacity;
+        result.totals.overwritten += stats.overwritten;
+        result.totals.flushed += stats.flushed;
+        result.totals.passed += stats.passed;
+        result.totals.triggers += stats.triggers;
+        gst_object_unref(element);
+    }
+    stop_pipeline(pipeline);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    PreRecord::registerElement();
+
+    /* Options: --rings N pipelines at once (100 by default), --ring-seconds N held by each (10 by default),
+     * --seconds N of audio through each (60 by default) */
+    guint rings = 100;
+    guint ring_seconds = 10;
+    guint seconds = 60;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--rings") == 0 && i + 1 < argc)
+        {
+            rings = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ring-seconds") == 0 && i + 1 < argc)
+        {
+            ring_seconds = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    guint buffers = (guint)((guint64)seconds * rate / samples_per_buffer);
+    double audio_seconds = (double)buffers * samples_per_buffer / rate;
+    g_print("%u pipelines of %.1f s stereo S16 at %d Hz, rings of %u s (%.2f MB each)\n", rings, audio_seconds, rate,
+            ring_seconds, ring_seconds * rate * 4 / 1e6);
+
+    /* "ring MB" is what the rings hold by construction, "rss MB" how much the process grew while running: the
+     * difference with "record all" is what the rings really cost. cpu_ms/s is per pipeline and second of audio. */
+    g_print("%-16s %10s %12s %10s %10s %12s %12s\n", "mode", "x realtime", "cpu_ms/s", "ring MB", "rss MB",
+            "flushed MB", "passed MB");
+
+    /* The first run also loads the plugins; it is not counted */
+    run(modes[1], 1, 10, 1, 0.0);
+    double holding_wall = 0.0;
+    for (const Mode &mode : modes)
+    {
+        RunResult result = run(mode, rings, buffers, ring_seconds, holding_wall / 2);
+        if (result.wall_seconds < 0)
+        {
+            g_print("%-16s %10s\n", mode.name, "failed");
+            continue;
+        }
+        if (mode.ring && !mode.trigger)
+        {
+            holding_wall = result.wall_seconds;
+        }
+        g_print("%-16s %10.1f %12.3f %10.1f %10.1f %12.1f %12.1f\n", mode.name, audio_seconds / result.wall_seconds,
+                result.cpu_seconds * 1e3 / rings / audio_seconds, result.totals.capacity / 1e6, result.rss_mb,
+                result.totals.flushed / 1e6, result.totals.passed / 1e6);
+    }
+    return 0;
+}
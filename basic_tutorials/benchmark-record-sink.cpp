@@ -0,0 +1,172 @@
+#include "benchmark-util.hpp"
+#include "record-sink.hpp"
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* 8 channels of S32 at 96 kHz in buffers of 1024 frames: 3 MB/s and 32 KiB per buffer, a multichannel recording */
+static const gint rate = 96000;
+static const gint channels = 8;
+static const gint samples_per_buffer = 1024;
+static const guint64 bytes_per_second = (guint64)rate * channels * 4;
+
+struct Mode
+{
+    const gchar *name;
+    gboolean record; /* recordsink rather than filesink */
+    guint batch_size;
+    gboolean direct_io;
+    const gchar *fsync;
+    gboolean preallocate;
+};
+
+static const Mode modes[] = {
+    {"filesink", FALSE, 0, FALSE, "close", FALSE},
+    {"record 0", TRUE, 0, FALSE, "close", FALSE},
+    {"record 1M", TRUE, 1 << 20, FALSE, "close", FALSE},
+    {"record 1M prealloc", TRUE, 1 << 20, FALSE, "close", TRUE},
+    {"record 1M direct", TRUE, 1 << 20, TRUE, "close", FALSE},
+    {"record 1M direct prealloc", TRUE, 1 << 20, TRUE, "close", TRUE},
+    {"record 4M direct prealloc", TRUE, 4 << 20, TRUE, "close", TRUE},
+    {"record 1M fsync 1s", TRUE, 1 << 20, FALSE, "interval", FALSE},
+    {"record 1M fsync batch", TRUE, 1 << 20, FALSE, "batch", FALSE},
+};
+
+struct RunResult
+{
+    double wall_seconds;
+    double cpu_seconds;
+    guint64 bytes;
+    RecordSink::Stats writes; /* Of every recordsink together */
+};
+
+/* `recorders` sources of silence through wavenc into one file each, all in one pipeline. Nothing syncs, so this is
+ * as fast as the disk takes the writes; the files are removed afterwards. */
+static RunResult run(const Mode &mode, guint recorders, guint buffers, const std::string &dir)
+{
+    RunResult result = {-1.0, 0.0, 0, {}};
+    GstElement *pipeline = gst_pipeline_new(NULL);
+    std::vector<GstElement *> sinks;
+    std::vector<std::string> files;
+    for (guint recorder = 0; recorder < recorders; ++recorder)
+    {
+        std::string description = "audiotestsrc wave=silence num-buffers=" + std::to_string(buffers) +
+                                  " samplesperbuffer=" + std::to_string(samples_per_buffer) +
+                                  " ! audio/x-raw,format=S32LE,channels=" + std::to_string(channels) +
+                                  ",rate=" + std::to_string(rate) + " ! wavenc";
+        GError *err = NULL;
+        GstElement *source = gst_parse_bin_from_description(description.c_str(), TRUE, &err);
+        GstElement *sink = gst_element_factory_make(mode.record ? RecordSink::name : "filesink", NULL);
+        if (!source || !sink)
+        {
+            g_printerr("%s could not be built: %s\n", mode.name, err ? err->message : "missing element");
+            g_clear_error(&err);
+            gst_object_unref(pipeline);
+            return result;
+        }
+        files.push_back(dir + "/record-" + std::to_string(recorder) + ".wav");
+        g_object_set(sink, "location", files.back().c_str(), "sync", FALSE, NULL);
+        if (mode.record)
+        {
+            guint64 preallocate = mode.preallocate ? (guint64)buffers * samples_per_buffer * channels * 4 + 4096 : 0;
+            g_object_set(sink, "batch-size", mode.batch_size, "direct-io", mode.direct_io, "fsync", mode.fsync,
+                         "preallocate", preallocate, NULL);
+        }
+        gst_bin_add_many(GST_BIN(pipeline), source, sink, NULL);
+        gst_element_link(source, sink);
+        sinks.push_back(sink);
+    }
+
+    double cpu_start = cpu_seconds();
+    gint64 start_us = g_get_monotonic_time();
+    gboolean ok = (gboolean)(play_to_eos(pipeline, mode.name).wall_seconds >= 0);
+
+    /* The files are closed (and synced as the policy says) on the way to NULL: that is part of the recording */
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    if (ok)
+    {
+        result.wall_seconds = (g_get_monotonic_time() - start_us) / 1e6;
+        result.cpu_seconds = cpu_seconds() - cpu_start;
+    }
+    for (guint recorder = 0; recorder < recorders; ++recorder)
+    {
+        std::error_code error;
+        guint64 size = std::filesystem::file_size(files[recorder], error);
+        result.bytes += error ? 0 : size;
+        result.writes.add(RecordSink::stats(sinks[recorder]));
+        std::filesystem::remove(files[recorder], error);
+    }
+    gst_object_unref(pipeline);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    RecordSink::registerElement();
+
+    /* Options: --recorders N writing at once (16 by default), --megabytes N written by each (128 by default), --dir
+     * DIR to write into (the current directory by default; use a real disk, not a tmpfs, which refuses O_DIRECT) */
+    guint recorders = 16;
+    guint megabytes = 128;
+    std::string dir = ".";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--recorders") == 0 && i + 1 < argc)
+        {
+            recorders = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--megabytes") == 0 && i + 1 < argc)
+        {
+            megabytes = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+    }
+
+    guint buffers = (guint)(((guint64)megabytes << 20) / ((guint64)samples_per_buffer * channels * 4));
+    double media_seconds = (double)buffers * samples_per_buffer / rate;
+    g_print("%u recorders of %.1f s of %d-channel S32 at %d Hz (%.1f MB each) into %s\n", recorders, media_seconds,
+            channels, rate, (double)buffers * samples_per_buffer * channels * 4 / 1e6, dir.c_str());
+
+    /* "streams" is how many such recordings the disk would keep up with in real time. The write times are those of
+     * single pwrite() calls, which filesink does not report, to within the 6% of a histogram bucket. */
+    g_print("%-26s %10s %10s %10s %10s %10s %10s\n", "sink", "MB/s", "streams", "cpu_ms/s", "p50 us", "p99 us",
+            "max us");
+
+    /* The first run also loads the plugins; it is not counted */
+    run(modes[0], 1, 10, dir);
+    for (const Mode &mode : modes)
+    {
+        RunResult result = run(mode, recorders, buffers, dir);
+        if (result.wall_seconds < 0)
+        {
+            g_print("%-26s %10s\n", mode.name, "failed");
+            continue;
+        }
+        if (mode.direct_io && !result.writes.direct)
+        {
+            g_print("%-26s %10s\n", mode.name, "no O_DIRECT on this file system");
+            continue;
+        }
+        double mb_per_second = result.bytes / 1e6 / result.wall_seconds;
+        g_print("%-26s %10.1f %10.1f %10.2f", mode.name, mb_per_second, mb_per_second * 1e6 / bytes_per_second,
+                result.cpu_seconds * 1e3 / recorders / media_seconds);
+        if (mode.record)
+        {
+            g_print(" %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n",
+                    result.writes.writePercentile(0.5), result.writes.writePercentile(0.99),
+                    result.writes.write_us_max);
+        }
+        else
+        {
+            g_print(" %10s %10s %10s\n", "-", "-", "-");
+        }
+    }
+    return 0;
+}
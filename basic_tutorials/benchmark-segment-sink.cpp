@@ -0,0 +1,203 @@
+#include "segment-sink.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const gint rate = 48000;
+static const gint samples_per_buffer = 1024;
+static const gint bytes_per_frame = 4; /* Stereo S16 */
+
+struct Mode
+{
+    const gchar *name;
+    guint segment_ms; /* 0 writes one file */
+    gboolean pre_open;
+    gboolean fsync;
+};
+
+static const Mode modes[] = {
+    {"one file", 0, TRUE, FALSE},
+    {"1 s, pre-open", 1000, TRUE, FALSE},
+    {"1 s, inline", 1000, FALSE, FALSE},
+    {"1 s, pre-open, fsync", 1000, TRUE, TRUE},
+    {"1 s, inline, fsync", 1000, FALSE, TRUE},
+    {"100 ms, pre-open", 100, TRUE, FALSE},
+    {"100 ms, inline", 100, FALSE, FALSE},
+};
+
+struct RunResult
+{
+    gboolean ok;
+    guint64 files;
+    guint64 bad_files;   /* Whose header does not describe exactly what the file holds */
+    guint64 frames_in;   /* Reached the sinks */
+    guint64 frames_read; /* Found in the files, by their headers */
+    guint64 discontinuities;
+    guint64 stalls;
+    SegmentSink::Stats::Durations render_us; /* Of buffers that did not start a file */
+    SegmentSink::Stats::Durations rotation_us;
+};
+
+/* Data frames of a finished WAV file, or -1 when its RIFF and data sizes do not match its length */
+static gint64 wav_frames(const std::filesystem::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    guint8 head[128];
+    file.read((char *)head, sizeof(head));
+    gsize got = (gsize)file.gcount();
+    auto u32 = [&head](gsize at) {
+        return (guint32)head[at] | (guint32)head[at + 1] << 8 | (guint32)head[at + 2] << 16 |
+               (guint32)head[at + 3] << 24;
+    };
+    std::error_code error;
+    guint64 size = std::filesystem::file_size(path, error);
+    if (error || got < 12 || memcmp(head, "RIFF", 4) != 0 || memcmp(head + 8, "WAVE", 4) != 0 || u32(4) + 8 != size)
+    {
+        return -1;
+    }
+    for (gsize at = 12; at + 8 <= got; at += 8 + u32(at + 4))
+    {
+        if (memcmp(head + at, "data", 4) == 0)
+        {
+            guint32 data_bytes = u32(at + 4);
+            return at + 8 + data_bytes == size ? data_bytes / bytes_per_frame : -1;
+        }
+    }
+    return -1;
+}
+
+/* `recorders` stereo S16 sources into a wavsegmentsink each, all in one pipeline and unsynced, so that cuts come as
+ * fast as the disk allows. `dir` is private to this run: the files are read back, checked and removed afterwards. */
+static RunResult run(const Mode &mode, guint recorders, guint buffers, const std::string &dir)
+{
+    RunResult result = {FALSE, 0, 0, 0, 0, 0, 0, {}, {}};
+    std::string description;
+    for (guint recorder = 0; recorder < recorders; ++recorder)
+    {
+        description += "audiotestsrc wave=pink-noise num-buffers=" + std::to_string(buffers) +
+                       " samplesperbuffer=" + std::to_string(samples_per_buffer) +
+                       " ! audio/x-raw,format=S16LE,channels=2,rate=" + std::to_string(rate) + " ! " +
+                       SegmentSink::name + " name=sink" + std::to_string(recorder) + " location=" + dir + "/segment-" +
+                       std::to_string(recorder) + "-%05u.wav max-time=" +
+                       std::to_string((guint64)mode.segment_ms * GST_MSECOND) +
+                       " pre-open=" + (mode.pre_open ? "true" : "false") + " fsync=" + (mode.fsync ? "true" : "false") +
+                       " ";
+    }
+
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description.c_str(), &err);
+    if (!pipeline)
+    {
+        g_printerr("%s could not be built: %s\n", mode.name, err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return result;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg =
+        gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    result.ok = (gboolean)(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (!result.ok)
+    {
+        gst_message_parse_error(msg, &err, NULL);
+        g_printerr("%s: %s\n", mode.name, err->message);
+        g_clear_error(&err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    for (guint recorder = 0; recorder < recorders; ++recorder)
+    {
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), ("sink" + std::to_string(recorder)).c_str());
+        SegmentSink::Stats stats = SegmentSink::stats(sink);
+        gst_object_unref(sink);
+        result.frames_in += stats.frames_in;
+        result.discontinuities += stats.discontinuities;
+        result.stalls += stats.stalls;
+        result.render_us.add(stats.render_us);
+        result.rotation_us.add(stats.rotation_us);
+    }
+    gst_object_unref(pipeline);
+
+    for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(dir))
+    {
+        gint64 frames = wav_frames(entry.path());
+        result.files++;
+        result.bad_files += frames < 0;
+        result.frames_read += frames < 0 ? 0 : (guint64)frames;
+        std::filesystem::remove(entry.path());
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    SegmentSink::registerElement();
+
+    /* Options: --recorders N writing at once (16 by default), --seconds N of audio each (120 by default), --dir DIR
+     * to write into (the current directory by default), in a directory of its own that is removed afterwards */
+    guint recorders = 16;
+    guint seconds = 120;
+    std::string dir = ".";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--recorders") == 0 && i + 1 < argc)
+        {
+            recorders = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+    }
+
+    /* Nothing but this run's segments is ever in the directory the runs read back and empty */
+    std::string private_dir = dir + "/benchmark-segment-sink-XXXXXX";
+    if (!g_mkdtemp(&private_dir[0]))
+    {
+        g_printerr("Could not create a directory in %s\n", dir.c_str());
+        return 1;
+    }
+
+    guint buffers = (guint)((guint64)seconds * rate / samples_per_buffer);
+    g_print("%u recorders of %.1f s stereo S16 at %d Hz into %s\n", recorders,
+            (double)buffers * samples_per_buffer / rate, rate, private_dir.c_str());
+
+    /* "lost" compares the frames that reached the sinks with the frames the headers of the files account for; a cut
+     * that dropped or repeated audio, or a header left unpatched, shows there. The write times of ordinary buffers
+     * (p50, p99, max) are set against those of the buffers that started a new file. */
+    g_print("%-22s %8s %6s %8s %6s %6s %9s %9s %9s %9s %9s\n", "segments", "files", "bad", "lost", "gaps", "stalls",
+            "p50 us", "p99 us", "max us", "cut p99", "cut max");
+    for (const Mode &mode : modes)
+    {
+        RunResult result = run(mode, recorders, buffers, private_dir);
+        if (!result.ok)
+        {
+            g_print("%-22s %8s\n", mode.name, "failed");
+            continue;
+        }
+        g_print("%-22s %8" G_GUINT64_FORMAT " %6" G_GUINT64_FORMAT " %8" G_GINT64_FORMAT " %6" G_GUINT64_FORMAT
+                " %6" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT
+                " %9" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT "\n",
+                mode.name, result.files, result.bad_files, (gint64)(result.frames_in - result.frames_read),
+                result.discontinuities, result.stalls, result.render_us.percentile(0.5),
+                result.render_us.percentile(0.99), result.render_us.max, result.rotation_us.percentile(0.99),
+                result.rotation_us.max);
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(private_dir, error);
+    return 0;
+}
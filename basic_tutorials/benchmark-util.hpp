@@ -0,0 +1,143 @@
+#pragma once
+
+#include "gst/gst.h"
+#include "simd-kernels.hpp"
+#include <cstring>
+#include <functional>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+/* What the benchmark-* programs have in common: the CPU time of the process, playing a pipeline description to EOS
+ * and the --levels switch. */
+
+/* User plus system time of the process in seconds, from a getrusage() sample or taken now */
+inline double cpu_seconds(const struct rusage &usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+inline double cpu_seconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return cpu_seconds(usage);
+}
+
+struct PipelineRun
+{
+    double wall_seconds = -1.0; /* Negative when the pipeline posted an error */
+    double cpu_seconds = 0.0;   /* Of the whole process */
+    glong minor_faults = 0;
+    glong major_faults = 0;
+};
+
+/* gst_parse_launch() of `description`, or nullptr after printing why it could not be built, headed by `name` */
+inline GstElement *build_pipeline(const std::string &description, const gchar *name)
+{
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description.c_str(), &err);
+    if (!pipeline)
+    {
+        g_printerr("%s could not be built: %s\n", name, err ? err->message : "unknown error");
+    }
+    g_clear_error(&err);
+    return pipeline;
+}
+
+/* Set `pipeline` PLAYING and wait for EOS: the wall time, CPU time and page faults that took, or a negative wall
+ * time after an error, which is printed headed by `name`. Element messages go to `on_element` on the way, if given.
+ * The pipeline is left PLAYING, so that its elements can still be asked what they did; stop_pipeline() ends it. */
+inline PipelineRun play_to_eos(GstElement *pipeline, const gchar *name,
+                               const std::function<void(GstMessage *)> &on_element = nullptr)
+{
+    PipelineRun result;
+    GstMessageType types = (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    if (on_element)
+    {
+        types = (GstMessageType)(types | GST_MESSAGE_ELEMENT);
+    }
+
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    gint64 start_us = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    for (;;)
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, types);
+        GstMessageType type = GST_MESSAGE_TYPE(msg);
+        if (type == GST_MESSAGE_EOS)
+        {
+            struct rusage after;
+            getrusage(RUSAGE_SELF, &after);
+            result.wall_seconds = (g_get_monotonic_time() - start_us) / 1e6;
+            result.cpu_seconds = cpu_seconds(after) - cpu_seconds(before);
+            result.minor_faults = after.ru_minflt - before.ru_minflt;
+            result.major_faults = after.ru_majflt - before.ru_majflt;
+        }
+        else if (type == GST_MESSAGE_ERROR)
+        {
+            GError *err = NULL;
+            gst_message_parse_error(msg, &err, NULL);
+            g_printerr("%s: %s\n", name, err->message);
+            g_clear_error(&err);
+        }
+        else
+        {
+            on_element(msg);
+        }
+        gst_message_unref(msg);
+        if (type != GST_MESSAGE_ELEMENT)
+        {
+            break;
+        }
+    }
+    gst_object_unref(bus);
+    return result;
+}
+
+/* Back to NULL and unreffed */
+inline void stop_pipeline(GstElement *pipeline)
+{
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+}
+
+/* --levels scalar,sse4.1,avx2: the SimdKernels levels to run at, leaving out those the CPU does not support; every
+ * level it supports without the switch. FALSE after printing a name that is not a level. */
+inline gboolean parse_levels(int argc, char **argv, std::vector<SimdKernels::Level> &levels)
+{
+    levels.clear();
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--levels") != 0 || i + 1 == argc)
+        {
+            continue;
+        }
+        gchar **names = g_strsplit(argv[++i], ",", -1);
+        for (gchar **name = names; *name; ++name)
+        {
+            SimdKernels::Level level;
+            if (!SimdKernels::parseLevel(*name, level))
+            {
+                g_printerr("Unknown level %s.\n", *name);
+                g_strfreev(names);
+                return FALSE;
+            }
+            if (level <= SimdKernels::detected())
+            {
+                levels.push_back(level);
+            }
+        }
+        g_strfreev(names);
+    }
+    if (levels.empty())
+    {
+        for (guint level = SimdKernels::scalar; level <= SimdKernels::detected(); ++level)
+        {
+            levels.push_back((SimdKernels::Level)level);
+        }
+    }
+    return TRUE;
+}
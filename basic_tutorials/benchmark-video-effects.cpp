@@ -0,0 +1,94 @@
+#include "benchmark-util.hpp"
+#include "simd-effects.hpp"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Size
+{
+    const gchar *name;
+    gint width;
+    gint height;
+};
+
+static const Size sizes[] = {{"720p", 1280, 720}, {"1080p", 1920, 1080}};
+
+/* Each effectv filter next to its in-tree counterpart */
+static const char *effects[][2] = {{"edgetv", "simdedgetv"}, {"agingtv", "simdagingtv"}, {"warptv", "simdwarptv"}};
+
+/* Seconds to push `frames` BGRx frames of `size` through `filter` into a fakesink that does not sync, or a negative
+ * value when the pipeline failed */
+static double run(const char *filter, const Size &size, guint frames)
+{
+    std::string description = "videotestsrc num-buffers=" + std::to_string(frames) +
+                               " ! video/x-raw,format=BGRx,width=" + std::to_string(size.width) +
+                               ",height=" + std::to_string(size.height) + ",framerate=30/1 ! " + filter +
+                               " ! fakesink sync=false";
+    GstElement *pipeline = build_pipeline(description, filter);
+    if (!pipeline)
+    {
+        return -1.0;
+    }
+    double seconds = play_to_eos(pipeline, filter).wall_seconds;
+    stop_pipeline(pipeline);
+    return seconds;
+}
+
+static void print_row(const Size &size, const char *filter, const gchar *level, double seconds, double baseline,
+                      guint frames)
+{
+    if (seconds < 0)
+    {
+        g_print("%-6s %-12s %-8s %10s %12s\n", size.name, filter, level, "failed", "-");
+        return;
+    }
+    /* identity's run is the cost of producing the frames; what is left over is the filter */
+    double filter_ms = std::max(seconds - std::max(baseline, 0.0), 0.0) * 1e3 / frames;
+    g_print("%-6s %-12s %-8s %10.1f %12.3f\n", size.name, filter, level, frames / seconds, filter_ms);
+}
+
+int main(int argc, char **argv)
+{
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    SimdEffects::registerElements();
+
+    /* Options: --frames N per run (300 by default), --levels scalar,sse4.1,avx2 the kernel levels to run the in-tree
+     * filters at (every level the CPU supports by default) */
+    guint frames = 300;
+    std::vector<SimdKernels::Level> levels;
+    if (!parse_levels(argc, argv, levels))
+    {
+        return -1;
+    }
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    g_print("%u frames per run, CPU supports %s\n", frames, SimdKernels::levelName(SimdKernels::detected()));
+    g_print("%-6s %-12s %-8s %10s %12s\n", "size", "filter", "kernels", "fps", "filter_ms");
+    for (const Size &size : sizes)
+    {
+        /* The first run also loads the plugins; it is not counted */
+        run("identity", size, 10);
+        double baseline = run("identity", size, frames);
+        print_row(size, "identity", "-", baseline, baseline, frames);
+
+        for (const auto &pair : effects)
+        {
+            print_row(size, pair[0], "effectv", run(pair[0], size, frames), baseline, frames);
+            for (SimdKernels::Level level : levels)
+            {
+                SimdKernels::setLevel(level);
+                print_row(size, pair[1], SimdKernels::levelName(level), run(pair[1], size, frames), baseline, frames);
+            }
+            SimdKernels::setLevel(SimdKernels::detected());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,441 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* Bounded lock-free ring (Vyukov's MPMC queue): every cell carries a sequence number, so a producer claims a cell
+ * with one CAS on the tail and a consumer with one CAS on the head, and nobody ever takes a lock. push() fails when
+ * the ring is full and pop() when it is empty. A consumer with nothing to do sleeps on epoch() with waitFor(),
+ * which every push() bumps, instead of polling. */
+template <typename T> class LockFreeRing
+{
+  public:
+    explicit LockFreeRing(std::size_t capacity) : mask{roundUp(capacity) - 1}, cells{new Cell[mask + 1]}
+    {
+        for (std::size_t i = 0; i <= mask; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LockFreeRing(const LockFreeRing &) = delete;
+    LockFreeRing &operator=(const LockFreeRing &) = delete;
+
+    gboolean push(const T &value)
+    {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)pos;
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    wake();
+                    return TRUE;
+                }
+            }
+            else if (diff < 0)
+            {
+                return FALSE;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    gboolean pop(T &value)
+    {
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return TRUE;
+                }
+            }
+            else if (diff < 0)
+            {
+                return FALSE;
+            }
+            else
+            {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /* Read the epoch before trying pop(), then waitFor() it when pop() failed: a push in between changes the epoch
+     * and the wait returns immediately, so no wakeup is lost */
+    guint32 epoch(void) const
+    {
+        return pushes.load(std::memory_order_acquire);
+    }
+
+    void waitFor(guint32 seen) const
+    {
+        pushes.wait(seen, std::memory_order_acquire);
+    }
+
+    void wake(void)
+    {
+        pushes.fetch_add(1, std::memory_order_release);
+        pushes.notify_all();
+    }
+
+    std::size_t capacity(void) const
+    {
+        return mask + 1;
+    }
+
+  private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    static std::size_t roundUp(std::size_t n)
+    {
+        std::size_t size = 2;
+        while (size < n)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+
+    std::size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    alignas(64) std::atomic<guint32> pushes{0};
+};
+
+/* Takes the messages off the buses of any number of pipelines without a main loop or a blocking pop. A sync
+ * handler on every bus moves each message, as it is posted on the streaming thread, into one MPSC ring; a
+ * dispatcher thread routes them into the SPSC ring of every matching subscriber, and every subscriber runs its
+ * handler on its own thread:
+ *
+ *     BusDispatcher dispatcher;
+ *     dispatcher.subscribe(GST_MESSAGE_ELEMENT, nullptr, on_level, 4096);
+ *     dispatcher.subscribe((GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR), nullptr, on_done);
+ *     dispatcher.attach(pipeline);
+ *     dispatcher.start();
+ *
+ * A slow subscriber only backs up its own ring, so EOS and errors reach their handler while a flood of element
+ * messages is still being printed. When a ring is full, message types in the lossless set (EOS, ERROR and WARNING
+ * by default) wait up to `lossless_wait_us` for room; any other message is dropped and counted. A lossless message
+ * that still finds the incoming ring full is left on the regular bus queue instead (see passed()), so that a
+ * dispatcher that was never started, or is held up, cannot block a streaming thread for good; one that still
+ * finds a subscriber's ring full is dropped and counted for that subscriber. Subscribe before start(); attach() and
+ * detach() can be called at any time. Other than that, messages never reach the regular bus queue, so bus watches
+ * and gst_bus_timed_pop on an attached bus see nothing. */
+class BusDispatcher
+{
+  public:
+    using Handler = std::function<void(GstMessage *msg)>;
+
+    static constexpr gint64 lossless_wait_us = 100000;
+
+    struct SubscriptionStats
+    {
+        guint64 delivered;
+        guint64 dropped;
+        double mean_latency_us; /* From the post on the streaming thread to the handler call */
+        gint64 max_latency_us;
+    };
+
+    BusDispatcher(std::size_t capacity = 4096,
+                  GstMessageType lossless = (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_WARNING))
+        : lossless{lossless}, incoming{capacity}
+    {
+    }
+
+    ~BusDispatcher()
+    {
+        while (!buses.empty())
+        {
+            detachBus(buses.back());
+        }
+        stop();
+        Item item;
+        while (incoming.pop(item))
+        {
+            gst_message_unref(item.msg);
+        }
+    }
+
+    BusDispatcher(const BusDispatcher &) = delete;
+    BusDispatcher &operator=(const BusDispatcher &) = delete;
+
+    /* Deliver messages of `types` posted by `source` or any element inside it (every source when nullptr) to
+     * `handler`, on a thread of its own. Returns the subscription index for stats(). */
+    std::size_t subscribe(GstMessageType types, GstObject *source, Handler handler, std::size_t capacity = 1024)
+    {
+        subscriptions.emplace_back(types, source, std::move(handler), capacity);
+        return subscriptions.size() - 1;
+    }
+
+    /* Route the messages of `pipeline` through the dispatcher */
+    void attach(GstElement *pipeline)
+    {
+        GstBus *bus = gst_element_get_bus(pipeline);
+        gst_bus_set_sync_handler(bus, syncHandler, this, NULL);
+        buses.push_back(bus);
+    }
+
+    /* Give the bus of `pipeline` back to the regular bus queue */
+    void detach(GstElement *pipeline)
+    {
+        GstBus *bus = gst_element_get_bus(pipeline);
+        for (GstBus *attached : buses)
+        {
+            if (attached == bus)
+            {
+                detachBus(attached);
+                break;
+            }
+        }
+        gst_object_unref(bus);
+    }
+
+    void start(void)
+    {
+        if (dispatcher.joinable())
+        {
+            return;
+        }
+        stopping.store(FALSE);
+        for (Subscription &subscription : subscriptions)
+        {
+            subscription.done.store(FALSE);
+            subscription.thread = std::thread(&BusDispatcher::deliver, &subscription);
+        }
+        dispatcher = std::thread(&BusDispatcher::dispatch, this);
+    }
+
+    /* Route what is already in the rings, wait for every handler to finish and join the threads */
+    void stop(void)
+    {
+        if (!dispatcher.joinable())
+        {
+            return;
+        }
+        stopping.store(TRUE);
+        incoming.wake();
+        dispatcher.join();
+        for (Subscription &subscription : subscriptions)
+        {
+            subscription.done.store(TRUE);
+            subscription.ring.wake();
+            subscription.thread.join();
+        }
+    }
+
+    /* Messages taken off the buses, and non-lossless messages dropped because the dispatcher fell behind */
+    guint64 posted(void) const
+    {
+        return posted_count.load(std::memory_order_relaxed);
+    }
+
+    guint64 dropped(void) const
+    {
+        return dropped_count.load(std::memory_order_relaxed);
+    }
+
+    /* Lossless messages left on the regular bus queue because the incoming ring stayed full */
+    guint64 passed(void) const
+    {
+        return passed_count.load(std::memory_order_relaxed);
+    }
+
+    SubscriptionStats stats(std::size_t index) const
+    {
+        const Subscription &subscription = subscriptions[index];
+        guint64 delivered = subscription.delivered.load(std::memory_order_relaxed);
+        gint64 latency_sum = subscription.latency_sum_us.load(std::memory_order_relaxed);
+        return SubscriptionStats{delivered, subscription.dropped.load(std::memory_order_relaxed),
+                                 delivered ? (double)latency_sum / delivered : 0.0,
+                                 subscription.latency_max_us.load(std::memory_order_relaxed)};
+    }
+
+  private:
+    struct Item
+    {
+        GstMessage *msg;
+        gint64 posted_us;
+    };
+
+    struct Subscription
+    {
+        Subscription(GstMessageType types, GstObject *source, Handler handler, std::size_t capacity)
+            : types{types}, source{source}, handler{std::move(handler)}, ring{capacity}
+        {
+        }
+
+        GstMessageType types;
+        GstObject *source;
+        Handler handler;
+        LockFreeRing<Item> ring;
+        std::thread thread;
+        std::atomic<gboolean> done{FALSE};
+        std::atomic<guint64> delivered{0};
+        std::atomic<guint64> dropped{0};
+        std::atomic<gint64> latency_sum_us{0};
+        std::atomic<gint64> latency_max_us{0};
+    };
+
+    void detachBus(GstBus *bus)
+    {
+        gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+        buses.erase(std::find(buses.begin(), buses.end(), bus));
+        gst_object_unref(bus);
+    }
+
+    /* Runs on whichever thread posted the message, so it only takes a ref and hands it over */
+    static GstBusSyncReply syncHandler(GstBus *bus, GstMessage *msg, gpointer user_data)
+    {
+        BusDispatcher *self = static_cast<BusDispatcher *>(user_data);
+        self->posted_count.fetch_add(1, std::memory_order_relaxed);
+        Item item{gst_message_ref(msg), g_get_monotonic_time()};
+        gboolean wait = GST_MESSAGE_TYPE(msg) & self->lossless;
+        if (!enqueue(self->incoming, item, wait))
+        {
+            gst_message_unref(item.msg);
+            if (wait)
+            {
+                self->passed_count.fetch_add(1, std::memory_order_relaxed);
+                return GST_BUS_PASS;
+            }
+            self->dropped_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return GST_BUS_DROP;
+    }
+
+    /* Push `item`; when `wait`, retry for up to lossless_wait_us while the ring is full */
+    static gboolean enqueue(LockFreeRing<Item> &ring, const Item &item, gboolean wait)
+    {
+        gint64 deadline = 0;
+        while (!ring.push(item))
+        {
+            if (!wait)
+            {
+                return FALSE;
+            }
+            gint64 now = g_get_monotonic_time();
+            if (!deadline)
+            {
+                deadline = now + lossless_wait_us;
+            }
+            else if (now >= deadline)
+            {
+                return FALSE;
+            }
+            std::this_thread::yield();
+        }
+        return TRUE;
+    }
+
+    static gboolean matches(const Subscription &subscription, GstMessage *msg)
+    {
+        if (!(GST_MESSAGE_TYPE(msg) & subscription.types))
+        {
+            return FALSE;
+        }
+        return !subscription.source ||
+               (GST_MESSAGE_SRC(msg) && gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg), subscription.source));
+    }
+
+    void dispatch(void)
+    {
+        Item item;
+        while (true)
+        {
+            guint32 seen = incoming.epoch();
+            if (!incoming.pop(item))
+            {
+                if (stopping.load())
+                {
+                    return;
+                }
+                incoming.waitFor(seen);
+                continue;
+            }
+            gboolean wait = GST_MESSAGE_TYPE(item.msg) & lossless;
+            for (Subscription &subscription : subscriptions)
+            {
+                if (!matches(subscription, item.msg))
+                {
+                    continue;
+                }
+                Item copy{gst_message_ref(item.msg), item.posted_us};
+                if (!enqueue(subscription.ring, copy, wait))
+                {
+                    subscription.dropped.fetch_add(1, std::memory_order_relaxed);
+                    gst_message_unref(copy.msg);
+                }
+            }
+            gst_message_unref(item.msg);
+        }
+    }
+
+    static void deliver(Subscription *subscription)
+    {
+        Item item;
+        while (true)
+        {
+            guint32 seen = subscription->ring.epoch();
+            if (!subscription->ring.pop(item))
+            {
+                if (subscription->done.load())
+                {
+                    return;
+                }
+                subscription->ring.waitFor(seen);
+                continue;
+            }
+            gint64 latency = g_get_monotonic_time() - item.posted_us;
+            subscription->latency_sum_us.fetch_add(latency, std::memory_order_relaxed);
+            if (latency > subscription->latency_max_us.load(std::memory_order_relaxed))
+            {
+                subscription->latency_max_us.store(latency, std::memory_order_relaxed);
+            }
+            subscription->handler(item.msg);
+            subscription->delivered.fetch_add(1, std::memory_order_relaxed);
+            gst_message_unref(item.msg);
+        }
+    }
+
+    GstMessageType lossless;
+    LockFreeRing<Item> incoming;
+    std::deque<Subscription> subscriptions;
+    std::vector<GstBus *> buses;
+    std::thread dispatcher;
+    std::atomic<gboolean> stopping{FALSE};
+    std::atomic<guint64> posted_count{0};
+    std::atomic<guint64> dropped_count{0};
+    std::atomic<guint64> passed_count{0};
+};
+
+using BusDispatcherPtr = BusDispatcher *;
@@ -1,3 +1,5 @@
+#include "headless.hpp"
+#include "simd-effects.hpp"
 #include <gst/gst.h>
 #include <iostream>
 
@@ -37,10 +39,15 @@ int tutorial_main(int argc, char **argv)
 
     /* Initialize Gstreamer */
     gst_init(&argc, &argv);
+    HeadlessOptions headless = HeadlessOptions::parse(argc, argv);
+    HeadlessReport report;
+
+    /* The in-tree simdedgetv, simdagingtv and simdwarptv can stand in for their effectv counterparts */
+    SimdEffects::registerElements();
 
     /* Create the elements */
     data.source = gst_element_factory_make("videotestsrc", "source");
-    data.sink = gst_element_factory_make("autovideosink", "sink");
+    data.sink = headless.makeSink("autovideosink", "sink");
     // data.filter = gst_element_factory_make("agingtv", "filter");
     // data.filter = gst_element_factory_make("dicetv", "filter");
     // data.filter = gst_element_factory_make("edgetv", "filter");
@@ -53,6 +60,9 @@ int tutorial_main(int argc, char **argv)
     // data.filter = gst_element_factory_make("streaktv", "filter");
     // data.filter = gst_element_factory_make("vertigotv", "filter");
     data.filter = gst_element_factory_make("warptv", "filter");
+    // data.filter = gst_element_factory_make("simdagingtv", "filter");
+    // data.filter = gst_element_factory_make("simdedgetv", "filter");
+    // data.filter = gst_element_factory_make("simdwarptv", "filter");
     data.converter = gst_element_factory_make("videoconvert", "converter");
 
     /* Create the empty pipeline */
@@ -76,6 +86,14 @@ int tutorial_main(int argc, char **argv)
         return -1;
     }
 
+    /* Bound the test source and count what reaches the sink when measuring */
+    if (headless.enabled)
+    {
+        headless.limitSource(data.source);
+        report.watch(data.sink);
+        report.start();
+    }
+
     /* Start playing */
     ret = gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
     if (ret == GST_STATE_CHANGE_FAILURE)
@@ -88,6 +106,11 @@ int tutorial_main(int argc, char **argv)
     /* Wait until error or EOS */
     bus = gst_element_get_bus(data.pipeline);
     msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    if (headless.enabled)
+    {
+        report.stop();
+        report.write("exercise-tutorial-2", headless);
+    }
 
     /* Parse message */
     if (msg != NULL)
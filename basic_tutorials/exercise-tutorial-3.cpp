@@ -1,4 +1,6 @@
 #include "gst/gst.h"
+#include "headless.hpp"
+#include "simd-effects.hpp"
 #include <iostream>
 
 /* Structure to contain all our information, so we can pass it to callbacks */
@@ -45,13 +47,19 @@ int main(int argc, char **argv)
 
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
+    HeadlessOptions headless = HeadlessOptions::parse(argc, argv);
+    HeadlessReport report;
 
-    /* Create the elements */
-    data.source = gst_element_factory_make("uridecodebin", "source");
+    /* The in-tree simdedgetv, simdagingtv and simdwarptv can stand in for their effectv counterparts */
+    SimdEffects::registerElements();
+
+    /* Create the elements. Headless runs decode a local file, or use test sources when none is given. */
+    data.source =
+        headless.makeDecodeSource("source", "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm");
 
     data.audio_resample = gst_element_factory_make("audioresample", "audio_resample");
     data.audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
-    data.audio_sink = gst_element_factory_make("autoaudiosink", "audio_sink");
+    data.audio_sink = headless.makeSink("autoaudiosink", "audio_sink");
 
     data.video_filter = gst_element_factory_make("agingtv", "filter");
     // data.video_filter = gst_element_factory_make("dicetv", "filter");
@@ -65,9 +73,12 @@ int main(int argc, char **argv)
     // data.video_filter = gst_element_factory_make("streaktv", "filter");
     // data.video_filter = gst_element_factory_make("vertigotv", "filter");
     // data.video_filter = gst_element_factory_make("warptv", "filter");
+    // data.video_filter = gst_element_factory_make("simdagingtv", "filter");
+    // data.video_filter = gst_element_factory_make("simdedgetv", "filter");
+    // data.video_filter = gst_element_factory_make("simdwarptv", "filter");
     data.video_convert1 = gst_element_factory_make("videoconvert", "video_convert1");
     data.video_convert2 = gst_element_factory_make("videoconvert", "video_convert2");
-    data.video_sink = gst_element_factory_make("autovideosink", "video_sink");
+    data.video_sink = headless.makeSink("autovideosink", "video_sink");
 
     /* Create the empty pipeline */
     data.pipeline = gst_pipeline_new("test-pipeline");
@@ -96,11 +107,19 @@ int main(int argc, char **argv)
         return -1;
     }
 
-    /* Set the URI to play */
-    g_object_set(data.source, "uri", "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm", NULL);
+    /* Connect to the pad-added signal; the synthetic source has its pads already and is linked right away */
+    if (!link_static_source_pads(data.source, data.audio_convert, data.video_convert1))
+    {
+        g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+    }
 
-    /* Connect to the pad-added signal */
-    g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+    /* Count what reaches the sinks when measuring */
+    if (headless.enabled)
+    {
+        report.watch(data.audio_sink);
+        report.watch(data.video_sink);
+        report.start();
+    }
 
     /* Start playing */
     ret = gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
@@ -162,6 +181,12 @@ int main(int argc, char **argv)
         }
     } while (!terminate);
 
+    if (headless.enabled)
+    {
+        report.stop();
+        report.write("exercise-tutorial-3", headless);
+    }
+
     /* Free resources */
     gst_object_unref(bus);
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
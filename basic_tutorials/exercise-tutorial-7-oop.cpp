@@ -1,607 +1,269 @@
-#include "gst/gst.h"
+#include "fast-startup.hpp"
+#include "headless.hpp"
+#include "latency-tracer.hpp"
+#include "pipeline-description.hpp"
+#include "pipeline-element.hpp"
+#include "queue-monitor.hpp"
+#include <cstring>
 #include <iostream>
-#include <regex>
 #include <string>
-#include <vector>
 
-using GstElementPtr = GstElement *;
-using GstPadPtr = GstPad *;
-
-bool is_number(std::string &s)
-{
-    return std::regex_match(s.c_str(), std::regex("[(-|+)|][0-9.]+"));
-}
-
-/* Structure to contain all our information, so we can pass it to callbacks */
-class Element
+int main(int argc, char **argv)
 {
-  public:
-    virtual gboolean checkValid(void) = 0;
-    virtual void gstElementFactoryMake(void) = 0;
-    virtual GstElementPtr getElement(const char *_element_name) = 0;
-    virtual GstPadPtr getPad(const char *_pad_name) = 0;
-    virtual void setPad(const char *_pad_name, GstPadPtr pad) = 0;
-    virtual gboolean linkManyElement(void) = 0;
-};
-
-using ElementPtr = Element *;
+    /* Define Elements */
+    PipelineElementPtr pipeline;
+    GstBus *bus;
+    GstMessage *msg;
+    GstStateChangeReturn ret;
+    gboolean terminate = FALSE;
 
-class AudioElement : public Element
-{
-  public:
-    AudioElement() : audio_convert{nullptr}, audio_resample{nullptr}, audio_sink{nullptr}
+    /* A plugin set has to be in place before gst_init() reads the registry */
+    std::string plugin_set = PluginSet::option(argc, argv, "--plugin-set");
+    if (!plugin_set.empty())
     {
+        PluginSet::applyEnvironment(plugin_set);
     }
 
-    gboolean checkValid(void) override
+    /* Initialize GStreamer */
+    gst_init(&argc, &argv);
+    FirstFrameClock clock;
+    clock.mark("gst_init done");
+    if (!plugin_set.empty() && PluginSet::load(plugin_set) > 0)
     {
-        return (gboolean)(audio_convert && audio_resample && audio_sink);
+        return -1;
     }
-
-    void gstElementFactoryMake(void) override
+    HeadlessOptions headless = HeadlessOptions::parse(argc, argv);
+    if (!headless.valid)
     {
-        // audio_queue = gst_element_factory_make("queue", "audio_queue");
-        audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
-        audio_resample = gst_element_factory_make("audioresample", "audio_resample");
-        audio_sink = gst_element_factory_make("autoaudiosink", "audio_sink");
+        return -1;
     }
+    HeadlessReport report;
 
-    GstElementPtr getElement(const char *_element_name) override
+    /* Options: --all-effects fans the video out to every effectv filter, --queue-buffers N sets their queue size,
+     * --toggle-effect NAME attaches and detaches a NAME branch every --toggle-period seconds while playing,
+     * --trace-latency times every element and prints the histograms on EOS and on SIGUSR1,
+     * --monitor-queues samples the queue of every branch every --monitor-interval ms, --monitor-csv FILE also
+     * writes the time series, --description FILE builds the topology from a pipeline description,
+     * --plugin-set FILE starts with only the plugins in FILE, --record-plugins FILE writes the plugins this run
+     * loaded, --ttff prints the time from process start to the first buffer of every sink, --convert-threads N
+     * splits the conversions of every video branch over N threads (0: one per core) */
+    gboolean all_effects = FALSE;
+    guint queue_buffers = 5;
+    std::string toggle_effect;
+    guint toggle_period = 5;
+    gboolean trace_latency = FALSE;
+    gboolean monitor_queues = FALSE;
+    guint monitor_interval = 50;
+    std::string monitor_csv;
+    std::string description_path;
+    std::string record_plugins;
+    gboolean ttff = FALSE;
+    guint convert_threads = 1;
+    for (int i = 1; i < argc; ++i)
     {
-        std::string element_name{_element_name};
-        if (element_name == "audio_convert")
+        if (strcmp(argv[i], "--all-effects") == 0)
         {
-            return audio_convert;
+            all_effects = TRUE;
         }
-        else if (element_name == "audio_resample")
+        else if (strcmp(argv[i], "--queue-buffers") == 0 && i + 1 < argc)
         {
-            return audio_resample;
+            queue_buffers = (guint)std::stoul(argv[++i]);
         }
-        else if (element_name == "audio_sink")
+        else if (strcmp(argv[i], "--toggle-effect") == 0 && i + 1 < argc)
         {
-            return audio_sink;
+            toggle_effect = argv[++i];
         }
-        else
+        else if (strcmp(argv[i], "--toggle-period") == 0 && i + 1 < argc)
         {
-            return nullptr;
+            toggle_period = (guint)std::stoul(argv[++i]);
         }
-    }
-
-    GstPadPtr getPad(const char *_pad_name) override
-    {
-        return nullptr;
-    }
-
-    void setPad(const char *_pad_name, GstPadPtr pad) override
-    {
-    }
-
-    gboolean linkManyElement(void) override
-    {
-        return gst_element_link_many(audio_convert, audio_resample, audio_sink, NULL);
-    }
-
-  private:
-    // GstElementPtr audio_queue;
-    GstElementPtr audio_convert;
-    GstElementPtr audio_resample;
-    GstElementPtr audio_sink;
-};
-
-using AudioElementPtr = AudioElement *;
-
-class VideoElement : public Element
-{
-  public:
-    VideoElement(std::string filter_name = "") : video_queue{nullptr}, video_convert{nullptr}, video_sink{nullptr}
-    {
-        this->filter_name = filter_name;
-        if (checkFilterNameValid(filter_name))
+        else if (strcmp(argv[i], "--trace-latency") == 0)
         {
-            video_filter = nullptr;
-            video_convert_after_filter = nullptr;
+            trace_latency = TRUE;
         }
-    }
-
-    gboolean checkValid(void) override
-    {
-        return (gboolean)(video_queue && video_convert && video_sink &&
-                          (!checkFilterNameValid(filter_name) || (video_filter && video_convert_after_filter)));
-    }
-
-    // Check if Element use filter or use a valid filter
-    gboolean checkFilterNameValid(std::string &filter_name)
-    {
-        std::vector<std::string> list_video_filter_name = {"agingtv",      "dicetv",    "edgetv",    "optv",
-                                                           "quarktv",      "radioactv", "revtv",     "rippletv",
-                                                           "shagadelictv", "streaktv",  "vertigotv", "warptv"};
-        std::vector<std::string>::iterator it =
-            std::find(list_video_filter_name.begin(), list_video_filter_name.end(), filter_name);
-        if (it == list_video_filter_name.end())
-            return 0;
-        else
-            return 1;
-    }
-
-    void gstElementFactoryMake(void) override
-    {
-        video_queue = gst_element_factory_make("queue", "video_queue");
-        video_convert = gst_element_factory_make("videoconvert", "video_convert1");
-        if (checkFilterNameValid(this->filter_name))
+        else if (strcmp(argv[i], "--monitor-queues") == 0)
         {
-            video_filter = gst_element_factory_make(this->filter_name.c_str(), "video_filter");
-            video_convert_after_filter = gst_element_factory_make("videoconvert", "video_convert_after_filter");
+            monitor_queues = TRUE;
         }
-        video_sink = gst_element_factory_make("autovideosink", "video_sink");
-    }
-
-    GstElementPtr getElement(const char *_element_name) override
-    {
-        std::string element_name{_element_name};
-        if (element_name == "video_queue")
+        else if (strcmp(argv[i], "--monitor-interval") == 0 && i + 1 < argc)
         {
-            return video_queue;
+            monitor_interval = (guint)std::stoul(argv[++i]);
         }
-        else if (element_name == "video_convert")
+        else if (strcmp(argv[i], "--monitor-csv") == 0 && i + 1 < argc)
         {
-            return video_convert;
+            monitor_csv = argv[++i];
+            monitor_queues = TRUE;
         }
-        else if (element_name == "video_filter")
+        else if (strcmp(argv[i], "--description") == 0 && i + 1 < argc)
         {
-            if (checkFilterNameValid(filter_name))
-            {
-                return video_filter;
-            }
-            else
-            {
-                return nullptr;
-            }
+            description_path = argv[++i];
         }
-        else if (element_name == "video_convert_after_filter")
+        else if (strcmp(argv[i], "--record-plugins") == 0 && i + 1 < argc)
         {
-            if (checkFilterNameValid(filter_name))
-            {
-                return video_convert_after_filter;
-            }
-            else
-            {
-                return nullptr;
-            }
+            record_plugins = argv[++i];
         }
-        else if (element_name == "video_sink")
+        else if (strcmp(argv[i], "--ttff") == 0)
         {
-            return video_sink;
+            ttff = TRUE;
         }
-        else
+        else if (strcmp(argv[i], "--convert-threads") == 0 && i + 1 < argc)
         {
-            return nullptr;
+            convert_threads = (guint)std::stoul(argv[++i]);
         }
     }
+    gboolean toggling = VideoElement::checkFilterNameValid(toggle_effect);
+    gboolean toggle_attached = FALSE;
+    std::size_t toggle_branch = 0;
+    gint64 next_toggle_us = g_get_monotonic_time() + toggle_period * G_USEC_PER_SEC;
 
-    GstPadPtr getPad(const char *_pad_name) override
+    /* Headless runs end every branch in an unsynchronised fakesink and use test sources unless given a file */
+    PipelineConfig config;
+    config.video_convert_threads = convert_threads;
+    config.mmap_source = headless.mmap;
+    SinkConfig effect_sink{headless.sinkFactory("autovideosink"), !headless.enabled};
+    if (headless.enabled)
     {
-        std::string pad_name{_pad_name};
-        if (pad_name == "queue_video_pad")
-        {
-            return queue_video_pad;
-        }
-        else if (pad_name == "tee_video_pad")
-        {
-            return tee_video_pad;
-        }
-        else
-        {
-            return nullptr;
-        }
+        config.audio_sink = SinkConfig{"fakesink", FALSE};
+        config.video_sink = SinkConfig{"fakesink", FALSE};
     }
-
-    void setPad(const char *_pad_name, GstPadPtr pad) override
+    if (headless.synthetic())
     {
-        std::string pad_name{_pad_name};
-        if (pad_name == "queue_video_pad")
-        {
-            queue_video_pad = pad;
-        }
-        else if (pad_name == "tee_video_pad")
-        {
-            tee_video_pad = pad;
-        }
+        config.source_description = headless.syntheticDescription();
     }
 
-    gboolean linkManyElement(void) override
+    /* A description replaces the default audio and video branches; headless still swaps in fakesinks */
+    PipelineDescription description;
+    if (!description_path.empty())
     {
-        if (checkFilterNameValid(filter_name))
-        {
-            std::cout << "HAS filter" << std::endl;
-            return gst_element_link_many(video_queue, video_convert, video_filter, video_convert_after_filter,
-                                         video_sink, NULL);
-        }
-        else
+        if (!PipelineDescription::load(description_path, description))
         {
-            std::cout << "NO filter" << std::endl;
-            return gst_element_link_many(video_queue, video_convert, video_sink, NULL);
+            return -1;
         }
-    }
-
-  private:
-    std::string filter_name;
-    GstElementPtr video_queue;
-    GstElementPtr video_convert;
-    GstElementPtr video_filter;
-    GstElementPtr video_convert_after_filter;
-    GstElementPtr video_sink;
-    GstPadPtr queue_video_pad;
-    GstPadPtr tee_video_pad;
-};
-
-using VideoElementPtr = VideoElement *;
-
-class TeeElement : public Element
-{
-  public:
-    TeeElement() : tee{nullptr}
-    {
-    }
-
-    gboolean checkValid(void) override
-    {
-        if (tee)
+        if (headless.enabled)
         {
-            return (gboolean)(1);
+            for (BranchDescription &branch : description.branches)
+            {
+                branch.sink = SinkConfig{"fakesink", FALSE};
+            }
         }
-        else
+        if (headless.synthetic())
         {
-            return (gboolean)(0);
+            description.config.source_description = config.source_description;
         }
+        description.config.mmap_source = config.mmap_source;
+        pipeline = description.instantiate();
     }
-
-    void gstElementFactoryMake(void) override
+    else
     {
-        tee = gst_element_factory_make("tee", "tee");
+        pipeline = new PipelineElement(config);
     }
 
-    GstElementPtr getElement(const char *_element_name) override
+    /* Effect branches are leaky: a slow filter drops frames instead of stalling the tee */
+    if (all_effects)
     {
-        std::string element_name{_element_name};
-        if (element_name == "tee")
+        for (std::string_view filter_name : VideoElement::list_video_filter_name)
         {
-            return tee;
+            VideoElementPtr effect =
+                new VideoElement(std::string(filter_name), QueueLimits::leakyBranch(queue_buffers), effect_sink);
+            effect->setConvertThreads(convert_threads);
+            pipeline->addBranch(effect);
         }
-        else
-        {
-            return nullptr;
-        }
-    }
-
-    GstPadPtr getPad(const char *_pad_name) override
-    {
-        return nullptr;
-    }
-
-    void setPad(const char *_pad_name, GstPadPtr pad) override
-    {
-    }
-
-    gboolean linkManyElement(void) override
-    {
-        return 1;
-    }
-
-  private:
-    GstElementPtr tee;
-};
-
-using TeeElementPtr = TeeElement *;
-
-class PipelineAction
-{
-  public:
-    virtual GstStateChangeReturn changeStatePlaying(void) = 0;
-    virtual GstStateChangeReturn changeStateNull(void) = 0;
-    virtual GstStateChangeReturn changeStateReady(void) = 0;
-    virtual GstStateChangeReturn changeStatePaused(void) = 0;
-    virtual void setSourceProperties(std::string &url) = 0;
-    virtual void addManyElement(void) = 0;
-    virtual gboolean linkRequestPadsTee(void) = 0;
-    virtual void unref(void) = 0;
-};
-
-class PipelineElement : public PipelineAction, public Element
-{
-  public:
-    PipelineElement() : pipeline{nullptr}, source{nullptr}, tee{nullptr}
-    {
-        list_elements.push_back(new AudioElement());
-        list_elements.push_back(new VideoElement());
-        // list_elements.push_back(new VideoElement("agingtv"));
-        // list_elements.push_back(new VideoElement("dicetv"));
-        // list_elements.push_back(new VideoElement("edgetv"));
-        // list_elements.push_back(new VideoElement("optv"));
-        // list_elements.push_back(new VideoElement("quarktv"));
-        // list_elements.push_back(new VideoElement("radioactv"));
-        // list_elements.push_back(new VideoElement("revtv"));
-        // list_elements.push_back(new VideoElement("rippletv"));
-        // list_elements.push_back(new VideoElement("shagadelictv"));
-        // list_elements.push_back(new VideoElement("streaktv"));
-        // list_elements.push_back(new VideoElement("vertigotv"));
-        // list_elements.push_back(new VideoElement("warptv"));
     }
 
-    ~PipelineElement()
-    {
-        for (ElementPtr ele : list_elements)
-        {
-            delete ele;
-        }
-        std::cout << __FUNCTION__ << std::endl;
-    }
+    /* Create the elements */
+    pipeline->gstElementFactoryMake();
 
-    GstStateChangeReturn changeStatePlaying() override
+    if (!pipeline->checkValid())
     {
-        return gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        g_printerr("Not all elements could be created.\n");
+        return -1;
     }
 
-    GstStateChangeReturn changeStateNull() override
+    /* Set the URI to play */
+    std::string url = headless.uri.empty() ? description.uri : headless.uri;
+    if (url.empty())
     {
-        return gst_element_set_state(pipeline, GST_STATE_NULL);
+        url = "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
     }
+    pipeline->setSourceProperties(url);
 
-    GstStateChangeReturn changeStateReady() override
-    {
-        return gst_element_set_state(pipeline, GST_STATE_READY);
-    }
+    /* Build the pipeline. Note that we are NOT linking the source at this point. We will do it later. */
+    pipeline->addManyElement();
 
-    GstStateChangeReturn changeStatePaused() override
+    if (!pipeline->linkManyElement())
     {
-        return gst_element_set_state(pipeline, GST_STATE_PAUSED);
+        g_printerr("Elements could not be linked.\n");
+        pipeline->unref();
+        return -1;
     }
 
-    void setSourceProperties(std::string &url) override
+    /* Manually link the Tee, which has "Request" pads */
+    gboolean ra = pipeline->linkRequestPadsTee();
+    if (!ra)
     {
-        /* Set the URI to play */
-        g_object_set(source, "uri", url.c_str(), NULL);
+        g_printerr("Tee could not be linked.\n");
+        pipeline->unref();
+        return -1;
     }
 
-    void addManyElement(void) override
+    /* Connect to the pad-added signal */
+    pipeline->linkSource();
+    if (ttff)
     {
-        gst_bin_add_many(GST_BIN(getElement("pipeline")), getElement("source"), getElement("tee"),
-                         getElement("list_elements.0.audio_convert"), getElement("list_elements.0.audio_resample"),
-                         getElement("list_elements.0.audio_sink"), getElement("list_elements.1.video_queue"),
-                         getElement("list_elements.1.video_convert"), getElement("list_elements.1.video_sink"), NULL);
+        clock.attach(pipeline->getElement("pipeline"));
     }
+    clock.mark("pipeline built");
 
-    gboolean linkManyElement(void) override
+    /* Time every element; branch latencies are measured from the tee of each media */
+    LatencyTracerPtr tracer = nullptr;
+    if (trace_latency)
     {
-        gboolean r = 1;
-        for (ElementPtr ele : list_elements)
-        {
-            r &= ele->linkManyElement();
-        }
-        return r;
+        tracer = new LatencyTracer();
+        tracer->attach(pipeline->getElement("pipeline"));
+        tracer->addOrigin(pipeline->getElement("tee"));
+        tracer->addOrigin(pipeline->getElement("tee_audio"));
+        tracer->dumpOnSignal(SIGUSR1);
     }
 
-    void unref(void) override
+    /* Sample the queue at the head of every branch */
+    QueueMonitor monitor;
+    if (monitor_queues)
     {
-        /* Release the request pads from the Tee, and unref them */
-        for (ElementPtr ele : list_elements)
+        for (std::size_t ei = 0; ei < pipeline->branchCount(); ++ei)
         {
-            GstPadPtr tee_video_pad = ele->getPad("tee_video_pad");
-            GstPadPtr queue_video_pad = ele->getPad("queue_video_pad");
-            if (tee_video_pad)
+            if (GstElementPtr queue = pipeline->getElement(ei, 0))
             {
-                gst_element_release_request_pad(tee->getElement("tee"), tee_video_pad);
-                gst_object_unref(tee_video_pad);
-                gst_object_unref(queue_video_pad);
+                monitor.watch(queue);
             }
         }
-        gst_object_unref(pipeline);
-    }
-
-    gboolean checkValid(void) override
-    {
-        gboolean ret = 1;
-
-        for (ElementPtr ele : list_elements)
+        if (!monitor_csv.empty())
         {
-            ret &= ele->checkValid();
-            if (!ret)
-                return 0;
+            monitor.writeCsv(monitor_csv);
         }
-
-        return (gboolean)(ret && pipeline && source && tee);
-    }
-
-    void gstElementFactoryMake(void) override
-    {
-        for (ElementPtr ele : list_elements)
-            ele->gstElementFactoryMake();
-
-        tee->gstElementFactoryMake();
-        source = gst_element_factory_make("uridecodebin", "source");
-        pipeline = gst_pipeline_new("test-pipeline");
+        monitor.start(monitor_interval);
     }
 
-    GstElementPtr getElement(const char *_element_name) override
+    /* Count what reaches the sink of every branch when measuring */
+    if (headless.enabled)
     {
-        std::string element_name{_element_name};
-        if (element_name == "pipeline")
+        for (std::size_t ei = 0; ei < pipeline->branchCount(); ++ei)
         {
-            return pipeline;
-        }
-        else if (element_name == "source")
-        {
-            return source;
-        }
-        else if (element_name == "tee")
-        {
-            return tee->getElement("tee");
-        }
-        else
-        {
-            if (!list_elements.empty())
-            {
-                return nullptr;
-            }
-
-            int idx = element_name.find(".");
-
-            if (idx < 0 || std::string_view(element_name.c_str(), idx) != "list_elements")
-            {
-                return nullptr;
-            }
-            std::string_view sub(element_name.c_str() + idx + 1);
-
-            idx = sub.find(".");
-
-            if (idx < 0)
-            {
-                return nullptr;
-            }
-
-            std::string list_elements_idx_char{std::string_view(element_name.c_str(), idx)};
-            if (is_number(list_elements_idx_char))
-            {
-                int list_elements_idx = std::stoi(list_elements_idx_char);
-                if (list_elements_idx < list_elements.size())
-                {
-                    std::string_view sub_element_name{sub.data() + idx + 1};
-                    return list_elements[list_elements_idx]->getElement(sub_element_name.data());
-                }
-                else
-                {
-                    return nullptr;
-                }
-            }
-            else
+            if (GstElementPtr sink = pipeline->branchSink(ei))
             {
-                return nullptr;
+                report.watch(sink);
             }
         }
+        report.start();
     }
 
-    GstPadPtr getPad(const char *_pad_name) override
-    {
-        return nullptr;
-    }
-
-    void setPad(const char *_pad_name, GstPadPtr pad) override
-    {
-    }
-
-    gboolean linkRequestPadsTee(void) override
-    {
-        int ei = 1; // element index
-
-        GstPadPtr queue_video_pad = gst_element_get_static_pad(list_elements[ei]->getElement("video_queue"), "sink");
-        GstPadPtr tee_video_pad = gst_element_get_request_pad(tee->getElement("tee"), "src_%u");
-        list_elements[ei]->setPad("queue_video_pad", queue_video_pad);
-        list_elements[ei]->setPad("tee_video_pad", tee_video_pad);
-        g_print("Obtained request pad %s for Tee branch.\n", gst_pad_get_name(tee_video_pad));
-        g_print("Obtained static pad %s for video_element.\n", gst_pad_get_name(queue_video_pad));
-        GstPadLinkReturn ra = gst_pad_link(tee_video_pad, queue_video_pad);
-
-        std::cout << "ra: " << ra << std::endl;
-
-        switch (ra)
-        {
-        case GST_PAD_LINK_OK:
-            g_print("link succeeded\n");
-            break;
-        case GST_PAD_LINK_WRONG_HIERARCHY:
-            g_printerr("pads have no common grandparent\n");
-            break;
-        case GST_PAD_LINK_WAS_LINKED:
-            g_printerr("pad was already linked\n");
-            break;
-        case GST_PAD_LINK_WRONG_DIRECTION:
-            g_printerr("pads have wrong direction\n");
-            break;
-        case GST_PAD_LINK_NOFORMAT:
-            g_printerr("pads do not have common format\n");
-            break;
-        case GST_PAD_LINK_NOSCHED:
-            g_printerr("pads cannot cooperate in scheduling\n");
-            break;
-        case GST_PAD_LINK_REFUSED:
-            g_printerr("refused for some reason\n");
-            break;
-        default:
-            break;
-        }
-
-        if (ra != GST_PAD_LINK_OK)
-        {
-            return 0;
-        }
-
-        return 1;
-    }
-
-  private:
-    GstElementPtr pipeline;
-    GstElementPtr source;
-    ElementPtr tee;
-    std::vector<ElementPtr> list_elements;
-};
-
-using PipelineElementPtr = PipelineElement *;
-
-/* Handler for the pad-added signal */
-static void pad_added_handler(GstElementPtr src, GstPadPtr pad, PipelineElementPtr data);
-
-int main(int argc, char **argv)
-{
-    /* Define Elements */
-    PipelineElementPtr pipeline = new PipelineElement();
-    GstBus *bus;
-    GstMessage *msg;
-    GstStateChangeReturn ret;
-    gboolean terminate = FALSE;
-
-    /* Initialize GStreamer */
-    gst_init(&argc, &argv);
-
-    /* Create the elements */
-    pipeline->gstElementFactoryMake();
-
-    if (!pipeline->checkValid())
-    {
-        g_printerr("Not all elements could be created.\n");
-        return -1;
-    }
-
-    /* Set the URI to play */
-    std::string url = "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
-    pipeline->setSourceProperties(url);
-
-    /* Build the pipeline. Note that we are NOT linking the source at this point. We will do it later. */
-    pipeline->addManyElement();
-
-    if (!pipeline->linkManyElement())
-    {
-        g_printerr("Elements could not be linked.\n");
-        pipeline->unref();
-        return -1;
-    }
-
-    /* Manually link the Tee, which has "Request" pads */
-    gboolean ra = pipeline->linkRequestPadsTee();
-    if (!ra)
-    {
-        g_printerr("Tee could not be linked.\n");
-        pipeline->unref();
-        return -1;
-    }
-
-    /* Connect to the pad-added signal */
-    g_signal_connect(pipeline->getElement("source"), "pad-added", G_CALLBACK(pad_added_handler), &pipeline);
-
     /* Start playing */
     ret = gst_element_set_state(pipeline->getElement("pipeline"), GST_STATE_PLAYING);
+    clock.mark("PLAYING requested");
     if (ret == GST_STATE_CHANGE_FAILURE)
     {
         g_printerr("Unable to set the pipeline to the playing state.\n");
         pipeline->unref();
+        delete tracer;
         return -1;
     }
 
@@ -611,9 +273,29 @@ int main(int argc, char **argv)
     do
     {
         msg = gst_bus_timed_pop_filtered(
-            bus, GST_CLOCK_TIME_NONE,
+            bus, toggling ? 100 * GST_MSECOND : GST_CLOCK_TIME_NONE,
             (GstMessageType)(GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
 
+        /* Hot add/remove of a branch; the other branches keep playing */
+        if (toggling && g_get_monotonic_time() >= next_toggle_us)
+        {
+            if (toggle_attached)
+            {
+                g_print("Detaching %s branch %zu.\n", toggle_effect.c_str(), toggle_branch);
+                pipeline->detachBranch(toggle_branch);
+                toggle_attached = FALSE;
+            }
+            else
+            {
+                g_print("Attaching %s branch.\n", toggle_effect.c_str());
+                VideoElementPtr effect =
+                    new VideoElement(toggle_effect, QueueLimits::leakyBranch(queue_buffers), effect_sink);
+                effect->setConvertThreads(convert_threads);
+                toggle_attached = pipeline->attachBranch(effect, &toggle_branch);
+            }
+            next_toggle_us += toggle_period * G_USEC_PER_SEC;
+        }
+
         /* Parse message */
         if (msg != NULL)
         {
@@ -656,68 +338,42 @@ int main(int argc, char **argv)
         }
     } while (!terminate);
 
-    /* Free resources */
-    pipeline->changeStateNull();
-    pipeline->unref();
-    delete pipeline;
-    std::cout << __FUNCTION__ << std::endl;
-}
-
-/* This function will be called by the pad-added signal */
-static void pad_added_handler(GstElementPtr src, GstPadPtr new_pad, PipelineElementPtr data)
-{
-    GstPadLinkReturn ret;
-    GstCaps *new_pad_caps = NULL;
-    GstStructure *new_pad_struct = NULL;
-    const gchar *new_pad_type = NULL;
-
-    g_print("Received new pad '%s' from '%s':\n", GST_PAD_NAME(new_pad), GST_ELEMENT_NAME(src));
-
-    /* Check the new pad's type */
-    new_pad_caps = gst_pad_get_current_caps(new_pad);
-    new_pad_struct = gst_caps_get_structure(new_pad_caps, 0);
-    new_pad_type = gst_structure_get_name(new_pad_struct);
-    std::cout << "new_pad_type: " << new_pad_type << std::endl;
-    GstPad *sink_pad;
-    if (g_str_has_prefix(new_pad_type, "audio/x-raw"))
-    {
-        sink_pad = gst_element_get_static_pad(data->getElement("list_elements.0.audio_convert"), "sink");
-    }
-    else if (g_str_has_prefix(new_pad_type, "video/x-raw"))
+    if (headless.enabled)
     {
-        sink_pad = gst_element_get_static_pad(data->getElement("tee"), "tee");
+        report.stop();
     }
-    else
+    if (tracer)
     {
-        g_print("It has type '%s' which is not raw video or raw audio. Ignoring.\n", new_pad_type);
-        goto exit;
+        tracer->dump();
     }
-
-    /* If our converter is already linked, we have nothing to do here */
-    if (gst_pad_is_linked(sink_pad))
+    if (monitor_queues)
     {
-        g_print("We are already linked. Ignoring.\n");
-        goto exit;
+        monitor.stop();
+        monitor.printSummary();
     }
 
-    /* Attempt the link */
-    ret = gst_pad_link(new_pad, sink_pad);
-    if (GST_PAD_LINK_FAILED(ret))
+    /* Report how every branch kept up */
+    pipeline->printBranchStats();
+    if (ttff)
     {
-        g_printerr("Type is '%s' but link failed.\n", new_pad_type);
+        clock.report();
     }
-    else
+    if (!record_plugins.empty())
     {
-        g_print("Link succeeded (type '%s').\n", new_pad_type);
+        PluginSet::record(record_plugins);
     }
 
-exit:
-    /* Unreference the new pad's caps, if we got them */
-    if (new_pad_caps != NULL)
+    /* Free resources */
+    gst_object_unref(bus);
+    pipeline->changeStateNull();
+    pipeline->unref();
+    delete pipeline;
+    delete tracer;
+    std::cout << __FUNCTION__ << std::endl;
+
+    /* The report goes last so it is the last line of stdout */
+    if (headless.enabled)
     {
-        gst_caps_unref(new_pad_caps);
+        report.write("exercise-tutorial-7-oop", headless);
     }
-
-    /* Unreference the sink pad */
-    gst_object_unref(sink_pad);
 }
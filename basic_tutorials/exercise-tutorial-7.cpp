@@ -1,4 +1,13 @@
 #include "gst/gst.h"
+#include "audio-meter.hpp"
+#include "batch-extract.hpp"
+#include "headless.hpp"
+#include "pre-record.hpp"
+#include "queue-monitor.hpp"
+#include "record-sink.hpp"
+#include "segment-sink.hpp"
+#include "simd-scope.hpp"
+#include <cstring>
 #include <iostream>
 
 /* Structure to contain all our information, so we can pass it to callbacks */
@@ -10,8 +19,10 @@ typedef struct _CustomData
     GstElement *audio_convert, *audio_resample;
     GstElement *tee_audio;
     GstElement *audio_queue, *audio_sink;
-    GstElement *wavescope_queue, *wavescope, *wavescope_convert, *wavescope_sink;
+    GstElement *wavescope_queue, *wavescope, *wavescope_caps, *wavescope_convert, *wavescope_sink;
     GstElement *file_queue, *file_wavenc, *filesink;
+    GstElement *file_prerecord; /* Only with --prerecord */
+    GstElement *meter_queue, *meter_sink; /* Only with --meter */
 
     GstElement *tee_video;
     GstElement *filter_video_queue, *filter_video_convert1, *filter_video_filter, *filter_video_convert2,
@@ -21,18 +32,19 @@ typedef struct _CustomData
     _CustomData()
         : pipeline{nullptr}, source{nullptr}, audio_convert{nullptr}, audio_resample{nullptr}, tee_audio{nullptr},
           audio_queue{nullptr}, audio_sink{nullptr}, wavescope_queue{nullptr}, wavescope{nullptr},
-          wavescope_convert{nullptr}, wavescope_sink{nullptr}, file_queue{nullptr}, file_wavenc{nullptr},
-          filesink{nullptr}, tee_video{nullptr}, filter_video_queue{nullptr}, filter_video_convert1{nullptr},
-          filter_video_filter{nullptr}, filter_video_convert2{nullptr}, filter_video_sink{nullptr},
-          origin_video_queue{nullptr}, origin_video_convert{nullptr}, origin_video_sink{nullptr}
+          wavescope_caps{nullptr}, wavescope_convert{nullptr}, wavescope_sink{nullptr}, file_queue{nullptr},
+          file_wavenc{nullptr}, filesink{nullptr}, file_prerecord{nullptr}, meter_queue{nullptr}, meter_sink{nullptr},
+          tee_video{nullptr}, filter_video_queue{nullptr}, filter_video_convert1{nullptr}, filter_video_filter{nullptr},
+          filter_video_convert2{nullptr}, filter_video_sink{nullptr}, origin_video_queue{nullptr},
+          origin_video_convert{nullptr}, origin_video_sink{nullptr}
     {
     }
 
     gboolean checkValid(void)
     {
         return (gboolean)(pipeline && source && audio_convert && audio_resample && tee_audio && audio_queue &&
-                          audio_sink && wavescope_queue && wavescope && wavescope_convert && wavescope_sink &&
-                          file_queue && file_wavenc && filesink && tee_video && filter_video_queue &&
+                          audio_sink && wavescope_queue && wavescope && wavescope_caps && wavescope_convert &&
+                          wavescope_sink && file_queue && file_wavenc && filesink && tee_video && filter_video_queue &&
                           filter_video_convert1 && filter_video_filter && filter_video_convert2 && filter_video_sink &&
                           origin_video_queue && origin_video_convert && origin_video_sink);
     }
@@ -66,6 +78,11 @@ typedef struct _CustomData
 /* Handler for the pad-added signal */
 static void pad_added_handler(GstElement *src, GstPad *pad, CustomData *data);
 
+/* Prints one line per meter interval, from the streaming thread of the metering branch */
+static void print_meter_reading(const AudioMeter::Reading &reading);
+static void print_record_stats(GstElement *sink);
+static void print_segment_stats(GstElement *sink);
+
 int main(int argc, char **argv)
 {
     /* Define Elements */
@@ -80,25 +97,115 @@ int main(int argc, char **argv)
     GstPad *tee_file_pad, *queue_file_pad;
     GstPad *tee_filter_video_pad, *queue_filter_video_pad;
     GstPad *tee_origin_video_pad, *queue_origin_video_pad;
+    GstPad *tee_meter_pad = NULL;
 
     /* Initialize GStreamer */
     gst_init(&argc, &argv);
+    HeadlessOptions headless = HeadlessOptions::parse(argc, argv);
+    if (!headless.valid)
+    {
+        return -1;
+    }
+    HeadlessReport report;
+    ScopeOptions scope = ScopeOptions::parse(argc, argv);
+    RecordOptions record = RecordOptions::parse(argc, argv);
+    SegmentOptions segment = SegmentOptions::parse(argc, argv);
+
+    /* Options: --monitor-queues samples the five branch queues every --monitor-interval ms (50 by default) and
+     * prints their occupancy on exit, --monitor-csv FILE also writes the time series. --batch DIR|MANIFEST runs
+     * only the file branch, unsynced, over every input on --workers N threads (one per core by default) and writes
+     * the WAV files into --batch-out DIR. --meter adds a metering branch to tee_audio that prints the peak, RMS and
+     * clipping of every channel each --meter-interval ms of audio (1000 by default). --prerecord SECONDS holds that
+     * much audio in front of wavenc instead of recording it, and writes it out followed by the rest of the stream
+     * --prerecord-trigger SECONDS after the pipeline starts playing (twice the held length by default). */
+    gboolean monitor_queues = FALSE;
+    guint monitor_interval = 50;
+    std::string monitor_csv;
+    std::string batch;
+    std::string batch_out = "batch-wav";
+    guint workers = 0;
+    gboolean meter = FALSE;
+    guint meter_interval = 1000;
+    guint prerecord_seconds = 0;
+    guint prerecord_trigger = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--monitor-queues") == 0)
+        {
+            monitor_queues = TRUE;
+        }
+        else if (strcmp(argv[i], "--monitor-interval") == 0 && i + 1 < argc)
+        {
+            monitor_interval = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--monitor-csv") == 0 && i + 1 < argc)
+        {
+            monitor_csv = argv[++i];
+            monitor_queues = TRUE;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batch = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch-out") == 0 && i + 1 < argc)
+        {
+            batch_out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            workers = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--meter") == 0)
+        {
+            meter = TRUE;
+        }
+        else if (strcmp(argv[i], "--meter-interval") == 0 && i + 1 < argc)
+        {
+            meter_interval = (guint)std::stoul(argv[++i]);
+            meter = TRUE;
+        }
+        else if (strcmp(argv[i], "--prerecord") == 0 && i + 1 < argc)
+        {
+            prerecord_seconds = (guint)std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--prerecord-trigger") == 0 && i + 1 < argc)
+        {
+            prerecord_trigger = (guint)std::stoul(argv[++i]);
+        }
+    }
+
+    /* Batch extraction has no display, no audio device and no hardcoded stream: nothing below is needed */
+    if (!batch.empty())
+    {
+        std::vector<std::string> uris = BatchExtractor::inputs(batch);
+        if (uris.empty())
+        {
+            g_printerr("No inputs in %s.\n", batch.c_str());
+            return -1;
+        }
+        BatchExtractor extractor(batch_out, workers, record);
+        return extractor.run(uris) == 0 ? 0 : -1;
+    }
+    QueueMonitor monitor;
+    AudioMeter audio_meter(meter_interval, print_meter_reading);
 
-    /* Create the elements */
-    data.source = gst_element_factory_make("uridecodebin", "source");
+    /* Create the elements. Headless runs decode a local file, or use test sources when none is given. */
+    data.source =
+        headless.makeDecodeSource("source", "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm");
 
     data.audio_convert = gst_element_factory_make("audioconvert", "audio_convert");
     data.audio_resample = gst_element_factory_make("audioresample", "audio_resample");
     data.tee_audio = gst_element_factory_make("tee", "tee_audio");
     data.audio_queue = gst_element_factory_make("queue", "audio_queue");
-    data.audio_sink = gst_element_factory_make("autoaudiosink", "audio_sink");
+    data.audio_sink = headless.makeSink("autoaudiosink", "audio_sink");
     data.wavescope_queue = gst_element_factory_make("queue", "wavescope_queue");
-    data.wavescope = gst_element_factory_make("wavescope", "wavescope");
+    data.wavescope = scope.makeScope("wavescope");
+    data.wavescope_caps = scope.makeCapsFilter("wavescope_caps");
     data.wavescope_convert = gst_element_factory_make("videoconvert", "wavescope_convert");
-    data.wavescope_sink = gst_element_factory_make("autovideosink", "wavescope_sink");
+    data.wavescope_sink = headless.makeSink("autovideosink", "wavescope_sink");
     data.file_queue = gst_element_factory_make("queue", "file_queue");
-    data.file_wavenc = gst_element_factory_make("wavenc", "file_wavenc");
-    data.filesink = gst_element_factory_make("filesink", "filesink");
+    data.file_wavenc = segment.makeEncoder("file_wavenc");
+    data.filesink = segment.enabled() ? segment.makeSink("filesink") : record.makeSink("filesink");
 
     data.tee_video = gst_element_factory_make("tee", "tee_video");
     data.filter_video_queue = gst_element_factory_make("queue", "filter_video_queue");
@@ -107,11 +214,11 @@ int main(int argc, char **argv)
     //"agingtv" | "dicetv" | "edgetv" | "optv" | "quarktv" | "radioactv" | "revtv" | "rippletv" | "shagadelictv" |
     //"streaktv" | "vertigotv" | "warptv";
     data.filter_video_convert2 = gst_element_factory_make("videoconvert", "filter_video_convert2");
-    data.filter_video_sink = gst_element_factory_make("autovideosink", "filter_video_sink");
+    data.filter_video_sink = headless.makeSink("autovideosink", "filter_video_sink");
 
     data.origin_video_queue = gst_element_factory_make("queue", "origin_video_queue");
     data.origin_video_convert = gst_element_factory_make("videoconvert", "origin_video_convert");
-    data.origin_video_sink = gst_element_factory_make("autovideosink", "origin_video_sink");
+    data.origin_video_sink = headless.makeSink("autovideosink", "origin_video_sink");
 
     /* Create the empty pipeline */
     data.pipeline = gst_pipeline_new("test-pipeline");
@@ -121,20 +228,36 @@ int main(int argc, char **argv)
         g_printerr("Not all elements could be created.\n");
         return -1;
     }
+    if (prerecord_seconds > 0)
+    {
+        PreRecord::registerElement();
+        data.file_prerecord = gst_element_factory_make(PreRecord::name, "file_prerecord");
+        if (!data.file_prerecord)
+        {
+            g_printerr("The pre-record stage could not be created.\n");
+            data.unref();
+            return -1;
+        }
+        g_object_set(data.file_prerecord, "seconds", prerecord_seconds, NULL);
+        gst_bin_add(GST_BIN(data.pipeline), data.file_prerecord);
+        prerecord_trigger = prerecord_trigger ? prerecord_trigger : 2 * prerecord_seconds;
+    }
 
     /* Build the pipeline. Note that we are NOT linking the source at this point. We will do it later. */
     gst_bin_add_many(GST_BIN(data.pipeline), data.source, data.audio_convert, data.audio_resample, data.tee_audio,
-                     data.audio_queue, data.audio_sink, data.wavescope_queue, data.wavescope, data.wavescope_convert,
-                     data.wavescope_sink, data.file_queue, data.file_wavenc, data.filesink, data.tee_video,
-                     data.filter_video_queue, data.filter_video_convert1, data.filter_video_filter,
+                     data.audio_queue, data.audio_sink, data.wavescope_queue, data.wavescope, data.wavescope_caps,
+                     data.wavescope_convert, data.wavescope_sink, data.file_queue, data.file_wavenc, data.filesink,
+                     data.tee_video, data.filter_video_queue, data.filter_video_convert1, data.filter_video_filter,
                      data.filter_video_convert2, data.filter_video_sink, data.origin_video_queue,
                      data.origin_video_convert, data.origin_video_sink, NULL);
 
     if (gst_element_link_many(data.audio_convert, data.audio_resample, data.tee_audio, NULL) != TRUE ||
         gst_element_link_many(data.audio_queue, data.audio_sink, NULL) != TRUE ||
-        gst_element_link_many(data.wavescope_queue, data.wavescope, data.wavescope_convert, data.wavescope_sink,
-                              NULL) != TRUE ||
-        gst_element_link_many(data.file_queue, data.file_wavenc, data.filesink, NULL) != TRUE ||
+        gst_element_link_many(data.wavescope_queue, data.wavescope, data.wavescope_caps, data.wavescope_convert,
+                              data.wavescope_sink, NULL) != TRUE ||
+        (data.file_prerecord && gst_element_link(data.file_queue, data.file_prerecord) != TRUE) ||
+        gst_element_link_many(data.file_prerecord ? data.file_prerecord : data.file_queue, data.file_wavenc,
+                              data.filesink, NULL) != TRUE ||
         gst_element_link_many(data.filter_video_queue, data.filter_video_convert1, data.filter_video_filter,
                               data.filter_video_convert2, data.filter_video_sink, NULL) != TRUE ||
         gst_element_link_many(data.origin_video_queue, data.origin_video_convert, data.origin_video_sink, NULL) != TRUE)
@@ -187,17 +310,74 @@ int main(int argc, char **argv)
     gst_object_unref(queue_filter_video_pad);
     gst_object_unref(queue_origin_video_pad);
 
-    /* Connect to the pad-added signal */
-    g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+    /* The metering branch is measured in place: the AudioMeter probes the sink pad of a fakesink behind a queue,
+     * which syncs so that the readings come as the audio is heard */
+    if (meter)
+    {
+        data.meter_queue = gst_element_factory_make("queue", "meter_queue");
+        data.meter_sink = gst_element_factory_make("fakesink", "meter_sink");
+        if (!data.meter_queue || !data.meter_sink)
+        {
+            g_printerr("Not all elements could be created.\n");
+            data.unref();
+            return -1;
+        }
+        g_object_set(data.meter_sink, "sync", !headless.enabled, NULL);
+        gst_bin_add_many(GST_BIN(data.pipeline), data.meter_queue, data.meter_sink, NULL);
+
+        tee_meter_pad = gst_element_get_request_pad(data.tee_audio, "src_%u");
+        GstPad *queue_meter_pad = gst_element_get_static_pad(data.meter_queue, "sink");
+        g_print("Obtained request pad %s for meter branch.\n", gst_pad_get_name(tee_meter_pad));
+        GstPadLinkReturn rm = gst_pad_link(tee_meter_pad, queue_meter_pad);
+        gst_object_unref(queue_meter_pad);
+        if (rm != GST_PAD_LINK_OK || gst_element_link(data.meter_queue, data.meter_sink) != TRUE)
+        {
+            g_printerr("Meter branch could not be linked.\n");
+            gst_object_unref(data.pipeline);
+            return -1;
+        }
+        audio_meter.attach(data.meter_sink);
+    }
 
-    /* Set the URI to play */
-    g_object_set(data.source, "uri", "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm", NULL);
+    /* Connect to the pad-added signal; the synthetic source has its pads already and is linked right away */
+    if (!link_static_source_pads(data.source, data.audio_convert, data.tee_video))
+    {
+        g_signal_connect(data.source, "pad-added", G_CALLBACK(pad_added_handler), &data);
+    }
 
-    /* Set the location to save audio file */
-    g_object_set(data.filesink, "location", "test.wav", NULL);
+    /* Set the location to save audio file; segments are named by --segment-location */
+    if (!segment.enabled())
+    {
+        g_object_set(data.filesink, "location", "test.wav", NULL);
+    }
 
-    /* Set the audio visualize style */
-    g_object_set(data.wavescope, "shader", 0, "style", 1, NULL);
+    /* Count what reaches the sinks when measuring */
+    if (headless.enabled)
+    {
+        report.watch(data.audio_sink);
+        report.watch(data.wavescope_sink);
+        report.watch(data.filesink);
+        report.watch(data.filter_video_sink);
+        report.watch(data.origin_video_sink);
+        report.start();
+    }
+    if (monitor_queues)
+    {
+        monitor.watch(data.audio_queue);
+        monitor.watch(data.wavescope_queue);
+        monitor.watch(data.file_queue);
+        monitor.watch(data.filter_video_queue);
+        monitor.watch(data.origin_video_queue);
+        if (meter)
+        {
+            monitor.watch(data.meter_queue);
+        }
+        if (!monitor_csv.empty())
+        {
+            monitor.writeCsv(monitor_csv);
+        }
+        monitor.start(monitor_interval);
+    }
 
     /* Start playing */
     ret = gst_element_set_state(data.pipeline, GST_STATE_PLAYING);
@@ -208,14 +388,21 @@ int main(int argc, char **argv)
         return -1;
     }
 
-    /* Listen to the bus */
+    /* Listen to the bus; with a pre-record stage, wake up every 100 ms to see whether it is time to trigger it */
     bus = gst_element_get_bus(data.pipeline);
+    gint64 trigger_at_us = g_get_monotonic_time() + (gint64)prerecord_trigger * G_USEC_PER_SEC;
+    GstClockTime timeout = data.file_prerecord ? 100 * GST_MSECOND : GST_CLOCK_TIME_NONE;
 
     do
     {
         msg = gst_bus_timed_pop_filtered(
-            bus, GST_CLOCK_TIME_NONE,
-            (GstMessageType)(GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+            bus, timeout, (GstMessageType)(GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        if (data.file_prerecord && timeout != GST_CLOCK_TIME_NONE && g_get_monotonic_time() >= trigger_at_us)
+        {
+            g_print("Writing the last %u s of audio to the file.\n", prerecord_seconds);
+            PreRecord::trigger(data.file_prerecord);
+            timeout = GST_CLOCK_TIME_NONE;
+        }
 
         /* Parse message */
         if (msg != NULL)
@@ -259,6 +446,17 @@ int main(int argc, char **argv)
         }
     } while (!terminate);
 
+    if (monitor_queues)
+    {
+        monitor.stop();
+        monitor.printSummary();
+    }
+    if (headless.enabled)
+    {
+        report.stop();
+        report.write("exercise-tutorial-7", headless);
+    }
+
     /* Release the request pads from the Tee, and unref them */
     gst_element_release_request_pad(data.tee_audio, tee_audio_pad);
     gst_element_release_request_pad(data.tee_audio, tee_wavescope_pad);
@@ -270,10 +468,25 @@ int main(int argc, char **argv)
     gst_object_unref(tee_file_pad);
     gst_object_unref(tee_filter_video_pad);
     gst_object_unref(tee_origin_video_pad);
+    if (tee_meter_pad)
+    {
+        gst_element_release_request_pad(data.tee_audio, tee_meter_pad);
+        gst_object_unref(tee_meter_pad);
+    }
 
     /* Free resources */
     gst_object_unref(bus);
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
+
+    /* The recordsink has closed its file by now, so the last sync is counted too */
+    if (segment.enabled())
+    {
+        print_segment_stats(data.filesink);
+    }
+    else if (record.enabled)
+    {
+        print_record_stats(data.filesink);
+    }
     data.unref();
 
     return 0;
@@ -337,3 +550,42 @@ exit:
     /* Unreference the sink pad */
     gst_object_unref(sink_pad);
 }
+
+static void print_meter_reading(const AudioMeter::Reading &reading)
+{
+    GString *line = g_string_new(NULL);
+    g_string_append_printf(line, "Meter %" GST_TIME_FORMAT, GST_TIME_ARGS(reading.pts));
+    for (std::size_t c = 0; c < reading.channels.size(); ++c)
+    {
+        const AudioMeter::Channel &channel = reading.channels[c];
+        g_string_append_printf(line, "  ch%zu peak %6.1f rms %6.1f dBFS clips %" G_GUINT64_FORMAT, c,
+                               AudioMeter::decibels(channel.peak), AudioMeter::decibels(channel.rms), channel.clips);
+    }
+    g_print("%s\n", line->str);
+    g_string_free(line, TRUE);
+}
+
+/* Writes made by the recordsink of the file branch, with the median and worst write times */
+static void print_record_stats(GstElement *sink)
+{
+    RecordSink::Stats stats = RecordSink::stats(sink);
+    if (stats.writes == 0)
+    {
+        return;
+    }
+    g_print("recordsink: %" G_GUINT64_FORMAT " writes, %.1f MB, %" G_GUINT64_FORMAT " syncs, %s, write p50 %"
+            G_GUINT64_FORMAT " us, max %" G_GUINT64_FORMAT " us\n",
+            stats.writes, stats.bytes / 1e6, stats.syncs, stats.direct ? "O_DIRECT" : "buffered",
+            stats.writePercentile(0.5), stats.write_us_max);
+}
+
+/* Files written by the wavsegmentsink of the file branch, whether any audio was lost and the worst cut */
+static void print_segment_stats(GstElement *sink)
+{
+    SegmentSink::Stats stats = SegmentSink::stats(sink);
+    g_print("wavsegmentsink: %" G_GUINT64_FORMAT " files, %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+            " frames written, %" G_GUINT64_FORMAT " input gaps (%" GST_TIME_FORMAT "), %" G_GUINT64_FORMAT
+            " stalls, write p50 %" G_GUINT64_FORMAT " us, worst cut %" G_GUINT64_FORMAT " us\n",
+            stats.segments, stats.frames_written, stats.frames_in, stats.discontinuities, GST_TIME_ARGS(stats.gaps),
+            stats.stalls, stats.render_us.percentile(0.5), stats.rotation_us.max);
+}
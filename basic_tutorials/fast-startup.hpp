@@ -0,0 +1,294 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Taken during static initialisation, before main() and gst_init(): the closest a tutorial can get to the start of
+ * its process without asking the kernel */
+inline const gint64 process_start_us = g_get_monotonic_time();
+
+/* The plugins one topology needs, as a plain list of plugin files. A normal run records the set with record() once
+ * the pipeline played, i.e. every plugin it actually loaded, including the decoders decodebin picked. A worker
+ * started with that set calls applyEnvironment() before gst_init(), so GStreamer starts from an empty private
+ * registry without scanning (or even stat-ing) the system plugin directories, and then load() opens exactly the
+ * recorded files, up front rather than on the first-frame path. Autoplugging (playbin, uridecodebin) only sees the
+ * recorded plugins, so record with the same kind of media the workers will get. */
+class PluginSet
+{
+  public:
+    /* The value of `option` (e.g. "--plugin-set"), read before gst_init() has seen the command line */
+    static std::string option(int argc, char **argv, const char *option)
+    {
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            if (strcmp(argv[i], option) == 0)
+            {
+                return argv[i + 1];
+            }
+        }
+        return "";
+    }
+
+    /* Call before gst_init(): no plugin directories, and a registry file of our own next to the set, so the system
+     * registry cache is neither read nor rewritten */
+    static void applyEnvironment(const std::string &path)
+    {
+        std::string registry = path + ".registry";
+        for (const char *name : {"GST_PLUGIN_SYSTEM_PATH_1_0", "GST_PLUGIN_PATH_1_0"})
+        {
+            g_setenv(name, "", TRUE);
+        }
+        g_setenv("GST_REGISTRY_1_0", registry.c_str(), TRUE);
+        g_setenv("GST_REGISTRY_FORK", "no", TRUE);
+    }
+
+    /* Call after gst_init(). Returns the number of plugins that could not be loaded. */
+    static guint load(const std::string &path, gboolean verbose = TRUE)
+    {
+        gchar *contents = NULL;
+        if (!g_file_get_contents(path.c_str(), &contents, NULL, NULL))
+        {
+            g_printerr("Plugin set %s could not be read.\n", path.c_str());
+            return 1;
+        }
+        gchar **files = g_strsplit(contents, "\n", -1);
+        g_free(contents);
+
+        gint64 start_us = g_get_monotonic_time();
+        guint loaded = 0;
+        guint failed = 0;
+        for (gchar **file = files; *file; ++file)
+        {
+            if (!**file)
+            {
+                continue;
+            }
+            GError *err = NULL;
+            GstPlugin *plugin = gst_plugin_load_file(*file, &err);
+            if (!plugin)
+            {
+                g_printerr("Plugin %s could not be loaded: %s\n", *file, err ? err->message : "unknown error");
+                g_clear_error(&err);
+                ++failed;
+                continue;
+            }
+            gst_object_unref(plugin);
+            ++loaded;
+        }
+        g_strfreev(files);
+        if (verbose)
+        {
+            g_print("Loaded %u plugins in %.2f ms.\n", loaded, (g_get_monotonic_time() - start_us) / 1e3);
+        }
+        return failed;
+    }
+
+    /* Write the file of every plugin loaded so far, one per line. Statically linked plugins have no file and
+     * are always there anyway. */
+    static gboolean record(const std::string &path)
+    {
+        std::string set;
+        guint count = 0;
+        GList *plugins = gst_registry_get_plugin_list(gst_registry_get());
+        for (GList *l = plugins; l; l = l->next)
+        {
+            GstPlugin *plugin = (GstPlugin *)l->data;
+            const gchar *file = gst_plugin_get_filename(plugin);
+            if (gst_plugin_is_loaded(plugin) && file)
+            {
+                set += file;
+                set += '\n';
+                ++count;
+            }
+        }
+        gst_plugin_list_free(plugins);
+
+        if (!g_file_set_contents(path.c_str(), set.c_str(), (gssize)set.size(), NULL))
+        {
+            g_printerr("Plugin set could not be written to %s.\n", path.c_str());
+            return FALSE;
+        }
+        g_print("Recorded %u plugins to %s.\n", count, path.c_str());
+        return TRUE;
+    }
+};
+
+/* Time to first frame: the wall time from process start to the first buffer reaching each sink of a pipeline.
+ * attach() finds the sinks now and as they are created (playbin and decodebin only add theirs while prerolling);
+ * mark() adds the application's own milestones, e.g. after gst_init() and when PLAYING was requested. A sink
+ * inside a sink that is already listed (the real sink of autovideosink) is not listed twice; a bin containing a sink
+ * carries the sink flag too, but only sink bins below the attached pipeline count as listed sinks. */
+class FirstFrameClock
+{
+  public:
+    ~FirstFrameClock()
+    {
+        if (bin && deep_added_id)
+        {
+            g_signal_handler_disconnect(bin, deep_added_id);
+        }
+        for (const WatchedSink &watched : watched_sinks)
+        {
+            g_signal_handler_disconnect(watched.element, watched.pad_added_id);
+            gst_object_unref(watched.element);
+        }
+        if (bin)
+        {
+            gst_object_unref(bin);
+        }
+    }
+
+    void attach(GstElement *pipeline)
+    {
+        bin = GST_ELEMENT(gst_object_ref(pipeline));
+        GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+        gst_iterator_foreach(it, watchIterated, this);
+        gst_iterator_free(it);
+        deep_added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(onDeepElementAdded), this);
+    }
+
+    void mark(const char *milestone)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        milestones.push_back(Milestone{milestone, g_get_monotonic_time()});
+    }
+
+    struct SinkTime
+    {
+        std::string name;
+        gint64 first_buffer_us; /* Monotonic, 0 when no buffer arrived yet */
+    };
+
+    /* The sinks found so far and when their first buffer arrived */
+    std::vector<SinkTime> firstBuffers(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<SinkTime> times;
+        for (const SinkClock &sink : sinks)
+        {
+            times.push_back(SinkTime{sink.name, sink.first_buffer_us.load(std::memory_order_relaxed)});
+        }
+        return times;
+    }
+
+    /* Milestones and the first buffer of every sink, in ms since process start */
+    void report(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        g_print("%-40s %12s\n", "time to first frame", "ms");
+        for (const Milestone &milestone : milestones)
+        {
+            g_print("%-40s %12.2f\n", milestone.name.c_str(), (milestone.at_us - process_start_us) / 1e3);
+        }
+        for (const SinkClock &sink : sinks)
+        {
+            gint64 first = sink.first_buffer_us.load(std::memory_order_relaxed);
+            std::string label = "first buffer at " + sink.name;
+            if (first)
+            {
+                g_print("%-40s %12.2f\n", label.c_str(), (first - process_start_us) / 1e3);
+            }
+            else
+            {
+                g_print("%-40s %12s\n", label.c_str(), "-");
+            }
+        }
+    }
+
+  private:
+    struct Milestone
+    {
+        std::string name;
+        gint64 at_us;
+    };
+
+    struct SinkClock
+    {
+        std::string name;
+        std::atomic<gint64> first_buffer_us{0};
+    };
+
+    /* A listed sink, held so that its pointer stays its own and its pad-added handler can be disconnected */
+    struct WatchedSink
+    {
+        GstElement *element;
+        gulong pad_added_id;
+    };
+
+    void watch(GstElement *element)
+    {
+        if (!GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+        {
+            return;
+        }
+        GstObject *parent = gst_object_get_parent(GST_OBJECT(element));
+        std::lock_guard<std::mutex> guard(lock);
+        gboolean inner = FALSE;
+        for (const WatchedSink &watched : watched_sinks)
+        {
+            inner |= (gboolean)(parent == GST_OBJECT(watched.element));
+        }
+        if (parent)
+        {
+            gst_object_unref(parent);
+        }
+        if (inner)
+        {
+            return;
+        }
+
+        /* Sink bins such as playsink only get their sink pads once something links to them */
+        SinkClock &sink = sinks.emplace_back();
+        sink.name = GST_ELEMENT_NAME(element);
+        gst_element_foreach_sink_pad(element, probePad, &sink);
+        gulong pad_added_id = g_signal_connect(element, "pad-added", G_CALLBACK(onPadAdded), &sink);
+        watched_sinks.push_back(WatchedSink{GST_ELEMENT(gst_object_ref(element)), pad_added_id});
+    }
+
+    static void onPadAdded(GstElement *element, GstPad *pad, SinkClock *sink)
+    {
+        if (GST_PAD_IS_SINK(pad))
+        {
+            probePad(element, pad, sink);
+        }
+    }
+
+    static gboolean probePad(GstElement *element, GstPad *pad, gpointer user_data)
+    {
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          firstBuffer, user_data, NULL);
+        return TRUE;
+    }
+
+    static GstPadProbeReturn firstBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        SinkClock *sink = static_cast<SinkClock *>(user_data);
+        gint64 unset = 0;
+        sink->first_buffer_us.compare_exchange_strong(unset, g_get_monotonic_time(), std::memory_order_relaxed);
+        return GST_PAD_PROBE_REMOVE;
+    }
+
+    static void watchIterated(const GValue *value, gpointer user_data)
+    {
+        static_cast<FirstFrameClock *>(user_data)->watch(GST_ELEMENT(g_value_get_object(value)));
+    }
+
+    static void onDeepElementAdded(GstBin *pipeline, GstBin *sub_bin, GstElement *element, FirstFrameClock *clock)
+    {
+        clock->watch(element);
+    }
+
+    GstElement *bin = nullptr;
+    gulong deep_added_id = 0;
+    std::mutex lock;
+    std::vector<Milestone> milestones;
+    std::deque<SinkClock> sinks;
+    std::vector<WatchedSink> watched_sinks;
+};
+
+using FirstFrameClockPtr = FirstFrameClock *;
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "pipeline-element.hpp"
+#include <functional>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <thread>
+
+/* A read-only view of one buffer handed to a tap callback. `data` points into the mapped GstBuffer itself, nothing
+ * is copied, and it is only valid until the callback returns; take a ref on `buffer` to keep the frame longer. */
+struct FrameView
+{
+    const guint8 *data;
+    gsize size;
+    GstClockTime pts;
+    GstClockTime duration;
+    GstCaps *caps;
+    GstBuffer *buffer;
+    const GstVideoInfo *video_info; /* Geometry and strides of a video frame, nullptr for audio */
+};
+
+using FrameCallback = std::function<void(const FrameView &)>;
+
+struct VideoTapSlots
+{
+    enum Slot : std::size_t
+    {
+        tap_queue,
+        tap_sink,
+        count
+    };
+    static constexpr std::array<std::string_view, count> names{"tap_queue", "tap_sink"};
+    static constexpr std::string_view media{"video"};
+};
+
+struct AudioTapSlots
+{
+    enum Slot : std::size_t
+    {
+        tap_queue,
+        tap_sink,
+        count
+    };
+    static constexpr std::array<std::string_view, count> names{"tap_queue", "tap_sink"};
+    static constexpr std::string_view media{"audio"};
+};
+
+/* A tee branch that ends in an appsink and hands every buffer to a C++ callback. It is added like any other
+ * branch, with addBranch() before build() or attachBranch() while playing.
+ *
+ * The callback runs on a consumer thread owned by the tap, not on the streaming thread, so a slow callback never
+ * blocks the tee. At most `max_in_flight` buffers wait in the appsink; when the callback falls behind, the appsink
+ * drops the oldest one, and the one-buffer queue in front of it leaks, so the callback always sees the most recent
+ * frames. dropped() counts both. */
+template <typename Slots> class AppSinkTap : public SlotElement<Slots>
+{
+    using SlotElement<Slots>::slots;
+
+  public:
+    using Slot = typename Slots::Slot;
+    static constexpr Slot tap_queue = Slots::tap_queue;
+    static constexpr Slot tap_sink = Slots::tap_sink;
+
+    AppSinkTap(FrameCallback callback, guint max_in_flight = 4)
+        : callback{std::move(callback)}, max_in_flight{MAX(max_in_flight, 1u)}
+    {
+    }
+
+    ~AppSinkTap()
+    {
+        stop();
+        if (sink)
+        {
+            gst_object_unref(sink);
+        }
+        gst_caps_replace(&last_caps, nullptr);
+    }
+
+    gboolean checkValid(void) override
+    {
+        return (gboolean)(slots[tap_queue] && slots[tap_sink]);
+    }
+
+    void gstElementFactoryMake(void) override
+    {
+        this->make(tap_queue, "queue");
+        this->make(tap_sink, "appsink");
+        if (slots[tap_queue])
+        {
+            /* The queue only decouples the tee from the appsink; the bound that matters is the appsink's. Buffers
+             * are counted as they enter it, so that what it leaks counts as dropped too. */
+            QueueLimits::leakyBranch(1).apply(slots[tap_queue]);
+            GstPadPtr queue_pad = gst_element_get_static_pad(slots[tap_queue], "sink");
+            gst_pad_add_probe(queue_pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                              BranchStats::inProbe, &stats, NULL);
+            gst_object_unref(queue_pad);
+        }
+        if (!slots[tap_sink])
+        {
+            return;
+        }
+
+        g_object_set(slots[tap_sink], "max-buffers", max_in_flight, "drop", TRUE, "sync", FALSE, "emit-signals", FALSE,
+                     "enable-last-sample", FALSE, NULL);
+        GstAppSinkCallbacks callbacks = {};
+        callbacks.eos = onEos;
+        callbacks.new_sample = onNewSample;
+        gst_app_sink_set_callbacks(GST_APP_SINK(slots[tap_sink]), &callbacks, this, NULL);
+
+        /* The pipeline drops its reference when the branch is detached; ours keeps the appsink alive until the
+         * consumer thread has stopped pulling from it */
+        sink = GST_APP_SINK(gst_object_ref(slots[tap_sink]));
+        consumer = std::thread(&AppSinkTap::consume, this);
+    }
+
+    gboolean linkManyElement(void) override
+    {
+        return gst_element_link(slots[tap_queue], slots[tap_sink]);
+    }
+
+    /* Stop the consumer thread and deliver what is still waiting in the appsink. Call after EOS for exact counts. */
+    void stop(void)
+    {
+        if (!consumer.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = TRUE;
+            cond.notify_all();
+        }
+        consumer.join();
+        drain();
+    }
+
+    guint64 delivered(void) const
+    {
+        return stats.buffers_out.load(std::memory_order_relaxed);
+    }
+
+    /* Buffers that entered the branch but never made it to the callback: leaked by the queue or dropped by the
+     * appsink. Exact once stop() returned; while running it also counts the buffer in the queue and the up to
+     * `max_in_flight` still waiting in the appsink. */
+    guint64 dropped(void) const
+    {
+        guint64 in = stats.buffers_in.load(std::memory_order_relaxed);
+        guint64 out = delivered();
+        return in > out ? in - out : 0;
+    }
+
+    double framesPerSecond(void) const
+    {
+        return stats.buffersPerSecond();
+    }
+
+    gboolean eos(void) const
+    {
+        return got_eos.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static GstFlowReturn onNewSample(GstAppSink *appsink, gpointer user_data)
+    {
+        /* Only wake the consumer; the sample stays in the appsink, which enforces the in-flight bound */
+        static_cast<AppSinkTap *>(user_data)->wake();
+        return GST_FLOW_OK;
+    }
+
+    static void onEos(GstAppSink *appsink, gpointer user_data)
+    {
+        AppSinkTap *tap = static_cast<AppSinkTap *>(user_data);
+        tap->got_eos.store(TRUE, std::memory_order_relaxed);
+        tap->wake();
+    }
+
+    void wake(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending = TRUE;
+        cond.notify_one();
+    }
+
+    void consume(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!stopping)
+        {
+            cond.wait(guard, [this] { return pending || stopping; });
+            pending = FALSE;
+            guard.unlock();
+            drain();
+            guard.lock();
+        }
+    }
+
+    void drain(void)
+    {
+        while (GstSample *sample = gst_app_sink_try_pull_sample(sink, 0))
+        {
+            deliver(sample);
+            gst_sample_unref(sample);
+        }
+    }
+
+    void deliver(GstSample *sample)
+    {
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        GstCaps *caps = gst_sample_get_caps(sample);
+        if (!buffer)
+        {
+            return;
+        }
+
+        /* Caps change rarely; parse the video geometry only when they do */
+        if (caps != last_caps)
+        {
+            gst_caps_replace(&last_caps, caps);
+            has_video_info = Slots::media == "video" && caps && gst_video_info_from_caps(&video_info, caps);
+        }
+
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            return;
+        }
+        FrameView view{map.data, map.size, GST_BUFFER_PTS(buffer), GST_BUFFER_DURATION(buffer), caps, buffer,
+                       has_video_info ? &video_info : nullptr};
+        callback(view);
+        gst_buffer_unmap(buffer, &map);
+
+        gint64 now = g_get_monotonic_time();
+        gint64 unset = 0;
+        stats.first_out_us.compare_exchange_strong(unset, now, std::memory_order_relaxed);
+        stats.last_out_us.store(now, std::memory_order_relaxed);
+        stats.buffers_out.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    FrameCallback callback;
+    guint max_in_flight;
+    GstAppSink *sink = nullptr;
+    std::thread consumer;
+    std::mutex lock;
+    std::condition_variable cond;
+    gboolean pending = FALSE;
+    gboolean stopping = FALSE;
+    std::atomic<gboolean> got_eos{FALSE};
+    BranchStats stats;
+    GstCaps *last_caps = nullptr;
+    GstVideoInfo video_info;
+    gboolean has_video_info = FALSE;
+};
+
+using VideoFrameTap = AppSinkTap<VideoTapSlots>;
+using VideoFrameTapPtr = VideoFrameTap *;
+using AudioFrameTap = AppSinkTap<AudioTapSlots>;
+using AudioFrameTapPtr = AudioFrameTap *;
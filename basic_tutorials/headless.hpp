@@ -0,0 +1,318 @@
+#pragma once
+
+#include "gst/gst.h"
+#include "mmap-source.hpp"
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <sys/resource.h>
+
+/* Command line switches shared by the tutorials that can run without a display or an audio device:
+ *
+ *     --headless        fakesinks with sync=false instead of autovideosink/autoaudiosink, and a JSON report
+ *     --uri FILE|URI    decode this local file instead of the tutorial stream (or the synthetic source)
+ *     --mmap            read local files with mmapfilesrc instead of filesrc
+ *     --num-buffers N   length of the synthetic sources, 300 by default
+ *     --json FILE       write the report to FILE instead of the last line of stdout
+ *
+ * Without --headless the tutorials behave as before. */
+struct HeadlessOptions
+{
+    gboolean enabled = FALSE;
+    std::string uri;
+    gboolean mmap = FALSE;
+    gint num_buffers = 300;
+    std::string json_path;
+    gboolean valid = TRUE; /* FALSE when --uri names a file that has no URI; the tutorial must not run then */
+
+    static HeadlessOptions parse(int argc, char **argv)
+    {
+        HeadlessOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "--headless") == 0)
+            {
+                options.enabled = TRUE;
+            }
+            else if (strcmp(argv[i], "--uri") == 0 && i + 1 < argc)
+            {
+                options.uri = argv[++i];
+            }
+            else if (strcmp(argv[i], "--mmap") == 0)
+            {
+                options.mmap = TRUE;
+            }
+            else if (strcmp(argv[i], "--num-buffers") == 0 && i + 1 < argc)
+            {
+                options.num_buffers = std::stoi(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            {
+                options.json_path = argv[++i];
+            }
+        }
+        if (!options.uri.empty() && options.uri.find("://") == std::string::npos)
+        {
+            /* Unlike g_filename_to_uri(), this takes relative paths too */
+            GError *err = NULL;
+            gchar *file_uri = gst_filename_to_uri(options.uri.c_str(), &err);
+            if (!file_uri)
+            {
+                g_printerr("--uri %s is not a usable file: %s\n", options.uri.c_str(),
+                           err ? err->message : "unknown error");
+                options.valid = FALSE;
+            }
+            options.uri = file_uri ? file_uri : "";
+            g_free(file_uri);
+            g_clear_error(&err);
+        }
+        return options;
+    }
+
+    /* The sink the tutorial asks for, or a fakesink that runs as fast as data arrives when headless */
+    GstElement *makeSink(const gchar *factory, const gchar *name) const
+    {
+        if (!enabled)
+        {
+            return gst_element_factory_make(factory, name);
+        }
+        GstElement *sink = gst_element_factory_make("fakesink", name);
+        if (sink)
+        {
+            g_object_set(sink, "sync", FALSE, NULL);
+        }
+        return sink;
+    }
+
+    const gchar *sinkFactory(const gchar *factory) const
+    {
+        return enabled ? "fakesink" : factory;
+    }
+
+    /* Bound a synthetic source that would otherwise run forever */
+    void limitSource(GstElement *source) const
+    {
+        if (enabled && num_buffers >= 0)
+        {
+            g_object_set(source, "num-buffers", num_buffers, NULL);
+        }
+    }
+
+    /* Headless runs of a decoding tutorial use the synthetic source unless a local file was given */
+    gboolean synthetic(void) const
+    {
+        return enabled && uri.empty();
+    }
+
+    /* Audio and video test sources shaped like the 480p tutorial stream, one audio buffer per video frame */
+    std::string syntheticDescription(void) const
+    {
+        std::string limit = num_buffers >= 0 ? " num-buffers=" + std::to_string(num_buffers) : "";
+        return "videotestsrc" + limit + " ! video/x-raw,width=854,height=480,framerate=30/1 audiotestsrc" + limit +
+               " samplesperbuffer=1470 ! audio/x-raw,rate=44100,channels=2";
+    }
+
+    /* uridecodebin for `fallback_uri` (or --uri), or the synthetic bin with one always pad per stream */
+    GstElement *makeDecodeSource(const gchar *name, const gchar *fallback_uri) const
+    {
+        if (!synthetic())
+        {
+            MmapSource::prefer(mmap);
+            GstElement *source = gst_element_factory_make("uridecodebin", name);
+            if (source)
+            {
+                g_object_set(source, "uri", uri.empty() ? fallback_uri : uri.c_str(), NULL);
+            }
+            return source;
+        }
+
+        GError *err = NULL;
+        GstElement *source = gst_parse_bin_from_description(syntheticDescription().c_str(), TRUE, &err);
+        if (err)
+        {
+            g_printerr("Synthetic source could not be created: %s\n", err->message);
+            g_clear_error(&err);
+        }
+        if (source)
+        {
+            gst_object_set_name(GST_OBJECT(source), name);
+        }
+        return source;
+    }
+};
+
+struct SourcePadTargets
+{
+    GstElement *audio;
+    GstElement *video;
+    guint linked;
+    gboolean ok;
+};
+
+inline gboolean link_source_pad(GstElement *source, GstPad *pad, gpointer user_data)
+{
+    SourcePadTargets *targets = (SourcePadTargets *)user_data;
+    GstCaps *caps = gst_pad_query_caps(pad, NULL);
+    gboolean audio = !gst_caps_is_any(caps) && !gst_caps_is_empty(caps) &&
+                     g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "audio/");
+    gst_caps_unref(caps);
+
+    GstPad *sink_pad = gst_element_get_static_pad(audio ? targets->audio : targets->video, "sink");
+    targets->ok &= (gboolean)(gst_pad_link(pad, sink_pad) == GST_PAD_LINK_OK);
+    gst_object_unref(sink_pad);
+    ++targets->linked;
+    return TRUE;
+}
+
+/* Link the always pads of a synthetic source to the elements the pad-added handler would use. Returns FALSE when
+ * the source has no always pads, i.e. it is a decodebin and pad-added must be connected instead. */
+inline gboolean link_static_source_pads(GstElement *source, GstElement *audio_target, GstElement *video_target)
+{
+    SourcePadTargets targets{audio_target, video_target, 0, TRUE};
+    gst_element_foreach_src_pad(source, link_source_pad, &targets);
+    if (targets.linked > 0 && !targets.ok)
+    {
+        g_printerr("Synthetic source could not be linked.\n");
+    }
+    return (gboolean)(targets.linked > 0);
+}
+
+/* Counts the buffers reaching each watched sink and the CPU time of the process between start() and stop(), and
+ * prints them as one JSON object:
+ *
+ *     {"topology": "...", "source": "synthetic", "wall_s": ..., "cpu_s": ..., "cpu_user_s": ..., "cpu_sys_s": ...,
+ *      "cpu_percent": ..., "frames_per_s": ..., "buffers_per_s": ..., "sinks": [{"name": ..., "media": ...,
+ *      "buffers": ..., "buffers_per_s": ...}, ...]}
+ *
+ * frames_per_s is the rate of the fastest video sink, buffers_per_s the rate summed over every sink. */
+class HeadlessReport
+{
+  public:
+    ~HeadlessReport()
+    {
+        for (SinkCount &sink : sinks)
+        {
+            gst_object_unref(sink.pad);
+        }
+    }
+
+    void watch(GstElement *sink)
+    {
+        GstPad *pad = gst_element_get_static_pad(sink, "sink");
+        if (!pad)
+        {
+            return;
+        }
+        sinks.emplace_back();
+        SinkCount &count = sinks.back();
+        count.name = GST_ELEMENT_NAME(sink);
+        count.pad = pad;
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          countProbe, &count, NULL);
+    }
+
+    void start(void)
+    {
+        getrusage(RUSAGE_SELF, &usage_start);
+        start_us = g_get_monotonic_time();
+    }
+
+    /* Call on EOS, before the pipeline goes to NULL, so the negotiated caps tell the media of each sink */
+    void stop(void)
+    {
+        wall_s = (g_get_monotonic_time() - start_us) / 1e6;
+        getrusage(RUSAGE_SELF, &usage_stop);
+        for (SinkCount &sink : sinks)
+        {
+            GstCaps *caps = gst_pad_get_current_caps(sink.pad);
+            const gchar *type = caps ? gst_structure_get_name(gst_caps_get_structure(caps, 0)) : "";
+            sink.media = g_str_has_prefix(type, "video/") ? "video" : g_str_has_prefix(type, "audio/") ? "audio" : "";
+            if (caps)
+            {
+                gst_caps_unref(caps);
+            }
+        }
+    }
+
+    std::string json(const char *topology, const HeadlessOptions &options) const
+    {
+        double user_s = seconds(usage_stop.ru_utime) - seconds(usage_start.ru_utime);
+        double sys_s = seconds(usage_stop.ru_stime) - seconds(usage_start.ru_stime);
+        double frames_per_s = 0.0;
+        double buffers_per_s = 0.0;
+        std::string sink_list;
+        for (const SinkCount &sink : sinks)
+        {
+            guint64 buffers = sink.buffers.load(std::memory_order_relaxed);
+            double rate = wall_s > 0 ? buffers / wall_s : 0.0;
+            buffers_per_s += rate;
+            if (sink.media == "video")
+            {
+                frames_per_s = MAX(frames_per_s, rate);
+            }
+            gchar *entry = g_strdup_printf("%s{\"name\": \"%s\", \"media\": \"%s\", \"buffers\": %" G_GUINT64_FORMAT
+                                           ", \"buffers_per_s\": %.1f}",
+                                           sink_list.empty() ? "" : ", ", sink.name.c_str(), sink.media.c_str(),
+                                           buffers, rate);
+            sink_list += entry;
+            g_free(entry);
+        }
+
+        gchar *head = g_strdup_printf("{\"topology\": \"%s\", \"source\": \"%s\", \"wall_s\": %.3f, \"cpu_s\": %.3f, "
+                                      "\"cpu_user_s\": %.3f, \"cpu_sys_s\": %.3f, \"cpu_percent\": %.1f, "
+                                      "\"frames_per_s\": %.1f, \"buffers_per_s\": %.1f, \"sinks\": [",
+                                      topology, options.synthetic() ? "synthetic" : "uri", wall_s, user_s + sys_s,
+                                      user_s, sys_s, wall_s > 0 ? (user_s + sys_s) * 100.0 / wall_s : 0.0,
+                                      frames_per_s, buffers_per_s);
+        std::string result = head;
+        g_free(head);
+        return result + sink_list + "]}";
+    }
+
+    /* Print the report as the last line of stdout, or write it to --json FILE */
+    void write(const char *topology, const HeadlessOptions &options) const
+    {
+        std::string report = json(topology, options);
+        if (options.json_path.empty())
+        {
+            g_print("%s\n", report.c_str());
+        }
+        else if (!g_file_set_contents(options.json_path.c_str(), report.c_str(), (gssize)report.size(), NULL))
+        {
+            g_printerr("Report could not be written to %s.\n", options.json_path.c_str());
+        }
+    }
+
+  private:
+    struct SinkCount
+    {
+        std::string name;
+        std::string media;
+        GstPad *pad = nullptr;
+        std::atomic<guint64> buffers{0};
+    };
+
+    static GstPadProbeReturn countProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        SinkCount *sink = static_cast<SinkCount *>(user_data);
+        guint64 n = 1;
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+        {
+            n = gst_buffer_list_length(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+        }
+        sink->buffers.fetch_add(n, std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+
+    static double seconds(const struct timeval &tv)
+    {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    std::deque<SinkCount> sinks;
+    gint64 start_us = 0;
+    double wall_s = 0.0;
+    struct rusage usage_start = {};
+    struct rusage usage_stop = {};
+};
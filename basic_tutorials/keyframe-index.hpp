@@ -0,0 +1,636 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/* Where the keyframes of one media file are, in time and in bytes, learnt once and kept next to the file:
+ *
+ *     KeyframeIndex index(uri);
+ *     if (!index.load())
+ *         index.scan();             (or attach(playbin) and let playback fill it in)
+ *     index.seek(playbin, 30 * GST_SECOND, FALSE);
+ *     index.save();
+ *
+ * The index learns from the demuxer: every video buffer without DELTA_UNIT is a keyframe, and the byte offset it is
+ * recorded with is the last range the source handed to the demuxer before it came out. Demuxers reading a local file
+ * in pull mode read a frame just before pushing it, so that is the offset of the frame itself; behind a push source
+ * (http) it is the start of the chunk that held it. scan() demuxes the whole file through parsebin without decoding;
+ * attach() learns from a pipeline that plays it, one stretch at a time: a flush or a new segment ends what is known
+ * to be contiguous, so only the spans that really played answer lookups.
+ *
+ * A key-unit seek the index can answer is resolved here rather than by the demuxer: it becomes an accurate seek to
+ * the exact keyframe before the target, so the demuxer has no keyframe to find and the decoder nothing to drop. An
+ * accurate seek is left as it is, since the demuxer already starts it from that keyframe; all the index adds is that
+ * the page cache is first asked for the bytes at the keyframe's offset, as for a key-unit seek, so the demuxer's first
+ * reads after the flush do not wait on the disk. Seeks it cannot answer fall through to the flags the tutorials used
+ * before.
+ *
+ * The file is <media>.keyframes, or one named after the URI in the user cache directory when the media is remote or
+ * its directory is read-only. A local file's size and modification time are stored with it, and an index whose file
+ * changed since is not loaded. Probes and signals point at the index, so it must outlive the pipelines attached to it
+ * (detach() ends learning early). */
+class KeyframeIndex
+{
+  public:
+    struct Keyframe
+    {
+        GstClockTime pts = GST_CLOCK_TIME_NONE;
+        guint64 offset = 0; /* Bytes into the file */
+    };
+
+    struct Stats
+    {
+        guint64 seeks = 0;
+        guint64 resolved = 0; /* Seeks the index answered */
+    };
+
+    /* `location` is a URI or a local path */
+    explicit KeyframeIndex(const std::string &location) : uri{toUri(location)}
+    {
+        gchar *filename = g_filename_from_uri(uri.c_str(), NULL, NULL);
+        if (filename)
+        {
+            path = filename;
+            g_free(filename);
+        }
+    }
+
+    ~KeyframeIndex()
+    {
+        detach();
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    KeyframeIndex(const KeyframeIndex &) = delete;
+    KeyframeIndex &operator=(const KeyframeIndex &) = delete;
+
+    const std::string &getUri(void) const
+    {
+        return uri;
+    }
+
+    /* Read the stored index, if there is one for this very file. Returns FALSE when there is none or it is stale. */
+    gboolean load(void)
+    {
+        for (const std::string &candidate : files())
+        {
+            gchar *contents = NULL;
+            if (!g_file_get_contents(candidate.c_str(), &contents, NULL, NULL))
+            {
+                continue;
+            }
+            gboolean loaded = parse(contents);
+            g_free(contents);
+            if (loaded)
+            {
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+
+    /* Write what is known, if anything was learnt since it was loaded. Returns FALSE when it could not be written. */
+    gboolean save(void)
+    {
+        std::string contents;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!dirty)
+            {
+                return TRUE;
+            }
+            contents = "keyframe-index 1\nidentity " + identity() + "\n";
+            for (const Span &span : mergedSpans())
+            {
+                contents += "span " + std::to_string(span.first) + " " + std::to_string(span.last) + "\n";
+            }
+            for (const auto &[pts, offset] : keys)
+            {
+                contents += "key " + std::to_string(pts) + " " + std::to_string(offset) + "\n";
+            }
+        }
+        for (const std::string &candidate : files())
+        {
+            gchar *dir = g_path_get_dirname(candidate.c_str());
+            g_mkdir_with_parents(dir, 0755);
+            g_free(dir);
+            if (g_file_set_contents(candidate.c_str(), contents.c_str(), (gssize)contents.size(), NULL))
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                saved_to = candidate;
+                dirty = FALSE;
+                return TRUE;
+            }
+        }
+        g_printerr("Keyframe index of %s could not be written.\n", uri.c_str());
+        return FALSE;
+    }
+
+    /* Demux the whole file, without decoding, as fast as it can be read. Returns FALSE on an error, in which case
+     * what was read up to it is kept. */
+    gboolean scan(void)
+    {
+        GstElement *pipeline = gst_pipeline_new("keyframe-scan");
+        GstElement *source = gst_element_make_from_uri(GST_URI_SRC, uri.c_str(), "source", NULL);
+        GstElement *parse = gst_element_factory_make("parsebin", "parse");
+        if (!source || !parse)
+        {
+            g_printerr("Keyframe index of %s: no source or no parsebin.\n", uri.c_str());
+            if (source)
+            {
+                gst_object_unref(source);
+            }
+            if (parse)
+            {
+                gst_object_unref(parse);
+            }
+            gst_object_unref(pipeline);
+            return FALSE;
+        }
+        gst_bin_add_many(GST_BIN(pipeline), source, parse, NULL);
+        gst_element_link(source, parse);
+        g_signal_connect(parse, "pad-added", G_CALLBACK(onScanPadAdded), this);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            video_pad = nullptr;
+            source_pad = nullptr;
+            current = -1;
+        }
+        watchSource(source);
+
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        GstBus *bus = gst_element_get_bus(pipeline);
+        GstMessage *msg =
+            gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        gboolean ok = (gboolean)(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+        if (!ok)
+        {
+            GError *err = NULL;
+            gst_message_parse_error(msg, &err, NULL);
+            g_printerr("Keyframe index of %s: %s\n", uri.c_str(), err->message);
+            g_clear_error(&err);
+        }
+        gst_message_unref(msg);
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+
+        std::lock_guard<std::mutex> guard(lock);
+        video_pad = nullptr;
+        source_pad = nullptr;
+        current = -1;
+        return ok;
+    }
+
+    /* Learn from `pipeline` (playbin, uridecodebin or any bin with a source and a demuxer) while it plays */
+    void attach(GstElement *pipeline)
+    {
+        detach();
+        bin = GST_ELEMENT(gst_object_ref(pipeline));
+        GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+        gst_iterator_foreach(it, watchIterated, this);
+        gst_iterator_free(it);
+        deep_added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(onDeepElementAdded), this);
+    }
+
+    /* Stop learning from the attached pipeline; pads already probed report nothing more */
+    void detach(void)
+    {
+        if (bin && deep_added_id)
+        {
+            g_signal_handler_disconnect(bin, deep_added_id);
+        }
+        if (bin)
+        {
+            gst_object_unref(bin);
+        }
+        bin = nullptr;
+        deep_added_id = 0;
+        std::lock_guard<std::mutex> guard(lock);
+        generation++;
+        video_pad = nullptr;
+        source_pad = nullptr;
+        current = -1;
+    }
+
+    /* The keyframe at or before `position`, if `position` lies in a stretch the index has seen contiguously */
+    gboolean lookup(GstClockTime position, Keyframe *keyframe)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        gboolean inside = FALSE;
+        for (const Span &span : spans)
+        {
+            inside |= (gboolean)(span.first <= position && position <= span.last);
+        }
+        auto it = keys.upper_bound(position);
+        if (!inside || it == keys.begin())
+        {
+            return FALSE;
+        }
+        --it;
+        keyframe->pts = it->first;
+        keyframe->offset = it->second;
+        return TRUE;
+    }
+
+    /* A flushing seek of `pipeline` to `position`: to the keyframe before it, or `accurate`ly to it with the keyframe's
+     * bytes prefetched */
+    gboolean seek(GstElement *pipeline, gint64 position, gboolean accurate)
+    {
+        Keyframe keyframe;
+        gboolean known = lookup((GstClockTime)position, &keyframe);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stats.seeks++;
+            stats.resolved += known ? 1 : 0;
+        }
+        if (!known)
+        {
+            return gst_element_seek_simple(
+                pipeline, GST_FORMAT_TIME,
+                (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | (accurate ? GST_SEEK_FLAG_ACCURATE : GST_SEEK_FLAG_KEY_UNIT)),
+                position);
+        }
+        prefetch(keyframe.offset);
+        return gst_element_seek_simple(pipeline, GST_FORMAT_TIME,
+                                       (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE),
+                                       accurate ? position : (gint64)keyframe.pts);
+    }
+
+    gsize size(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return keys.size();
+    }
+
+    /* Every keyframe known, in order */
+    std::vector<GstClockTime> keyframes(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<GstClockTime> times;
+        times.reserve(keys.size());
+        for (const auto &[pts, offset] : keys)
+        {
+            times.push_back(pts);
+        }
+        return times;
+    }
+
+    /* How much of the media the index covers, summed over its spans */
+    GstClockTime covered(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        GstClockTime total = 0;
+        for (const Span &span : mergedSpans())
+        {
+            total += span.last - span.first;
+        }
+        return total;
+    }
+
+    /* The file last written by save(), empty before */
+    std::string savedTo(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return saved_to;
+    }
+
+    Stats getStats(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+
+    /* Bytes the page cache is asked to read in at a keyframe before seeking to it */
+    gsize prefetch_bytes = 1024 * 1024;
+
+  private:
+    /* A stretch of media seen without a flush: every keyframe in it is known */
+    struct Span
+    {
+        GstClockTime first;
+        GstClockTime last;
+    };
+
+    /* Probe data of a demuxer source pad; whether it is the video stream is decided on its first buffer */
+    struct StreamProbe
+    {
+        KeyframeIndex *index;
+        guint64 generation;
+    };
+
+    static std::string toUri(const std::string &location)
+    {
+        if (gst_uri_is_valid(location.c_str()))
+        {
+            return location;
+        }
+        gchar *uri = gst_filename_to_uri(location.c_str(), NULL);
+        std::string result = uri ? uri : location;
+        g_free(uri);
+        return result;
+    }
+
+    /* Where the index may live, in the order it is tried */
+    std::vector<std::string> files(void) const
+    {
+        std::vector<std::string> candidates;
+        if (!path.empty())
+        {
+            candidates.push_back(path + ".keyframes");
+        }
+        gchar *name = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri.c_str(), -1);
+        gchar *cached = g_build_filename(g_get_user_cache_dir(), "gst-keyframes", name, NULL);
+        candidates.push_back(std::string(cached) + ".keyframes");
+        g_free(cached);
+        g_free(name);
+        return candidates;
+    }
+
+    /* Size and modification time of a local file, so that an index of an older version of it is not used */
+    std::string identity(void) const
+    {
+        struct stat st;
+        if (path.empty() || stat(path.c_str(), &st) != 0)
+        {
+            return "remote";
+        }
+        return std::to_string((guint64)st.st_size) + " " + std::to_string((gint64)st.st_mtim.tv_sec) + "." +
+               std::to_string((gint64)st.st_mtim.tv_nsec);
+    }
+
+    gboolean parse(const gchar *contents)
+    {
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        gboolean valid = lines[0] && strcmp(lines[0], "keyframe-index 1") == 0 && lines[1] &&
+                         identity() == std::string(lines[1]).substr(std::min<gsize>(9, strlen(lines[1])));
+        std::map<GstClockTime, guint64> loaded_keys;
+        std::vector<Span> loaded_spans;
+        for (gchar **line = lines + 2; valid && *line; ++line)
+        {
+            guint64 a = 0, b = 0;
+            if (sscanf(*line, "key %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &a, &b) == 2)
+            {
+                loaded_keys[a] = b;
+            }
+            else if (sscanf(*line, "span %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &a, &b) == 2)
+            {
+                loaded_spans.push_back(Span{a, b});
+            }
+            else
+            {
+                valid = (gboolean)(**line == '\0');
+            }
+        }
+        g_strfreev(lines);
+        if (!valid)
+        {
+            return FALSE;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        keys = std::move(loaded_keys);
+        spans = std::move(loaded_spans);
+        current = -1;
+        dirty = FALSE;
+        return TRUE;
+    }
+
+    /* The spans sorted, with the overlapping and touching ones joined; called with the lock held */
+    std::vector<Span> mergedSpans(void) const
+    {
+        std::vector<Span> sorted = spans;
+        std::sort(sorted.begin(), sorted.end(), [](const Span &a, const Span &b) { return a.first < b.first; });
+        std::vector<Span> merged;
+        for (const Span &span : sorted)
+        {
+            if (!merged.empty() && span.first <= merged.back().last)
+            {
+                merged.back().last = std::max(merged.back().last, span.last);
+            }
+            else
+            {
+                merged.push_back(span);
+            }
+        }
+        return merged;
+    }
+
+    void prefetch(guint64 offset)
+    {
+        if (path.empty() || prefetch_bytes == 0)
+        {
+            return;
+        }
+        if (fd < 0)
+        {
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd >= 0)
+        {
+            posix_fadvise(fd, (off_t)offset, (off_t)prefetch_bytes, POSIX_FADV_WILLNEED);
+        }
+    }
+
+    void watch(GstElement *element)
+    {
+        if (GST_IS_BIN(element))
+        {
+            return;
+        }
+        GstElementFactory *factory = gst_element_get_factory(element);
+        const gchar *klass = factory ? gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS) : NULL;
+        if (klass && strstr(klass, "Demux"))
+        {
+            GstIterator *it = gst_element_iterate_src_pads(element);
+            gst_iterator_foreach(it, watchIteratedPad, this);
+            gst_iterator_free(it);
+            g_signal_connect(element, "pad-added", G_CALLBACK(onDemuxPadAdded), this);
+        }
+        else if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SOURCE))
+        {
+            watchSource(element);
+        }
+    }
+
+    /* The first source seen reports the byte offsets */
+    void watchSource(GstElement *source)
+    {
+        GstPad *pad = gst_element_get_static_pad(source, "src");
+        if (!pad)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (!source_pad)
+        {
+            source_pad = pad;
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, sourceBuffer, new StreamProbe{this, generation},
+                              deleteProbe);
+        }
+        gst_object_unref(pad);
+    }
+
+    void watchStream(GstPad *pad)
+    {
+        guint64 at;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            at = generation;
+        }
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                          streamData, new StreamProbe{this, at}, deleteProbe);
+    }
+
+    static void deleteProbe(gpointer user_data)
+    {
+        delete static_cast<StreamProbe *>(user_data);
+    }
+
+    static GstPadProbeReturn sourceBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        StreamProbe *probe = static_cast<StreamProbe *>(user_data);
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (!buffer)
+        {
+            return GST_PAD_PROBE_OK;
+        }
+        KeyframeIndex *index = probe->index;
+        std::lock_guard<std::mutex> guard(index->lock);
+        if (probe->generation != index->generation)
+        {
+            return GST_PAD_PROBE_REMOVE;
+        }
+        guint64 offset = GST_BUFFER_OFFSET(buffer);
+        index->last_offset = offset != GST_BUFFER_OFFSET_NONE ? offset : info->offset;
+        return GST_PAD_PROBE_OK;
+    }
+
+    static GstPadProbeReturn streamData(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        StreamProbe *probe = static_cast<StreamProbe *>(user_data);
+        KeyframeIndex *index = probe->index;
+        std::lock_guard<std::mutex> guard(index->lock);
+        if (probe->generation != index->generation)
+        {
+            return GST_PAD_PROBE_REMOVE;
+        }
+        if (index->video_pad != pad)
+        {
+            if (index->video_pad || !(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER))
+            {
+                return GST_PAD_PROBE_OK;
+            }
+            GstCaps *caps = gst_pad_get_current_caps(pad);
+            gboolean video = caps && gst_caps_get_size(caps) > 0 &&
+                             g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "video/");
+            if (caps)
+            {
+                gst_caps_unref(caps);
+            }
+            if (!video)
+            {
+                return GST_PAD_PROBE_OK;
+            }
+            index->video_pad = pad;
+        }
+
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+        {
+            GstEventType type = GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info));
+            if (type == GST_EVENT_FLUSH_STOP || type == GST_EVENT_SEGMENT)
+            {
+                index->current = -1;
+            }
+            return GST_PAD_PROBE_OK;
+        }
+
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        GstClockTime pts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer) : GST_BUFFER_DTS(buffer);
+        if (!GST_CLOCK_TIME_IS_VALID(pts))
+        {
+            return GST_PAD_PROBE_OK;
+        }
+        if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        {
+            index->keys.emplace(pts, index->last_offset);
+            if (index->current < 0)
+            {
+                index->spans.push_back(Span{pts, pts});
+                index->current = (gint)index->spans.size() - 1;
+            }
+            index->dirty = TRUE;
+        }
+        if (index->current >= 0)
+        {
+            GstClockTime end = pts + (GST_BUFFER_DURATION_IS_VALID(buffer) ? GST_BUFFER_DURATION(buffer) : 0);
+            Span &span = index->spans[index->current];
+            span.last = std::max(span.last, end);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    static void watchIterated(const GValue *value, gpointer user_data)
+    {
+        static_cast<KeyframeIndex *>(user_data)->watch(GST_ELEMENT(g_value_get_object(value)));
+    }
+
+    static void watchIteratedPad(const GValue *value, gpointer user_data)
+    {
+        static_cast<KeyframeIndex *>(user_data)->watchStream(GST_PAD(g_value_get_object(value)));
+    }
+
+    static void onDeepElementAdded(GstBin *pipeline, GstBin *sub_bin, GstElement *element, KeyframeIndex *index)
+    {
+        index->watch(element);
+    }
+
+    static void onDemuxPadAdded(GstElement *demux, GstPad *pad, KeyframeIndex *index)
+    {
+        index->watchStream(pad);
+    }
+
+    /* parsebin's pads carry the parsed streams; they are learnt from and dropped */
+    static void onScanPadAdded(GstElement *parse, GstPad *pad, KeyframeIndex *index)
+    {
+        GstElement *sink = gst_element_factory_make("fakesink", NULL);
+        g_object_set(sink, "sync", FALSE, NULL);
+        GstBin *pipeline = GST_BIN(gst_element_get_parent(parse));
+        gst_bin_add(pipeline, sink);
+        gst_object_unref(pipeline);
+        GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_link(pad, sink_pad);
+        gst_object_unref(sink_pad);
+        gst_element_sync_state_with_parent(sink);
+        index->watchStream(pad);
+    }
+
+    std::string uri;
+    std::string path; /* Of a local file, empty otherwise */
+    int fd = -1;      /* Of `path`, opened on the first prefetch */
+    GstElement *bin = nullptr;
+    gulong deep_added_id = 0;
+
+    std::mutex lock;
+    std::map<GstClockTime, guint64> keys; /* pts -> byte offset */
+    std::vector<Span> spans;
+    gint current = -1; /* The span being extended, -1 after a flush until the next keyframe */
+    guint64 generation = 0;
+    GstPad *video_pad = nullptr;  /* Compared only, never dereferenced */
+    GstPad *source_pad = nullptr; /* Likewise */
+    guint64 last_offset = 0;
+    gboolean dirty = FALSE;
+    std::string saved_to;
+    Stats stats;
+};
@@ -0,0 +1,474 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Log-linear histogram of nanosecond values in the style of HdrHistogram. Every power of two is split into
+ * `sub_count` equal buckets, so a bucket is at most 1/16 (6.25%) wide relative to its value, from 1 ns to hours,
+ * in under 8 KB. record() is one relaxed atomic increment and may be called from any number of threads. */
+class LatencyHistogram
+{
+  public:
+    static constexpr unsigned sub_bits = 4;
+    static constexpr unsigned sub_count = 1u << sub_bits;
+    static constexpr unsigned bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    void record(guint64 ns)
+    {
+        counts[indexOf(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+        guint64 seen = highest.load(std::memory_order_relaxed);
+        while (ns > seen && !highest.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /* Upper bound of the bucket holding the p-th fraction of the values (p in [0, 1]), clamped to the maximum */
+    guint64 percentile(double p) const
+    {
+        guint64 n = count();
+        if (n == 0)
+        {
+            return 0;
+        }
+        guint64 rank = MAX((guint64)(p * n + 0.5), (guint64)1);
+        guint64 seen = 0;
+        for (unsigned i = 0; i < bucket_count; ++i)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return MIN(upperBound(i), max());
+            }
+        }
+        return max();
+    }
+
+    guint64 count(void) const
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    guint64 totalNs(void) const
+    {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+    guint64 max(void) const
+    {
+        return highest.load(std::memory_order_relaxed);
+    }
+
+    double mean(void) const
+    {
+        guint64 n = count();
+        return n ? (double)totalNs() / n : 0.0;
+    }
+
+    static constexpr unsigned indexOf(guint64 value)
+    {
+        if (value < sub_count)
+        {
+            return (unsigned)value;
+        }
+        unsigned shift = (unsigned)std::bit_width(value) - 1 - sub_bits;
+        return (shift + 1) * sub_count + (unsigned)((value >> shift) & (sub_count - 1));
+    }
+
+    static constexpr guint64 lowerBound(unsigned index)
+    {
+        if (index < sub_count)
+        {
+            return index;
+        }
+        unsigned shift = index / sub_count - 1;
+        return (guint64)(sub_count + index % sub_count) << shift;
+    }
+
+    static constexpr guint64 upperBound(unsigned index)
+    {
+        return index + 1 < bucket_count ? lowerBound(index + 1) - 1 : G_MAXUINT64;
+    }
+
+  private:
+    std::array<std::atomic<guint64>, bucket_count> counts{};
+    std::atomic<guint64> total{0};
+    std::atomic<guint64> sum{0};
+    std::atomic<guint64> highest{0};
+};
+
+static_assert(LatencyHistogram::indexOf(15) == 15);
+static_assert(LatencyHistogram::indexOf(1000) < LatencyHistogram::bucket_count);
+static_assert(LatencyHistogram::lowerBound(LatencyHistogram::indexOf(1000)) <= 1000);
+static_assert(LatencyHistogram::upperBound(LatencyHistogram::indexOf(1000)) >= 1000);
+static_assert(LatencyHistogram::indexOf(G_MAXUINT64) == LatencyHistogram::bucket_count - 1);
+
+/* Time every buffer spends in every element of a pipeline, from pad probes:
+ *
+ * - the sink pad probe of an element stamps the buffer PTS with the time it entered, and the src pad probe looks the
+ *   PTS up again when the buffer (or the frame made from it) leaves, so queues and decoders that hand buffers to
+ *   another thread or reorder them are timed as well as in-place filters;
+ * - a sink has no src pad; it gets the time from the origin of its media (see addOrigin()) to its sink pad
+ *   instead, i.e. the latency of its whole branch.
+ *
+ * Queues are timed too, but what they show is waiting, not work, so they are listed apart from the elements that
+ * process data and do not count towards the share of the processing time.
+ *
+ * Only leaf elements are traced, bins are looked into: the decoder and parsers uridecodebin creates while
+ * playing, and branches attached later, are picked up through deep-element-added. Buffers without a PTS are not
+ * timed. The report is printed on dump(), which the application calls on EOS, and whenever the process receives
+ * the signal given to dumpOnSignal(). Traced elements, also those of branches detached since, are kept alive until
+ * the tracer is destroyed, which removes its probes again; a buffer already inside a probe at that moment still
+ * reads the tracer, so destroy it once the pipeline is stopped (or at least paused). */
+class LatencyTracer
+{
+  public:
+    static constexpr std::size_t ring_size = 64;
+
+    ~LatencyTracer()
+    {
+        stopping.store(TRUE, std::memory_order_relaxed);
+        if (signal_watch.joinable())
+        {
+            signal_watch.join();
+        }
+        if (bin && deep_added_id)
+        {
+            g_signal_handler_disconnect(bin, deep_added_id);
+        }
+        for (ElementTrace &trace : traces)
+        {
+            g_signal_handler_disconnect(trace.element, trace.pad_added_id);
+            for (auto &[pad, probe_id] : trace.probes)
+            {
+                gst_pad_remove_probe(pad, probe_id);
+                gst_object_unref(pad);
+            }
+            gst_object_unref(trace.element);
+        }
+        if (bin)
+        {
+            gst_object_unref(bin);
+        }
+    }
+
+    /* Trace every element of `pipeline`, now and whenever one is added to it or to one of its bins */
+    void attach(GstElement *pipeline)
+    {
+        bin = GST_ELEMENT(gst_object_ref(pipeline));
+        GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+        gst_iterator_foreach(it, traceIterated, this);
+        gst_iterator_free(it);
+        deep_added_id = g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(onDeepElementAdded), this);
+    }
+
+    /* Branch latencies of the sinks are measured from the sink pad of an origin with the same media, e.g. from
+     * the tee of their branch. Call after attach() and before the pipeline plays. */
+    void addOrigin(GstElement *element)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (ElementTrace &trace : traces)
+        {
+            if (trace.element == element)
+            {
+                origins.push_back(&trace);
+            }
+        }
+    }
+
+    /* Print the report whenever `signum` (e.g. SIGUSR1) is received */
+    void dumpOnSignal(int signum)
+    {
+        std::signal(signum, [](int) { signalled() = 1; });
+        if (!signal_watch.joinable())
+        {
+            signal_watch = std::thread([this] {
+                while (!stopping.load(std::memory_order_relaxed))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    if (signalled())
+                    {
+                        signalled() = 0;
+                        dump();
+                    }
+                }
+            });
+        }
+    }
+
+    /* Elements sorted by the total time buffers spent in them, with their share and percentiles in microseconds */
+    void dump(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<const ElementTrace *> sorted;
+        guint64 grand_total = 0;
+        for (const ElementTrace &trace : traces)
+        {
+            if (trace.latency.count() > 0)
+            {
+                sorted.push_back(&trace);
+                grand_total += trace.kind == Kind::processing ? trace.latency.totalNs() : 0;
+            }
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const ElementTrace *a, const ElementTrace *b) {
+            return a->kind != b->kind ? a->kind < b->kind : a->latency.totalNs() > b->latency.totalNs();
+        });
+
+        g_print("%-28s %-16s %10s %7s %10s %10s %10s %10s %10s\n", "element", "factory", "buffers", "share",
+                "mean_us", "p50_us", "p99_us", "p999_us", "max_us");
+        for (const ElementTrace *trace : sorted)
+        {
+            const LatencyHistogram &h = trace->latency;
+            std::string name = trace->name + (trace->kind == Kind::queue    ? " (wait)"
+                                              : trace->kind == Kind::branch ? " (branch)"
+                                                                            : "");
+            g_print("%-28s %-16s %10" G_GUINT64_FORMAT " %6.1f%% %10.1f %10.1f %10.1f %10.1f %10.1f\n", name.c_str(),
+                    trace->factory.c_str(), h.count(),
+                    trace->kind == Kind::processing && grand_total ? h.totalNs() * 100.0 / grand_total : 0.0,
+                    h.mean() / 1e3, h.percentile(0.50) / 1e3, h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3,
+                    h.max() / 1e3);
+        }
+    }
+
+  private:
+    /* Entry stamps of the last `ring_size` buffers, written by the thread streaming into the element and read by
+     * the one streaming out of it. A stamp overwritten while being read only loses that one sample. */
+    struct Stamp
+    {
+        std::atomic<guint64> pts{GST_CLOCK_TIME_NONE};
+        std::atomic<guint64> ns{0};
+    };
+
+    enum class Kind
+    {
+        processing,
+        queue,
+        branch
+    };
+
+    struct ElementTrace
+    {
+        GstElement *element; /* Ref held, so that a detached element cannot be freed and another one traced at its
+                              * address be taken for it */
+        gulong pad_added_id;
+        std::vector<std::pair<GstPad *, gulong>> probes; /* Pads ref'd, removed by the destructor */
+        std::string name;
+        std::string factory;
+        Kind kind;
+        LatencyTracer *tracer;
+        std::atomic<const ElementTrace *> origin{nullptr};
+        std::array<Stamp, ring_size> stamps;
+        std::atomic<std::size_t> next{0};
+        LatencyHistogram latency;
+
+        void stamp(guint64 pts, guint64 now)
+        {
+            Stamp &slot = stamps[next.fetch_add(1, std::memory_order_relaxed) % ring_size];
+            slot.pts.store(GST_CLOCK_TIME_NONE, std::memory_order_relaxed);
+            slot.ns.store(now, std::memory_order_relaxed);
+            slot.pts.store(pts, std::memory_order_release);
+        }
+
+        /* Entry time of the newest buffer with this PTS, or 0 */
+        guint64 find(guint64 pts) const
+        {
+            std::size_t newest = next.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < ring_size; ++i)
+            {
+                const Stamp &slot = stamps[(newest + ring_size - 1 - i) % ring_size];
+                if (slot.pts.load(std::memory_order_acquire) == pts)
+                {
+                    return slot.ns.load(std::memory_order_relaxed);
+                }
+            }
+            return 0;
+        }
+    };
+
+    static volatile std::sig_atomic_t &signalled(void)
+    {
+        static volatile std::sig_atomic_t flag = 0;
+        return flag;
+    }
+
+    static guint64 bufferPts(GstPadProbeInfo *info)
+    {
+        GstBuffer *buffer = nullptr;
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+        {
+            GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+            buffer = gst_buffer_list_length(list) ? gst_buffer_list_get(list, 0) : nullptr;
+        }
+        else
+        {
+            buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        }
+        return buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+    }
+
+    static GstPadProbeReturn entryProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        ElementTrace *trace = static_cast<ElementTrace *>(user_data);
+        guint64 pts = bufferPts(info);
+        if (!GST_CLOCK_TIME_IS_VALID(pts))
+        {
+            return GST_PAD_PROBE_OK;
+        }
+        guint64 now = gst_util_get_timestamp();
+        trace->stamp(pts, now);
+        if (trace->kind == Kind::branch)
+        {
+            const ElementTrace *origin = trace->origin.load(std::memory_order_relaxed);
+            if (!origin)
+            {
+                origin = trace->tracer->originFor(pad);
+                trace->origin.store(origin, std::memory_order_relaxed);
+            }
+            guint64 entered = origin ? origin->find(pts) : 0;
+            if (entered)
+            {
+                trace->latency.record(now - entered);
+            }
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    static GstPadProbeReturn exitProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        ElementTrace *trace = static_cast<ElementTrace *>(user_data);
+        guint64 pts = bufferPts(info);
+        if (!GST_CLOCK_TIME_IS_VALID(pts))
+        {
+            return GST_PAD_PROBE_OK;
+        }
+        if (guint64 entered = trace->find(pts))
+        {
+            trace->latency.record(gst_util_get_timestamp() - entered);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* Media type of the caps on a pad, e.g. "video" for video/x-raw */
+    static std::string padMedia(GstPad *pad)
+    {
+        GstCaps *caps = gst_pad_get_current_caps(pad);
+        std::string media;
+        if (caps)
+        {
+            media = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+            media = media.substr(0, media.find('/'));
+            gst_caps_unref(caps);
+        }
+        return media;
+    }
+
+    /* The origin whose sink pad carries the same media as `pad`; resolved once per sink, on its first buffer */
+    const ElementTrace *originFor(GstPad *pad)
+    {
+        std::string media = padMedia(pad);
+        for (const ElementTrace *origin : origins)
+        {
+            GstPad *origin_pad = gst_element_get_static_pad(origin->element, "sink");
+            gboolean match = origin_pad && padMedia(origin_pad) == media;
+            if (origin_pad)
+            {
+                gst_object_unref(origin_pad);
+            }
+            if (match)
+            {
+                return origin;
+            }
+        }
+        return nullptr;
+    }
+
+    /* Called with the lock held */
+    static gboolean probePad(GstElement *element, GstPad *pad, gpointer user_data)
+    {
+        ElementTrace *trace = static_cast<ElementTrace *>(user_data);
+        const GstPadProbeType type = (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST);
+        gboolean src = gst_pad_get_direction(pad) == GST_PAD_SRC;
+        gulong probe_id = gst_pad_add_probe(pad, type, src ? exitProbe : entryProbe, trace, NULL);
+        if (probe_id)
+        {
+            trace->probes.emplace_back(GST_PAD(gst_object_ref(pad)), probe_id);
+        }
+        return TRUE;
+    }
+
+    static void onPadAdded(GstElement *element, GstPad *pad, ElementTrace *trace)
+    {
+        std::lock_guard<std::mutex> guard(trace->tracer->lock);
+        probePad(element, pad, trace);
+    }
+
+    void trace(GstElement *element)
+    {
+        if (GST_IS_BIN(element))
+        {
+            return;
+        }
+        GstElementFactory *factory = gst_element_get_factory(element);
+
+        std::lock_guard<std::mutex> guard(lock);
+        for (const ElementTrace &existing : traces)
+        {
+            if (existing.element == element)
+            {
+                return;
+            }
+        }
+        ElementTrace &trace = traces.emplace_back();
+        trace.element = GST_ELEMENT(gst_object_ref(element));
+        trace.name = GST_ELEMENT_NAME(element);
+        trace.factory = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : "";
+        if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+        {
+            trace.kind = Kind::branch;
+        }
+        else if (trace.factory == "queue" || trace.factory == "queue2" || trace.factory == "multiqueue")
+        {
+            trace.kind = Kind::queue;
+        }
+        else
+        {
+            trace.kind = Kind::processing;
+        }
+        trace.tracer = this;
+        gst_element_foreach_sink_pad(element, probePad, &trace);
+        gst_element_foreach_src_pad(element, probePad, &trace);
+        trace.pad_added_id = g_signal_connect(element, "pad-added", G_CALLBACK(onPadAdded), &trace);
+    }
+
+    static void traceIterated(const GValue *value, gpointer user_data)
+    {
+        static_cast<LatencyTracer *>(user_data)->trace(GST_ELEMENT(g_value_get_object(value)));
+    }
+
+    static void onDeepElementAdded(GstBin *pipeline, GstBin *sub_bin, GstElement *element, LatencyTracer *tracer)
+    {
+        tracer->trace(element);
+    }
+
+    GstElement *bin = nullptr;
+    gulong deep_added_id = 0;
+    std::mutex lock;
+    std::deque<ElementTrace> traces;
+    std::vector<const ElementTrace *> origins;
+    std::thread signal_watch;
+    std::atomic<gboolean> stopping{FALSE};
+};
+
+using LatencyTracerPtr = LatencyTracer *;
@@ -0,0 +1,428 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <gst/base/gstbasesrc.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A local file source that maps the file instead of reading it, registered as the element "mmapfilesrc" of this
+ * process. It handles file:// URIs, so once preferred it is what uridecodebin and playbin pick for local media:
+ *
+ *     MmapSource::prefer(TRUE);   (or PipelineConfig::mmap_source, or --mmap with --uri)
+ *
+ * Every buffer wraps its range of the mapping as read-only memory: nothing is copied and nothing is allocated but
+ * the GstBuffer itself, and the mapping lives until the last buffer pointing into it is gone. The pages come from the
+ * page cache as the demuxer touches them; the kernel is told the access is sequential and asked, with
+ * MADV_WILLNEED, to read `readahead` bytes ahead of the last range handed out, so that the streaming thread rarely
+ * waits on a fault. Pulling from elsewhere (a demuxer seeking to its index) just moves that window.
+ *
+ * What cannot be mapped (pipes, character devices, an empty file) is read with read() into allocated buffers, as
+ * filesrc does, and is not seekable. A file truncated while it is mapped makes the reader fault with SIGBUS, so this
+ * is for media that is complete on disk, not for files still being written. */
+class MmapSource
+{
+  public:
+    static constexpr const gchar *name = "mmapfilesrc";
+
+    struct Stats
+    {
+        gboolean mapped = FALSE;
+        guint64 buffers = 0;
+        guint64 wrapped = 0; /* Bytes handed out from the mapping */
+        guint64 read = 0;    /* Bytes copied with read() */
+        guint64 advice = 0;  /* madvise(MADV_WILLNEED) calls */
+    };
+
+    /* Register the element factory and its URI handler; safe to call more than once. It is registered without a
+     * rank: filesrc stays the source of file:// URIs until prefer() is called. */
+    static gboolean registerElement(void)
+    {
+        static const gboolean registered = [] {
+            GTypeInfo info = {};
+            info.class_size = sizeof(SourceClass);
+            info.class_init = classInit;
+            info.instance_size = sizeof(Source);
+            info.instance_init = instanceInit;
+            type = g_type_register_static(GST_TYPE_BASE_SRC, "GstMmapFileSrc", &info, (GTypeFlags)0);
+            static const GInterfaceInfo uri_info = {uriHandlerInit, NULL, NULL};
+            g_type_add_interface_static(type, GST_TYPE_URI_HANDLER, &uri_info);
+            return gst_element_register(NULL, name, GST_RANK_NONE, type);
+        }();
+        return registered;
+    }
+
+    /* Rank mmapfilesrc above filesrc for file:// URIs, or back below it. The rank is process-wide and read when a
+     * uridecodebin makes its source, so whoever builds such a pipeline calls this with its own choice every time. */
+    static void prefer(gboolean preferred)
+    {
+        registerElement();
+        GstElementFactory *factory = gst_element_factory_find(name);
+        if (factory)
+        {
+            gst_plugin_feature_set_rank(GST_PLUGIN_FEATURE(factory), preferred ? GST_RANK_PRIMARY + 1 : GST_RANK_NONE);
+            gst_object_unref(factory);
+        }
+    }
+
+    static Stats stats(GstElement *element)
+    {
+        if (!element || type == 0 || G_OBJECT_TYPE(element) != type)
+        {
+            return Stats();
+        }
+        State *state = ((Source *)element)->state;
+        std::lock_guard<std::mutex> guard(state->lock);
+        return state->stats;
+    }
+
+  private:
+    /* The mapping of one open file; every buffer wrapping part of it holds a reference */
+    struct Mapping
+    {
+        std::atomic<gint> refs{1};
+        guint8 *base = nullptr;
+        gsize size = 0;
+    };
+
+    struct State
+    {
+        std::string location;
+        guint64 readahead = 16 << 20;
+
+        /* Streaming thread */
+        int fd = -1;
+        guint64 size = 0;
+        Mapping *mapping = nullptr;
+        guint64 advised_start = 0; /* The MADV_WILLNEED window */
+        guint64 advised_end = 0;
+        guint64 read_offset = 0; /* Of the next read() without a mapping */
+
+        std::mutex lock;
+        Stats stats;
+    };
+
+    struct Source
+    {
+        GstBaseSrc parent;
+        State *state;
+    };
+
+    struct SourceClass
+    {
+        GstBaseSrcClass parent_class;
+    };
+
+    enum Property : guint
+    {
+        prop_0,
+        prop_location,
+        prop_readahead
+    };
+
+    static inline GType type = 0;
+    static inline gpointer parent_class = nullptr;
+    static inline GstStaticPadTemplate src_template =
+        GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+    static void classInit(gpointer g_class, gpointer class_data)
+    {
+        parent_class = g_type_class_peek_parent(g_class);
+
+        GObjectClass *object_class = G_OBJECT_CLASS(g_class);
+        object_class->set_property = setProperty;
+        object_class->get_property = getProperty;
+        object_class->finalize = finalize;
+        GParamFlags flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property(
+            object_class, prop_location,
+            g_param_spec_string("location", "Location", "File to read", NULL, flags));
+        g_object_class_install_property(object_class, prop_readahead,
+                                        g_param_spec_uint64("readahead", "Readahead",
+                                                            "Bytes to ask the kernel to read ahead, 0 for none", 0,
+                                                            G_MAXUINT64, 16 << 20, flags));
+
+        GstElementClass *element_class = GST_ELEMENT_CLASS(g_class);
+        gst_element_class_set_static_metadata(element_class, "Mapped file source", "Source/File",
+                                              "Reads a local file through a memory mapping", "basic_tutorials");
+        gst_element_class_add_static_pad_template(element_class, &src_template);
+
+        GstBaseSrcClass *src_class = GST_BASE_SRC_CLASS(g_class);
+        src_class->start = start;
+        src_class->stop = stop;
+        src_class->get_size = getSize;
+        src_class->is_seekable = isSeekable;
+        src_class->create = create;
+    }
+
+    /* Pushed buffers are whole pages; pulled ones are what the demuxer asks for */
+    static void instanceInit(GTypeInstance *instance, gpointer g_class)
+    {
+        Source *self = (Source *)instance;
+        self->state = new State();
+        gst_base_src_set_blocksize(GST_BASE_SRC(instance), 256 * 1024);
+    }
+
+    static void finalize(GObject *object)
+    {
+        Source *self = (Source *)object;
+        delete self->state;
+        self->state = nullptr;
+        G_OBJECT_CLASS(parent_class)->finalize(object);
+    }
+
+    static void setProperty(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+    {
+        State *state = ((Source *)object)->state;
+        switch (id)
+        {
+        case prop_location:
+            state->location = g_value_get_string(value) ? g_value_get_string(value) : "";
+            break;
+        case prop_readahead:
+            state->readahead = g_value_get_uint64(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+            break;
+        }
+    }
+
+    static void getProperty(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+    {
+        State *state = ((Source *)object)->state;
+        switch (id)
+        {
+        case prop_location:
+            g_value_set_string(value, state->location.c_str());
+            break;
+        case prop_readahead:
+            g_value_set_uint64(value, state->readahead);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+            break;
+        }
+    }
+
+    static void uriHandlerInit(gpointer g_iface, gpointer iface_data)
+    {
+        GstURIHandlerInterface *iface = (GstURIHandlerInterface *)g_iface;
+        iface->get_type = uriType;
+        iface->get_protocols = uriProtocols;
+        iface->get_uri = getUri;
+        iface->set_uri = setUri;
+    }
+
+    static GstURIType uriType(GType type)
+    {
+        return GST_URI_SRC;
+    }
+
+    static const gchar *const *uriProtocols(GType type)
+    {
+        static const gchar *const protocols[] = {"file", NULL};
+        return protocols;
+    }
+
+    static gchar *getUri(GstURIHandler *handler)
+    {
+        State *state = ((Source *)handler)->state;
+        /* A relative location is taken from the current directory, like filesrc does */
+        return state->location.empty() ? NULL : gst_filename_to_uri(state->location.c_str(), NULL);
+    }
+
+    static gboolean setUri(GstURIHandler *handler, const gchar *uri, GError **error)
+    {
+        gchar *location = g_filename_from_uri(uri, NULL, error);
+        if (!location)
+        {
+            return FALSE;
+        }
+        ((Source *)handler)->state->location = location;
+        g_free(location);
+        return TRUE;
+    }
+
+    static gboolean start(GstBaseSrc *src)
+    {
+        State *state = ((Source *)src)->state;
+        state->fd = open(state->location.c_str(), O_RDONLY | O_CLOEXEC);
+        if (state->fd < 0)
+        {
+            GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("Could not open %s for reading.", state->location.c_str()),
+                              ("%s", g_strerror(errno)));
+            return FALSE;
+        }
+
+        struct stat st;
+        state->size = 0;
+        state->mapping = nullptr;
+        state->advised_start = 0;
+        state->advised_end = 0;
+        state->read_offset = 0;
+        if (fstat(state->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            state->size = (guint64)st.st_size;
+            void *base = mmap(NULL, state->size, PROT_READ, MAP_SHARED, state->fd, 0);
+            if (base != MAP_FAILED)
+            {
+                madvise(base, state->size, MADV_SEQUENTIAL);
+                state->mapping = new Mapping();
+                state->mapping->base = (guint8 *)base;
+                state->mapping->size = state->size;
+            }
+            else
+            {
+                int error = errno;
+                GST_ELEMENT_WARNING(src, RESOURCE, READ,
+                                    ("Could not map %s, reading it instead.", state->location.c_str()),
+                                    ("%s", g_strerror(error)));
+            }
+        }
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats = Stats();
+        state->stats.mapped = (gboolean)(state->mapping != nullptr);
+        return TRUE;
+    }
+
+    /* The buffers still out keep the mapping; the descriptor is not needed by it */
+    static gboolean stop(GstBaseSrc *src)
+    {
+        State *state = ((Source *)src)->state;
+        if (state->mapping)
+        {
+            unrefMapping(state->mapping);
+            state->mapping = nullptr;
+        }
+        if (state->fd >= 0)
+        {
+            close(state->fd);
+            state->fd = -1;
+        }
+        return TRUE;
+    }
+
+    static gboolean getSize(GstBaseSrc *src, guint64 *size)
+    {
+        State *state = ((Source *)src)->state;
+        if (!state->mapping)
+        {
+            return FALSE;
+        }
+        *size = state->size;
+        return TRUE;
+    }
+
+    static gboolean isSeekable(GstBaseSrc *src)
+    {
+        return (gboolean)(((Source *)src)->state->mapping != nullptr);
+    }
+
+    static GstFlowReturn create(GstBaseSrc *src, guint64 offset, guint length, GstBuffer **buffer)
+    {
+        State *state = ((Source *)src)->state;
+        if (!state->mapping)
+        {
+            return createRead(src, state, offset, length, buffer);
+        }
+        if (offset >= state->size)
+        {
+            return GST_FLOW_EOS;
+        }
+        gsize size = (gsize)MIN((guint64)length, state->size - offset);
+        adviseAhead(state, offset + size);
+
+        state->mapping->refs.fetch_add(1, std::memory_order_relaxed);
+        *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, state->mapping->base, state->mapping->size,
+                                              (gsize)offset, size, state->mapping, unrefMapping);
+        GST_BUFFER_OFFSET(*buffer) = offset;
+        GST_BUFFER_OFFSET_END(*buffer) = offset + size;
+
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.buffers++;
+        state->stats.wrapped += size;
+        return GST_FLOW_OK;
+    }
+
+    /* Keep `readahead` bytes advised from `position` on: advise again once less than half of the window is left
+     * ahead, or when a pull lands outside of it */
+    static void adviseAhead(State *state, guint64 position)
+    {
+        if (state->readahead == 0 || position >= state->size || position < state->advised_start ||
+            position > state->advised_end)
+        {
+            state->advised_end = state->advised_start = 0;
+        }
+        if (state->readahead == 0 || position >= state->size ||
+            (state->advised_end > 0 &&
+             (position + state->readahead / 2 <= state->advised_end || state->advised_end == state->size)))
+        {
+            return;
+        }
+        guint64 page = (guint64)sysconf(_SC_PAGESIZE);
+        guint64 from = position / page * page;
+        guint64 length = MIN(state->readahead, state->size - from);
+        madvise(state->mapping->base + from, length, MADV_WILLNEED);
+        state->advised_start = from;
+        state->advised_end = from + length;
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.advice++;
+    }
+
+    /* What filesrc does: a fresh buffer per block, filled with read() */
+    static GstFlowReturn createRead(GstBaseSrc *src, State *state, guint64 offset, guint length, GstBuffer **buffer)
+    {
+        if (offset != state->read_offset && offset != (guint64)-1)
+        {
+            GST_ELEMENT_ERROR(src, RESOURCE, SEEK, ("%s cannot be seeked.", state->location.c_str()), (NULL));
+            return GST_FLOW_ERROR;
+        }
+        GstBuffer *out = gst_buffer_new_allocate(NULL, length, NULL);
+        GstMapInfo map;
+        gst_buffer_map(out, &map, GST_MAP_WRITE);
+        ssize_t n;
+        do
+        {
+            n = read(state->fd, map.data, length);
+        } while (n < 0 && errno == EINTR);
+        gst_buffer_unmap(out, &map);
+        if (n <= 0)
+        {
+            gst_buffer_unref(out);
+            if (n == 0)
+            {
+                return GST_FLOW_EOS;
+            }
+            GST_ELEMENT_ERROR(src, RESOURCE, READ, ("Could not read %s.", state->location.c_str()),
+                              ("%s", g_strerror(errno)));
+            return GST_FLOW_ERROR;
+        }
+        gst_buffer_set_size(out, (gssize)n);
+        GST_BUFFER_OFFSET(out) = state->read_offset;
+        state->read_offset += (guint64)n;
+        GST_BUFFER_OFFSET_END(out) = state->read_offset;
+        *buffer = out;
+
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.buffers++;
+        state->stats.read += (guint64)n;
+        return GST_FLOW_OK;
+    }
+
+    static void unrefMapping(gpointer data)
+    {
+        Mapping *mapping = (Mapping *)data;
+        if (mapping->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            munmap(mapping->base, mapping->size);
+            delete mapping;
+        }
+    }
+};
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "pipeline-element.hpp"
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* One tee branch of a description: the media picks the tee and the branch class (AudioElement or VideoElement) */
+struct BranchDescription
+{
+    std::string media;
+    std::string filter; /* effectv or SimdEffects filter of a video branch, empty for none */
+    QueueLimits limits;
+    SinkConfig sink;
+    gboolean fused = FALSE;    /* see VideoElement */
+    guint convert_threads = 1; /* see VideoElement::setConvertThreads() */
+};
+
+/* A pipeline topology written down once and compiled into PipelineElement graphs as often as needed:
+ *
+ *     # comments and blank lines are skipped, values with spaces are quoted as in a shell
+ *     pipeline name=effects
+ *     source factory=uridecodebin uri=https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm
+ *     branch audio sink=autoaudiosink
+ *     branch video sink=autovideosink
+ *     branch video filter=edgetv max-size-buffers=5 max-size-bytes=0 max-size-time=0 leaky=downstream
+ *
+ * `pipeline` takes name= and verbose=true|false. `source` takes factory=, description= (a gst-launch bin, one src
+ * pad per stream), uri=, num-buffers= and caps=.
+ * `branch audio|video` takes filter= (video only), fused=true|false (video only, no conversions around a filter
+ * that takes YUV), convert-threads= (video only, 0 for one per core), the queue limits max-size-buffers=,
+ * max-size-bytes=, max-size-time= (ns) and leaky=no|upstream|downstream, and sink= and sync=true|false. Every branch
+ * hangs off the tee of its media, which the pipeline creates on its own. Elements are created through
+ * ElementFactoryCache, so compiling the same description many times resolves each factory once. */
+struct PipelineDescription
+{
+    PipelineConfig config;
+    std::string uri;
+    std::vector<BranchDescription> branches;
+
+    static gboolean parse(const std::string &text, PipelineDescription &description)
+    {
+        description = PipelineDescription();
+        description.config.audio = FALSE;
+        description.config.video = FALSE;
+
+        std::size_t line_number = 0;
+        std::size_t begin = 0;
+        while (begin < text.size())
+        {
+            std::size_t end = text.find('\n', begin);
+            if (end == std::string::npos)
+            {
+                end = text.size();
+            }
+            std::string line = text.substr(begin, end - begin);
+            begin = end + 1;
+            ++line_number;
+
+            std::size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+            {
+                continue;
+            }
+
+            gint argc = 0;
+            gchar **argv = NULL;
+            GError *err = NULL;
+            if (!g_shell_parse_argv(line.c_str(), &argc, &argv, &err))
+            {
+                g_printerr("Pipeline description line %zu: %s\n", line_number, err->message);
+                g_clear_error(&err);
+                return FALSE;
+            }
+            gboolean ok = description.parseLine(argc, argv);
+            g_strfreev(argv);
+            if (!ok)
+            {
+                g_printerr("Pipeline description line %zu: %s\n", line_number, line.c_str() + first);
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+
+    static gboolean load(const std::string &path, PipelineDescription &description)
+    {
+        gchar *contents = NULL;
+        if (!g_file_get_contents(path.c_str(), &contents, NULL, NULL))
+        {
+            g_printerr("Pipeline description %s could not be read.\n", path.c_str());
+            return FALSE;
+        }
+        std::string text{contents};
+        g_free(contents);
+        return parse(text, description);
+    }
+
+    /* A PipelineElement with every branch registered, ready for the usual gstElementFactoryMake(), ... steps */
+    PipelineElementPtr instantiate(const std::string &name = "") const
+    {
+        PipelineConfig instance_config = config;
+        if (!name.empty())
+        {
+            instance_config.name = name;
+        }
+        PipelineElementPtr pipeline = new PipelineElement(instance_config);
+        for (const BranchDescription &branch : branches)
+        {
+            if (branch.media == "audio")
+            {
+                pipeline->addBranch(new AudioElement(branch.limits, branch.sink));
+            }
+            else
+            {
+                VideoElementPtr video = new VideoElement(branch.filter, branch.limits, branch.sink, branch.fused);
+                video->setConvertThreads(branch.convert_threads);
+                pipeline->addBranch(video);
+            }
+        }
+        return pipeline;
+    }
+
+    /* instantiate() and build(), with the uri set. Returns nullptr when the pipeline could not be built. */
+    PipelineElementPtr compile(const std::string &name = "") const
+    {
+        PipelineElementPtr pipeline = instantiate(name);
+        if (!pipeline->build())
+        {
+            if (pipeline->getElement("pipeline"))
+            {
+                pipeline->unref();
+            }
+            delete pipeline;
+            return nullptr;
+        }
+        if (!uri.empty())
+        {
+            std::string url = uri;
+            pipeline->setSourceProperties(url);
+        }
+        return pipeline;
+    }
+
+  private:
+    static gboolean parseUnsigned(std::string_view value, guint64 &out)
+    {
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+        return (gboolean)(ec == std::errc() && end == value.data() + value.size());
+    }
+
+    static gboolean parseBool(std::string_view value, gboolean &out)
+    {
+        if (value == "true" || value == "1")
+        {
+            out = TRUE;
+            return TRUE;
+        }
+        if (value == "false" || value == "0")
+        {
+            out = FALSE;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    gboolean parseLine(gint argc, gchar **argv)
+    {
+        std::string_view keyword{argv[0]};
+        gint first_option = 1;
+        BranchDescription branch;
+        if (keyword == "branch")
+        {
+            if (argc < 2)
+            {
+                return FALSE;
+            }
+            branch.media = argv[1];
+            if (branch.media == "audio")
+            {
+                branch.sink = config.audio_sink;
+            }
+            else if (branch.media == "video")
+            {
+                branch.sink = config.video_sink;
+            }
+            else
+            {
+                return FALSE;
+            }
+            first_option = 2;
+        }
+        else if (keyword != "pipeline" && keyword != "source")
+        {
+            return FALSE;
+        }
+
+        for (gint i = first_option; i < argc; ++i)
+        {
+            std::string_view option{argv[i]};
+            std::size_t equals = option.find('=');
+            if (equals == std::string_view::npos)
+            {
+                return FALSE;
+            }
+            std::string_view key = option.substr(0, equals);
+            std::string_view value = option.substr(equals + 1);
+            gboolean ok = keyword == "pipeline" ? pipelineOption(key, value)
+                          : keyword == "source" ? sourceOption(key, value)
+                                                : branchOption(branch, key, value);
+            if (!ok)
+            {
+                return FALSE;
+            }
+        }
+
+        if (keyword == "branch")
+        {
+            if ((!branch.filter.empty() || branch.fused) &&
+                (branch.media != "video" || !VideoElement::checkFilterNameValid(branch.filter)))
+            {
+                return FALSE;
+            }
+            branches.push_back(branch);
+        }
+        return TRUE;
+    }
+
+    gboolean pipelineOption(std::string_view key, std::string_view value)
+    {
+        if (key == "name")
+        {
+            config.name = value;
+            return TRUE;
+        }
+        if (key == "verbose")
+        {
+            return parseBool(value, config.verbose);
+        }
+        return FALSE;
+    }
+
+    gboolean sourceOption(std::string_view key, std::string_view value)
+    {
+        guint64 number = 0;
+        if (key == "factory")
+        {
+            config.source_factory = value;
+        }
+        else if (key == "description")
+        {
+            config.source_description = value;
+        }
+        else if (key == "uri")
+        {
+            uri = value;
+        }
+        else if (key == "caps")
+        {
+            config.source_caps = value;
+        }
+        else if (key == "num-buffers" && parseUnsigned(value, number))
+        {
+            config.num_buffers = (gint)number;
+        }
+        else
+        {
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    static gboolean branchOption(BranchDescription &branch, std::string_view key, std::string_view value)
+    {
+        guint64 number = 0;
+        if (key == "filter")
+        {
+            branch.filter = value;
+        }
+        else if (key == "sink")
+        {
+            branch.sink.factory = value;
+        }
+        else if (key == "sync")
+        {
+            return parseBool(value, branch.sink.sync);
+        }
+        else if (key == "fused")
+        {
+            return parseBool(value, branch.fused);
+        }
+        else if (key == "leaky")
+        {
+            if (value == "no")
+            {
+                branch.limits.leaky = 0;
+            }
+            else if (value == "upstream")
+            {
+                branch.limits.leaky = 1;
+            }
+            else if (value == "downstream")
+            {
+                branch.limits.leaky = 2;
+            }
+            else
+            {
+                return FALSE;
+            }
+        }
+        else if (!parseUnsigned(value, number))
+        {
+            return FALSE;
+        }
+        else if (key == "max-size-buffers")
+        {
+            branch.limits.max_size_buffers = (guint)number;
+        }
+        else if (key == "max-size-bytes")
+        {
+            branch.limits.max_size_bytes = (guint)number;
+        }
+        else if (key == "max-size-time")
+        {
+            branch.limits.max_size_time = number;
+        }
+        else if (key == "convert-threads" && branch.media == "video")
+        {
+            branch.convert_threads = (guint)number;
+        }
+        else
+        {
+            return FALSE;
+        }
+        return TRUE;
+    }
+};
+
+using PipelineDescriptionPtr = PipelineDescription *;
@@ -0,0 +1,1395 @@
+#pragma once
+
+#include "gst/gst.h"
+#include "mmap-source.hpp"
+#include "simd-effects.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using GstElementPtr = GstElement *;
+using GstPadPtr = GstPad *;
+
+/* Structure to contain all our information, so we can pass it to callbacks */
+class Element
+{
+  public:
+    virtual ~Element() = default;
+    virtual gboolean checkValid(void) = 0;
+    virtual void gstElementFactoryMake(void) = 0;
+    virtual GstElementPtr getElement(const char *_element_name) = 0;
+    virtual GstElementPtr getSlot(std::size_t slot) = 0;
+    virtual std::size_t slotCount(void) = 0;
+    virtual std::string_view mediaType(void) = 0;
+    virtual void setPrefix(const std::string &prefix) = 0;
+    virtual void setVerbose(gboolean verbose) = 0;
+    virtual GstPadPtr getPad(const char *_pad_name) = 0;
+    virtual void setPad(const char *_pad_name, GstPadPtr pad) = 0;
+    virtual gboolean linkManyElement(void) = 0;
+};
+
+using ElementPtr = Element *;
+
+/* gst_element_factory_make() finds the factory in the registry, under the registry lock, every time it is called.
+ * The cache resolves each factory name once, keeps the loaded factory and creates every further element straight
+ * from it with gst_element_factory_create(), so building many copies of one topology pays for one lookup per
+ * factory name. Unknown names are remembered too and keep failing without another lookup. */
+class ElementFactoryCache
+{
+  public:
+    static ElementFactoryCache &instance(void)
+    {
+        static ElementFactoryCache cache;
+        return cache;
+    }
+
+    ~ElementFactoryCache()
+    {
+        for (auto &[name, factory] : factories)
+        {
+            if (factory)
+            {
+                gst_object_unref(factory);
+            }
+        }
+    }
+
+    GstElementPtr make(const char *factory_name, const char *name)
+    {
+        GstElementFactory *factory = find(factory_name);
+        return factory ? gst_element_factory_create(factory, name) : nullptr;
+    }
+
+    GstElementFactory *find(std::string_view factory_name)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = factories.find(factory_name);
+        if (it != factories.end())
+        {
+            hit_count.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        std::string key{factory_name};
+        GstElementFactory *factory = gst_element_factory_find(key.c_str());
+        if (factory)
+        {
+            /* Load the plugin now, so creating an element never has to */
+            GstPluginFeature *loaded = gst_plugin_feature_load(GST_PLUGIN_FEATURE(factory));
+            gst_object_unref(factory);
+            factory = loaded ? GST_ELEMENT_FACTORY(loaded) : nullptr;
+        }
+        factories.emplace(std::move(key), factory);
+        return factory;
+    }
+
+    guint64 hits(void) const
+    {
+        return hit_count.load(std::memory_order_relaxed);
+    }
+
+    guint64 misses(void) const
+    {
+        return miss_count.load(std::memory_order_relaxed);
+    }
+
+  private:
+    ElementFactoryCache() = default;
+
+    std::mutex lock;
+    std::map<std::string, GstElementFactory *, std::less<>> factories;
+    std::atomic<guint64> hit_count{0}; /* Read without the lock */
+    std::atomic<guint64> miss_count{0};
+};
+
+/* Typed element registry. A branch lists its elements once in a Slots struct:
+ *
+ *     struct AudioSlots
+ *     {
+ *         enum Slot : std::size_t { audio_queue, audio_convert, audio_resample, audio_sink, count };
+ *         static constexpr std::array<std::string_view, count> names{"audio_queue", ..., "audio_sink"};
+ *         static constexpr std::string_view media{"audio"};
+ *     };
+ *
+ * and derives from SlotElement<AudioSlots>. Elements are then reached by index (O(1)), by
+ * template argument (checked at compile time), or by name through a constexpr table scan
+ * that never allocates.
+ *
+ * A Slots struct whose `media` is "audio" or "video" describes a tee branch: slot 0 must be the
+ * branch queue, and the request pad of the tee is stored in "tee_pad" and linked to "queue_pad". */
+template <typename Slots> class SlotElement : public Element, public Slots
+{
+  public:
+    static constexpr std::size_t count = Slots::count;
+
+    /* Resolve a slot name to its index. Returns `count` for unknown names, so it can be used in a static_assert */
+    static constexpr std::size_t slotIndex(std::string_view name)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (Slots::names[i] == name)
+            {
+                return i;
+            }
+        }
+        return count;
+    }
+
+    template <std::size_t S> GstElementPtr get(void) const
+    {
+        static_assert(S < count, "slot index out of range");
+        return slots[S];
+    }
+
+    GstElementPtr getSlot(std::size_t slot) override
+    {
+        return slot < count ? slots[slot] : nullptr;
+    }
+
+    std::size_t slotCount(void) override
+    {
+        return count;
+    }
+
+    GstElementPtr getElement(const char *_element_name) override
+    {
+        return getSlot(slotIndex(_element_name));
+    }
+
+    std::string_view mediaType(void) override
+    {
+        return Slots::media;
+    }
+
+    /* Element names are "<prefix><slot name>", so several branches of one kind can share a bin */
+    void setPrefix(const std::string &prefix) override
+    {
+        this->prefix = prefix;
+    }
+
+    /* Print link progress, as the tutorials do */
+    void setVerbose(gboolean verbose) override
+    {
+        this->verbose = verbose;
+    }
+
+    GstPadPtr getPad(const char *_pad_name) override
+    {
+        std::string_view pad_name{_pad_name};
+        if (pad_name == "queue_pad")
+        {
+            return queue_pad;
+        }
+        else if (pad_name == "tee_pad")
+        {
+            return tee_pad;
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+
+    void setPad(const char *_pad_name, GstPadPtr pad) override
+    {
+        std::string_view pad_name{_pad_name};
+        if (pad_name == "queue_pad")
+        {
+            queue_pad = pad;
+        }
+        else if (pad_name == "tee_pad")
+        {
+            tee_pad = pad;
+        }
+    }
+
+  protected:
+    GstElementPtr make(std::size_t slot, const char *factory_name)
+    {
+        std::string name = prefix;
+        name += Slots::names[slot];
+        return slots[slot] = ElementFactoryCache::instance().make(factory_name, name.c_str());
+    }
+
+    std::array<GstElementPtr, count> slots{};
+    std::string prefix;
+    gboolean verbose = TRUE;
+    GstPadPtr queue_pad = nullptr;
+    GstPadPtr tee_pad = nullptr;
+};
+
+/* Limits for the queue at the head of a tee branch. The defaults are the ones of the queue element, which block
+ * the tee when full. A leaky branch drops its oldest buffers instead, so a slow effect cannot stall the tee or
+ * its siblings. Keep at least one non-leaky branch per tee: its sink is what paces a non-live source. */
+struct QueueLimits
+{
+    guint max_size_buffers = 200;
+    guint max_size_bytes = 10 * 1024 * 1024;
+    guint64 max_size_time = GST_SECOND;
+    gint leaky = 0; /* 0: no, 1: upstream (drop new buffers), 2: downstream (drop old buffers) */
+
+    static QueueLimits leakyBranch(guint max_size_buffers = 5)
+    {
+        QueueLimits limits;
+        limits.max_size_buffers = max_size_buffers;
+        limits.max_size_bytes = 0;
+        limits.max_size_time = 0;
+        limits.leaky = 2;
+        return limits;
+    }
+
+    void apply(GstElementPtr queue) const
+    {
+        g_object_set(queue, "max-size-buffers", max_size_buffers, "max-size-bytes", max_size_bytes, "max-size-time",
+                     max_size_time, "leaky", leaky, NULL);
+    }
+};
+
+/* The sink at the end of a branch. Headless runs use fakesink; sync = FALSE lets the branch run as fast as the
+ * data arrives instead of pacing it to the clock. */
+struct SinkConfig
+{
+    std::string factory;
+    gboolean sync = TRUE;
+
+    void apply(GstElementPtr sink) const
+    {
+        if (!sync)
+        {
+            g_object_set(sink, "sync", FALSE, NULL);
+        }
+    }
+};
+
+/* Per-branch counters, filled from pad probes on both sides of the branch queue */
+struct BranchStats
+{
+    std::atomic<guint64> buffers_in{0};
+    std::atomic<guint64> buffers_out{0};
+    std::atomic<gint64> first_out_us{0};
+    std::atomic<gint64> last_out_us{0};
+
+    static guint64 countBuffers(GstPadProbeInfo *info)
+    {
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+        {
+            return gst_buffer_list_length(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+        }
+        return 1;
+    }
+
+    static GstPadProbeReturn inProbe(GstPadPtr pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        BranchStats *stats = static_cast<BranchStats *>(user_data);
+        stats->buffers_in.fetch_add(countBuffers(info), std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+
+    static GstPadProbeReturn outProbe(GstPadPtr pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        BranchStats *stats = static_cast<BranchStats *>(user_data);
+        gint64 now = g_get_monotonic_time();
+        gint64 unset = 0;
+        stats->first_out_us.compare_exchange_strong(unset, now, std::memory_order_relaxed);
+        stats->last_out_us.store(now, std::memory_order_relaxed);
+        stats->buffers_out.fetch_add(countBuffers(info), std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+
+    void attach(GstElementPtr queue)
+    {
+        const GstPadProbeType type = (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST);
+        GstPadPtr sink = gst_element_get_static_pad(queue, "sink");
+        GstPadPtr src = gst_element_get_static_pad(queue, "src");
+        gst_pad_add_probe(sink, type, inProbe, this, NULL);
+        gst_pad_add_probe(src, type, outProbe, this, NULL);
+        gst_object_unref(sink);
+        gst_object_unref(src);
+    }
+
+    /* Buffers the queue threw away: everything that went in, minus what came out or is still queued */
+    guint64 dropped(GstElementPtr queue) const
+    {
+        guint level = 0;
+        g_object_get(queue, "current-level-buffers", &level, NULL);
+        guint64 in = buffers_in.load(std::memory_order_relaxed);
+        guint64 out = buffers_out.load(std::memory_order_relaxed) + level;
+        return in > out ? in - out : 0;
+    }
+
+    double buffersPerSecond(void) const
+    {
+        gint64 span_us = last_out_us.load(std::memory_order_relaxed) - first_out_us.load(std::memory_order_relaxed);
+        return span_us > 0 ? buffers_out.load(std::memory_order_relaxed) * 1e6 / span_us : 0.0;
+    }
+};
+
+struct AudioSlots
+{
+    enum Slot : std::size_t
+    {
+        audio_queue,
+        audio_convert,
+        audio_resample,
+        audio_sink,
+        count
+    };
+    static constexpr std::array<std::string_view, count> names{"audio_queue", "audio_convert", "audio_resample",
+                                                               "audio_sink"};
+    static constexpr std::string_view media{"audio"};
+};
+
+class AudioElement : public SlotElement<AudioSlots>
+{
+  public:
+    AudioElement(QueueLimits limits = QueueLimits(), SinkConfig sink = SinkConfig{"autoaudiosink"})
+        : limits{limits}, sink{sink}
+    {
+    }
+
+    gboolean checkValid(void) override
+    {
+        return (gboolean)(slots[audio_queue] && slots[audio_convert] && slots[audio_resample] && slots[audio_sink]);
+    }
+
+    void gstElementFactoryMake(void) override
+    {
+        make(audio_queue, "queue");
+        make(audio_convert, "audioconvert");
+        make(audio_resample, "audioresample");
+        make(audio_sink, sink.factory.c_str());
+        if (slots[audio_queue])
+        {
+            limits.apply(slots[audio_queue]);
+        }
+        if (slots[audio_sink])
+        {
+            sink.apply(slots[audio_sink]);
+        }
+    }
+
+    gboolean linkManyElement(void) override
+    {
+        return gst_element_link_many(slots[audio_queue], slots[audio_convert], slots[audio_resample],
+                                     slots[audio_sink], NULL);
+    }
+
+  private:
+    QueueLimits limits;
+    SinkConfig sink;
+};
+
+using AudioElementPtr = AudioElement *;
+
+struct VideoSlots
+{
+    enum Slot : std::size_t
+    {
+        video_queue,
+        video_convert,
+        video_filter,
+        video_convert_after_filter,
+        video_sink,
+        count
+    };
+    static constexpr std::array<std::string_view, count> names{"video_queue", "video_convert", "video_filter",
+                                                               "video_convert_after_filter", "video_sink"};
+    static constexpr std::string_view media{"video"};
+};
+
+class VideoElement : public SlotElement<VideoSlots>
+{
+  public:
+    static constexpr std::array<std::string_view, 12> list_video_filter_name = {
+        "agingtv", "dicetv", "edgetv",       "optv",     "quarktv",   "radioactv",
+        "revtv",   "rippletv", "shagadelictv", "streaktv", "vertigotv", "warptv"};
+
+    /* A fused branch runs an effect that takes YUV (SimdEffects::takesYuv) on the frames as they arrive and converts
+     * once, after it, only if the sink needs another format: queue -> filter -> videoconvert -> sink, where the
+     * videoconvert is a passthrough whenever the sink takes the decoder's format. Other effects ignore `fused`. */
+    VideoElement(std::string filter_name = "", QueueLimits limits = QueueLimits(),
+                 SinkConfig sink = SinkConfig{"autovideosink"}, gboolean fused = FALSE)
+        : limits{limits}, sink{sink}
+    {
+        this->filter_name = filter_name;
+        has_filter = checkFilterNameValid(this->filter_name);
+        this->fused = (gboolean)(fused && has_filter && SimdEffects::takesYuv(this->filter_name));
+    }
+
+    gboolean checkValid(void) override
+    {
+        return (gboolean)(slots[video_queue] && slots[video_convert] && slots[video_sink] &&
+                          (!has_filter || (slots[video_filter] && (fused || slots[video_convert_after_filter]))));
+    }
+
+    // Check if Element use filter or use a valid filter: an effectv one, or an in-tree SimdEffects one
+    static gboolean checkFilterNameValid(std::string_view filter_name)
+    {
+        return (gboolean)(std::find(list_video_filter_name.begin(), list_video_filter_name.end(), filter_name) !=
+                              list_video_filter_name.end() ||
+                          SimdEffects::isSimdEffect(filter_name));
+    }
+
+    gboolean isFused(void) const
+    {
+        return fused;
+    }
+
+    /* Threads each videoconvert of the branch splits a frame over, in horizontal slices: 1 (the default) converts on
+     * the streaming thread, 0 uses one thread per core. Call before gstElementFactoryMake(). */
+    void setConvertThreads(guint threads)
+    {
+        convert_threads = threads;
+    }
+
+    void gstElementFactoryMake(void) override
+    {
+        make(video_queue, "queue");
+        make(video_convert, "videoconvert");
+        if (has_filter)
+        {
+            if (SimdEffects::isSimdEffect(this->filter_name))
+            {
+                SimdEffects::registerElements();
+            }
+            make(video_filter, this->filter_name.c_str());
+            if (!fused)
+            {
+                make(video_convert_after_filter, "videoconvert");
+            }
+        }
+        make(video_sink, sink.factory.c_str());
+        applyConvertThreads(slots[video_convert]);
+        applyConvertThreads(slots[video_convert_after_filter]);
+        if (slots[video_queue])
+        {
+            limits.apply(slots[video_queue]);
+        }
+        if (slots[video_sink])
+        {
+            sink.apply(slots[video_sink]);
+        }
+    }
+
+    gboolean linkManyElement(void) override
+    {
+        if (has_filter)
+        {
+            if (verbose)
+            {
+                std::cout << (fused ? "HAS fused filter" : "HAS filter") << std::endl;
+            }
+            if (fused)
+            {
+                return gst_element_link_many(slots[video_queue], slots[video_filter], slots[video_convert],
+                                             slots[video_sink], NULL);
+            }
+            return gst_element_link_many(slots[video_queue], slots[video_convert], slots[video_filter],
+                                         slots[video_convert_after_filter], slots[video_sink], NULL);
+        }
+        else
+        {
+            if (verbose)
+            {
+                std::cout << "NO filter" << std::endl;
+            }
+            return gst_element_link_many(slots[video_queue], slots[video_convert], slots[video_sink], NULL);
+        }
+    }
+
+    /* Bytes one frame costs in memory traffic through `element` once caps are negotiated: the frame it reads plus the
+     * frame it writes. A converter whose input and output caps are the same is a passthrough and costs nothing. */
+    static guint64 frameTraffic(GstElementPtr element, gboolean converter)
+    {
+        if (!element)
+        {
+            return 0;
+        }
+        GstPadPtr sink_pad = gst_element_get_static_pad(element, "sink");
+        GstPadPtr src_pad = gst_element_get_static_pad(element, "src");
+        GstCaps *in_caps = sink_pad ? gst_pad_get_current_caps(sink_pad) : NULL;
+        GstCaps *out_caps = src_pad ? gst_pad_get_current_caps(src_pad) : NULL;
+        guint64 bytes = 0;
+        GstVideoInfo in_info, out_info;
+        if (in_caps && out_caps && !(converter && gst_caps_is_equal(in_caps, out_caps)) &&
+            gst_video_info_from_caps(&in_info, in_caps) && gst_video_info_from_caps(&out_info, out_caps))
+        {
+            bytes = GST_VIDEO_INFO_SIZE(&in_info) + GST_VIDEO_INFO_SIZE(&out_info);
+        }
+        if (in_caps)
+        {
+            gst_caps_unref(in_caps);
+        }
+        if (out_caps)
+        {
+            gst_caps_unref(out_caps);
+        }
+        if (sink_pad)
+        {
+            gst_object_unref(sink_pad);
+        }
+        if (src_pad)
+        {
+            gst_object_unref(src_pad);
+        }
+        return bytes;
+    }
+
+    /* Memory traffic per frame of the converters and the effect of this branch, while playing */
+    guint64 bytesPerFrame(void) const
+    {
+        return frameTraffic(slots[video_convert], TRUE) + frameTraffic(slots[video_filter], FALSE) +
+               frameTraffic(slots[video_convert_after_filter], TRUE);
+    }
+
+  private:
+    /* n-threads only exists since GStreamer 1.20; older versions keep converting on one thread */
+    void applyConvertThreads(GstElementPtr convert) const
+    {
+        if (convert && convert_threads != 1 &&
+            g_object_class_find_property(G_OBJECT_GET_CLASS(convert), "n-threads"))
+        {
+            g_object_set(convert, "n-threads", convert_threads, NULL);
+        }
+    }
+
+    std::string filter_name;
+    gboolean has_filter;
+    gboolean fused = FALSE;
+    guint convert_threads = 1;
+    QueueLimits limits;
+    SinkConfig sink;
+};
+
+using VideoElementPtr = VideoElement *;
+
+struct TeeSlots
+{
+    enum Slot : std::size_t
+    {
+        tee,
+        count
+    };
+    static constexpr std::array<std::string_view, count> names{"tee"};
+    static constexpr std::string_view media{""};
+};
+
+class TeeElement : public SlotElement<TeeSlots>
+{
+  public:
+    TeeElement()
+    {
+    }
+
+    gboolean checkValid(void) override
+    {
+        return (gboolean)(slots[tee] != nullptr);
+    }
+
+    void gstElementFactoryMake(void) override
+    {
+        make(tee, "tee");
+        if (slots[tee])
+        {
+            /* Branches can be attached and detached while playing, so an unlinked src pad is not an error */
+            g_object_set(slots[tee], "allow-not-linked", TRUE, NULL);
+        }
+    }
+
+    gboolean linkManyElement(void) override
+    {
+        return 1;
+    }
+};
+
+using TeeElementPtr = TeeElement *;
+
+class PipelineAction
+{
+  public:
+    virtual ~PipelineAction() = default;
+    virtual GstStateChangeReturn changeStatePlaying(void) = 0;
+    virtual GstStateChangeReturn changeStateNull(void) = 0;
+    virtual GstStateChangeReturn changeStateReady(void) = 0;
+    virtual GstStateChangeReturn changeStatePaused(void) = 0;
+    virtual void setSourceProperties(std::string &url) = 0;
+    virtual void addManyElement(void) = 0;
+    virtual gboolean linkRequestPadsTee(void) = 0;
+    virtual void unref(void) = 0;
+};
+
+struct PipelineSlots
+{
+    enum Slot : std::size_t
+    {
+        pipeline,
+        source,
+        source_filter,
+        tee,
+        tee_audio,
+        count
+    };
+    static constexpr std::array<std::string_view, count> names{"pipeline", "source", "source_filter", "tee",
+                                                               "tee_audio"};
+    static constexpr std::string_view media{""};
+};
+
+/* What a PipelineElement is built from. The default is the tutorial pipeline: uridecodebin feeding one audio and
+ * one video branch that play on the local devices. */
+struct PipelineConfig
+{
+    std::string name = "test-pipeline";
+    std::string source_factory = "uridecodebin";
+    std::string source_description; /* A gst-launch bin used instead of source_factory, one src pad per stream */
+    gint num_buffers = -1;   /* Stop test sources after this many buffers, -1 runs forever */
+    std::string source_caps; /* Caps forced on a static source pad, e.g. "video/x-raw,width=1920,height=1080" */
+    std::function<void(GstElementPtr)> source_setup; /* Called on the source once created, e.g. to set up appsrc */
+    gboolean mmap_source = FALSE; /* file:// URIs are read by mmapfilesrc instead of filesrc, see MmapSource */
+    gboolean audio = TRUE;
+    gboolean video = TRUE;
+    gboolean verbose = TRUE; /* Print pad and link progress, as the tutorials do */
+    SinkConfig audio_sink{"autoaudiosink"};
+    SinkConfig video_sink{"autovideosink"};
+    guint video_convert_threads = 1; /* See VideoElement::setConvertThreads() */
+};
+
+/* Print the result of a gst_pad_link() call */
+inline void printPadLinkReturn(GstPadLinkReturn ra)
+{
+    switch (ra)
+    {
+    case GST_PAD_LINK_OK:
+        g_print("link succeeded\n");
+        break;
+    case GST_PAD_LINK_WRONG_HIERARCHY:
+        g_printerr("pads have no common grandparent\n");
+        break;
+    case GST_PAD_LINK_WAS_LINKED:
+        g_printerr("pad was already linked\n");
+        break;
+    case GST_PAD_LINK_WRONG_DIRECTION:
+        g_printerr("pads have wrong direction\n");
+        break;
+    case GST_PAD_LINK_NOFORMAT:
+        g_printerr("pads do not have common format\n");
+        break;
+    case GST_PAD_LINK_NOSCHED:
+        g_printerr("pads cannot cooperate in scheduling\n");
+        break;
+    case GST_PAD_LINK_REFUSED:
+        g_printerr("refused for some reason\n");
+        break;
+    default:
+        break;
+    }
+}
+
+/* Audio branches hang off tee_audio and video branches off tee; every branch gets its own request pad */
+class PipelineElement : public PipelineAction, public SlotElement<PipelineSlots>
+{
+  public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    PipelineElement(PipelineConfig config = PipelineConfig())
+        : config{config}, tee_element{new TeeElement()}, tee_audio_element{new TeeElement()}, audio_branch{npos},
+          video_branch{npos}
+    {
+        tee_audio_element->setPrefix("audio_");
+        if (config.audio)
+        {
+            addBranch(new AudioElement(QueueLimits(), config.audio_sink));
+        }
+        if (config.video)
+        {
+            VideoElementPtr video = new VideoElement("", QueueLimits(), config.video_sink);
+            video->setConvertThreads(config.video_convert_threads);
+            addBranch(video);
+        }
+    }
+
+    ~PipelineElement()
+    {
+        for (ElementPtr ele : list_elements)
+        {
+            delete ele;
+        }
+        delete tee_element;
+        delete tee_audio_element;
+        if (config.verbose)
+        {
+            std::cout << __FUNCTION__ << std::endl;
+        }
+    }
+
+    /* Register a branch and return its index, which stays valid for the lifetime of the pipeline.
+     * Branches added here are built by gstElementFactoryMake(); use attachBranch() once the pipeline runs.
+     * The first branch of each media is the one audioBranch()/videoBranch() report. */
+    std::size_t addBranch(ElementPtr branch)
+    {
+        std::size_t index = list_elements.size();
+        branch->setPrefix("branch" + std::to_string(index) + "_");
+        branch->setVerbose(config.verbose);
+        list_elements.push_back(branch);
+        branch_stats.emplace_back();
+        if (branch->mediaType() == "audio" && audio_branch == npos)
+        {
+            audio_branch = index;
+        }
+        else if (branch->mediaType() == "video" && video_branch == npos)
+        {
+            video_branch = index;
+        }
+        return index;
+    }
+
+    std::size_t branchCount(void) const
+    {
+        return list_elements.size();
+    }
+
+    std::size_t audioBranch(void) const
+    {
+        return audio_branch;
+    }
+
+    std::size_t videoBranch(void) const
+    {
+        return video_branch;
+    }
+
+    GstStateChangeReturn changeStatePlaying() override
+    {
+        return gst_element_set_state(slots[pipeline], GST_STATE_PLAYING);
+    }
+
+    GstStateChangeReturn changeStateNull() override
+    {
+        return gst_element_set_state(slots[pipeline], GST_STATE_NULL);
+    }
+
+    GstStateChangeReturn changeStateReady() override
+    {
+        return gst_element_set_state(slots[pipeline], GST_STATE_READY);
+    }
+
+    GstStateChangeReturn changeStatePaused() override
+    {
+        return gst_element_set_state(slots[pipeline], GST_STATE_PAUSED);
+    }
+
+    void setSourceProperties(std::string &url) override
+    {
+        /* Set the URI to play; test sources have nothing to set */
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(slots[source]), "uri"))
+        {
+            g_object_set(slots[source], "uri", url.c_str(), NULL);
+        }
+    }
+
+    void addManyElement(void) override
+    {
+        GstBin *bin = GST_BIN(slots[pipeline]);
+        gst_bin_add_many(bin, slots[source], slots[tee], slots[tee_audio], NULL);
+        if (slots[source_filter])
+        {
+            gst_bin_add(bin, slots[source_filter]);
+        }
+        for (ElementPtr ele : list_elements)
+        {
+            if (!ele)
+                continue;
+            for (std::size_t s = 0; s < ele->slotCount(); ++s)
+            {
+                /* Optional slots (e.g. video_filter of an unfiltered branch) stay empty */
+                if (GstElementPtr e = ele->getSlot(s))
+                {
+                    gst_bin_add(bin, e);
+                }
+            }
+        }
+    }
+
+    gboolean linkManyElement(void) override
+    {
+        gboolean r = 1;
+        for (ElementPtr ele : list_elements)
+        {
+            if (!ele)
+                continue;
+            r &= ele->linkManyElement();
+        }
+        return r;
+    }
+
+    void unref(void) override
+    {
+        /* Release the request pads from the Tee, and unref them */
+        for (ElementPtr ele : list_elements)
+        {
+            if (!ele)
+                continue;
+            GstPadPtr tee_pad = ele->getPad("tee_pad");
+            GstPadPtr queue_pad = ele->getPad("queue_pad");
+            if (tee_pad)
+            {
+                gst_element_release_request_pad(teeFor(ele), tee_pad);
+                gst_object_unref(tee_pad);
+                gst_object_unref(queue_pad);
+                ele->setPad("tee_pad", nullptr);
+                ele->setPad("queue_pad", nullptr);
+            }
+        }
+        gst_object_unref(slots[pipeline]);
+    }
+
+    gboolean checkValid(void) override
+    {
+        gboolean ret = 1;
+
+        for (ElementPtr ele : list_elements)
+        {
+            if (!ele)
+                continue;
+            ret &= ele->checkValid();
+            if (!ret)
+                return 0;
+        }
+
+        return (gboolean)(ret && slots[pipeline] && slots[source] && slots[tee] && slots[tee_audio] &&
+                          (config.source_caps.empty() || slots[source_filter]));
+    }
+
+    void gstElementFactoryMake(void) override
+    {
+        for (ElementPtr ele : list_elements)
+            if (ele)
+                ele->gstElementFactoryMake();
+
+        tee_element->gstElementFactoryMake();
+        tee_audio_element->gstElementFactoryMake();
+        slots[tee] = tee_element->get<TeeElement::tee>();
+        slots[tee_audio] = tee_audio_element->get<TeeElement::tee>();
+        if (!config.source_description.empty())
+        {
+            GError *err = NULL;
+            slots[source] = gst_parse_bin_from_description(config.source_description.c_str(), TRUE, &err);
+            if (err)
+            {
+                g_printerr("Source description could not be parsed: %s\n", err->message);
+                g_clear_error(&err);
+            }
+            if (slots[source])
+            {
+                gst_object_set_name(GST_OBJECT(slots[source]), "source");
+            }
+        }
+        else
+        {
+            MmapSource::prefer(config.mmap_source);
+            slots[source] = ElementFactoryCache::instance().make(config.source_factory.c_str(), "source");
+        }
+        if (slots[source] && config.num_buffers >= 0 &&
+            g_object_class_find_property(G_OBJECT_GET_CLASS(slots[source]), "num-buffers"))
+        {
+            g_object_set(slots[source], "num-buffers", config.num_buffers, NULL);
+        }
+        if (slots[source] && config.source_setup)
+        {
+            config.source_setup(slots[source]);
+        }
+        if (!config.source_caps.empty())
+        {
+            GstCaps *caps = gst_caps_from_string(config.source_caps.c_str());
+            slots[source_filter] = caps ? ElementFactoryCache::instance().make("capsfilter", "source_filter") : nullptr;
+            if (slots[source_filter])
+            {
+                g_object_set(slots[source_filter], "caps", caps, NULL);
+            }
+            if (caps)
+            {
+                gst_caps_unref(caps);
+            }
+        }
+        slots[pipeline] = gst_pipeline_new(config.name.c_str());
+    }
+
+    /* Sources with an always src pad (videotestsrc, audiotestsrc) are linked straight to their tee, and a
+     * source_description bin links each of its pads to the tee of its media. Decodebins only expose pads once they
+     * know the stream, so those are linked from pad-added. With `source_caps`, a single-pad source goes through a
+     * capsfilter first. */
+    gboolean linkSource(void)
+    {
+        GstPadPtr src_pad = gst_element_get_static_pad(slots[source], "src");
+        if (src_pad)
+        {
+            GstElementPtr target = teeForPad(src_pad);
+            gst_object_unref(src_pad);
+            if (slots[source_filter])
+            {
+                return gst_element_link_many(slots[source], slots[source_filter], target, NULL);
+            }
+            return gst_element_link(slots[source], target);
+        }
+
+        SourcePads pads{this, 0, 1};
+        gst_element_foreach_src_pad(slots[source], linkSourcePad, &pads);
+        if (pads.count == 0)
+        {
+            g_signal_connect(slots[source], "pad-added", G_CALLBACK(padAddedHandler), this);
+            return 1;
+        }
+        return pads.ok;
+    }
+
+    /* All the setup steps of the tutorial in one call: create, add, link the branches, the tees and the source */
+    gboolean build(void)
+    {
+        gstElementFactoryMake();
+        if (!checkValid())
+        {
+            g_printerr("Not all elements could be created.\n");
+            return 0;
+        }
+
+        addManyElement();
+        if (!linkManyElement())
+        {
+            g_printerr("Elements could not be linked.\n");
+            return 0;
+        }
+
+        /* Manually link the Tee, which has "Request" pads */
+        if (!linkRequestPadsTee())
+        {
+            g_printerr("Tee could not be linked.\n");
+            return 0;
+        }
+
+        if (!linkSource())
+        {
+            g_printerr("Source could not be linked.\n");
+            return 0;
+        }
+        return 1;
+    }
+
+    /* This function will be called by the pad-added signal */
+    static void padAddedHandler(GstElementPtr src, GstPadPtr new_pad, PipelineElement *data)
+    {
+        GstPadLinkReturn ret;
+        GstCaps *new_pad_caps = NULL;
+        GstStructure *new_pad_struct = NULL;
+        const gchar *new_pad_type = NULL;
+        GstPadPtr sink_pad = NULL;
+
+        gboolean verbose = data->config.verbose;
+        if (verbose)
+        {
+            g_print("Received new pad '%s' from '%s':\n", GST_PAD_NAME(new_pad), GST_ELEMENT_NAME(src));
+        }
+
+        /* Check the new pad's type */
+        new_pad_caps = gst_pad_get_current_caps(new_pad);
+        new_pad_struct = gst_caps_get_structure(new_pad_caps, 0);
+        new_pad_type = gst_structure_get_name(new_pad_struct);
+        if (g_str_has_prefix(new_pad_type, "audio/x-raw") && data->audio_branch != npos)
+        {
+            sink_pad = gst_element_get_static_pad(data->slots[tee_audio], "sink");
+        }
+        else if (g_str_has_prefix(new_pad_type, "video/x-raw") && data->video_branch != npos)
+        {
+            sink_pad = gst_element_get_static_pad(data->slots[tee], "sink");
+        }
+        else
+        {
+            if (verbose)
+            {
+                g_print("It has type '%s' which is not raw video or raw audio. Ignoring.\n", new_pad_type);
+            }
+            goto exit;
+        }
+
+        /* If our tee is already linked, we have nothing to do here */
+        if (gst_pad_is_linked(sink_pad))
+        {
+            if (verbose)
+            {
+                g_print("We are already linked. Ignoring.\n");
+            }
+            goto exit;
+        }
+
+        /* Attempt the link */
+        ret = gst_pad_link(new_pad, sink_pad);
+        if (GST_PAD_LINK_FAILED(ret))
+        {
+            g_printerr("Type is '%s' but link failed.\n", new_pad_type);
+        }
+        else if (verbose)
+        {
+            g_print("Link succeeded (type '%s').\n", new_pad_type);
+        }
+
+    exit:
+        /* Unreference the new pad's caps, if we got them */
+        if (new_pad_caps != NULL)
+        {
+            gst_caps_unref(new_pad_caps);
+        }
+
+        /* Unreference the sink pad */
+        if (sink_pad != NULL)
+        {
+            gst_object_unref(sink_pad);
+        }
+    }
+
+    /* The last element of a branch, i.e. its sink */
+    GstElementPtr branchSink(std::size_t ei)
+    {
+        if (ei >= list_elements.size() || !list_elements[ei])
+        {
+            return nullptr;
+        }
+        GstElementPtr sink = nullptr;
+        for (std::size_t s = list_elements[ei]->slotCount(); !sink && s-- > 0;)
+        {
+            sink = list_elements[ei]->getSlot(s);
+        }
+        return sink;
+    }
+
+    /* O(1) lookup of a branch element, e.g. getElement(audioBranch(), AudioElement::audio_convert) */
+    GstElementPtr getElement(std::size_t branch, std::size_t slot)
+    {
+        return branch < list_elements.size() && list_elements[branch] ? list_elements[branch]->getSlot(slot) : nullptr;
+    }
+
+    /* Name lookup kept for "pipeline", "source", "tee" and "list_elements.<i>.<slot>" paths. The path is
+     * split in place with std::from_chars; nothing is allocated and no regex is compiled. */
+    GstElementPtr getElement(const char *_element_name) override
+    {
+        std::string_view element_name{_element_name};
+        std::size_t slot = slotIndex(element_name);
+        if (slot < count)
+        {
+            return slots[slot];
+        }
+
+        constexpr std::string_view list_prefix{"list_elements."};
+        if (element_name.substr(0, list_prefix.size()) != list_prefix)
+        {
+            return nullptr;
+        }
+        std::string_view sub = element_name.substr(list_prefix.size());
+
+        std::size_t list_elements_idx = 0;
+        auto [end, ec] = std::from_chars(sub.data(), sub.data() + sub.size(), list_elements_idx);
+        if (ec != std::errc() || end == sub.data() + sub.size() || *end != '.' ||
+            list_elements_idx >= list_elements.size() || !list_elements[list_elements_idx])
+        {
+            return nullptr;
+        }
+        return list_elements[list_elements_idx]->getElement(end + 1);
+    }
+
+    /* Fan every branch out of its tee: one request pad per branch, linked to the sink pad of the branch queue */
+    gboolean linkRequestPadsTee(void) override
+    {
+        gboolean r = 1;
+        for (std::size_t ei = 0; ei < list_elements.size(); ++ei)
+        {
+            r &= linkBranch(ei);
+        }
+        return r;
+    }
+
+    /* Build, link and start a branch while the pipeline is running. The new tee pad carries no data until it is
+     * linked, so the branch is brought to the pipeline state first and linked last. Call from the application
+     * thread. */
+    gboolean attachBranch(ElementPtr branch, std::size_t *index_out = nullptr)
+    {
+        std::size_t ei = addBranch(branch);
+        branch->gstElementFactoryMake();
+        if (!branch->checkValid())
+        {
+            g_printerr("Not all elements of branch %zu could be created.\n", ei);
+
+            /* The ones that were created are still floating, owned by nobody */
+            for (std::size_t s = 0; s < branch->slotCount(); ++s)
+            {
+                if (GstElementPtr e = branch->getSlot(s))
+                {
+                    gst_object_unref(gst_object_ref_sink(e));
+                }
+            }
+            list_elements[ei] = nullptr;
+            delete branch;
+            return 0;
+        }
+
+        GstBin *bin = GST_BIN(slots[pipeline]);
+        for (std::size_t s = 0; s < branch->slotCount(); ++s)
+        {
+            if (GstElementPtr e = branch->getSlot(s))
+            {
+                gst_bin_add(bin, e);
+            }
+        }
+
+        /* Start from the sink so every element is ready before data reaches it */
+        gboolean r = branch->linkManyElement();
+        for (std::size_t s = branch->slotCount(); r && s-- > 0;)
+        {
+            if (GstElementPtr e = branch->getSlot(s))
+            {
+                r &= gst_element_sync_state_with_parent(e);
+            }
+        }
+
+        if (!r || !linkBranch(ei))
+        {
+            g_printerr("Branch %zu could not be attached.\n", ei);
+            detachBranch(ei, FALSE);
+            return 0;
+        }
+
+        if (index_out)
+        {
+            *index_out = ei;
+        }
+        return 1;
+    }
+
+    /* Unlink a branch from its tee while the pipeline is running and tear it down; the other branches keep
+     * flowing. The tee pad is unlinked from an IDLE probe, i.e. between two buffers, and then released. With
+     * `drain`, an EOS is pushed into the branch and its sink gets up to `timeout` to finish (e.g. to close a
+     * recording) before the branch is set to NULL. Call from the application thread. */
+    gboolean detachBranch(std::size_t ei, gboolean drain = TRUE,
+                          std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+    {
+        if (ei >= list_elements.size() || !list_elements[ei])
+        {
+            return 0;
+        }
+        ElementPtr branch = list_elements[ei];
+        GstPadPtr tee_pad = branch->getPad("tee_pad");
+        GstPadPtr queue_pad = branch->getPad("queue_pad");
+        gboolean r = 1;
+
+        if (tee_pad)
+        {
+            auto wait = std::make_shared<ProbeWait>();
+            wait->peer = queue_pad;
+            gulong id = gst_pad_add_probe(tee_pad, GST_PAD_PROBE_TYPE_IDLE, unlinkOnIdle,
+                                          new std::shared_ptr<ProbeWait>(wait), ProbeWait::release);
+            if (!wait->waitFor(timeout))
+            {
+                g_printerr("Tee pad %s of branch %zu never went idle.\n", GST_PAD_NAME(tee_pad), ei);
+                gst_pad_remove_probe(tee_pad, id);
+                gst_pad_unlink(tee_pad, queue_pad);
+                r = 0;
+            }
+            gst_element_release_request_pad(teeFor(branch), tee_pad);
+            gst_object_unref(tee_pad);
+            branch->setPad("tee_pad", nullptr);
+        }
+
+        if (queue_pad)
+        {
+            GstElementPtr sink = branchSink(ei);
+            GstPadPtr sink_pad = sink ? gst_element_get_static_pad(sink, "sink") : nullptr;
+            if (drain && sink_pad)
+            {
+                auto wait = std::make_shared<ProbeWait>();
+                gulong id = gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, notifyOnEos,
+                                              new std::shared_ptr<ProbeWait>(wait), ProbeWait::release);
+                gst_pad_send_event(queue_pad, gst_event_new_eos());
+                if (!wait->waitFor(timeout))
+                {
+                    g_printerr("Branch %zu did not drain in time.\n", ei);
+                }
+                gst_pad_remove_probe(sink_pad, id);
+            }
+            if (sink_pad)
+            {
+                gst_object_unref(sink_pad);
+            }
+            gst_object_unref(queue_pad);
+            branch->setPad("queue_pad", nullptr);
+        }
+
+        GstBin *bin = GST_BIN(slots[pipeline]);
+        for (std::size_t s = 0; s < branch->slotCount(); ++s)
+        {
+            if (GstElementPtr e = branch->getSlot(s))
+            {
+                gst_element_set_state(e, GST_STATE_NULL);
+                gst_bin_remove(bin, e);
+            }
+        }
+
+        list_elements[ei] = nullptr;
+        delete branch;
+        return r;
+    }
+
+    /* Per-branch throughput and drops, measured at the branch queue */
+    void printBranchStats(void)
+    {
+        g_print("%-8s %-8s %-14s %12s %12s %12s %10s\n", "branch", "media", "head", "in", "out", "dropped",
+                "buf/s");
+        for (std::size_t ei = 0; ei < list_elements.size(); ++ei)
+        {
+            if (!list_elements[ei])
+                continue;
+            GstElementPtr queue = list_elements[ei]->getSlot(0);
+            BranchStats &stats = branch_stats[ei];
+            std::string media{list_elements[ei]->mediaType()};
+            g_print("%-8zu %-8s %-14s %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT
+                    " %10.1f\n",
+                    ei, media.c_str(), queue ? GST_ELEMENT_NAME(queue) : "-", stats.buffers_in.load(),
+                    stats.buffers_out.load(), queue ? stats.dropped(queue) : 0, stats.buffersPerSecond());
+        }
+    }
+
+  private:
+    /* One-shot flag raised from a pad probe and waited on by the application thread. Probes hold their own
+     * reference, so a probe that fires after the waiter timed out never touches freed memory. */
+    struct ProbeWait
+    {
+        std::mutex lock;
+        std::condition_variable cond;
+        gboolean done = FALSE;
+        GstPadPtr peer = nullptr;
+
+        void notify(void)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            done = TRUE;
+            cond.notify_all();
+        }
+
+        gboolean waitFor(std::chrono::milliseconds timeout)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            return (gboolean)cond.wait_for(guard, timeout, [this] { return done != FALSE; });
+        }
+
+        static ProbeWait &from(gpointer user_data)
+        {
+            return **static_cast<std::shared_ptr<ProbeWait> *>(user_data);
+        }
+
+        static void release(gpointer user_data)
+        {
+            delete static_cast<std::shared_ptr<ProbeWait> *>(user_data);
+        }
+    };
+
+    static GstPadProbeReturn unlinkOnIdle(GstPadPtr pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        ProbeWait &wait = ProbeWait::from(user_data);
+        gst_pad_unlink(pad, wait.peer);
+        wait.notify();
+        return GST_PAD_PROBE_REMOVE;
+    }
+
+    static GstPadProbeReturn notifyOnEos(GstPadPtr pad, GstPadProbeInfo *info, gpointer user_data)
+    {
+        if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS)
+        {
+            ProbeWait::from(user_data).notify();
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstElementPtr teeFor(ElementPtr branch)
+    {
+        return branch->mediaType() == "audio" ? slots[tee_audio] : slots[tee];
+    }
+
+    /* A pad that cannot tell its caps yet (e.g. an appsrc without caps) feeds the video tee */
+    GstElementPtr teeForPad(GstPadPtr pad)
+    {
+        GstCaps *caps = gst_pad_query_caps(pad, NULL);
+        gboolean audio = !gst_caps_is_any(caps) && !gst_caps_is_empty(caps) &&
+                         g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "audio/");
+        gst_caps_unref(caps);
+        return audio ? slots[tee_audio] : slots[tee];
+    }
+
+    struct SourcePads
+    {
+        PipelineElement *self;
+        std::size_t count;
+        gboolean ok;
+    };
+
+    static gboolean linkSourcePad(GstElementPtr src, GstPadPtr pad, gpointer user_data)
+    {
+        SourcePads *pads = static_cast<SourcePads *>(user_data);
+        GstPadPtr sink_pad = gst_element_get_static_pad(pads->self->teeForPad(pad), "sink");
+        pads->ok &= (gboolean)(gst_pad_link(pad, sink_pad) == GST_PAD_LINK_OK);
+        gst_object_unref(sink_pad);
+        ++pads->count;
+        return TRUE;
+    }
+
+    gboolean linkBranch(std::size_t ei)
+    {
+        ElementPtr branch = list_elements[ei];
+        if (!branch || branch->mediaType().empty())
+        {
+            return 1;
+        }
+
+        GstPadPtr queue_pad = gst_element_get_static_pad(branch->getSlot(0), "sink");
+        GstPadPtr tee_pad = gst_element_get_request_pad(teeFor(branch), "src_%u");
+        branch->setPad("queue_pad", queue_pad);
+        branch->setPad("tee_pad", tee_pad);
+        GstPadLinkReturn ra = gst_pad_link(tee_pad, queue_pad);
+        if (config.verbose || ra != GST_PAD_LINK_OK)
+        {
+            g_print("Obtained request pad %s for %s branch %zu.\n", GST_PAD_NAME(tee_pad),
+                    std::string(branch->mediaType()).c_str(), ei);
+            printPadLinkReturn(ra);
+        }
+        if (ra != GST_PAD_LINK_OK)
+        {
+            return 0;
+        }
+
+        branch_stats[ei].attach(branch->getSlot(0));
+        return 1;
+    }
+
+    PipelineConfig config;
+    TeeElementPtr tee_element;
+    TeeElementPtr tee_audio_element;
+    std::vector<ElementPtr> list_elements;
+    std::deque<BranchStats> branch_stats;
+    std::size_t audio_branch;
+    std::size_t video_branch;
+};
+
+using PipelineElementPtr = PipelineElement *;
+
+/* Compile-time checks: slot names resolve without touching the runtime */
+static_assert(AudioElement::slotIndex("audio_convert") == AudioElement::audio_convert);
+static_assert(VideoElement::slotIndex("video_sink") == VideoElement::video_sink);
+static_assert(VideoElement::slotIndex("no_such_slot") == VideoElement::count);
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "pipeline-element.hpp"
+#include <deque>
+
+/* Runs many independent PipelineElement instances in one process. The bus of every pipeline is watched from one
+ * shared GMainContext, dispatched by whichever thread calls run(), so N pipelines cost their own streaming threads
+ * but share a single thread for message handling and a single plugin registry. */
+class PipelineHost
+{
+  public:
+    struct Entry
+    {
+        PipelineHost *host;
+        PipelineElementPtr pipeline;
+        GSource *watch;
+        gboolean done;
+        gboolean failed;
+        gint64 start_us;
+        gint64 end_us;
+    };
+
+    PipelineHost() : context{g_main_context_new()}, loop{nullptr}, running{0}
+    {
+        loop = g_main_loop_new(context, FALSE);
+    }
+
+    ~PipelineHost()
+    {
+        for (Entry &entry : entries)
+        {
+            g_source_destroy(entry.watch);
+            g_source_unref(entry.watch);
+            entry.pipeline->changeStateNull();
+            entry.pipeline->unref();
+            delete entry.pipeline;
+        }
+        g_main_loop_unref(loop);
+        g_main_context_unref(context);
+    }
+
+    GMainContext *getContext(void)
+    {
+        return context;
+    }
+
+    /* Take ownership of a built pipeline and watch its bus from the shared context */
+    std::size_t add(PipelineElementPtr pipeline)
+    {
+        entries.push_back(Entry{this, pipeline, nullptr, FALSE, FALSE, 0, 0});
+        Entry &entry = entries.back();
+
+        GstBus *bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+        entry.watch = gst_bus_create_watch(bus);
+        g_source_set_callback(entry.watch, (GSourceFunc)busCallback, &entry, NULL);
+        g_source_attach(entry.watch, context);
+        gst_object_unref(bus);
+        return entries.size() - 1;
+    }
+
+    /* Set every pipeline to PLAYING. Returns the number that failed to start. */
+    std::size_t start(void)
+    {
+        std::size_t failures = 0;
+        for (Entry &entry : entries)
+        {
+            entry.start_us = g_get_monotonic_time();
+            if (entry.pipeline->changeStatePlaying() == GST_STATE_CHANGE_FAILURE)
+            {
+                g_printerr("Unable to set %s to the playing state.\n", pipelineName(entry));
+                entry.failed = TRUE;
+                entry.done = TRUE;
+                entry.end_us = entry.start_us;
+                ++failures;
+            }
+            else
+            {
+                ++running;
+            }
+        }
+        return failures;
+    }
+
+    /* Dispatch bus messages of all pipelines until every one reached EOS or failed */
+    void run(void)
+    {
+        if (running > 0)
+        {
+            g_main_loop_run(loop);
+        }
+    }
+
+    /* Call `func` every `interval_ms` from the shared context while run() is dispatching */
+    guint addTimeout(guint interval_ms, GSourceFunc func, gpointer user_data)
+    {
+        GSource *timeout = g_timeout_source_new(interval_ms);
+        g_source_set_callback(timeout, func, user_data, NULL);
+        guint id = g_source_attach(timeout, context);
+        g_source_unref(timeout);
+        return id;
+    }
+
+    const std::deque<Entry> &getEntries(void) const
+    {
+        return entries;
+    }
+
+  private:
+    static const gchar *pipelineName(Entry &entry)
+    {
+        return GST_ELEMENT_NAME(entry.pipeline->getElement("pipeline"));
+    }
+
+    void finish(Entry &entry, gboolean failed)
+    {
+        if (entry.done)
+        {
+            return;
+        }
+        entry.done = TRUE;
+        entry.failed = failed;
+        entry.end_us = g_get_monotonic_time();
+        if (--running == 0)
+        {
+            g_main_loop_quit(loop);
+        }
+    }
+
+    static gboolean busCallback(GstBus *bus, GstMessage *msg, Entry *entry)
+    {
+        GError *err;
+        gchar *debug_info;
+
+        switch (GST_MESSAGE_TYPE(msg))
+        {
+        case GST_MESSAGE_ERROR:
+            gst_message_parse_error(msg, &err, &debug_info);
+            g_printerr("%s: Error received from element %s: %s\n", pipelineName(*entry), GST_OBJECT_NAME(msg->src),
+                       err->message);
+            g_printerr("Debugging information: %s\n", debug_info ? debug_info : "none");
+            g_clear_error(&err);
+            g_free(debug_info);
+            entry->host->finish(*entry, TRUE);
+            break;
+
+        case GST_MESSAGE_EOS:
+            entry->host->finish(*entry, FALSE);
+            break;
+
+        default:
+            break;
+        }
+        return TRUE;
+    }
+
+    GMainContext *context;
+    GMainLoop *loop;
+    std::deque<Entry> entries;
+    std::size_t running;
+};
+
+using PipelineHostPtr = PipelineHost *;
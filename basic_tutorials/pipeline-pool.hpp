@@ -0,0 +1,163 @@
+#pragma once
+
+#include "pipeline-element.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/* Prebuilt pipelines of one topology, recycled between jobs instead of rebuilt. Every pipeline is built once and
+ * parked in READY; a job only swaps the uri and plays it. Elements, tee request pads, branch links and the
+ * plugins they use all stay, and a decodebin source re-exposes its pads into the same tees on the next job.
+ *
+ *     PipelinePool pool(2, [&](std::size_t i) { return description.compile("worker-" + std::to_string(i)); });
+ *     for (const std::string &uri : uris)
+ *         pool.process(uri);
+ *
+ * acquire() and release() are thread-safe, so several workers can share one pool; process() is acquire(), play to
+ * EOS or error, release(). A pipeline must have a branch for every stream the clips carry: a branch that never
+ * gets data never prerolls, and the job never ends. */
+class PipelinePool
+{
+  public:
+    using Factory = std::function<PipelineElementPtr(std::size_t index)>;
+
+    /* `factory` returns a built pipeline, or nullptr when it could not build one */
+    PipelinePool(std::size_t size, Factory factory)
+    {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            PipelineElementPtr pipeline = factory(i);
+            if (!pipeline)
+            {
+                continue;
+            }
+            if (pipeline->changeStateReady() == GST_STATE_CHANGE_FAILURE)
+            {
+                g_printerr("Pooled pipeline %zu could not be set to READY.\n", i);
+                destroy(pipeline);
+                continue;
+            }
+            pipelines.push_back(pipeline);
+            idle.push_back(pipeline);
+        }
+    }
+
+    ~PipelinePool()
+    {
+        for (PipelineElementPtr pipeline : pipelines)
+        {
+            destroy(pipeline);
+        }
+    }
+
+    PipelinePool(const PipelinePool &) = delete;
+    PipelinePool &operator=(const PipelinePool &) = delete;
+
+    /* Pipelines that could be built */
+    std::size_t size(void) const
+    {
+        return pipelines.size();
+    }
+
+    /* A READY pipeline; blocks until one is released. Returns nullptr when the pool is empty. */
+    PipelineElementPtr acquire(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (pipelines.empty())
+        {
+            return nullptr;
+        }
+        cond.wait(guard, [this] { return !idle.empty(); });
+        PipelineElementPtr pipeline = idle.back();
+        idle.pop_back();
+        return pipeline;
+    }
+
+    /* Back to READY, with whatever the last job left on the bus dropped, and back into the pool */
+    void release(PipelineElementPtr pipeline)
+    {
+        pipeline->changeStateReady();
+        GstBus *bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+        gst_bus_set_flushing(bus, TRUE);
+        gst_bus_set_flushing(bus, FALSE);
+        gst_object_unref(bus);
+
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(pipeline);
+        ++recycled_count;
+        cond.notify_one();
+    }
+
+    /* Play `uri` on a pooled pipeline until EOS (TRUE), an error or `timeout` (FALSE) */
+    gboolean process(const std::string &uri, GstClockTime timeout = GST_CLOCK_TIME_NONE)
+    {
+        PipelineElementPtr pipeline = acquire();
+        if (!pipeline)
+        {
+            return FALSE;
+        }
+        std::string url = uri;
+        pipeline->setSourceProperties(url);
+
+        gboolean ok = FALSE;
+        if (pipeline->changeStatePlaying() == GST_STATE_CHANGE_FAILURE)
+        {
+            g_printerr("Unable to play %s.\n", uri.c_str());
+        }
+        else
+        {
+            GstBus *bus = gst_element_get_bus(pipeline->getElement("pipeline"));
+            GstMessage *msg =
+                gst_bus_timed_pop_filtered(bus, timeout, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+            if (!msg)
+            {
+                g_printerr("%s did not finish in time.\n", uri.c_str());
+            }
+            else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+            {
+                GError *err;
+                gchar *debug_info;
+                gst_message_parse_error(msg, &err, &debug_info);
+                g_printerr("%s: Error received from element %s: %s\n", uri.c_str(), GST_OBJECT_NAME(msg->src),
+                           err->message);
+                g_clear_error(&err);
+                g_free(debug_info);
+            }
+            else
+            {
+                ok = TRUE;
+            }
+            if (msg)
+            {
+                gst_message_unref(msg);
+            }
+            gst_object_unref(bus);
+        }
+        release(pipeline);
+        return ok;
+    }
+
+    /* Jobs run so far; every one of them reused a pipeline instead of building one */
+    guint64 recycled(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return recycled_count;
+    }
+
+  private:
+    static void destroy(PipelineElementPtr pipeline)
+    {
+        pipeline->changeStateNull();
+        pipeline->unref();
+        delete pipeline;
+    }
+
+    std::vector<PipelineElementPtr> pipelines;
+    std::vector<PipelineElementPtr> idle;
+    std::mutex lock;
+    std::condition_variable cond;
+    guint64 recycled_count = 0;
+};
+
+using PipelinePoolPtr = PipelinePool *;
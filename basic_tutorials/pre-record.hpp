@@ -0,0 +1,391 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <gst/audio/audio.h>
+#include <gst/base/gstbasetransform.h>
+#include <mutex>
+#include <vector>
+
+/* A pre-record (DVR) stage for the file branch, registered as the element "prerecord" of this process:
+ *
+ *     file_queue ! prerecord seconds=30 ! wavenc ! filesink
+ *
+ * Until it is triggered, nothing goes past it: the audio is copied into a ring that holds the last `seconds` of it
+ * and the buffers are dropped. PreRecord::trigger(), from any thread, makes the next buffer push the whole history
+ * downstream first and then lets everything through, so the file starts `seconds` before the incident.
+ * PreRecord::rearm() goes back to holding.
+ *
+ * The ring is one block of seconds * rate * bytes per frame, allocated when the caps are set and kept as long as
+ * they do not change size, so holding costs a memcpy per buffer and no allocation; memory is bounded by the ring,
+ * not by how long nothing happens. Only the flush allocates, in buffers of at most 64 KiB. The first buffer held is
+ * announced downstream as a gap, so that the sinks behind preroll and the pipeline can reach PLAYING.
+ *
+ * The history is timestamped backwards from the newest buffer held, so a gap in the input while holding shows as a
+ * shift of the older audio rather than as a hole. */
+class PreRecord
+{
+  public:
+    static constexpr const gchar *name = "prerecord";
+
+    struct Stats
+    {
+        guint64 capacity = 0; /* Bytes of the ring */
+        guint64 held = 0;     /* Bytes in it now */
+        guint64 overwritten = 0;
+        guint64 flushed = 0;
+        guint64 passed = 0; /* Bytes let through after a trigger */
+        guint64 triggers = 0;
+    };
+
+    /* Register the element factory; safe to call more than once */
+    static gboolean registerElement(void)
+    {
+        static const gboolean registered = [] {
+            GTypeInfo info = {};
+            info.class_size = sizeof(PreRecordClass);
+            info.class_init = classInit;
+            info.instance_size = sizeof(Element);
+            info.instance_init = instanceInit;
+            type = g_type_register_static(GST_TYPE_BASE_TRANSFORM, "GstPreRecord", &info, (GTypeFlags)0);
+            return gst_element_register(NULL, name, GST_RANK_NONE, type);
+        }();
+        return registered;
+    }
+
+    /* Write the history and keep recording, from the next buffer on */
+    static void trigger(GstElement *element)
+    {
+        if (State *state = stateOf(element))
+        {
+            state->request = request_trigger;
+        }
+    }
+
+    /* Stop recording and start holding again, from the next buffer on */
+    static void rearm(GstElement *element)
+    {
+        if (State *state = stateOf(element))
+        {
+            state->request = request_rearm;
+        }
+    }
+
+    static Stats stats(GstElement *element)
+    {
+        State *state = stateOf(element);
+        if (!state)
+        {
+            return Stats();
+        }
+        std::lock_guard<std::mutex> guard(state->lock);
+        return state->stats;
+    }
+
+  private:
+    static constexpr gsize flush_buffer_size = 64 * 1024;
+
+    enum Request : gint
+    {
+        request_none,
+        request_trigger,
+        request_rearm
+    };
+
+    struct State
+    {
+        guint seconds = 10;
+
+        /* Streaming thread */
+        gint bpf = 0;
+        gint rate = 0;
+        std::vector<guint8> ring;
+        gsize head = 0; /* Where the next byte goes */
+        gsize held = 0;
+        GstClockTime end = GST_CLOCK_TIME_NONE; /* Of the newest audio held */
+        gboolean recording = FALSE;
+        gboolean gap_sent = FALSE;
+
+        std::atomic<gint> request{request_none};
+        std::mutex lock;
+        Stats stats;
+    };
+
+    struct Element
+    {
+        GstBaseTransform parent;
+        State *state;
+    };
+
+    struct PreRecordClass
+    {
+        GstBaseTransformClass parent_class;
+    };
+
+    enum Property : guint
+    {
+        prop_0,
+        prop_seconds
+    };
+
+    static inline GType type = 0;
+    static inline gpointer parent_class = nullptr;
+
+    static inline GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+        "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS("audio/x-raw, layout = (string) interleaved"));
+    static inline GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+        "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS("audio/x-raw, layout = (string) interleaved"));
+
+    static State *stateOf(GstElement *element)
+    {
+        if (!element || type == 0 || G_OBJECT_TYPE(element) != type)
+        {
+            return nullptr;
+        }
+        return ((Element *)element)->state;
+    }
+
+    static void classInit(gpointer g_class, gpointer class_data)
+    {
+        parent_class = g_type_class_peek_parent(g_class);
+
+        GObjectClass *object_class = G_OBJECT_CLASS(g_class);
+        object_class->set_property = setProperty;
+        object_class->get_property = getProperty;
+        object_class->finalize = finalize;
+        g_object_class_install_property(
+            object_class, prop_seconds,
+            g_param_spec_uint("seconds", "Seconds", "Audio kept before a trigger", 1, 3600, 10,
+                              (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+        GstElementClass *element_class = GST_ELEMENT_CLASS(g_class);
+        gst_element_class_set_static_metadata(element_class, "Pre-record", "Filter/Audio",
+                                              "Holds the last seconds of audio until triggered", "basic_tutorials");
+        gst_element_class_add_static_pad_template(element_class, &sink_template);
+        gst_element_class_add_static_pad_template(element_class, &src_template);
+
+        /* Buffers are only read, so they go through untouched once triggered */
+        GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS(g_class);
+        transform_class->passthrough_on_same_caps = TRUE;
+        transform_class->transform_ip_on_passthrough = TRUE;
+        transform_class->start = start;
+        transform_class->set_caps = setCaps;
+        transform_class->sink_event = sinkEvent;
+        transform_class->transform_ip = transformIp;
+    }
+
+    static void instanceInit(GTypeInstance *instance, gpointer g_class)
+    {
+        Element *self = (Element *)instance;
+        self->state = new State();
+        gst_base_transform_set_passthrough(GST_BASE_TRANSFORM(instance), TRUE);
+    }
+
+    static void finalize(GObject *object)
+    {
+        Element *self = (Element *)object;
+        delete self->state;
+        self->state = nullptr;
+        G_OBJECT_CLASS(parent_class)->finalize(object);
+    }
+
+    static void setProperty(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+    {
+        if (id == prop_seconds)
+        {
+            ((Element *)object)->state->seconds = g_value_get_uint(value);
+        }
+        else
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+        }
+    }
+
+    static void getProperty(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+    {
+        if (id == prop_seconds)
+        {
+            g_value_set_uint(value, ((Element *)object)->state->seconds);
+        }
+        else
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+        }
+    }
+
+    static gboolean start(GstBaseTransform *transform)
+    {
+        State *state = ((Element *)transform)->state;
+        state->recording = FALSE;
+        state->gap_sent = FALSE;
+        state->request = request_none;
+        clear(state);
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats = Stats();
+        state->stats.capacity = state->ring.size();
+        return TRUE;
+    }
+
+    /* The ring is sized for the new format; the audio held in another one is dropped */
+    static gboolean setCaps(GstBaseTransform *transform, GstCaps *incaps, GstCaps *outcaps)
+    {
+        State *state = ((Element *)transform)->state;
+        GstAudioInfo info;
+        if (!gst_audio_info_from_caps(&info, incaps))
+        {
+            return FALSE;
+        }
+        state->bpf = GST_AUDIO_INFO_BPF(&info);
+        state->rate = GST_AUDIO_INFO_RATE(&info);
+        gsize capacity = (gsize)state->seconds * state->rate * state->bpf;
+        if (state->ring.size() != capacity)
+        {
+            state->ring.assign(capacity, 0);
+            state->ring.shrink_to_fit();
+        }
+        clear(state);
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.capacity = capacity;
+        state->stats.held = 0;
+        return TRUE;
+    }
+
+    static gboolean sinkEvent(GstBaseTransform *transform, GstEvent *event)
+    {
+        if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+        {
+            State *state = ((Element *)transform)->state;
+            clear(state);
+            state->gap_sent = FALSE;
+        }
+        return GST_BASE_TRANSFORM_CLASS(parent_class)->sink_event(transform, event);
+    }
+
+    static GstFlowReturn transformIp(GstBaseTransform *transform, GstBuffer *buffer)
+    {
+        State *state = ((Element *)transform)->state;
+        if (state->bpf == 0)
+        {
+            return GST_FLOW_NOT_NEGOTIATED;
+        }
+        gint request = state->request.exchange(request_none);
+        if (request == request_trigger && !state->recording)
+        {
+            GstFlowReturn ret = flush(transform, state);
+            if (ret != GST_FLOW_OK)
+            {
+                return ret;
+            }
+            state->recording = TRUE;
+        }
+        else if (request == request_rearm && state->recording)
+        {
+            state->recording = FALSE;
+            state->gap_sent = FALSE;
+        }
+
+        if (state->recording)
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->stats.passed += gst_buffer_get_size(buffer);
+            return GST_FLOW_OK;
+        }
+
+        hold(state, buffer);
+        if (!state->gap_sent)
+        {
+            GstClockTime pts = GST_BUFFER_PTS(buffer);
+            gst_pad_push_event(GST_BASE_TRANSFORM_SRC_PAD(transform),
+                               gst_event_new_gap(GST_CLOCK_TIME_IS_VALID(pts) ? pts : 0, GST_BUFFER_DURATION(buffer)));
+            state->gap_sent = TRUE;
+        }
+        return GST_BASE_TRANSFORM_FLOW_DROPPED;
+    }
+
+    /* Copy the buffer into the ring over the oldest audio; a buffer longer than the ring leaves its tail */
+    static void hold(State *state, GstBuffer *buffer)
+    {
+        GstMapInfo map;
+        if (state->ring.empty() || !gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            return;
+        }
+        gsize capacity = state->ring.size();
+        guint64 frames = map.size / state->bpf;
+        gsize size = frames * state->bpf;
+        const guint8 *data = map.data;
+        if (size > capacity)
+        {
+            data += size - capacity;
+            size = capacity;
+        }
+        gsize first = std::min(size, capacity - state->head);
+        memcpy(state->ring.data() + state->head, data, first);
+        memcpy(state->ring.data(), data + first, size - first);
+        state->head = (state->head + size) % capacity;
+        gsize overwritten = state->held + size > capacity ? state->held + size - capacity : 0;
+        state->held = std::min(state->held + size, capacity);
+        gst_buffer_unmap(buffer, &map);
+
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        state->end = GST_CLOCK_TIME_IS_VALID(pts) ? pts + gst_util_uint64_scale_int(frames, GST_SECOND, state->rate)
+                                                  : GST_CLOCK_TIME_NONE;
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.held = state->held;
+        state->stats.overwritten += overwritten;
+    }
+
+    /* Push the history, oldest first, in buffers of at most flush_buffer_size whole frames */
+    static GstFlowReturn flush(GstBaseTransform *transform, State *state)
+    {
+        gsize capacity = state->ring.size();
+        gsize tail = capacity ? (state->head + capacity - state->held) % capacity : 0;
+        guint64 frame = 0;
+        guint64 frames = state->held / state->bpf;
+        GstClockTime start = GST_CLOCK_TIME_IS_VALID(state->end)
+                                 ? state->end - MIN(state->end, gst_util_uint64_scale_int(frames, GST_SECOND,
+                                                                                          state->rate))
+                                 : GST_CLOCK_TIME_NONE;
+        gsize chunk = MAX(flush_buffer_size / state->bpf, (gsize)1) * state->bpf;
+        GstFlowReturn ret = GST_FLOW_OK;
+        for (gsize done = 0; done < state->held && ret == GST_FLOW_OK;)
+        {
+            gsize size = MIN(chunk, state->held - done);
+            GstBuffer *buffer = gst_buffer_new_allocate(NULL, size, NULL);
+            gsize at = (tail + done) % capacity;
+            gsize first = MIN(size, capacity - at);
+            gst_buffer_fill(buffer, 0, state->ring.data() + at, first);
+            gst_buffer_fill(buffer, first, state->ring.data(), size - first);
+            guint64 buffer_frames = size / state->bpf;
+            if (GST_CLOCK_TIME_IS_VALID(start))
+            {
+                GST_BUFFER_PTS(buffer) = start + gst_util_uint64_scale_int(frame, GST_SECOND, state->rate);
+                GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(buffer_frames, GST_SECOND, state->rate);
+            }
+            if (done == 0)
+            {
+                GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+            }
+            ret = gst_pad_push(GST_BASE_TRANSFORM_SRC_PAD(transform), buffer);
+            done += size;
+            frame += buffer_frames;
+        }
+
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.flushed += state->held;
+        state->stats.triggers++;
+        state->stats.held = 0;
+        state->held = 0;
+        state->head = 0;
+        return ret;
+    }
+
+    static void clear(State *state)
+    {
+        state->head = 0;
+        state->held = 0;
+        state->end = GST_CLOCK_TIME_NONE;
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Watches the queues of a pipeline. A sampler thread reads current-level-buffers/bytes/time of every queue at a
+ * fixed interval: the peaks and mean fill are kept as it goes, the newest `history` samples stay in memory and every
+ * sample is appended to the CSV file given to writeCsv(), so a long run neither grows without bound nor loses its
+ * time series. The overrun (queue full) and underrun (queue empty) signals of each queue
+ * are counted. The first overrun of every queue is timestamped, so when a full branch stalls its tee the summary
+ * shows which queue filled first.
+ *
+ *     QueueMonitor monitor;
+ *     monitor.watch(data.audio_queue);
+ *     monitor.writeCsv("queues.csv");
+ *     monitor.start(50);
+ *     ...
+ *     monitor.stop();
+ *     monitor.printSummary();
+ *
+ * The queues must be watched, and the CSV file given, before start(). */
+class QueueMonitor
+{
+  public:
+    static constexpr std::size_t history = 4096;
+
+    struct Sample
+    {
+        gint64 t_us; /* Since start() */
+        std::size_t queue;
+        guint buffers;
+        guint bytes;
+        guint64 time_ns;
+    };
+
+    ~QueueMonitor()
+    {
+        stop();
+        for (Watched &queue : queues)
+        {
+            g_signal_handler_disconnect(queue.element, queue.overrun_id);
+            g_signal_handler_disconnect(queue.element, queue.underrun_id);
+            gst_object_unref(queue.element);
+        }
+        if (csv)
+        {
+            fclose(csv);
+        }
+    }
+
+    void watch(GstElement *queue)
+    {
+        queues.emplace_back();
+        Watched &watched = queues.back();
+        watched.index = queues.size() - 1;
+        watched.element = GST_ELEMENT(gst_object_ref(queue));
+        watched.name = GST_ELEMENT_NAME(queue);
+        g_object_get(queue, "max-size-buffers", &watched.max_buffers, "max-size-bytes", &watched.max_bytes,
+                     "max-size-time", &watched.max_time, NULL);
+        watched.overrun_id = g_signal_connect(queue, "overrun", G_CALLBACK(onOverrun), &watched);
+        watched.underrun_id = g_signal_connect(queue, "underrun", G_CALLBACK(onUnderrun), &watched);
+    }
+
+    void start(guint interval_ms)
+    {
+        if (sampler.joinable())
+        {
+            return;
+        }
+        start_us = g_get_monotonic_time();
+        stopping = FALSE;
+        sampler = std::thread([this, interval_ms] {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!stopping)
+            {
+                guard.unlock();
+                sampleAll();
+                guard.lock();
+                cond.wait_for(guard, std::chrono::milliseconds(interval_ms), [this] { return stopping != FALSE; });
+            }
+        });
+    }
+
+    void stop(void)
+    {
+        if (!sampler.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = TRUE;
+            cond.notify_all();
+        }
+        sampler.join();
+        if (csv)
+        {
+            fclose(csv);
+            csv = nullptr;
+        }
+    }
+
+    /* The newest `history` samples, oldest first. Only read after stop(). */
+    std::vector<Sample> getSamples(void) const
+    {
+        std::vector<Sample> recent(samples.begin() + next, samples.end());
+        recent.insert(recent.end(), samples.begin(), samples.begin() + next);
+        return recent;
+    }
+
+    /* Per queue: its limits, peak and mean fill, overrun/underrun counts and when it first overran. Queues are
+     * listed in the order they first filled; the first line is the queue that filled first. */
+    void printSummary(void) const
+    {
+        std::vector<const Watched *> order;
+        for (const Watched &queue : queues)
+        {
+            order.push_back(&queue);
+        }
+        std::stable_sort(order.begin(), order.end(), [](const Watched *a, const Watched *b) {
+            gint64 fa = a->first_overrun_us.load(), fb = b->first_overrun_us.load();
+            return fa && fb ? fa < fb : fa != 0;
+        });
+
+        g_print("%-22s %8s %10s %8s %10s %12s %8s %9s %9s %14s\n", "queue", "max_buf", "max_bytes", "peak_buf",
+                "peak_bytes", "peak_time_ms", "mean_%", "overruns", "underrun", "first_full_ms");
+        for (const Watched *queue : order)
+        {
+            gint64 first = queue->first_overrun_us.load();
+            g_print("%-22s %8u %10u %8u %10u %12.1f %8.1f %9" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT " %14s\n",
+                    queue->name.c_str(), queue->max_buffers, queue->max_bytes, queue->peak_buffers, queue->peak_bytes,
+                    queue->peak_time / 1e6, queue->sampled ? queue->fill_sum * 100.0 / queue->sampled : 0.0,
+                    queue->overruns.load(), queue->underruns.load(),
+                    first ? std::to_string((first - start_us) / 1000).c_str() : "-");
+        }
+    }
+
+    /* Append every sample to `path` as CSV, t_ms,queue,buffers,bytes,time_ms,fill_percent, from start() until
+     * stop(). Call before start(). */
+    gboolean writeCsv(const std::string &path)
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            g_printerr("Queue samples could not be written to %s.\n", path.c_str());
+            return FALSE;
+        }
+        if (csv)
+        {
+            fclose(csv);
+        }
+        csv = file;
+        fprintf(csv, "t_ms,queue,buffers,bytes,time_ms,fill_percent\n");
+        return TRUE;
+    }
+
+  private:
+    struct Watched
+    {
+        std::size_t index;
+        GstElement *element;
+        std::string name;
+        guint max_buffers = 0;
+        guint max_bytes = 0;
+        guint64 max_time = 0;
+        guint peak_buffers = 0; /* The peaks and fill only change on the sampler thread */
+        guint peak_bytes = 0;
+        guint64 peak_time = 0;
+        double fill_sum = 0.0;
+        std::size_t sampled = 0;
+        gulong overrun_id = 0;
+        gulong underrun_id = 0;
+        std::atomic<guint64> overruns{0};
+        std::atomic<guint64> underruns{0};
+        std::atomic<gint64> first_overrun_us{0};
+    };
+
+    /* How full the queue is against whichever of its limits is closest, 0 limits being unlimited */
+    static double fill(const Watched &queue, const Sample &sample)
+    {
+        double f = 0.0;
+        if (queue.max_buffers)
+        {
+            f = MAX(f, (double)sample.buffers / queue.max_buffers);
+        }
+        if (queue.max_bytes)
+        {
+            f = MAX(f, (double)sample.bytes / queue.max_bytes);
+        }
+        if (queue.max_time)
+        {
+            f = MAX(f, (double)sample.time_ns / queue.max_time);
+        }
+        return f;
+    }
+
+    void sampleAll(void)
+    {
+        gint64 now = g_get_monotonic_time() - start_us;
+        for (Watched &queue : queues)
+        {
+            Sample sample{now, queue.index, 0, 0, 0};
+            g_object_get(queue.element, "current-level-buffers", &sample.buffers, "current-level-bytes",
+                         &sample.bytes, "current-level-time", &sample.time_ns, NULL);
+            double f = fill(queue, sample);
+            queue.peak_buffers = MAX(queue.peak_buffers, sample.buffers);
+            queue.peak_bytes = MAX(queue.peak_bytes, sample.bytes);
+            queue.peak_time = MAX(queue.peak_time, sample.time_ns);
+            queue.fill_sum += f;
+            ++queue.sampled;
+
+            if (samples.size() < history)
+            {
+                samples.push_back(sample);
+            }
+            else
+            {
+                samples[next] = sample;
+                next = (next + 1) % history;
+            }
+            if (csv)
+            {
+                fprintf(csv, "%.1f,%s,%u,%u,%.3f,%.1f\n", sample.t_us / 1e3, queue.name.c_str(), sample.buffers,
+                        sample.bytes, sample.time_ns / 1e6, f * 100.0);
+            }
+        }
+    }
+
+    /* Both signals are emitted from the streaming threads */
+    static void onOverrun(GstElement *queue, Watched *watched)
+    {
+        gint64 unset = 0;
+        watched->first_overrun_us.compare_exchange_strong(unset, g_get_monotonic_time(), std::memory_order_relaxed);
+        watched->overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void onUnderrun(GstElement *queue, Watched *watched)
+    {
+        watched->underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::deque<Watched> queues;
+    std::vector<Sample> samples; /* A ring once `history` long, `next` being the oldest */
+    std::size_t next = 0;
+    FILE *csv = nullptr;
+    gint64 start_us = 0;
+    std::thread sampler;
+    std::mutex lock;
+    std::condition_variable cond;
+    gboolean stopping = FALSE;
+};
+
+using QueueMonitorPtr = QueueMonitor *;
@@ -0,0 +1,678 @@
+#pragma once
+
+#include "gst/gst.h"
+#include "latency-tracer.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <gst/base/gstbasesink.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+/* A filesink for recordings, registered as the element "recordsink" of this process. Buffers are copied into an
+ * aligned staging buffer and written with one pwrite() per batch instead of one write per buffer, so the disk sees
+ * a few large sequential writes whatever size wavenc's buffers come in.
+ *
+ *     location        the file to write
+ *     batch-size      bytes per write, rounded up to 4 KiB (1 MiB by default); 0 writes every buffer as it arrives
+ *     direct-io       open with O_DIRECT and bypass the page cache (FALSE by default); falls back to buffered writes
+ *                     where the file system refuses it
+ *     fsync           none, close (the default), interval or batch: fdatasync() after every batch, or at most once
+ *                     per fsync-interval ms (1000 by default); close always ends with fsync()
+ *     preallocate     bytes to reserve with fallocate() when the file is opened (0 by default); what is left of the
+ *                     reservation past the end of the recording is released on close
+ *
+ * Like filesink it follows byte segments, so wavenc can go back and rewrite its header at EOS. With direct-io the
+ * writes that cannot be aligned (such a header, the tail of the last batch) go through a second descriptor without
+ * O_DIRECT. stats() gives the count and bytes of the writes and a histogram of their durations, for benchmarks. */
+class RecordSink
+{
+  public:
+    static constexpr const gchar *name = "recordsink";
+    static constexpr gsize alignment = 4096;
+
+    enum Fsync : guint
+    {
+        fsync_none,
+        fsync_close,
+        fsync_interval,
+        fsync_batch
+    };
+
+    struct Stats
+    {
+        guint64 writes = 0;
+        guint64 bytes = 0;
+        guint64 syncs = 0;
+        gboolean direct = FALSE; /* O_DIRECT was asked for and the file system took it */
+
+        /* Write durations in us, bucketed as LatencyHistogram does, so that an hour of recording takes no more
+         * memory than a second */
+        std::array<guint64, LatencyHistogram::bucket_count> write_us{};
+        guint64 write_us_max = 0;
+
+        void recordWrite(guint64 us)
+        {
+            write_us[LatencyHistogram::indexOf(us)]++;
+            write_us_max = std::max(write_us_max, us);
+        }
+
+        /* Upper bound of the bucket holding the p-th fraction of the write durations, clamped to the longest */
+        guint64 writePercentile(double p) const
+        {
+            if (writes == 0)
+            {
+                return 0;
+            }
+            guint64 rank = std::max((guint64)(p * writes + 0.5), (guint64)1);
+            guint64 seen = 0;
+            for (unsigned i = 0; i < LatencyHistogram::bucket_count; ++i)
+            {
+                seen += write_us[i];
+                if (seen >= rank)
+                {
+                    return std::min(LatencyHistogram::upperBound(i), write_us_max);
+                }
+            }
+            return write_us_max;
+        }
+
+        /* Fold in the stats of another recordsink */
+        void add(const Stats &other)
+        {
+            writes += other.writes;
+            bytes += other.bytes;
+            syncs += other.syncs;
+            direct |= other.direct;
+            for (unsigned i = 0; i < LatencyHistogram::bucket_count; ++i)
+            {
+                write_us[i] += other.write_us[i];
+            }
+            write_us_max = std::max(write_us_max, other.write_us_max);
+        }
+    };
+
+    /* "none", "close", "interval" or "batch" */
+    static gboolean parseFsync(std::string_view name, Fsync &fsync)
+    {
+        static constexpr std::string_view names[] = {"none", "close", "interval", "batch"};
+        for (guint i = 0; i < G_N_ELEMENTS(names); ++i)
+        {
+            if (name == names[i])
+            {
+                fsync = (Fsync)i;
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+
+    /* Register the element factory; safe to call more than once */
+    static gboolean registerElement(void)
+    {
+        static const gboolean registered = [] {
+            GTypeInfo info = {};
+            info.class_size = sizeof(SinkClass);
+            info.class_init = classInit;
+            info.instance_size = sizeof(Sink);
+            info.instance_init = instanceInit;
+            type = g_type_register_static(GST_TYPE_BASE_SINK, "GstRecordSink", &info, (GTypeFlags)0);
+            return gst_element_register(NULL, name, GST_RANK_NONE, type);
+        }();
+        return registered;
+    }
+
+    /* What a recordsink wrote so far; empty for any other element */
+    static Stats stats(GstElement *element)
+    {
+        if (!element || type == 0 || G_OBJECT_TYPE(element) != type)
+        {
+            return Stats();
+        }
+        State *state = ((Sink *)element)->state;
+        std::lock_guard<std::mutex> guard(state->lock);
+        return state->stats;
+    }
+
+  private:
+    /* Properties, set before the element starts; the rest belongs to the streaming thread */
+    struct State
+    {
+        std::string location;
+        guint batch_size = 1 << 20;
+        gboolean direct_io = FALSE;
+        Fsync fsync = fsync_close;
+        guint fsync_interval_ms = 1000;
+        guint64 preallocate = 0;
+
+        int fd = -1;          /* O_DIRECT when direct */
+        int buffered_fd = -1; /* The same file, for the writes that cannot be aligned */
+        gboolean direct = FALSE;
+        guint8 *staging = nullptr;
+        gsize staging_size = 0;
+        gsize staged = 0;
+        guint64 offset = 0; /* Of the next byte to arrive; staging holds the `staged` bytes before it */
+        guint64 end = 0;
+        gint64 last_sync_us = 0;
+
+        std::mutex lock;
+        Stats stats;
+    };
+
+    struct Sink
+    {
+        GstBaseSink parent;
+        State *state;
+    };
+
+    struct SinkClass
+    {
+        GstBaseSinkClass parent_class;
+    };
+
+    enum Property : guint
+    {
+        prop_0,
+        prop_location,
+        prop_batch_size,
+        prop_direct_io,
+        prop_fsync,
+        prop_fsync_interval,
+        prop_preallocate
+    };
+
+    static inline GType type = 0;
+    static inline gpointer parent_class = nullptr;
+
+    static inline GstStaticPadTemplate sink_template =
+        GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+    static void classInit(gpointer g_class, gpointer class_data)
+    {
+        parent_class = g_type_class_peek_parent(g_class);
+
+        GObjectClass *object_class = G_OBJECT_CLASS(g_class);
+        object_class->set_property = setProperty;
+        object_class->get_property = getProperty;
+        object_class->finalize = finalize;
+        GParamFlags flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property(
+            object_class, prop_location, g_param_spec_string("location", "Location", "File to write", NULL, flags));
+        g_object_class_install_property(object_class, prop_batch_size,
+                                        g_param_spec_uint("batch-size", "Batch size",
+                                                          "Bytes per write, 0 to write every buffer as it arrives", 0,
+                                                          G_MAXINT, 1 << 20, flags));
+        g_object_class_install_property(
+            object_class, prop_direct_io,
+            g_param_spec_boolean("direct-io", "Direct I/O", "Bypass the page cache with O_DIRECT", FALSE, flags));
+        g_object_class_install_property(
+            object_class, prop_fsync,
+            g_param_spec_string("fsync", "Fsync", "none, close, interval or batch", "close", flags));
+        g_object_class_install_property(object_class, prop_fsync_interval,
+                                        g_param_spec_uint("fsync-interval", "Fsync interval",
+                                                          "Milliseconds between syncs with fsync=interval", 1,
+                                                          G_MAXUINT, 1000, flags));
+        g_object_class_install_property(object_class, prop_preallocate,
+                                        g_param_spec_uint64("preallocate", "Preallocate",
+                                                            "Bytes to reserve with fallocate when opening", 0,
+                                                            G_MAXUINT64, 0, flags));
+
+        GstElementClass *element_class = GST_ELEMENT_CLASS(g_class);
+        gst_element_class_set_static_metadata(element_class, "Record sink", "Sink/File",
+                                              "Writes to a file in large aligned batches", "basic_tutorials");
+        gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+        GstBaseSinkClass *sink_class = GST_BASE_SINK_CLASS(g_class);
+        sink_class->start = start;
+        sink_class->stop = stop;
+        sink_class->render = render;
+        sink_class->event = event;
+        sink_class->query = query;
+    }
+
+    static void instanceInit(GTypeInstance *instance, gpointer g_class)
+    {
+        Sink *self = (Sink *)instance;
+        self->state = new State();
+        gst_base_sink_set_sync(GST_BASE_SINK(instance), FALSE);
+    }
+
+    static void finalize(GObject *object)
+    {
+        Sink *self = (Sink *)object;
+        delete self->state;
+        self->state = nullptr;
+        G_OBJECT_CLASS(parent_class)->finalize(object);
+    }
+
+    static void setProperty(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+    {
+        State *state = ((Sink *)object)->state;
+        switch (id)
+        {
+        case prop_location:
+            state->location = g_value_get_string(value) ? g_value_get_string(value) : "";
+            break;
+        case prop_batch_size:
+            state->batch_size = g_value_get_uint(value);
+            break;
+        case prop_direct_io:
+            state->direct_io = g_value_get_boolean(value);
+            break;
+        case prop_fsync:
+            if (!g_value_get_string(value) || !parseFsync(g_value_get_string(value), state->fsync))
+            {
+                g_printerr("recordsink: unknown fsync policy, keeping the previous one.\n");
+            }
+            break;
+        case prop_fsync_interval:
+            state->fsync_interval_ms = g_value_get_uint(value);
+            break;
+        case prop_preallocate:
+            state->preallocate = g_value_get_uint64(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+            break;
+        }
+    }
+
+    static void getProperty(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+    {
+        static const gchar *fsync_names[] = {"none", "close", "interval", "batch"};
+        State *state = ((Sink *)object)->state;
+        switch (id)
+        {
+        case prop_location:
+            g_value_set_string(value, state->location.c_str());
+            break;
+        case prop_batch_size:
+            g_value_set_uint(value, state->batch_size);
+            break;
+        case prop_direct_io:
+            g_value_set_boolean(value, state->direct_io);
+            break;
+        case prop_fsync:
+            g_value_set_string(value, fsync_names[state->fsync]);
+            break;
+        case prop_fsync_interval:
+            g_value_set_uint(value, state->fsync_interval_ms);
+            break;
+        case prop_preallocate:
+            g_value_set_uint64(value, state->preallocate);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+            break;
+        }
+    }
+
+    static gboolean start(GstBaseSink *sink)
+    {
+        State *state = ((Sink *)sink)->state;
+        if (state->location.empty())
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND, ("No file name specified for writing."), (NULL));
+            return FALSE;
+        }
+
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        state->direct = FALSE;
+        state->fd = -1;
+        if (state->direct_io && state->batch_size > 0)
+        {
+            state->fd = open(state->location.c_str(), flags | O_DIRECT, 0644);
+            if (state->fd >= 0)
+            {
+                state->direct = TRUE;
+            }
+            else if (errno == EINVAL)
+            {
+                g_printerr("recordsink: %s does not support O_DIRECT, writing through the page cache.\n",
+                           state->location.c_str());
+            }
+        }
+        if (state->fd < 0)
+        {
+            state->fd = open(state->location.c_str(), flags, 0644);
+        }
+        state->buffered_fd = state->direct ? open(state->location.c_str(), O_WRONLY | O_CLOEXEC) : state->fd;
+        if (state->fd < 0 || state->buffered_fd < 0)
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, OPEN_WRITE, ("Could not open %s for writing.", state->location.c_str()),
+                              ("%s", g_strerror(errno)));
+            closeFiles(state);
+            return FALSE;
+        }
+
+        if (state->preallocate > 0 && fallocate(state->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)state->preallocate) != 0)
+        {
+            g_printerr("recordsink: could not preallocate %s: %s.\n", state->location.c_str(), g_strerror(errno));
+        }
+
+        state->staging_size = (state->batch_size + alignment - 1) / alignment * alignment;
+        if (state->staging_size > 0 &&
+            posix_memalign((void **)&state->staging, alignment, state->staging_size) != 0)
+        {
+            state->staging = nullptr;
+            GST_ELEMENT_ERROR(sink, RESOURCE, NO_SPACE_LEFT, ("Could not allocate the staging buffer."), (NULL));
+            closeFiles(state);
+            return FALSE;
+        }
+        state->staged = 0;
+        state->offset = 0;
+        state->end = 0;
+        state->last_sync_us = g_get_monotonic_time();
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats = Stats();
+        state->stats.direct = state->direct;
+        return TRUE;
+    }
+
+    static gboolean stop(GstBaseSink *sink)
+    {
+        State *state = ((Sink *)sink)->state;
+        gboolean ok = flush(state);
+        if (state->fd >= 0)
+        {
+            /* Give back the reservation past the end before syncing, so that the sync covers the final size; the
+             * size does not change */
+            if (state->preallocate > state->end)
+            {
+                ok &= ftruncate(state->fd, (off_t)state->end) == 0;
+            }
+            if (state->fsync != fsync_none)
+            {
+                ok &= sync(state, FALSE);
+            }
+        }
+        closeFiles(state);
+        free(state->staging);
+        state->staging = nullptr;
+        if (!ok)
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, CLOSE, ("Could not finish %s.", state->location.c_str()),
+                              ("%s", g_strerror(errno)));
+        }
+        return ok;
+    }
+
+    static GstFlowReturn render(GstBaseSink *sink, GstBuffer *buffer)
+    {
+        State *state = ((Sink *)sink)->state;
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            return GST_FLOW_ERROR;
+        }
+        gboolean ok = TRUE;
+        if (state->staging_size == 0)
+        {
+            ok = writeAt(state, state->fd, map.data, map.size, state->offset);
+            state->offset += map.size;
+            state->end = std::max(state->end, state->offset);
+            ok &= maybeSync(state);
+        }
+        else
+        {
+            for (gsize done = 0; ok && done < map.size;)
+            {
+                gsize n = std::min(map.size - done, state->staging_size - state->staged);
+                memcpy(state->staging + state->staged, map.data + done, n);
+                state->staged += n;
+                state->offset += n;
+                done += n;
+                if (state->staged == state->staging_size)
+                {
+                    ok = flush(state);
+                }
+            }
+        }
+        gst_buffer_unmap(buffer, &map);
+        if (!ok)
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Could not write to %s.", state->location.c_str()),
+                              ("%s", g_strerror(errno)));
+            return GST_FLOW_ERROR;
+        }
+        return GST_FLOW_OK;
+    }
+
+    /* A byte segment moves the write position (wavenc going back to its header); EOS writes what is staged. A
+     * failed write fails the event, so the header is not rewritten over a hole and EOS does not pass for success. */
+    static gboolean event(GstBaseSink *sink, GstEvent *event)
+    {
+        State *state = ((Sink *)sink)->state;
+        gboolean ok = TRUE;
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+        {
+            const GstSegment *segment;
+            gst_event_parse_segment(event, &segment);
+            if (segment->format == GST_FORMAT_BYTES && segment->start != state->offset)
+            {
+                ok = flush(state);
+                if (ok)
+                {
+                    state->offset = segment->start;
+                }
+            }
+        }
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS)
+        {
+            ok = flush(state);
+        }
+        if (!ok)
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Could not write to %s.", state->location.c_str()),
+                              ("%s", g_strerror(errno)));
+            gst_event_unref(event);
+            return FALSE;
+        }
+        return GST_BASE_SINK_CLASS(parent_class)->event(sink, event);
+    }
+
+    static gboolean query(GstBaseSink *sink, GstQuery *query)
+    {
+        if (GST_QUERY_TYPE(query) == GST_QUERY_SEEKING)
+        {
+            GstFormat format;
+            gst_query_parse_seeking(query, &format, NULL, NULL, NULL);
+            if (format == GST_FORMAT_BYTES)
+            {
+                gst_query_set_seeking(query, GST_FORMAT_BYTES, TRUE, 0, -1);
+                return TRUE;
+            }
+        }
+        return GST_BASE_SINK_CLASS(parent_class)->query(sink, query);
+    }
+
+    /* Write the staged bytes: the aligned part with O_DIRECT when the batch starts aligned, the rest buffered. On
+     * failure they stay staged, and the next flush writes them again from the start. */
+    static gboolean flush(State *state)
+    {
+        if (state->staged == 0)
+        {
+            return TRUE;
+        }
+        guint64 at = state->offset - state->staged;
+        gsize done = 0;
+        gboolean ok = TRUE;
+        if (state->direct && at % alignment == 0)
+        {
+            done = state->staged / alignment * alignment;
+            if (done > 0)
+            {
+                ok = writeAt(state, state->fd, state->staging, done, at);
+            }
+        }
+        if (ok && done < state->staged)
+        {
+            ok = writeAt(state, state->buffered_fd, state->staging + done, state->staged - done, at + done);
+        }
+        if (!ok)
+        {
+            return FALSE;
+        }
+        state->staged = 0;
+        state->end = std::max(state->end, state->offset);
+        return maybeSync(state);
+    }
+
+    static gboolean writeAt(State *state, int fd, const guint8 *data, gsize size, guint64 at)
+    {
+        gint64 start_us = g_get_monotonic_time();
+        for (gsize done = 0; done < size;)
+        {
+            ssize_t n = pwrite(fd, data + done, size - done, (off_t)(at + done));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return FALSE;
+            }
+            done += (gsize)n;
+        }
+        guint64 elapsed_us = (guint64)(g_get_monotonic_time() - start_us);
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.writes++;
+        state->stats.bytes += size;
+        state->stats.recordWrite(elapsed_us);
+        return TRUE;
+    }
+
+    static gboolean maybeSync(State *state)
+    {
+        if (state->fsync == fsync_batch ||
+            (state->fsync == fsync_interval &&
+             g_get_monotonic_time() - state->last_sync_us >= (gint64)state->fsync_interval_ms * 1000))
+        {
+            return sync(state, TRUE);
+        }
+        return TRUE;
+    }
+
+    /* fdatasync while recording, a full fsync on close so that the size and times are on disk too */
+    static gboolean sync(State *state, gboolean data_only)
+    {
+        gboolean ok = (data_only ? fdatasync(state->fd) : fsync(state->fd)) == 0;
+        state->last_sync_us = g_get_monotonic_time();
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.syncs++;
+        return ok;
+    }
+
+    static void closeFiles(State *state)
+    {
+        if (state->buffered_fd >= 0 && state->buffered_fd != state->fd)
+        {
+            close(state->buffered_fd);
+        }
+        if (state->fd >= 0)
+        {
+            close(state->fd);
+        }
+        state->fd = -1;
+        state->buffered_fd = -1;
+    }
+};
+
+/* Command line switches of the tutorials with a recording branch:
+ *
+ *     --recordsink                  write with recordsink instead of filesink
+ *     --record-batch BYTES          recordsink's batch-size; K, M and G suffixes are taken
+ *     --record-direct               recordsink's direct-io
+ *     --record-fsync POLICY         recordsink's fsync: none, close, interval or batch
+ *     --record-fsync-interval MS    recordsink's fsync-interval
+ *     --record-preallocate BYTES    recordsink's preallocate, with the same suffixes
+ *
+ * Any --record-* switch implies --recordsink. */
+struct RecordOptions
+{
+    gboolean enabled = FALSE;
+    guint batch_size = 1 << 20;
+    gboolean direct_io = FALSE;
+    std::string fsync = "close";
+    guint fsync_interval_ms = 1000;
+    guint64 preallocate = 0;
+
+    static RecordOptions parse(int argc, char **argv)
+    {
+        RecordOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            gboolean has_value = i + 1 < argc;
+            if (strcmp(argv[i], "--recordsink") == 0)
+            {
+                options.enabled = TRUE;
+            }
+            else if (strcmp(argv[i], "--record-batch") == 0 && has_value)
+            {
+                options.batch_size = (guint)parseBytes(argv[++i]);
+                options.enabled = TRUE;
+            }
+            else if (strcmp(argv[i], "--record-direct") == 0)
+            {
+                options.direct_io = TRUE;
+                options.enabled = TRUE;
+            }
+            else if (strcmp(argv[i], "--record-fsync") == 0 && has_value)
+            {
+                options.fsync = argv[++i];
+                options.enabled = TRUE;
+            }
+            else if (strcmp(argv[i], "--record-fsync-interval") == 0 && has_value)
+            {
+                options.fsync_interval_ms = (guint)std::stoul(argv[++i]);
+                options.enabled = TRUE;
+            }
+            else if (strcmp(argv[i], "--record-preallocate") == 0 && has_value)
+            {
+                options.preallocate = parseBytes(argv[++i]);
+                options.enabled = TRUE;
+            }
+        }
+        return options;
+    }
+
+    /* "512", "64K", "4M", "1G" */
+    static guint64 parseBytes(const gchar *text)
+    {
+        gchar *suffix = NULL;
+        guint64 value = g_ascii_strtoull(text, &suffix, 10);
+        switch (suffix ? g_ascii_toupper(*suffix) : 0)
+        {
+        case 'K':
+            return value << 10;
+        case 'M':
+            return value << 20;
+        case 'G':
+            return value << 30;
+        default:
+            return value;
+        }
+    }
+
+    /* recordsink set up from the switches, or a plain filesink */
+    GstElement *makeSink(const gchar *name) const
+    {
+        if (!enabled)
+        {
+            return gst_element_factory_make("filesink", name);
+        }
+        RecordSink::registerElement();
+        GstElement *sink = gst_element_factory_make(RecordSink::name, name);
+        if (sink)
+        {
+            g_object_set(sink, "batch-size", batch_size, "direct-io", direct_io, "fsync", fsync.c_str(),
+                         "fsync-interval", fsync_interval_ms, "preallocate", preallocate, NULL);
+        }
+        return sink;
+    }
+};
@@ -0,0 +1,441 @@
+#pragma once
+
+#include "keyframe-index.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sched.h>
+#include <set>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* Small RGB stills of a clip, decoded in the background, for a slider to show while it is being dragged:
+ *
+ *     ScrubPreview preview(uri, &index);
+ *     preview.start();
+ *     ...
+ *     std::shared_ptr<const ScrubPreview::Thumbnail> thumbnail = preview.lookup(position);
+ *
+ * A thread of its own runs a second, video-only playbin into an appsink that scales every frame to `width` pixels
+ * across, kept paused: a thumbnail is one flushing key-unit seek and the frame it prerolls with. The positions it
+ * decodes are the keyframes of the index when it covers the clip (each seek then lands exactly on one, and decodes
+ * nothing else), or one every `interval` otherwise. It works outwards from the focus, the last position looked up
+ * (or given to focus() while the clip plays), as far as the memory budget reaches around it, and then sleeps until
+ * the focus moves. When the budget is exceeded, the least recently used thumbnails out of that reach are evicted.
+ *
+ * The thread, the streaming threads of its pipeline and the decoder threads they start run under SCHED_IDLE and in
+ * the idle I/O class, so the cache only fills with CPU time and disk bandwidth that playback leaves unused. */
+class ScrubPreview
+{
+  public:
+    struct Thumbnail
+    {
+        GstClockTime position; /* The keyframe or grid position it was decoded for, its key in the cache */
+        GstClockTime pts;      /* Of the frame it shows */
+        gint width;
+        gint height;
+        gint stride; /* Bytes per row, rows are packed RGB */
+        std::vector<guint8> pixels;
+    };
+
+    struct Stats
+    {
+        guint64 hits = 0;
+        guint64 near_hits = 0; /* Served with the thumbnail of a neighbouring position */
+        guint64 misses = 0;
+        guint64 decoded = 0;
+        guint64 failed = 0;
+        guint64 evicted = 0;
+        gsize bytes = 0;
+        gsize positions = 0; /* Positions the clip was divided into */
+        gint64 decode_us = 0;
+    };
+
+    /* `index` may be NULL; it is only read, when the thread starts */
+    ScrubPreview(const std::string &uri, KeyframeIndex *index = nullptr, gsize budget_bytes = 32 * 1024 * 1024,
+                 gint width = 160)
+        : uri{uri}, index{index}, budget_bytes{budget_bytes}, width{width}
+    {
+    }
+
+    ~ScrubPreview()
+    {
+        stop();
+    }
+
+    ScrubPreview(const ScrubPreview &) = delete;
+    ScrubPreview &operator=(const ScrubPreview &) = delete;
+
+    void start(void)
+    {
+        if (!worker.joinable())
+        {
+            stopping = FALSE;
+            worker = std::thread(&ScrubPreview::run, this);
+        }
+    }
+
+    void stop(void)
+    {
+        if (!worker.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = TRUE;
+            cond.notify_all();
+        }
+        worker.join();
+    }
+
+    /* Called on the background thread after each new thumbnail, e.g. to schedule a redraw on the main loop */
+    void onThumbnail(std::function<void(void)> callback)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        on_thumbnail = std::move(callback);
+    }
+
+    /* Decode around `position` next */
+    void focus(GstClockTime position)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        setFocus(position);
+    }
+
+    /* The thumbnail for `position`, or the closest one decoded within a few positions of it; NULL when there is
+     * none yet. Moves the focus there. */
+    std::shared_ptr<const Thumbnail> lookup(GstClockTime position)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        setFocus(position);
+        if (positions.empty())
+        {
+            stats.misses++;
+            return nullptr;
+        }
+        for (gsize distance = 0; distance <= near_positions; ++distance)
+        {
+            for (gssize at : {(gssize)focus_at - (gssize)distance, (gssize)(focus_at + distance)})
+            {
+                auto it = at >= 0 && at < (gssize)positions.size() ? cache.find(positions[at]) : cache.end();
+                if (it != cache.end())
+                {
+                    lru.splice(lru.begin(), lru, it->second);
+                    (distance == 0 ? stats.hits : stats.near_hits)++;
+                    return *it->second;
+                }
+            }
+        }
+        stats.misses++;
+        return nullptr;
+    }
+
+    Stats getStats(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+
+    /* Spacing of the positions when the index does not cover the clip */
+    GstClockTime interval = 2 * GST_SECOND;
+
+  private:
+    using Entry = std::list<std::shared_ptr<const Thumbnail>>::iterator;
+
+    /* Called with the lock held */
+    void setFocus(GstClockTime position)
+    {
+        auto it = std::upper_bound(positions.begin(), positions.end(), position);
+        gsize at = it == positions.begin() ? 0 : (gsize)(it - positions.begin()) - 1;
+        if (at != focus_at)
+        {
+            focus_at = at;
+            cond.notify_all();
+        }
+    }
+
+    /* Move the calling thread to SCHED_IDLE and the idle I/O class, or back to SCHED_OTHER and the default I/O class
+     * (which follows the CPU priority); threads it starts inherit both */
+    static void setLowPriority(gboolean low)
+    {
+        struct sched_param param = {};
+        sched_setscheduler(0, low ? SCHED_IDLE : SCHED_OTHER, &param);
+        const int ioprio_who_process = 1;
+        const int ioprio_class_idle = 3;
+        syscall(SYS_ioprio_set, ioprio_who_process, 0, low ? ioprio_class_idle << 13 : 0);
+    }
+
+    /* Streaming threads announce themselves on the bus from the thread itself, when they enter their task and when
+     * they leave it. They come from the process-wide default task pool and may serve the main playbin next, so the
+     * priority is given back on the way out. Nothing else reads this bus, so every message is dropped here; errors
+     * show as seeks that preroll nothing. */
+    static GstBusSyncReply onSyncMessage(GstBus *bus, GstMessage *msg, gpointer user_data)
+    {
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS)
+        {
+            GstStreamStatusType type;
+            gst_message_parse_stream_status(msg, &type, NULL);
+            if (type == GST_STREAM_STATUS_TYPE_ENTER || type == GST_STREAM_STATUS_TYPE_LEAVE)
+            {
+                setLowPriority((gboolean)(type == GST_STREAM_STATUS_TYPE_ENTER));
+            }
+        }
+        return GST_BUS_DROP;
+    }
+
+    /* How many positions on either side of the focus are filled: the 2 * reach + 1 of them always fit the budget, so
+     * filling them never evicts one of them. Called with the lock held. */
+    gsize reach(void) const
+    {
+        if (!thumbnail_bytes)
+        {
+            return positions.size();
+        }
+        gsize fit = budget_bytes / thumbnail_bytes;
+        return fit > 0 ? (fit - 1) / 2 : 0;
+    }
+
+    /* Called with the lock held */
+    gboolean inReach(GstClockTime position) const
+    {
+        gsize at = (gsize)(std::lower_bound(positions.begin(), positions.end(), position) - positions.begin());
+        return (gboolean)((at > focus_at ? at - focus_at : focus_at - at) <= reach());
+    }
+
+    /* The next position to decode: the nearest to the focus that is neither cached nor failed, within reach of it.
+     * Called with the lock held. */
+    gboolean pickNext(GstClockTime *position)
+    {
+        gsize limit = reach();
+        for (gsize distance = 0; distance <= limit && distance < positions.size(); ++distance)
+        {
+            for (gssize at : {(gssize)focus_at - (gssize)distance, (gssize)(focus_at + distance)})
+            {
+                if (at < 0 || at >= (gssize)positions.size())
+                {
+                    continue;
+                }
+                GstClockTime candidate = positions[at];
+                if (!cache.count(candidate) && !failed.count(candidate))
+                {
+                    *position = candidate;
+                    return TRUE;
+                }
+            }
+        }
+        return FALSE;
+    }
+
+    /* Copy the frame of `sample` into a packed thumbnail */
+    static std::shared_ptr<Thumbnail> convert(GstSample *sample, GstClockTime position)
+    {
+        GstVideoInfo info;
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        GstVideoFrame frame;
+        if (!buffer || !gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+            !gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ))
+        {
+            return nullptr;
+        }
+        std::shared_ptr<Thumbnail> thumbnail = std::make_shared<Thumbnail>();
+        thumbnail->position = position;
+        thumbnail->pts = GST_BUFFER_PTS(buffer);
+        thumbnail->width = GST_VIDEO_INFO_WIDTH(&info);
+        thumbnail->height = GST_VIDEO_INFO_HEIGHT(&info);
+        thumbnail->stride = thumbnail->width * 3;
+        thumbnail->pixels.resize((gsize)thumbnail->stride * thumbnail->height);
+        const guint8 *rows = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+        gint source_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+        for (gint row = 0; row < thumbnail->height; ++row)
+        {
+            memcpy(thumbnail->pixels.data() + (gsize)row * thumbnail->stride, rows + (gsize)row * source_stride,
+                   thumbnail->stride);
+        }
+        gst_video_frame_unmap(&frame);
+        return thumbnail;
+    }
+
+    /* Over the budget, the least recently used thumbnail out of reach of the focus goes first: evicting one within
+     * reach would only have it decoded again. Called with the lock held. */
+    void insert(std::shared_ptr<const Thumbnail> thumbnail)
+    {
+        gsize bytes = thumbnail->pixels.size();
+        thumbnail_bytes = bytes;
+        lru.push_front(std::move(thumbnail));
+        cache[lru.front()->position] = lru.begin();
+        stats.bytes += bytes;
+        while (stats.bytes > budget_bytes && lru.size() > 1)
+        {
+            auto victim = std::prev(lru.end());
+            while (victim != lru.begin() && inReach((*victim)->position))
+            {
+                --victim;
+            }
+            if (victim == lru.begin())
+            {
+                victim = std::prev(lru.end());
+            }
+            stats.bytes -= (*victim)->pixels.size();
+            cache.erase((*victim)->position);
+            lru.erase(victim);
+            stats.evicted++;
+        }
+    }
+
+    /* The positions to decode, once the duration is known */
+    std::vector<GstClockTime> layout(GstClockTime duration)
+    {
+        if (index && index->size() >= 2 && index->covered() + interval >= duration)
+        {
+            return index->keyframes();
+        }
+        std::vector<GstClockTime> grid;
+        for (GstClockTime position = 0; position < duration; position += MAX(interval, GST_MSECOND))
+        {
+            grid.push_back(position);
+        }
+        return grid;
+    }
+
+    GstElement *makePipeline(GstAppSink **sink)
+    {
+        GError *err = NULL;
+        std::string description = "videoconvert ! videoscale ! video/x-raw,format=RGB,pixel-aspect-ratio=1/1,width=" +
+                                  std::to_string(width) + " ! appsink name=thumbnails sync=false max-buffers=1";
+        GstElement *video_sink = gst_parse_bin_from_description(description.c_str(), TRUE, &err);
+        GstElement *playbin = gst_element_factory_make("playbin", "scrub-preview");
+        if (!video_sink || !playbin)
+        {
+            g_printerr("Scrub preview pipeline could not be built: %s\n", err ? err->message : "no playbin");
+            g_clear_error(&err);
+            if (video_sink)
+            {
+                gst_object_unref(video_sink);
+            }
+            if (playbin)
+            {
+                gst_object_unref(playbin);
+            }
+            return nullptr;
+        }
+        *sink = GST_APP_SINK(gst_bin_get_by_name(GST_BIN(video_sink), "thumbnails"));
+
+        /* Video only (GST_PLAY_FLAG_VIDEO): audio and subtitles are not even decoded */
+        g_object_set(playbin, "uri", uri.c_str(), "video-sink", video_sink, "flags", 0x1, NULL);
+        GstBus *bus = gst_element_get_bus(playbin);
+        gst_bus_set_sync_handler(bus, onSyncMessage, NULL, NULL);
+        gst_object_unref(bus);
+        return playbin;
+    }
+
+    void run(void)
+    {
+        setLowPriority(TRUE);
+        GstAppSink *sink = nullptr;
+        GstElement *pipeline = makePipeline(&sink);
+        if (!pipeline)
+        {
+            return;
+        }
+        gst_element_set_state(pipeline, GST_STATE_PAUSED);
+        GstSample *preroll = gst_app_sink_try_pull_preroll(sink, 10 * GST_SECOND);
+        gint64 duration = 0;
+        if (!preroll || !gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration) || duration <= 0)
+        {
+            g_printerr("Scrub preview of %s: the clip did not preroll or has no duration.\n", uri.c_str());
+        }
+        else
+        {
+            std::vector<GstClockTime> layout_positions = layout((GstClockTime)duration);
+            std::lock_guard<std::mutex> guard(lock);
+            positions = std::move(layout_positions);
+            stats.positions = positions.size();
+        }
+        if (preroll)
+        {
+            gst_sample_unref(preroll);
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (!stopping)
+        {
+            GstClockTime position = GST_CLOCK_TIME_NONE;
+            cond.wait(guard, [&] { return stopping || pickNext(&position); });
+            if (stopping)
+            {
+                break;
+            }
+            guard.unlock();
+
+            gint64 start_us = g_get_monotonic_time();
+            std::shared_ptr<Thumbnail> thumbnail;
+            if (gst_element_seek_simple(pipeline, GST_FORMAT_TIME,
+                                        (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT), position))
+            {
+                GstSample *sample = gst_app_sink_try_pull_preroll(sink, 5 * GST_SECOND);
+                if (sample)
+                {
+                    thumbnail = convert(sample, position);
+                    gst_sample_unref(sample);
+                }
+            }
+            gint64 took_us = g_get_monotonic_time() - start_us;
+
+            guard.lock();
+            stats.decode_us += took_us;
+            if (thumbnail)
+            {
+                stats.decoded++;
+                insert(std::move(thumbnail));
+            }
+            else
+            {
+                stats.failed++;
+                failed.insert(position);
+            }
+            std::function<void(void)> callback = on_thumbnail;
+            guard.unlock();
+            if (callback)
+            {
+                callback();
+            }
+            guard.lock();
+        }
+        guard.unlock();
+
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(sink);
+        gst_object_unref(pipeline);
+    }
+
+    /* Positions the lookup may fall back to on either side when its own is not decoded yet */
+    static constexpr gsize near_positions = 4;
+
+    std::string uri;
+    KeyframeIndex *index;
+    gsize budget_bytes;
+    gint width;
+    std::thread worker;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    gboolean stopping = FALSE;
+    std::vector<GstClockTime> positions;             /* Sorted, empty until the clip prerolled */
+    gsize focus_at = 0;                              /* Into `positions` */
+    std::list<std::shared_ptr<const Thumbnail>> lru; /* Most recently used first */
+    std::map<GstClockTime, Entry> cache;             /* By position */
+    std::set<GstClockTime> failed;
+    gsize thumbnail_bytes = 0; /* Of the last one decoded; they all share the size */
+    std::function<void(void)> on_thumbnail;
+    Stats stats;
+};
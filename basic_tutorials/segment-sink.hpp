@@ -0,0 +1,810 @@
+#pragma once
+
+#include "gst/gst.h"
+#include "latency-tracer.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <gst/audio/audio.h>
+#include <gst/base/gstbasesink.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* wavenc ! filesink cut into a new WAV file every max-time of audio or max-size bytes, while the pipeline keeps
+ * playing; registered as the element "wavsegmentsink" of this process:
+ *
+ *     ... ! audioconvert ! wavsegmentsink location=test-%05u.wav max-time=60000000000
+ *
+ * A segment ends at a buffer boundary, before the buffer that would take it past either limit, and the next one
+ * starts with that buffer, so no sample is lost or repeated between files. Every file is a complete WAV: its header
+ * is written with unknown sizes when it opens and patched with the real ones when it closes. Files past 4 GiB cannot
+ * be described by a WAV header, so segments are always cut before that.
+ *
+ * Opening a file (a directory update on the disk) and finishing one (the header patch, the optional fdatasync and
+ * the close that may have to wait for writeback) are what stalls a recording at each cut. With pre-open, the
+ * default, a worker thread opens the next file while the current one is written and finishes the old one after the
+ * cut, so the streaming thread only swaps descriptors. Each finished file is announced with an element message
+ * "wavsegmentsink-segment-closed" (location, index, frames, pts, duration) once it is complete on disk.
+ *
+ * stats() counts the frames received and written, the timestamp gaps of the input, the waits for a file that was
+ * not open yet, and how long the buffers and the cuts took to write. */
+class SegmentSink
+{
+  public:
+    static constexpr const gchar *name = "wavsegmentsink";
+
+    struct Stats
+    {
+        guint64 segments = 0; /* Finished */
+        guint64 frames_in = 0;
+        guint64 frames_written = 0;
+        guint64 discontinuities = 0; /* Timestamp jumps of more than a frame in the input */
+        GstClockTime gaps = 0;       /* What those jumps add up to */
+        guint64 stalls = 0;          /* Cuts that had to wait for the next file */
+
+        /* Render durations in us, bucketed as LatencyHistogram does, so that days of recording take no more memory
+         * than a second */
+        struct Durations
+        {
+            std::array<guint64, LatencyHistogram::bucket_count> buckets{};
+            guint64 count = 0;
+            guint64 max = 0;
+
+            void record(guint64 us)
+            {
+                buckets[LatencyHistogram::indexOf(us)]++;
+                count++;
+                max = std::max(max, us);
+            }
+
+            /* Upper bound of the bucket holding the p-th fraction of the durations, clamped to the longest */
+            guint64 percentile(double p) const
+            {
+                if (count == 0)
+                {
+                    return 0;
+                }
+                guint64 rank = std::max((guint64)(p * count + 0.5), (guint64)1);
+                guint64 seen = 0;
+                for (unsigned i = 0; i < LatencyHistogram::bucket_count; ++i)
+                {
+                    seen += buckets[i];
+                    if (seen >= rank)
+                    {
+                        return std::min(LatencyHistogram::upperBound(i), max);
+                    }
+                }
+                return max;
+            }
+
+            void add(const Durations &other)
+            {
+                for (unsigned i = 0; i < LatencyHistogram::bucket_count; ++i)
+                {
+                    buckets[i] += other.buckets[i];
+                }
+                count += other.count;
+                max = std::max(max, other.max);
+            }
+        };
+
+        Durations render_us;   /* Buffers that went on in the same file */
+        Durations rotation_us; /* Buffers that started a new file, i.e. the cuts */
+    };
+
+    /* Register the element factory; safe to call more than once */
+    static gboolean registerElement(void)
+    {
+        static const gboolean registered = [] {
+            GTypeInfo info = {};
+            info.class_size = sizeof(SinkClass);
+            info.class_init = classInit;
+            info.instance_size = sizeof(Sink);
+            info.instance_init = instanceInit;
+            type = g_type_register_static(GST_TYPE_BASE_SINK, "GstWavSegmentSink", &info, (GTypeFlags)0);
+            return gst_element_register(NULL, name, GST_RANK_NONE, type);
+        }();
+        return registered;
+    }
+
+    /* What a wavsegmentsink did so far; empty for any other element */
+    static Stats stats(GstElement *element)
+    {
+        if (!element || type == 0 || G_OBJECT_TYPE(element) != type)
+        {
+            return Stats();
+        }
+        State *state = ((Sink *)element)->state;
+        std::lock_guard<std::mutex> guard(state->lock);
+        return state->stats;
+    }
+
+  private:
+    static constexpr guint64 wav_limit = G_MAXUINT32;
+
+    struct Segment
+    {
+        std::string location;
+        int fd = -1;
+        guint index = 0;
+        guint64 bytes = 0; /* Of samples, after the header */
+        guint64 frames = 0;
+        GstClockTime pts = GST_CLOCK_TIME_NONE;
+        GstAudioInfo info = {};     /* The format it was begun in; the worker reads this, never State::info */
+        std::vector<guint8> header; /* With the sizes of a segment still being written */
+    };
+
+    struct State
+    {
+        /* Properties */
+        std::string location = "segment-%05u.wav";
+        GstClockTime max_time = 0;
+        guint64 max_size = 0;
+        gboolean pre_open = TRUE;
+        gboolean fsync = FALSE;
+
+        /* Streaming thread */
+        std::string pattern; /* location as checked by start(), for the worker too */
+        GstAudioInfo info;
+        gboolean has_info = FALSE;
+        Segment segment;
+        guint next_index = 0;
+        GstClockTime base_pts = GST_CLOCK_TIME_NONE; /* Timestamp continuity is counted in frames from here */
+        guint64 base_frames = 0;
+
+        /* Shared with the worker */
+        std::thread worker;
+        std::mutex jobs_lock;
+        std::condition_variable jobs_cond;
+        gboolean quit = FALSE;
+        gboolean open_wanted = FALSE;
+        guint open_index = 0;
+        Segment ready; /* Pre-opened, fd -1 until it is */
+        std::deque<Segment> finishing;
+        std::atomic<gboolean> failed{FALSE};
+
+        std::mutex lock;
+        Stats stats;
+    };
+
+    struct Sink
+    {
+        GstBaseSink parent;
+        State *state;
+    };
+
+    struct SinkClass
+    {
+        GstBaseSinkClass parent_class;
+    };
+
+    enum Property : guint
+    {
+        prop_0,
+        prop_location,
+        prop_max_time,
+        prop_max_size,
+        prop_pre_open,
+        prop_fsync
+    };
+
+    static inline GType type = 0;
+    static inline gpointer parent_class = nullptr;
+
+    /* The PCM and float formats of wavenc, little-endian and interleaved; audioconvert in front converts the rest */
+    static inline GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+        "sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS("audio/x-raw, format = (string) { S16LE, S24LE, S32LE, F32LE, F64LE, U8 }, "
+                        "layout = (string) interleaved, rate = (int) [ 1, MAX ], channels = (int) [ 1, 65535 ]"));
+
+    static void classInit(gpointer g_class, gpointer class_data)
+    {
+        parent_class = g_type_class_peek_parent(g_class);
+
+        GObjectClass *object_class = G_OBJECT_CLASS(g_class);
+        object_class->set_property = setProperty;
+        object_class->get_property = getProperty;
+        object_class->finalize = finalize;
+        GParamFlags flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property(object_class, prop_location,
+                                        g_param_spec_string("location", "Location",
+                                                            "File name pattern with a %u for the segment index",
+                                                            "segment-%05u.wav", flags));
+        g_object_class_install_property(object_class, prop_max_time,
+                                        g_param_spec_uint64("max-time", "Max time",
+                                                            "Nanoseconds of audio per file, 0 for no limit", 0,
+                                                            G_MAXUINT64, 0, flags));
+        g_object_class_install_property(object_class, prop_max_size,
+                                        g_param_spec_uint64("max-size", "Max size",
+                                                            "Bytes per file with the header, 0 for up to 4 GiB", 0,
+                                                            G_MAXUINT64, 0, flags));
+        g_object_class_install_property(
+            object_class, prop_pre_open,
+            g_param_spec_boolean("pre-open", "Pre-open",
+                                 "Open the next file and finish the last one on a worker thread", TRUE, flags));
+        g_object_class_install_property(
+            object_class, prop_fsync,
+            g_param_spec_boolean("fsync", "Fsync", "fdatasync every file before closing it", FALSE, flags));
+
+        GstElementClass *element_class = GST_ELEMENT_CLASS(g_class);
+        gst_element_class_set_static_metadata(element_class, "WAV segment sink", "Sink/File",
+                                              "Writes raw audio into a sequence of WAV files", "basic_tutorials");
+        gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+        GstBaseSinkClass *sink_class = GST_BASE_SINK_CLASS(g_class);
+        sink_class->start = start;
+        sink_class->stop = stop;
+        sink_class->set_caps = setCaps;
+        sink_class->render = render;
+        sink_class->event = event;
+    }
+
+    static void instanceInit(GTypeInstance *instance, gpointer g_class)
+    {
+        Sink *self = (Sink *)instance;
+        self->state = new State();
+        gst_base_sink_set_sync(GST_BASE_SINK(instance), FALSE);
+    }
+
+    static void finalize(GObject *object)
+    {
+        Sink *self = (Sink *)object;
+        delete self->state;
+        self->state = nullptr;
+        G_OBJECT_CLASS(parent_class)->finalize(object);
+    }
+
+    static void setProperty(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+    {
+        State *state = ((Sink *)object)->state;
+        switch (id)
+        {
+        case prop_location:
+            state->location = g_value_get_string(value) ? g_value_get_string(value) : "";
+            break;
+        case prop_max_time:
+            state->max_time = g_value_get_uint64(value);
+            break;
+        case prop_max_size:
+            state->max_size = g_value_get_uint64(value);
+            break;
+        case prop_pre_open:
+            state->pre_open = g_value_get_boolean(value);
+            break;
+        case prop_fsync:
+            state->fsync = g_value_get_boolean(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+            break;
+        }
+    }
+
+    static void getProperty(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+    {
+        State *state = ((Sink *)object)->state;
+        switch (id)
+        {
+        case prop_location:
+            g_value_set_string(value, state->location.c_str());
+            break;
+        case prop_max_time:
+            g_value_set_uint64(value, state->max_time);
+            break;
+        case prop_max_size:
+            g_value_set_uint64(value, state->max_size);
+            break;
+        case prop_pre_open:
+            g_value_set_boolean(value, state->pre_open);
+            break;
+        case prop_fsync:
+            g_value_set_boolean(value, state->fsync);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec);
+            break;
+        }
+    }
+
+    static gboolean start(GstBaseSink *sink)
+    {
+        State *state = ((Sink *)sink)->state;
+        if (!validPattern(state->location))
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND,
+                              ("The location needs exactly one %%u or %%d for the segment index, and no other %%."),
+                              (NULL));
+            return FALSE;
+        }
+        state->pattern = state->location;
+        state->has_info = FALSE;
+        state->segment = Segment();
+        state->next_index = 0;
+        state->base_pts = GST_CLOCK_TIME_NONE;
+        state->base_frames = 0;
+        state->quit = FALSE;
+        state->open_wanted = FALSE;
+        state->ready = Segment();
+        state->finishing.clear();
+        state->failed = FALSE;
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->stats = Stats();
+        }
+        if (state->pre_open)
+        {
+            requestOpen(state, 0);
+            state->worker = std::thread(work, (GstElement *)sink, state);
+        }
+        return TRUE;
+    }
+
+    static gboolean stop(GstBaseSink *sink)
+    {
+        State *state = ((Sink *)sink)->state;
+        gboolean ok = endSegment((GstElement *)sink, state);
+        if (state->worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> guard(state->jobs_lock);
+                state->quit = TRUE;
+            }
+            state->jobs_cond.notify_all();
+            state->worker.join();
+        }
+        return ok && !state->failed;
+    }
+
+    /* A new format is a new file: a WAV header describes one format */
+    static gboolean setCaps(GstBaseSink *sink, GstCaps *caps)
+    {
+        State *state = ((Sink *)sink)->state;
+        GstAudioInfo info;
+        if (!gst_audio_info_from_caps(&info, caps))
+        {
+            return FALSE;
+        }
+        if (state->has_info && state->segment.fd >= 0 &&
+            (GST_AUDIO_INFO_FORMAT(&info) != GST_AUDIO_INFO_FORMAT(&state->info) ||
+             GST_AUDIO_INFO_RATE(&info) != GST_AUDIO_INFO_RATE(&state->info) ||
+             GST_AUDIO_INFO_CHANNELS(&info) != GST_AUDIO_INFO_CHANNELS(&state->info)))
+        {
+            endSegment((GstElement *)sink, state);
+        }
+        state->info = info;
+        state->has_info = TRUE;
+        state->base_pts = GST_CLOCK_TIME_NONE;
+        return TRUE;
+    }
+
+    static GstFlowReturn render(GstBaseSink *sink, GstBuffer *buffer)
+    {
+        State *state = ((Sink *)sink)->state;
+        if (!state->has_info)
+        {
+            return GST_FLOW_NOT_NEGOTIATED;
+        }
+        gint64 start_us = g_get_monotonic_time();
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            return GST_FLOW_ERROR;
+        }
+        gint bpf = GST_AUDIO_INFO_BPF(&state->info);
+        gint rate = GST_AUDIO_INFO_RATE(&state->info);
+        guint64 frames = map.size / bpf;
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        countContinuity(state, pts, frames, rate);
+
+        /* Cut before the buffer that would not fit; a buffer larger than a whole segment gets a file of its own */
+        Segment &segment = state->segment;
+        guint64 max_bytes = std::min(state->max_size ? state->max_size : wav_limit, wav_limit);
+        guint64 max_frames = state->max_time ? gst_util_uint64_scale_ceil(state->max_time, rate, GST_SECOND) : 0;
+        gboolean rotated = FALSE;
+        gboolean ok = TRUE;
+        if (segment.fd >= 0 && segment.frames > 0 &&
+            ((max_frames && segment.frames + frames > max_frames) ||
+             segment.header.size() + segment.bytes + map.size > max_bytes))
+        {
+            ok = endSegment((GstElement *)sink, state);
+        }
+        if (ok && segment.fd < 0)
+        {
+            ok = beginSegment(state, pts);
+            rotated = TRUE;
+        }
+        if (ok)
+        {
+            ok = writeAll(segment.fd, map.data, map.size, segment.header.size() + segment.bytes);
+            segment.bytes += map.size;
+            segment.frames += frames;
+        }
+        gst_buffer_unmap(buffer, &map);
+        if (!ok || state->failed)
+        {
+            GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Could not write %s.", segment.location.c_str()),
+                              ("%s", g_strerror(errno)));
+            return GST_FLOW_ERROR;
+        }
+
+        guint64 elapsed_us = (guint64)(g_get_monotonic_time() - start_us);
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.frames_written += frames;
+        if (rotated && segment.index > 0)
+        {
+            state->stats.rotation_us.record(elapsed_us);
+        }
+        else
+        {
+            state->stats.render_us.record(elapsed_us);
+        }
+        return GST_FLOW_OK;
+    }
+
+    /* EOS finishes the last file before the application hears of it */
+    static gboolean event(GstBaseSink *sink, GstEvent *event)
+    {
+        State *state = ((Sink *)sink)->state;
+        if (GST_EVENT_TYPE(event) == GST_EVENT_EOS)
+        {
+            endSegment((GstElement *)sink, state);
+            std::unique_lock<std::mutex> guard(state->jobs_lock);
+            state->jobs_cond.wait(guard, [state] { return state->finishing.empty() || !state->worker.joinable(); });
+        }
+        return GST_BASE_SINK_CLASS(parent_class)->event(sink, event);
+    }
+
+    /* A timestamp more than a frame away from where the frames counted so far lead is a gap in the input */
+    static void countContinuity(State *state, GstClockTime pts, guint64 frames, gint rate)
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        if (GST_CLOCK_TIME_IS_VALID(pts))
+        {
+            if (!GST_CLOCK_TIME_IS_VALID(state->base_pts))
+            {
+                state->base_pts = pts;
+                state->base_frames = state->stats.frames_in;
+            }
+            GstClockTime expected =
+                state->base_pts + gst_util_uint64_scale_int(state->stats.frames_in - state->base_frames, GST_SECOND,
+                                                            rate);
+            GstClockTimeDiff drift = GST_CLOCK_DIFF(expected, pts);
+            if (ABS(drift) > (GstClockTimeDiff)(GST_SECOND / rate))
+            {
+                state->stats.discontinuities++;
+                state->stats.gaps += ABS(drift);
+                state->base_pts = pts;
+                state->base_frames = state->stats.frames_in;
+            }
+        }
+        state->stats.frames_in += frames;
+    }
+
+    /* Take the pre-opened file, or open one here without pre-open */
+    static gboolean beginSegment(State *state, GstClockTime pts)
+    {
+        Segment segment;
+        if (state->pre_open)
+        {
+            std::unique_lock<std::mutex> guard(state->jobs_lock);
+            if (state->ready.fd < 0)
+            {
+                std::lock_guard<std::mutex> stats_guard(state->lock);
+                state->stats.stalls++;
+            }
+            state->jobs_cond.wait(guard, [state] { return state->ready.fd >= 0 || state->failed; });
+            if (state->failed)
+            {
+                return FALSE;
+            }
+            segment = std::move(state->ready);
+            state->ready = Segment();
+            state->open_wanted = TRUE;
+            state->open_index = segment.index + 1;
+            guard.unlock();
+            state->jobs_cond.notify_all();
+        }
+        else if (!openSegment(state->pattern, state->next_index++, segment))
+        {
+            return FALSE;
+        }
+        segment.pts = pts;
+        segment.info = state->info;
+        segment.header = header(&segment.info, G_MAXUINT32);
+        state->segment = std::move(segment);
+        return writeAll(state->segment.fd, state->segment.header.data(), state->segment.header.size(), 0);
+    }
+
+    /* Hand the current file to the worker to finish, or finish it here without pre-open */
+    static gboolean endSegment(GstElement *element, State *state)
+    {
+        if (state->segment.fd < 0)
+        {
+            return TRUE;
+        }
+        state->segment.header = header(&state->segment.info, state->segment.bytes);
+        Segment segment = std::move(state->segment);
+        state->segment = Segment();
+        if (!state->pre_open)
+        {
+            return finishSegment(element, state, segment);
+        }
+        {
+            std::lock_guard<std::mutex> guard(state->jobs_lock);
+            state->finishing.push_back(std::move(segment));
+        }
+        state->jobs_cond.notify_all();
+        return TRUE;
+    }
+
+    static void requestOpen(State *state, guint index)
+    {
+        std::lock_guard<std::mutex> guard(state->jobs_lock);
+        state->open_wanted = TRUE;
+        state->open_index = index;
+    }
+
+    /* The worker thread: finishes the files handed over and keeps the next one open, until stop */
+    static void work(GstElement *element, State *state)
+    {
+        std::unique_lock<std::mutex> guard(state->jobs_lock);
+        for (;;)
+        {
+            state->jobs_cond.wait(guard, [state] {
+                return state->quit || !state->finishing.empty() || (state->open_wanted && state->ready.fd < 0);
+            });
+            if (!state->finishing.empty())
+            {
+                Segment segment = std::move(state->finishing.front());
+                guard.unlock();
+                gboolean ok = finishSegment(element, state, segment);
+                guard.lock();
+                state->finishing.pop_front();
+                if (!ok)
+                {
+                    state->failed = TRUE;
+                }
+                state->jobs_cond.notify_all();
+                continue;
+            }
+            if (state->quit)
+            {
+                break;
+            }
+            guint index = state->open_index;
+            state->open_wanted = FALSE;
+            guard.unlock();
+            Segment segment;
+            gboolean ok = openSegment(state->pattern, index, segment);
+            guard.lock();
+            state->ready = std::move(segment);
+            if (!ok)
+            {
+                state->failed = TRUE;
+            }
+            state->jobs_cond.notify_all();
+        }
+
+        /* The file opened for a segment that never came is left empty: remove it */
+        if (state->ready.fd >= 0)
+        {
+            close(state->ready.fd);
+            unlink(state->ready.location.c_str());
+            state->ready = Segment();
+        }
+    }
+
+    /* `pattern` is printf'ed with the index, so it may hold one %u or %d, zero-padded to a width of up to 99 (%05u),
+     * and %% otherwise: any other conversion would read an argument that is not there */
+    static gboolean validPattern(const std::string &pattern)
+    {
+        guint conversions = 0;
+        for (gsize i = 0; i < pattern.size(); ++i)
+        {
+            if (pattern[i] != '%')
+            {
+                continue;
+            }
+            if (++i < pattern.size() && pattern[i] == '%')
+            {
+                continue;
+            }
+            gsize width = i;
+            while (i < pattern.size() && g_ascii_isdigit(pattern[i]))
+            {
+                ++i;
+            }
+            if (i - width > 2 || i == pattern.size() || (pattern[i] != 'u' && pattern[i] != 'd'))
+            {
+                return FALSE;
+            }
+            conversions++;
+        }
+        return (gboolean)(conversions == 1);
+    }
+
+    static gboolean openSegment(const std::string &pattern, guint index, Segment &segment)
+    {
+        gchar *location = g_strdup_printf(pattern.c_str(), index);
+        segment.location = location;
+        segment.index = index;
+        g_free(location);
+        segment.fd = open(segment.location.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (segment.fd < 0)
+        {
+            g_printerr("wavsegmentsink: could not open %s: %s.\n", segment.location.c_str(), g_strerror(errno));
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    /* Patch the sizes into the header, close and announce */
+    static gboolean finishSegment(GstElement *element, State *state, Segment &segment)
+    {
+        gboolean ok = writeAll(segment.fd, segment.header.data(), segment.header.size(), 0);
+        if (state->fsync)
+        {
+            ok &= fdatasync(segment.fd) == 0;
+        }
+        ok &= close(segment.fd) == 0;
+        if (!ok)
+        {
+            g_printerr("wavsegmentsink: could not finish %s: %s.\n", segment.location.c_str(), g_strerror(errno));
+            return FALSE;
+        }
+
+        gint rate = GST_AUDIO_INFO_RATE(&segment.info);
+        GstClockTime duration = gst_util_uint64_scale_int(segment.frames, GST_SECOND, rate);
+        GstStructure *structure = gst_structure_new(
+            "wavsegmentsink-segment-closed", "location", G_TYPE_STRING, segment.location.c_str(), "index", G_TYPE_UINT,
+            segment.index, "frames", G_TYPE_UINT64, segment.frames, "pts", G_TYPE_UINT64, segment.pts, "duration",
+            G_TYPE_UINT64, duration, NULL);
+        gst_element_post_message(element, gst_message_new_element(GST_OBJECT(element), structure));
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats.segments++;
+        return TRUE;
+    }
+
+    static gboolean writeAll(int fd, const guint8 *data, gsize size, guint64 at)
+    {
+        for (gsize done = 0; done < size;)
+        {
+            ssize_t n = pwrite(fd, data + done, size - done, (off_t)(at + done));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return FALSE;
+            }
+            done += (gsize)n;
+        }
+        return TRUE;
+    }
+
+    /* RIFF header of `data_bytes` of samples, G_MAXUINT32 while they are not known yet (which readers take as "up to
+     * the end of the file"). More than two channels or more than 16 bits need WAVE_FORMAT_EXTENSIBLE, as in wavenc. */
+    static std::vector<guint8> header(const GstAudioInfo *info, guint64 data_bytes)
+    {
+        gboolean is_float = GST_AUDIO_INFO_IS_FLOAT(info);
+        guint16 bits = (guint16)GST_AUDIO_INFO_WIDTH(info);
+        guint16 channels = (guint16)GST_AUDIO_INFO_CHANNELS(info);
+        guint16 tag = is_float ? 3 : 1;
+        gboolean extensible = (gboolean)(channels > 2 || bits > 16);
+        guint32 fmt_bytes = extensible ? 40 : 16;
+
+        std::vector<guint8> out;
+        auto put = [&out](guint64 value, guint bytes) {
+            for (guint i = 0; i < bytes; ++i)
+            {
+                out.push_back((guint8)(value >> (8 * i)));
+            }
+        };
+        auto tag4 = [&out](const gchar *fourcc) { out.insert(out.end(), fourcc, fourcc + 4); };
+
+        guint32 header_bytes = 12 + 8 + fmt_bytes + 8;
+        tag4("RIFF");
+        put(std::min<guint64>(data_bytes + header_bytes - 8, G_MAXUINT32), 4);
+        tag4("WAVE");
+        tag4("fmt ");
+        put(fmt_bytes, 4);
+        put(extensible ? 0xfffe : tag, 2);
+        put(channels, 2);
+        put((guint32)GST_AUDIO_INFO_RATE(info), 4);
+        put((guint32)GST_AUDIO_INFO_RATE(info) * GST_AUDIO_INFO_BPF(info), 4);
+        put((guint16)GST_AUDIO_INFO_BPF(info), 2);
+        put(bits, 2);
+        if (extensible)
+        {
+            static const guint8 subformat_tail[] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                                    0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71};
+            put(22, 2);
+            put(bits, 2);
+            put(0, 4); /* No channel positions */
+            put(tag, 2);
+            out.insert(out.end(), subformat_tail, subformat_tail + sizeof(subformat_tail));
+        }
+        tag4("data");
+        put(std::min<guint64>(data_bytes, G_MAXUINT32), 4);
+        return out;
+    }
+};
+
+/* Command line switches of the tutorials with a recording branch:
+ *
+ *     --segment-seconds N     cut the recording into a new WAV file every N seconds
+ *     --segment-megabytes N   ... or every N MB, whichever comes first
+ *     --segment-location PAT  file names, with a %u for the index (test-%05u.wav by default)
+ *     --segment-no-pre-open   open and finish the files on the streaming thread, for comparison
+ *
+ * Either limit turns the wavenc ! filesink of the branch into audioconvert ! wavsegmentsink. */
+struct SegmentOptions
+{
+    guint seconds = 0;
+    guint megabytes = 0;
+    std::string location = "test-%05u.wav";
+    gboolean pre_open = TRUE;
+
+    static SegmentOptions parse(int argc, char **argv)
+    {
+        SegmentOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            gboolean has_value = i + 1 < argc;
+            if (strcmp(argv[i], "--segment-seconds") == 0 && has_value)
+            {
+                options.seconds = (guint)std::stoul(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--segment-megabytes") == 0 && has_value)
+            {
+                options.megabytes = (guint)std::stoul(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--segment-location") == 0 && has_value)
+            {
+                options.location = argv[++i];
+            }
+            else if (strcmp(argv[i], "--segment-no-pre-open") == 0)
+            {
+                options.pre_open = FALSE;
+            }
+        }
+        return options;
+    }
+
+    gboolean enabled(void) const
+    {
+        return (gboolean)(seconds > 0 || megabytes > 0);
+    }
+
+    /* What goes in front of the sink: the encoder of a single file, or a converter to a format the segments take */
+    GstElement *makeEncoder(const gchar *name) const
+    {
+        return gst_element_factory_make(enabled() ? "audioconvert" : "wavenc", name);
+    }
+
+    /* wavsegmentsink set up from the switches, or nullptr when segmenting is off */
+    GstElement *makeSink(const gchar *name) const
+    {
+        if (!enabled())
+        {
+            return nullptr;
+        }
+        SegmentSink::registerElement();
+        GstElement *sink = gst_element_factory_make(SegmentSink::name, name);
+        if (sink)
+        {
+            g_object_set(sink, "location", location.c_str(), "max-time", (guint64)seconds * GST_SECOND, "max-size",
+                         (guint64)megabytes * 1000000, "pre-open", pre_open, NULL);
+        }
+        return sink;
+    }
+};
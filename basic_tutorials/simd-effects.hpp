@@ -0,0 +1,314 @@
+#pragma once
+
+#include "simd-kernels.hpp"
+#include <array>
+#include <cmath>
+#include <gst/video/video.h>
+#include <string_view>
+#include <vector>
+
+/* In-tree counterparts of edgetv, agingtv and warptv, registered as the elements "simdedgetv", "simdagingtv" and
+ * "simdwarptv" of this process. They take the same BGRx/RGBx frames as effectv and run the SimdKernels at the level
+ * the CPU supports, so they are drop-in replacements in a tee branch:
+ *
+ *     SimdEffects::registerElements();
+ *     pipeline->addBranch(new VideoElement("simdedgetv"));
+ *
+ * simdedgetv and simdagingtv also take 8-bit YUV frames (I420, NV12, ...) as they come out of a decoder and apply
+ * the effect to the planes directly, which is what lets a fused VideoElement branch drop its colour conversions:
+ * edges are drawn on the luma plane over grey chroma, aging fades luma and desaturates chroma.
+ *
+ * The looks follow effectv without being pixel-identical: simdagingtv draws the scratches but no dust or pits, and
+ * simdwarptv derives its own displacement table from the frame counter. */
+class SimdEffects
+{
+  public:
+    enum Kind : guint
+    {
+        edge,
+        aging,
+        warp,
+        count
+    };
+
+    static constexpr std::array<std::string_view, count> names{"simdedgetv", "simdagingtv", "simdwarptv"};
+
+    static gboolean isSimdEffect(std::string_view name)
+    {
+        return (gboolean)(std::find(names.begin(), names.end(), name) != names.end());
+    }
+
+    /* The effect runs on YUV frames too, so it needs no conversion in front of it */
+    static gboolean takesYuv(std::string_view name)
+    {
+        return (gboolean)(name == names[edge] || name == names[aging]);
+    }
+
+    /* Register the three element factories; safe to call more than once */
+    static gboolean registerElements(void)
+    {
+        static const gboolean registered = [] {
+            static const gchar *type_names[count] = {"GstSimdEdgeTv", "GstSimdAgingTv", "GstSimdWarpTv"};
+            gboolean ok = TRUE;
+            for (guint kind = 0; kind < count; ++kind)
+            {
+                GTypeInfo info = {};
+                info.class_size = sizeof(EffectClass);
+                info.class_init = classInit;
+                info.class_data = GUINT_TO_POINTER(kind);
+                info.instance_size = sizeof(Effect);
+                info.instance_init = instanceInit;
+                GType type = g_type_register_static(GST_TYPE_VIDEO_FILTER, type_names[kind], &info, (GTypeFlags)0);
+                ok &= gst_element_register(NULL, names[kind].data(), GST_RANK_NONE, type);
+            }
+            return ok;
+        }();
+        return registered;
+    }
+
+  private:
+    struct Scratch
+    {
+        gint life;
+        gint x; /* 24.8 fixed point */
+        gint dx;
+        gint init;
+    };
+
+    /* What an effect keeps between frames; a C++ object owned by the GObject instance */
+    struct State
+    {
+        guint32 frame = 0;
+        guint32 random = 1;
+        std::array<Scratch, 7> scratches{};
+        std::vector<gint32> dist;   /* warp: index into ctable per pixel, from the distance to the centre */
+        std::vector<gint32> ctable; /* warp: (dy, dx) pairs per distance, rebuilt every frame */
+
+        guint32 fastrand(void)
+        {
+            random = random * 1103515245 + 12345;
+            return random;
+        }
+    };
+
+    struct Effect
+    {
+        GstVideoFilter parent;
+        Kind kind;
+        State *state;
+    };
+
+    struct EffectClass
+    {
+        GstVideoFilterClass parent_class;
+        Kind kind;
+    };
+
+    static inline gpointer parent_class = nullptr;
+
+#define SIMD_EFFECTS_PACKED "{ BGRx, RGBx }"
+#define SIMD_EFFECTS_ANY "{ BGRx, RGBx, I420, YV12, Y42B, Y444, NV12, NV21, GRAY8 }"
+    static inline GstStaticPadTemplate packed_sink_template = GST_STATIC_PAD_TEMPLATE(
+        "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(SIMD_EFFECTS_PACKED)));
+    static inline GstStaticPadTemplate packed_src_template = GST_STATIC_PAD_TEMPLATE(
+        "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(SIMD_EFFECTS_PACKED)));
+    static inline GstStaticPadTemplate any_sink_template = GST_STATIC_PAD_TEMPLATE(
+        "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(SIMD_EFFECTS_ANY)));
+    static inline GstStaticPadTemplate any_src_template = GST_STATIC_PAD_TEMPLATE(
+        "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(SIMD_EFFECTS_ANY)));
+#undef SIMD_EFFECTS_PACKED
+#undef SIMD_EFFECTS_ANY
+
+    static void classInit(gpointer g_class, gpointer class_data)
+    {
+        static const gchar *long_names[count] = {"SIMD EdgeTV effect", "SIMD AgingTV effect", "SIMD WarpTV effect"};
+        static const gchar *descriptions[count] = {"Apply edge detect on video", "AgingTV adds age to video input",
+                                                   "WarpTV does realtime goo'ing of the video input"};
+        EffectClass *klass = (EffectClass *)g_class;
+        klass->kind = (Kind)GPOINTER_TO_UINT(class_data);
+        parent_class = g_type_class_peek_parent(g_class);
+
+        G_OBJECT_CLASS(g_class)->finalize = finalize;
+        GstElementClass *element_class = GST_ELEMENT_CLASS(g_class);
+        gst_element_class_set_static_metadata(element_class, long_names[klass->kind], "Filter/Effect/Video",
+                                              descriptions[klass->kind], "basic_tutorials");
+        gboolean yuv = takesYuv(names[klass->kind]);
+        gst_element_class_add_static_pad_template(element_class, yuv ? &any_sink_template : &packed_sink_template);
+        gst_element_class_add_static_pad_template(element_class, yuv ? &any_src_template : &packed_src_template);
+
+        GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS(g_class);
+        filter_class->set_info = setInfo;
+        filter_class->transform_frame = transformFrame;
+    }
+
+    static void instanceInit(GTypeInstance *instance, gpointer g_class)
+    {
+        Effect *self = (Effect *)instance;
+        self->kind = ((EffectClass *)g_class)->kind;
+        self->state = new State();
+    }
+
+    static void finalize(GObject *object)
+    {
+        Effect *self = (Effect *)object;
+        delete self->state;
+        self->state = nullptr;
+        G_OBJECT_CLASS(parent_class)->finalize(object);
+    }
+
+    static gboolean setInfo(GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info, GstCaps *outcaps,
+                            GstVideoInfo *out_info)
+    {
+        Effect *self = (Effect *)filter;
+        if (self->kind != warp)
+        {
+            return TRUE;
+        }
+        gint width = GST_VIDEO_INFO_WIDTH(in_info);
+        gint height = GST_VIDEO_INFO_HEIGHT(in_info);
+        State *state = self->state;
+        state->dist.resize((std::size_t)width * height);
+        gint max_distance = 0;
+        for (gint y = 0; y < height; ++y)
+        {
+            for (gint x = 0; x < width; ++x)
+            {
+                gint dx = x - width / 2;
+                gint dy = y - height / 2;
+                gint distance = (gint)std::sqrt((double)(dx * dx + dy * dy));
+                state->dist[(std::size_t)y * width + x] = 2 * distance;
+                max_distance = std::max(max_distance, distance);
+            }
+        }
+        state->ctable.assign(2 * (std::size_t)(max_distance + 1), 0);
+        return TRUE;
+    }
+
+    static GstFlowReturn transformFrame(GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+    {
+        Effect *self = (Effect *)filter;
+        State *state = self->state;
+        SimdKernels::Level level = SimdKernels::level();
+        gint width = GST_VIDEO_FRAME_WIDTH(in_frame);
+        gint height = GST_VIDEO_FRAME_HEIGHT(in_frame);
+        GstVideoFormat format = GST_VIDEO_FRAME_FORMAT(in_frame);
+        gboolean packed = format == GST_VIDEO_FORMAT_BGRx || format == GST_VIDEO_FORMAT_RGBx;
+
+        /* Packed frames have one plane of 4-byte pixels; plane 0 of a YUV frame is luma, the others chroma */
+        for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(in_frame); ++plane)
+        {
+            const guint8 *src = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(in_frame, plane);
+            guint8 *dest = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(out_frame, plane);
+            gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE(in_frame, plane);
+            gint dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE(out_frame, plane);
+            gint component = plane == 0 ? 0 : 1;
+            gint step = GST_VIDEO_FRAME_COMP_PSTRIDE(in_frame, component);
+            gint bytes = GST_VIDEO_FRAME_COMP_WIDTH(in_frame, component) * step;
+            gint rows = GST_VIDEO_FRAME_COMP_HEIGHT(in_frame, component);
+            gboolean chroma = !packed && plane > 0;
+
+            switch (self->kind)
+            {
+            case edge:
+                for (gint y = 0; y < rows; ++y)
+                {
+                    const guint8 *row = src + (gsize)y * src_stride;
+                    const guint8 *below = y + 1 < rows ? row + src_stride : row;
+                    if (chroma)
+                    {
+                        memset(dest + (gsize)y * dest_stride, 0x80, bytes);
+                    }
+                    else
+                    {
+                        SimdKernels::edgeRow(level, row, below, dest + (gsize)y * dest_stride, bytes, step);
+                    }
+                }
+                break;
+
+            case aging:
+                for (gint y = 0; y < rows; ++y)
+                {
+                    SimdKernels::agingRow(level, src + (gsize)y * src_stride, dest + (gsize)y * dest_stride, bytes,
+                                          state->frame * 0x01000193u + (guint32)y * 0x9e3779b9u, chroma ? 0x20 : 0x18,
+                                          chroma ? 0 : 0x10);
+                }
+                if (plane == 0)
+                {
+                    scratch(state, dest, dest_stride, width, height, step);
+                }
+                break;
+
+            case warp:
+                updateWarpTable(state);
+                for (gint y = 0; y < height; ++y)
+                {
+                    SimdKernels::warpRow(level, (const guint32 *)src, src_stride / 4,
+                                         state->dist.data() + (gsize)y * width, state->ctable.data(),
+                                         (guint32 *)(dest + (gsize)y * dest_stride), y, width, height);
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+        ++state->frame;
+        return GST_FLOW_OK;
+    }
+
+    /* The vertical film scratches of agingtv: a few lines that drift sideways for a couple of frames. `step` is 4
+     * for packed pixels (brighten every colour) and 1 for a luma plane. */
+    static void scratch(State *state, guint8 *dest, gint stride, gint width, gint height, gint step)
+    {
+        if (height < 2)
+        {
+            return;
+        }
+        for (Scratch &line : state->scratches)
+        {
+            if (!line.life)
+            {
+                if ((state->fastrand() & 0xf0000000) == 0)
+                {
+                    line.life = 2 + (state->fastrand() >> 27);
+                    line.x = state->fastrand() % (width * 256);
+                    line.dx = ((gint)state->fastrand()) >> 23;
+                    line.init = (state->fastrand() % (height - 1)) + 1;
+                }
+                continue;
+            }
+            line.x += line.dx;
+            if (line.x < 0 || line.x >= width * 256)
+            {
+                line.life = 0;
+                continue;
+            }
+            gint y1 = line.init;
+            line.init = 0;
+            gint y2 = --line.life ? height : (gint)(state->fastrand() % height);
+            guint8 *p = dest + (gsize)(line.x >> 8) * step;
+            for (gint y = y1; y < y2; ++y)
+            {
+                guint8 *pixel = p + (gsize)y * stride;
+                for (gint c = 0; c < std::min(step, 3); ++c)
+                {
+                    pixel[c] = (guint8)std::min(pixel[c] + 0x20, 255);
+                }
+            }
+        }
+    }
+
+    static void updateWarpTable(State *state)
+    {
+        double t = state->frame;
+        double xw = std::sin((t + 100) * G_PI / 128) * 30 + std::sin((t - 10) * G_PI / 512) * 40;
+        double yw = std::sin(t * G_PI / 256) * -35 + std::sin((t + 30) * G_PI / 512) * 40;
+        double cw = std::sin((t - 70) * G_PI / 64) * 50;
+        for (std::size_t d = 0; d < state->ctable.size() / 2; ++d)
+        {
+            double angle = (d * (128 + cw) / 4096.0 + t / 64.0) * 2 * G_PI;
+            state->ctable[2 * d] = (gint32)(std::sin(angle) * yw);
+            state->ctable[2 * d + 1] = (gint32)(std::cos(angle) * xw);
+        }
+    }
+};
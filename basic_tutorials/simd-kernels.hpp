@@ -0,0 +1,729 @@
+#pragma once
+
+#include "gst/gst.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_KERNELS_X86 1
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/* Per-row pixel kernels of the in-tree video effects, in a scalar version and SSE4.1/AVX2 versions picked at run
+ * time. The edge and aging kernels work on bytes, so they run on packed 4-byte pixels (BGRx, RGBx, ...) and on the
+ * 8-bit planes of YUV frames alike; the warp kernel moves whole 4-byte pixels. The min/max kernel decimates S16
+ * audio for the in-tree scope and the level kernels meter S16/F32 audio. Every kernel takes the level to run at, so
+ * a caller can hold one level for a whole frame. The vector versions handle whole vectors and leave the end of a row
+ * to the scalar one, and all three give bit-identical results (but for the rounding of the F32 sum of squares).
+ *
+ * level() starts at the best the CPU supports; setLevel() lowers it for every later frame (e.g. to compare levels
+ * in a benchmark) and never raises it above detected(). */
+class SimdKernels
+{
+  public:
+    enum Level : guint
+    {
+        scalar,
+        sse41,
+        avx2
+    };
+
+    static Level detected(void)
+    {
+#ifdef SIMD_KERNELS_X86
+        static const Level best = __builtin_cpu_supports("avx2")     ? avx2
+                                  : __builtin_cpu_supports("sse4.1") ? sse41
+                                                                     : scalar;
+        return best;
+#else
+        return scalar;
+#endif
+    }
+
+    static Level level(void)
+    {
+        return current().load(std::memory_order_relaxed);
+    }
+
+    /* Returns the level actually set */
+    static Level setLevel(Level wanted)
+    {
+        Level level = std::min(wanted, detected());
+        current().store(level, std::memory_order_relaxed);
+        return level;
+    }
+
+    static const gchar *levelName(Level level)
+    {
+        return level == avx2 ? "avx2" : level == sse41 ? "sse4.1" : "scalar";
+    }
+
+    /* "scalar", "sse4.1", "avx2" or "auto" (what the CPU supports) */
+    static gboolean parseLevel(std::string_view name, Level &level)
+    {
+        if (name == "scalar")
+        {
+            level = scalar;
+        }
+        else if (name == "sse4.1")
+        {
+            level = sse41;
+        }
+        else if (name == "avx2")
+        {
+            level = avx2;
+        }
+        else if (name == "auto")
+        {
+            level = detected();
+        }
+        else
+        {
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    /* Edge strength: (|right - byte| + |below - byte|) * 4, saturated, over `bytes` bytes of a row. The right
+     * neighbour is `step` bytes further (4 for packed pixels, 1 for a plane) and the end of a row is its own right
+     * neighbour; the last row passes itself as `below`. */
+    static void edgeRow(Level level, const guint8 *row, const guint8 *below, guint8 *out, gint bytes, gint step)
+    {
+        gint i = 0;
+#ifdef SIMD_KERNELS_X86
+        if (level == avx2)
+        {
+            i = edgeAvx2(row, below, out, bytes, step);
+        }
+        else if (level == sse41)
+        {
+            i = edgeSse41(row, below, out, bytes, step);
+        }
+#endif
+        for (; i < bytes; ++i)
+        {
+            gint right = i + step < bytes ? row[i + step] : row[i];
+            gint edge = (std::abs(right - row[i]) + std::abs(below[i] - row[i])) * 4;
+            out[i] = (guint8)std::min(edge, 255);
+        }
+    }
+
+    /* Faded colours: byte - byte / 4 + `lift`, plus `grain` where the noise hashed from `seed` and the 4-byte word
+     * of the row has the bit set. 0x18 and 0x10 age packed RGB and luma; 0x20 and 0 pull chroma towards grey. */
+    static void agingRow(Level level, const guint8 *row, guint8 *out, gint bytes, guint32 seed, guint8 lift = 0x18,
+                         guint8 grain = 0x10)
+    {
+        guint32 lifts = lift * 0x01010101u;
+        guint32 grains = grain * 0x01010101u;
+        gint w = 0;
+#ifdef SIMD_KERNELS_X86
+        if (level == avx2)
+        {
+            w = agingAvx2(row, out, bytes / 4, seed, lifts, grains);
+        }
+        else if (level == sse41)
+        {
+            w = agingSse41(row, out, bytes / 4, seed, lifts, grains);
+        }
+#endif
+        for (; w < bytes / 4; ++w)
+        {
+            guint32 a;
+            memcpy(&a, row + 4 * w, 4);
+            guint32 b = (a >> 2) & 0x3f3f3f3f;
+            guint32 aged = a - b + lifts + (noise(seed + (guint32)w) & grains);
+            memcpy(out + 4 * w, &aged, 4);
+        }
+        for (gint i = 4 * w; i < bytes; ++i)
+        {
+            guint32 bits = noise(seed + (guint32)(i / 4)) >> (8 * (i % 4));
+            out[i] = (guint8)(row[i] - (row[i] >> 2) + lift + (bits & grain));
+        }
+    }
+
+    /* Radial warp of row `y`: pixel x is read from (x + ctable[dist[x] + 1], y + ctable[dist[x]]) of `src`, clamped
+     * to the frame. `dist` is the row of a per-frame-size table of even indices into `ctable`. */
+    static void warpRow(Level level, const guint32 *src, gint src_stride, const gint32 *dist, const gint32 *ctable,
+                        guint32 *out, gint y, gint width, gint height)
+    {
+        gint x = 0;
+#ifdef SIMD_KERNELS_X86
+        if (level == avx2)
+        {
+            x = warpAvx2(src, src_stride, dist, ctable, out, y, width, height);
+        }
+        else if (level == sse41)
+        {
+            x = warpSse41(src, src_stride, dist, ctable, out, y, width, height);
+        }
+#endif
+        for (; x < width; ++x)
+        {
+            gint sx = std::clamp(x + ctable[dist[x] + 1], 0, width - 1);
+            gint sy = std::clamp(y + ctable[dist[x]], 0, height - 1);
+            out[x] = src[sy * src_stride + sx];
+        }
+    }
+
+    /* Smallest and largest sample of each channel over `frames` frames of interleaved S16 audio, into `mins` and
+     * `maxs` of `channels` entries. The vector versions take mono and stereo, where every lane keeps to one channel;
+     * other layouts run scalar. */
+    static void minMaxS16(Level level, const gint16 *samples, gint frames, gint channels, gint16 *mins, gint16 *maxs)
+    {
+        for (gint c = 0; c < channels; ++c)
+        {
+            mins[c] = G_MAXINT16;
+            maxs[c] = G_MININT16;
+        }
+        gint i = 0;
+#ifdef SIMD_KERNELS_X86
+        if (channels <= 2 && level == avx2)
+        {
+            i = minMaxAvx2(samples, frames * channels, channels, mins, maxs);
+        }
+        else if (channels <= 2 && level == sse41)
+        {
+            i = minMaxSse41(samples, frames * channels, channels, mins, maxs);
+        }
+#endif
+        for (gint frame = i / channels; frame < frames; ++frame)
+        {
+            for (gint c = 0; c < channels; ++c)
+            {
+                gint16 sample = samples[frame * channels + c];
+                mins[c] = std::min(mins[c], sample);
+                maxs[c] = std::max(maxs[c], sample);
+            }
+        }
+    }
+
+    /* Level of `frames` frames of interleaved S16 audio, added per channel to `peaks` (largest |sample|, 32768 at
+     * most), `squares` (sum of sample^2) and `clips` (samples at full scale, |sample| >= 32767). Exact integers, so
+     * every level gives the same sums. */
+    static void levelS16(Level level, const gint16 *samples, gint frames, gint channels, guint32 *peaks,
+                         guint64 *squares, guint64 *clips)
+    {
+        gint i = 0;
+#ifdef SIMD_KERNELS_X86
+        if (channels <= 2 && level == avx2)
+        {
+            i = levelS16Avx2(samples, frames * channels, channels, peaks, squares, clips);
+        }
+        else if (channels <= 2 && level == sse41)
+        {
+            i = levelS16Sse41(samples, frames * channels, channels, peaks, squares, clips);
+        }
+#endif
+        for (gint frame = i / channels; frame < frames; ++frame)
+        {
+            for (gint c = 0; c < channels; ++c)
+            {
+                gint32 sample = samples[frame * channels + c];
+                guint32 magnitude = (guint32)std::abs(sample);
+                peaks[c] = std::max(peaks[c], magnitude);
+                squares[c] += (guint64)(sample * sample);
+                clips[c] += magnitude >= G_MAXINT16;
+            }
+        }
+    }
+
+    /* The same over F32 samples, full scale being 1.0. The vector versions add the squares in another order, so
+     * `squares` may differ from the scalar sum in the last bits of the double. */
+    static void levelF32(Level level, const gfloat *samples, gint frames, gint channels, gfloat *peaks,
+                         gdouble *squares, guint64 *clips)
+    {
+        gint i = 0;
+#ifdef SIMD_KERNELS_X86
+        if (channels <= 2 && level == avx2)
+        {
+            i = levelF32Avx2(samples, frames * channels, channels, peaks, squares, clips);
+        }
+        else if (channels <= 2 && level == sse41)
+        {
+            i = levelF32Sse41(samples, frames * channels, channels, peaks, squares, clips);
+        }
+#endif
+        for (gint frame = i / channels; frame < frames; ++frame)
+        {
+            for (gint c = 0; c < channels; ++c)
+            {
+                gfloat sample = samples[frame * channels + c];
+                gfloat magnitude = std::fabs(sample);
+                peaks[c] = std::max(peaks[c], magnitude);
+                squares[c] += (gdouble)sample * sample;
+                clips[c] += magnitude >= 1.0f;
+            }
+        }
+    }
+
+  private:
+    static std::atomic<Level> &current(void)
+    {
+        static std::atomic<Level> level{detected()};
+        return level;
+    }
+
+    static guint32 noise(guint32 h)
+    {
+        h *= 0x9e3779b1u;
+        h ^= h >> 15;
+        h *= 0x85ebca77u;
+        h ^= h >> 13;
+        return h;
+    }
+
+#ifdef SIMD_KERNELS_X86
+    /* The vector versions return the first byte, word or pixel they left to the scalar loop */
+
+    SIMD_TARGET("avx2")
+    static gint edgeAvx2(const guint8 *row, const guint8 *below, guint8 *out, gint bytes, gint step)
+    {
+        gint i = 0;
+        for (; i + 32 + step <= bytes; i += 32)
+        {
+            __m256i pixel = _mm256_loadu_si256((const __m256i *)(row + i));
+            __m256i right = _mm256_loadu_si256((const __m256i *)(row + i + step));
+            __m256i down = _mm256_loadu_si256((const __m256i *)(below + i));
+            __m256i dx = _mm256_or_si256(_mm256_subs_epu8(pixel, right), _mm256_subs_epu8(right, pixel));
+            __m256i dy = _mm256_or_si256(_mm256_subs_epu8(pixel, down), _mm256_subs_epu8(down, pixel));
+            __m256i edge = _mm256_adds_epu8(dx, dy);
+            edge = _mm256_adds_epu8(edge, edge);
+            edge = _mm256_adds_epu8(edge, edge);
+            _mm256_storeu_si256((__m256i *)(out + i), edge);
+        }
+        return i;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static gint edgeSse41(const guint8 *row, const guint8 *below, guint8 *out, gint bytes, gint step)
+    {
+        gint i = 0;
+        for (; i + 16 + step <= bytes; i += 16)
+        {
+            __m128i pixel = _mm_loadu_si128((const __m128i *)(row + i));
+            __m128i right = _mm_loadu_si128((const __m128i *)(row + i + step));
+            __m128i down = _mm_loadu_si128((const __m128i *)(below + i));
+            __m128i dx = _mm_or_si128(_mm_subs_epu8(pixel, right), _mm_subs_epu8(right, pixel));
+            __m128i dy = _mm_or_si128(_mm_subs_epu8(pixel, down), _mm_subs_epu8(down, pixel));
+            __m128i edge = _mm_adds_epu8(dx, dy);
+            edge = _mm_adds_epu8(edge, edge);
+            edge = _mm_adds_epu8(edge, edge);
+            _mm_storeu_si128((__m128i *)(out + i), edge);
+        }
+        return i;
+    }
+
+    SIMD_TARGET("avx2")
+    static gint agingAvx2(const guint8 *row, guint8 *out, gint words, guint32 seed, guint32 lifts, guint32 grains)
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i low_bits = _mm256_set1_epi32(0x3f3f3f3f);
+        const __m256i lift = _mm256_set1_epi32((gint)lifts);
+        const __m256i grain = _mm256_set1_epi32((gint)grains);
+        const __m256i k1 = _mm256_set1_epi32((gint)0x9e3779b1u);
+        const __m256i k2 = _mm256_set1_epi32((gint)0x85ebca77u);
+        gint x = 0;
+        for (; x + 8 <= words; x += 8)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(row + 4 * x));
+            __m256i b = _mm256_and_si256(_mm256_srli_epi32(a, 2), low_bits);
+            __m256i h = _mm256_add_epi32(_mm256_set1_epi32((gint)(seed + (guint32)x)), lanes);
+            h = _mm256_mullo_epi32(h, k1);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+            h = _mm256_mullo_epi32(h, k2);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+            __m256i faded = _mm256_add_epi32(_mm256_sub_epi32(a, b), lift);
+            _mm256_storeu_si256((__m256i *)(out + 4 * x), _mm256_add_epi32(faded, _mm256_and_si256(h, grain)));
+        }
+        return x;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static gint agingSse41(const guint8 *row, guint8 *out, gint words, guint32 seed, guint32 lifts, guint32 grains)
+    {
+        const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i low_bits = _mm_set1_epi32(0x3f3f3f3f);
+        const __m128i lift = _mm_set1_epi32((gint)lifts);
+        const __m128i grain = _mm_set1_epi32((gint)grains);
+        const __m128i k1 = _mm_set1_epi32((gint)0x9e3779b1u);
+        const __m128i k2 = _mm_set1_epi32((gint)0x85ebca77u);
+        gint x = 0;
+        for (; x + 4 <= words; x += 4)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(row + 4 * x));
+            __m128i b = _mm_and_si128(_mm_srli_epi32(a, 2), low_bits);
+            __m128i h = _mm_add_epi32(_mm_set1_epi32((gint)(seed + (guint32)x)), lanes);
+            h = _mm_mullo_epi32(h, k1);
+            h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+            h = _mm_mullo_epi32(h, k2);
+            h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+            __m128i faded = _mm_add_epi32(_mm_sub_epi32(a, b), lift);
+            _mm_storeu_si128((__m128i *)(out + 4 * x), _mm_add_epi32(faded, _mm_and_si128(h, grain)));
+        }
+        return x;
+    }
+
+    SIMD_TARGET("avx2")
+    static gint warpAvx2(const guint32 *src, gint src_stride, const gint32 *dist, const gint32 *ctable, guint32 *out,
+                         gint y, gint width, gint height)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i max_x = _mm256_set1_epi32(width - 1);
+        const __m256i max_y = _mm256_set1_epi32(height - 1);
+        const __m256i stride = _mm256_set1_epi32(src_stride);
+        const __m256i row = _mm256_set1_epi32(y);
+        const __m256i step = _mm256_set1_epi32(8);
+        __m256i column = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        gint x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m256i index = _mm256_loadu_si256((const __m256i *)(dist + x));
+            __m256i dy = _mm256_i32gather_epi32((const int *)ctable, index, 4);
+            __m256i dx = _mm256_i32gather_epi32((const int *)ctable + 1, index, 4);
+            __m256i sx = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(column, dx), zero), max_x);
+            __m256i sy = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(row, dy), zero), max_y);
+            __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(sy, stride), sx);
+            _mm256_storeu_si256((__m256i *)(out + x), _mm256_i32gather_epi32((const int *)src, offset, 4));
+            column = _mm256_add_epi32(column, step);
+        }
+        return x;
+    }
+
+    /* No gather before AVX2: the offsets are computed four at a time, the loads stay scalar */
+    SIMD_TARGET("sse4.1")
+    static gint warpSse41(const guint32 *src, gint src_stride, const gint32 *dist, const gint32 *ctable, guint32 *out,
+                          gint y, gint width, gint height)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i max_x = _mm_set1_epi32(width - 1);
+        const __m128i max_y = _mm_set1_epi32(height - 1);
+        const __m128i stride = _mm_set1_epi32(src_stride);
+        const __m128i row = _mm_set1_epi32(y);
+        const __m128i step = _mm_set1_epi32(4);
+        __m128i column = _mm_setr_epi32(0, 1, 2, 3);
+        alignas(16) gint32 offsets[4];
+        gint x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            const gint32 *index = dist + x;
+            __m128i dy = _mm_setr_epi32(ctable[index[0]], ctable[index[1]], ctable[index[2]], ctable[index[3]]);
+            __m128i dx =
+                _mm_setr_epi32(ctable[index[0] + 1], ctable[index[1] + 1], ctable[index[2] + 1], ctable[index[3] + 1]);
+            __m128i sx = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(column, dx), zero), max_x);
+            __m128i sy = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(row, dy), zero), max_y);
+            _mm_store_si128((__m128i *)offsets, _mm_add_epi32(_mm_mullo_epi32(sy, stride), sx));
+            out[x] = src[offsets[0]];
+            out[x + 1] = src[offsets[1]];
+            out[x + 2] = src[offsets[2]];
+            out[x + 3] = src[offsets[3]];
+            column = _mm_add_epi32(column, step);
+        }
+        return x;
+    }
+
+    /* These return the first sample left to the scalar loop, always a whole number of frames */
+    SIMD_TARGET("avx2")
+    static gint minMaxAvx2(const gint16 *samples, gint count, gint channels, gint16 *mins, gint16 *maxs)
+    {
+        if (count < 16)
+        {
+            return 0;
+        }
+        __m256i low = _mm256_set1_epi16(G_MAXINT16);
+        __m256i high = _mm256_set1_epi16(G_MININT16);
+        gint i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i sample = _mm256_loadu_si256((const __m256i *)(samples + i));
+            low = _mm256_min_epi16(low, sample);
+            high = _mm256_max_epi16(high, sample);
+        }
+        foldMinMax(_mm_min_epi16(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1)),
+                   _mm_max_epi16(_mm256_castsi256_si128(high), _mm256_extracti128_si256(high, 1)), channels, mins,
+                   maxs);
+        return i;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static gint minMaxSse41(const gint16 *samples, gint count, gint channels, gint16 *mins, gint16 *maxs)
+    {
+        if (count < 8)
+        {
+            return 0;
+        }
+        __m128i low = _mm_set1_epi16(G_MAXINT16);
+        __m128i high = _mm_set1_epi16(G_MININT16);
+        gint i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i sample = _mm_loadu_si128((const __m128i *)(samples + i));
+            low = _mm_min_epi16(low, sample);
+            high = _mm_max_epi16(high, sample);
+        }
+        foldMinMax(low, high, channels, mins, maxs);
+        return i;
+    }
+
+    /* Eight lanes down to one per channel: in stereo the even lanes are the left channel and the odd ones the right,
+     * so the last step that would mix them is for mono only */
+    SIMD_TARGET("sse4.1")
+    static void foldMinMax(__m128i low, __m128i high, gint channels, gint16 *mins, gint16 *maxs)
+    {
+        low = _mm_min_epi16(low, _mm_srli_si128(low, 8));
+        high = _mm_max_epi16(high, _mm_srli_si128(high, 8));
+        low = _mm_min_epi16(low, _mm_srli_si128(low, 4));
+        high = _mm_max_epi16(high, _mm_srli_si128(high, 4));
+        if (channels == 1)
+        {
+            low = _mm_min_epi16(low, _mm_srli_si128(low, 2));
+            high = _mm_max_epi16(high, _mm_srli_si128(high, 2));
+        }
+        mins[0] = std::min(mins[0], (gint16)_mm_extract_epi16(low, 0));
+        maxs[0] = std::max(maxs[0], (gint16)_mm_extract_epi16(high, 0));
+        if (channels == 2)
+        {
+            mins[1] = std::min(mins[1], (gint16)_mm_extract_epi16(low, 1));
+            maxs[1] = std::max(maxs[1], (gint16)_mm_extract_epi16(high, 1));
+        }
+    }
+
+    /* In stereo every 32-bit lane holds a left and a right sample. Masking one of them out of the multiplier makes
+     * _madd give the square of the other, so the two channels are summed apart; in mono it sums both squares, which
+     * fits 32 bits unsigned. The squares are widened to 64 bits before they are added up. */
+    SIMD_TARGET("avx2")
+    static gint levelS16Avx2(const gint16 *samples, gint count, gint channels, guint32 *peaks, guint64 *squares,
+                             guint64 *clips)
+    {
+        if (count < 16)
+        {
+            return 0;
+        }
+        const __m256i full_scale = _mm256_set1_epi16(G_MAXINT16);
+        const __m256i first_half = _mm256_set1_epi32(channels == 2 ? 0x0000ffff : -1);
+        __m256i peak = _mm256_setzero_si256();
+        __m256i sum0 = _mm256_setzero_si256();
+        __m256i sum1 = _mm256_setzero_si256();
+        gint i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i sample = _mm256_loadu_si256((const __m256i *)(samples + i));
+            __m256i magnitude = _mm256_abs_epi16(sample); /* -32768 stays 0x8000, which is 32768 unsigned */
+            peak = _mm256_max_epu16(peak, magnitude);
+
+            __m256i square = _mm256_madd_epi16(sample, _mm256_and_si256(sample, first_half));
+            sum0 = _mm256_add_epi64(sum0, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(square)));
+            sum0 = _mm256_add_epi64(sum0, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(square, 1)));
+            if (channels == 2)
+            {
+                square = _mm256_madd_epi16(sample, _mm256_andnot_si256(first_half, sample));
+                sum1 = _mm256_add_epi64(sum1, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(square)));
+                sum1 = _mm256_add_epi64(sum1, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(square, 1)));
+            }
+
+            /* Two mask bits per sample; clipping is rare, so counting is skipped when none is set */
+            __m256i full = _mm256_cmpeq_epi16(_mm256_max_epu16(magnitude, full_scale), magnitude);
+            guint32 bits = (guint32)_mm256_movemask_epi8(full);
+            if (bits)
+            {
+                addClips(bits, channels, clips);
+            }
+        }
+        foldPeaks(_mm_max_epu16(_mm256_castsi256_si128(peak), _mm256_extracti128_si256(peak, 1)), channels, peaks);
+        alignas(32) guint64 lanes[2][4];
+        _mm256_store_si256((__m256i *)lanes[0], sum0);
+        _mm256_store_si256((__m256i *)lanes[1], sum1);
+        for (gint c = 0; c < channels; ++c)
+        {
+            squares[c] += lanes[c][0] + lanes[c][1] + lanes[c][2] + lanes[c][3];
+        }
+        return i;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static gint levelS16Sse41(const gint16 *samples, gint count, gint channels, guint32 *peaks, guint64 *squares,
+                              guint64 *clips)
+    {
+        if (count < 8)
+        {
+            return 0;
+        }
+        const __m128i full_scale = _mm_set1_epi16(G_MAXINT16);
+        const __m128i first_half = _mm_set1_epi32(channels == 2 ? 0x0000ffff : -1);
+        __m128i peak = _mm_setzero_si128();
+        __m128i sum0 = _mm_setzero_si128();
+        __m128i sum1 = _mm_setzero_si128();
+        gint i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i sample = _mm_loadu_si128((const __m128i *)(samples + i));
+            __m128i magnitude = _mm_abs_epi16(sample);
+            peak = _mm_max_epu16(peak, magnitude);
+
+            __m128i square = _mm_madd_epi16(sample, _mm_and_si128(sample, first_half));
+            sum0 = _mm_add_epi64(sum0, _mm_cvtepu32_epi64(square));
+            sum0 = _mm_add_epi64(sum0, _mm_cvtepu32_epi64(_mm_srli_si128(square, 8)));
+            if (channels == 2)
+            {
+                square = _mm_madd_epi16(sample, _mm_andnot_si128(first_half, sample));
+                sum1 = _mm_add_epi64(sum1, _mm_cvtepu32_epi64(square));
+                sum1 = _mm_add_epi64(sum1, _mm_cvtepu32_epi64(_mm_srli_si128(square, 8)));
+            }
+
+            __m128i full = _mm_cmpeq_epi16(_mm_max_epu16(magnitude, full_scale), magnitude);
+            guint32 bits = (guint32)_mm_movemask_epi8(full);
+            if (bits)
+            {
+                addClips(bits, channels, clips);
+            }
+        }
+        foldPeaks(peak, channels, peaks);
+        alignas(16) guint64 lanes[2][2];
+        _mm_store_si128((__m128i *)lanes[0], sum0);
+        _mm_store_si128((__m128i *)lanes[1], sum1);
+        for (gint c = 0; c < channels; ++c)
+        {
+            squares[c] += lanes[c][0] + lanes[c][1];
+        }
+        return i;
+    }
+
+    /* Eight 16-bit magnitudes down to one peak per channel, as foldMinMax does */
+    SIMD_TARGET("sse4.1")
+    static void foldPeaks(__m128i peak, gint channels, guint32 *peaks)
+    {
+        peak = _mm_max_epu16(peak, _mm_srli_si128(peak, 8));
+        peak = _mm_max_epu16(peak, _mm_srli_si128(peak, 4));
+        if (channels == 1)
+        {
+            peak = _mm_max_epu16(peak, _mm_srli_si128(peak, 2));
+        }
+        peaks[0] = std::max(peaks[0], (guint32)_mm_extract_epi16(peak, 0));
+        if (channels == 2)
+        {
+            peaks[1] = std::max(peaks[1], (guint32)_mm_extract_epi16(peak, 1));
+        }
+    }
+
+    /* `bits` from a byte movemask over 16-bit samples: bytes 0-1 are the first sample, 2-3 the second, ... */
+    static void addClips(guint32 bits, gint channels, guint64 *clips)
+    {
+        if (channels == 2)
+        {
+            clips[0] += __builtin_popcount(bits & 0x33333333u) / 2;
+            clips[1] += __builtin_popcount(bits & 0xccccccccu) / 2;
+        }
+        else
+        {
+            clips[0] += __builtin_popcount(bits) / 2;
+        }
+    }
+
+    /* The squares are summed as doubles, each one exact, in four or two lanes that alternate channels in stereo */
+    SIMD_TARGET("avx2")
+    static gint levelF32Avx2(const gfloat *samples, gint count, gint channels, gfloat *peaks, gdouble *squares,
+                             guint64 *clips)
+    {
+        if (count < 8)
+        {
+            return 0;
+        }
+        const __m256 no_sign = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 full_scale = _mm256_set1_ps(1.0f);
+        __m256 peak = _mm256_setzero_ps();
+        __m256d sum = _mm256_setzero_pd();
+        gint i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 sample = _mm256_loadu_ps(samples + i);
+            __m256 magnitude = _mm256_and_ps(sample, no_sign);
+            peak = _mm256_max_ps(magnitude, peak); /* Keeps the peak, as std::max does, when the sample is a NaN */
+
+            __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(sample));
+            __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(sample, 1));
+            sum = _mm256_add_pd(sum, _mm256_add_pd(_mm256_mul_pd(low, low), _mm256_mul_pd(high, high)));
+
+            guint32 bits = (guint32)_mm256_movemask_ps(_mm256_cmp_ps(magnitude, full_scale, _CMP_GE_OQ));
+            if (bits)
+            {
+                addFloatClips(bits, channels, clips);
+            }
+        }
+        alignas(32) gfloat peak_lanes[8];
+        alignas(32) gdouble sum_lanes[4];
+        _mm256_store_ps(peak_lanes, peak);
+        _mm256_store_pd(sum_lanes, sum);
+        for (gint lane = 0; lane < 8; ++lane)
+        {
+            peaks[lane % channels] = std::max(peaks[lane % channels], peak_lanes[lane]);
+        }
+        for (gint lane = 0; lane < 4; ++lane)
+        {
+            squares[lane % channels] += sum_lanes[lane];
+        }
+        return i;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static gint levelF32Sse41(const gfloat *samples, gint count, gint channels, gfloat *peaks, gdouble *squares,
+                              guint64 *clips)
+    {
+        if (count < 4)
+        {
+            return 0;
+        }
+        const __m128 no_sign = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 full_scale = _mm_set1_ps(1.0f);
+        __m128 peak = _mm_setzero_ps();
+        __m128d sum = _mm_setzero_pd();
+        gint i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 sample = _mm_loadu_ps(samples + i);
+            __m128 magnitude = _mm_and_ps(sample, no_sign);
+            peak = _mm_max_ps(magnitude, peak);
+
+            __m128d low = _mm_cvtps_pd(sample);
+            __m128d high = _mm_cvtps_pd(_mm_movehl_ps(sample, sample));
+            sum = _mm_add_pd(sum, _mm_add_pd(_mm_mul_pd(low, low), _mm_mul_pd(high, high)));
+
+            guint32 bits = (guint32)_mm_movemask_ps(_mm_cmpge_ps(magnitude, full_scale));
+            if (bits)
+            {
+                addFloatClips(bits, channels, clips);
+            }
+        }
+        alignas(16) gfloat peak_lanes[4];
+        alignas(16) gdouble sum_lanes[2];
+        _mm_store_ps(peak_lanes, peak);
+        _mm_store_pd(sum_lanes, sum);
+        for (gint lane = 0; lane < 4; ++lane)
+        {
+            peaks[lane % channels] = std::max(peaks[lane % channels], peak_lanes[lane]);
+        }
+        for (gint lane = 0; lane < 2; ++lane)
+        {
+            squares[lane % channels] += sum_lanes[lane];
+        }
+        return i;
+    }
+
+    /* `bits` from a movemask over floats, one bit per sample */
+    static void addFloatClips(guint32 bits, gint channels, guint64 *clips)
+    {
+        if (channels == 2)
+        {
+            clips[0] += __builtin_popcount(bits & 0x55555555u);
+            clips[1] += __builtin_popcount(bits & 0xaaaaaaaau);
+        }
+        else
+        {
+            clips[0] += __builtin_popcount(bits);
+        }
+    }
+#endif
+};
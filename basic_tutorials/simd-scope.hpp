@@ -0,0 +1,235 @@
+#pragma once
+
+#include "simd-kernels.hpp"
+#include <cstdio>
+#include <cstring>
+#include <gst/audio/audio.h>
+#include <gst/pbutils/gstaudiovisualizer.h>
+#include <gst/video/video.h>
+#include <string>
+
+/* In-tree replacement for wavescope, registered as the element "simdscope" of this process. Every video frame splits
+ * the audio it covers into one run of samples per column and draws each column from the smallest to the largest
+ * sample of its run, one band per channel, with SimdKernels::minMaxS16 finding the extremes.
+ *
+ * It draws straight into packed RGB (BGRx, RGBx, xRGB, xBGR) and into I420, YV12 and NV12, so most video sinks take
+ * its frames as they come and a videoconvert behind it stays in passthrough; wavescope only makes BGRx, which a sink
+ * that wants YUV gets through a full conversion. As for wavescope, the output size and frame rate come from the caps
+ * downstream, independently of the audio rate:
+ *
+ *     SimdScope::registerElement();
+ *     ... ! simdscope ! video/x-raw,width=640,height=360,framerate=30/1 ! videoconvert ! autovideosink
+ *
+ * The shader of the base class starts at none, like the tutorials set it on wavescope; the fade shaders only know
+ * packed pixels and are switched off when a YUV format is negotiated. */
+class SimdScope
+{
+  public:
+    static constexpr const gchar *name = "simdscope";
+
+    /* Register the element factory; safe to call more than once */
+    static gboolean registerElement(void)
+    {
+        static const gboolean registered = [] {
+            GTypeInfo info = {};
+            info.class_size = sizeof(ScopeClass);
+            info.class_init = classInit;
+            info.instance_size = sizeof(Scope);
+            info.instance_init = instanceInit;
+            GType type = g_type_register_static(GST_TYPE_AUDIO_VISUALIZER, "GstSimdScope", &info, (GTypeFlags)0);
+            return gst_element_register(NULL, name, GST_RANK_NONE, type);
+        }();
+        return registered;
+    }
+
+  private:
+    struct Scope
+    {
+        GstAudioVisualizer parent;
+    };
+
+    struct ScopeClass
+    {
+        GstAudioVisualizerClass parent_class;
+    };
+
+    /* Luma and chroma of black and of the trace in YUV; in packed RGB the frame is cleared to black already and the
+     * trace is 0xffffffff, white whatever the byte order */
+    static constexpr guint8 luma_black = 16;
+    static constexpr guint8 luma_trace = 235;
+    static constexpr guint8 chroma_grey = 128;
+
+    static inline GstStaticPadTemplate sink_template =
+        GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+                                GST_STATIC_CAPS("audio/x-raw, format = (string) " GST_AUDIO_NE(S16) ", "
+                                                "layout = (string) interleaved, rate = (int) [ 8000, 192000 ], "
+                                                "channels = (int) [ 1, 2 ]"));
+    static inline GstStaticPadTemplate src_template =
+        GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+                                GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{ BGRx, RGBx, xRGB, xBGR, I420, YV12, NV12 }")));
+
+    static void classInit(gpointer g_class, gpointer class_data)
+    {
+        GstElementClass *element_class = GST_ELEMENT_CLASS(g_class);
+        gst_element_class_set_static_metadata(element_class, "SIMD waveform oscilloscope", "Visualization",
+                                              "Draws the min/max envelope of the audio per column", "basic_tutorials");
+        gst_element_class_add_static_pad_template(element_class, &sink_template);
+        gst_element_class_add_static_pad_template(element_class, &src_template);
+
+        GstAudioVisualizerClass *scope_class = GST_AUDIO_VISUALIZER_CLASS(g_class);
+        scope_class->setup = setup;
+        scope_class->render = render;
+    }
+
+    static void instanceInit(GTypeInstance *instance, gpointer g_class)
+    {
+        g_object_set(instance, "shader", 0, NULL);
+    }
+
+    static gboolean setup(GstAudioVisualizer *scope)
+    {
+        if (GST_VIDEO_INFO_IS_YUV(&scope->vinfo))
+        {
+            g_object_set(scope, "shader", 0, NULL);
+        }
+        return TRUE;
+    }
+
+    static gboolean render(GstAudioVisualizer *scope, GstBuffer *audio, GstVideoFrame *video)
+    {
+        GstMapInfo map;
+        if (!gst_buffer_map(audio, &map, GST_MAP_READ))
+        {
+            return FALSE;
+        }
+        gint channels = GST_AUDIO_INFO_CHANNELS(&scope->ainfo);
+        gint frames = (gint)(map.size / (sizeof(gint16) * channels));
+        const gint16 *samples = (const gint16 *)map.data;
+        gint width = GST_VIDEO_FRAME_WIDTH(video);
+        gint band = GST_VIDEO_FRAME_HEIGHT(video) / channels;
+        gboolean yuv = GST_VIDEO_INFO_IS_YUV(&video->info);
+        guint8 *pixels = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(video, 0);
+        gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(video, 0);
+
+        /* The base class cleared the frame to zeros, which is green in YUV */
+        if (yuv)
+        {
+            for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(video); ++plane)
+            {
+                memset(GST_VIDEO_FRAME_PLANE_DATA(video, plane), plane == 0 ? luma_black : chroma_grey,
+                       (gsize)GST_VIDEO_FRAME_PLANE_STRIDE(video, plane) * GST_VIDEO_FRAME_COMP_HEIGHT(video, plane));
+            }
+        }
+
+        SimdKernels::Level level = SimdKernels::level();
+        gint16 mins[2], maxs[2];
+        gint last_top[2] = {0, 0}, last_bottom[2] = {0, 0};
+        for (gint x = 0; x < width && frames > 0 && band > 0; ++x)
+        {
+            /* Fewer samples than columns repeat samples rather than leave gaps */
+            gint start = (gint)((gint64)x * frames / width);
+            gint end = std::max((gint)((gint64)(x + 1) * frames / width), start + 1);
+            SimdKernels::minMaxS16(level, samples + start * channels, end - start, channels, mins, maxs);
+            for (gint c = 0; c < channels; ++c)
+            {
+                gint top = c * band + (G_MAXINT16 - maxs[c]) * (band - 1) / 65535;
+                gint bottom = c * band + (G_MAXINT16 - mins[c]) * (band - 1) / 65535;
+
+                /* A column that does not reach the previous one is stretched to it, so the trace stays joined */
+                gint from = x > 0 ? std::min(top, last_bottom[c]) : top;
+                gint to = x > 0 ? std::max(bottom, last_top[c]) : bottom;
+                last_top[c] = top;
+                last_bottom[c] = bottom;
+                for (gint y = from; y <= to; ++y)
+                {
+                    if (yuv)
+                    {
+                        pixels[y * stride + x] = luma_trace;
+                    }
+                    else
+                    {
+                        *(guint32 *)(pixels + y * stride + 4 * x) = 0xffffffffu;
+                    }
+                }
+            }
+        }
+        gst_buffer_unmap(audio, &map);
+        return TRUE;
+    }
+};
+
+/* Command line switches of the tutorials with an audio visualisation branch:
+ *
+ *     --simdscope       draw with simdscope instead of wavescope
+ *     --scope-size WxH  size of the visualisation, whatever the sink prefers by default
+ *     --scope-fps N     frame rate of the visualisation, whatever the sink prefers by default
+ *
+ * The size and frame rate go to a capsfilter right behind the scope, and apply to wavescope too. */
+struct ScopeOptions
+{
+    gboolean simd = FALSE;
+    gint width = 0;
+    gint height = 0;
+    gint fps = 0;
+
+    static ScopeOptions parse(int argc, char **argv)
+    {
+        ScopeOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "--simdscope") == 0)
+            {
+                options.simd = TRUE;
+            }
+            else if (strcmp(argv[i], "--scope-size") == 0 && i + 1 < argc)
+            {
+                if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+                {
+                    options.width = options.height = 0;
+                }
+            }
+            else if (strcmp(argv[i], "--scope-fps") == 0 && i + 1 < argc)
+            {
+                options.fps = std::stoi(argv[++i]);
+            }
+        }
+        return options;
+    }
+
+    /* simdscope, or wavescope drawing lines without a shader as the tutorials always set it up */
+    GstElement *makeScope(const gchar *name) const
+    {
+        if (simd)
+        {
+            SimdScope::registerElement();
+            return gst_element_factory_make(SimdScope::name, name);
+        }
+        GstElement *scope = gst_element_factory_make("wavescope", name);
+        if (scope)
+        {
+            g_object_set(scope, "shader", 0, "style", 1, NULL);
+        }
+        return scope;
+    }
+
+    GstElement *makeCapsFilter(const gchar *name) const
+    {
+        GstElement *filter = gst_element_factory_make("capsfilter", name);
+        if (!filter)
+        {
+            return NULL;
+        }
+        GstCaps *caps = gst_caps_new_empty_simple("video/x-raw");
+        if (width > 0 && height > 0)
+        {
+            gst_caps_set_simple(caps, "width", G_TYPE_INT, width, "height", G_TYPE_INT, height, NULL);
+        }
+        if (fps > 0)
+        {
+            gst_caps_set_simple(caps, "framerate", GST_TYPE_FRACTION, fps, 1, NULL);
+        }
+        g_object_set(filter, "caps", caps, NULL);
+        gst_caps_unref(caps);
+        return filter;
+    }
+};